@@ -64,9 +64,11 @@ ExternalProject_Add(
     CONFIGURE_COMMAND ""
     BUILD_COMMAND ""
     TEST_COMMAND ""
-    INSTALL_COMMAND ${CMAKE_COMMAND} -E copy
+    INSTALL_COMMAND ${CMAKE_COMMAND} -E make_directory ${DEP_INSTALL_DIR}/include/stb
+        COMMAND ${CMAKE_COMMAND} -E copy
         ${PROJECT_BINARY_DIR}/dep_stb-prefix/src/dep_stb/stb_image.h
-        ${DEP_INSTALL_DIR}/include/stb/stb_image.h
+        ${PROJECT_BINARY_DIR}/dep_stb-prefix/src/dep_stb/stb_image_write.h
+        ${DEP_INSTALL_DIR}/include/stb
     )
 set(DEP_LIST ${DEP_LIST} dep_stb)
 
@@ -0,0 +1,88 @@
+#version 330 core
+in vec4 vertexColor;
+in vec2 texCoord;
+out vec4 fragColor;
+
+uniform sampler2D gAlbedoSpec;
+uniform sampler2D gNormal;
+uniform sampler2D gDepth;
+uniform mat4 inverseViewProjection;
+
+uniform vec3 viewPos;
+struct Light {
+    int directional;
+    vec3 position;
+    vec3 direction;
+    vec2 cutoff;
+    vec3 attenuation;
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+};
+uniform Light light;
+uniform int blinn;
+uniform mat4 lightTransform;
+
+#include "lighting_common.glsl"
+
+vec3 DecodeOctahedral(vec2 e) {
+    e = e * 2.0 - 1.0;
+    vec3 n = vec3(e.xy, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.0);
+    n.xy += vec2(n.x >= 0.0 ? -t : t, n.y >= 0.0 ? -t : t);
+    return normalize(n);
+}
+
+void main() {
+    ivec2 coord = ivec2(gl_FragCoord.xy);
+    float depth = texelFetch(gDepth, coord, 0).r;
+    if (depth == 1.0)
+        discard;
+
+    vec4 albedoSpec = texelFetch(gAlbedoSpec, coord, 0);
+    vec4 normalShininess = texelFetch(gNormal, coord, 0);
+    vec3 texColor = albedoSpec.rgb;
+    vec3 specColor = vec3(albedoSpec.a);
+    vec3 pixelNorm = DecodeOctahedral(normalShininess.xy);
+    float shininess = max(normalShininess.z * 256.0, 1.0);
+
+    vec4 worldPos = inverseViewProjection * vec4(texCoord * 2.0 - 1.0, depth * 2.0 - 1.0, 1.0);
+    vec3 fragPos = worldPos.xyz / worldPos.w;
+    vec3 viewDir = normalize(viewPos - fragPos);
+
+    vec3 result = texColor * light.ambient;
+    vec3 lightDir;
+    float intensity = 1.0;
+    float attenuation = 1.0;
+    if (light.directional == 1) {
+        lightDir = normalize(-light.direction);
+    } else {
+        float dist = length(light.position - fragPos);
+        vec3 distPoly = vec3(1.0, dist, dist*dist);
+        attenuation = 1.0 / dot(distPoly, light.attenuation);
+        lightDir = (light.position - fragPos) / dist;
+
+        float theta = dot(lightDir, normalize(-light.direction));
+        intensity = clamp((theta - light.cutoff[1]) / (light.cutoff[0] - light.cutoff[1]), 0.0, 1.0);
+    }
+
+    if (intensity > 0.0) {
+        float diff = max(dot(pixelNorm, lightDir), 0.0);
+        vec3 diffuse = diff * texColor * light.diffuse;
+        float spec = 0.0;
+        if (blinn == 0) {
+            vec3 reflectDir = reflect(-lightDir, pixelNorm);
+            spec = pow(max(dot(viewDir, reflectDir), 0.0), shininess);
+        } else {
+            vec3 halfDir = normalize(lightDir + viewDir);
+            spec = pow(max(dot(halfDir, pixelNorm), 0.0), shininess);
+        }
+        vec3 specular = spec * specColor * light.specular;
+        float shadow = ShadowCalculation(lightTransform * vec4(fragPos, 1.0), pixelNorm, lightDir);
+        result += (diffuse + specular) * intensity * (1.0 - shadow);
+    }
+    result *= attenuation;
+    if (clusterEnabled == 1)
+        result += ClusterLighting(fragPos, texColor, specColor, shininess, pixelNorm, viewDir);
+    fragColor = vec4(result, 1.0);
+}
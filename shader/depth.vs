@@ -0,0 +1,11 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+
+uniform mat4 transform;
+
+// the lit pass re-rasterizes with GL_EQUAL, so depth must match it bit for bit
+invariant gl_Position;
+
+void main() {
+    gl_Position = transform * vec4(aPos, 1.0);
+}
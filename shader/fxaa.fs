@@ -0,0 +1,137 @@
+#version 330 core
+in vec4 vertexColor;
+in vec2 texCoord;
+out vec4 fragColor;
+
+// luma based edge detection and blend along the edge, after fxaa 3.11 (quality preset)
+uniform sampler2D tex;
+// the scene only covers renderSize texels of tex when rendered at a reduced scale
+uniform vec2 renderSize;
+
+const float EDGE_THRESHOLD_MIN = 0.0312;
+const float EDGE_THRESHOLD_MAX = 0.125;
+const float SUBPIXEL_QUALITY = 0.75;
+const int SEARCH_STEPS = 10;
+const float SEARCH_STEP_SIZE[SEARCH_STEPS] = float[](1.0, 1.0, 1.0, 1.0, 1.0, 1.5, 2.0, 2.0, 4.0, 8.0);
+
+vec3 Fetch(vec2 uv) {
+    return texture(tex, min(uv, (renderSize - 0.5) / vec2(textureSize(tex, 0)))).rgb;
+}
+
+float Luma(vec3 color) {
+    // perceptual luma, the approximate sqrt keeps dark edges from being ignored
+    return sqrt(dot(color, vec3(0.299, 0.587, 0.114)));
+}
+
+float LumaAt(vec2 uv) {
+    return Luma(Fetch(uv));
+}
+
+void main() {
+    vec2 texelSize = 1.0 / vec2(textureSize(tex, 0));
+    vec2 uv = gl_FragCoord.xy * texelSize;
+
+    vec3 color = Fetch(uv);
+    float lumaCenter = Luma(color);
+    float lumaDown = LumaAt(uv + vec2(0.0, -texelSize.y));
+    float lumaUp = LumaAt(uv + vec2(0.0, texelSize.y));
+    float lumaLeft = LumaAt(uv + vec2(-texelSize.x, 0.0));
+    float lumaRight = LumaAt(uv + vec2(texelSize.x, 0.0));
+
+    float lumaMin = min(lumaCenter, min(min(lumaDown, lumaUp), min(lumaLeft, lumaRight)));
+    float lumaMax = max(lumaCenter, max(max(lumaDown, lumaUp), max(lumaLeft, lumaRight)));
+    float lumaRange = lumaMax - lumaMin;
+    if (lumaRange < max(EDGE_THRESHOLD_MIN, lumaMax * EDGE_THRESHOLD_MAX)) {
+        fragColor = vec4(color, 1.0);
+        return;
+    }
+
+    float lumaDownLeft = LumaAt(uv + vec2(-texelSize.x, -texelSize.y));
+    float lumaUpRight = LumaAt(uv + vec2(texelSize.x, texelSize.y));
+    float lumaUpLeft = LumaAt(uv + vec2(-texelSize.x, texelSize.y));
+    float lumaDownRight = LumaAt(uv + vec2(texelSize.x, -texelSize.y));
+
+    float lumaDownUp = lumaDown + lumaUp;
+    float lumaLeftRight = lumaLeft + lumaRight;
+    float lumaLeftCorners = lumaDownLeft + lumaUpLeft;
+    float lumaDownCorners = lumaDownLeft + lumaDownRight;
+    float lumaRightCorners = lumaDownRight + lumaUpRight;
+    float lumaUpCorners = lumaUpRight + lumaUpLeft;
+
+    float edgeHorizontal = abs(-2.0 * lumaLeft + lumaLeftCorners) +
+        abs(-2.0 * lumaCenter + lumaDownUp) * 2.0 + abs(-2.0 * lumaRight + lumaRightCorners);
+    float edgeVertical = abs(-2.0 * lumaUp + lumaUpCorners) +
+        abs(-2.0 * lumaCenter + lumaLeftRight) * 2.0 + abs(-2.0 * lumaDown + lumaDownCorners);
+    bool horizontal = edgeHorizontal >= edgeVertical;
+
+    // pick the side of the edge with the steeper gradient
+    float luma1 = horizontal ? lumaDown : lumaLeft;
+    float luma2 = horizontal ? lumaUp : lumaRight;
+    float gradient1 = luma1 - lumaCenter;
+    float gradient2 = luma2 - lumaCenter;
+    bool steepest1 = abs(gradient1) >= abs(gradient2);
+    float gradientScaled = 0.25 * max(abs(gradient1), abs(gradient2));
+
+    float stepLength = horizontal ? texelSize.y : texelSize.x;
+    float lumaLocalAverage;
+    if (steepest1) {
+        stepLength = -stepLength;
+        lumaLocalAverage = 0.5 * (luma1 + lumaCenter);
+    }
+    else {
+        lumaLocalAverage = 0.5 * (luma2 + lumaCenter);
+    }
+
+    // walk along the edge in both directions until the luma leaves the local average
+    vec2 currentUv = uv;
+    if (horizontal)
+        currentUv.y += stepLength * 0.5;
+    else
+        currentUv.x += stepLength * 0.5;
+    vec2 offset = horizontal ? vec2(texelSize.x, 0.0) : vec2(0.0, texelSize.y);
+
+    vec2 uv1 = currentUv - offset;
+    vec2 uv2 = currentUv + offset;
+    float lumaEnd1 = LumaAt(uv1) - lumaLocalAverage;
+    float lumaEnd2 = LumaAt(uv2) - lumaLocalAverage;
+    bool reached1 = abs(lumaEnd1) >= gradientScaled;
+    bool reached2 = abs(lumaEnd2) >= gradientScaled;
+    for (int i = 1; i < SEARCH_STEPS && !(reached1 && reached2); i++) {
+        if (!reached1) {
+            uv1 -= offset * SEARCH_STEP_SIZE[i];
+            lumaEnd1 = LumaAt(uv1) - lumaLocalAverage;
+            reached1 = abs(lumaEnd1) >= gradientScaled;
+        }
+        if (!reached2) {
+            uv2 += offset * SEARCH_STEP_SIZE[i];
+            lumaEnd2 = LumaAt(uv2) - lumaLocalAverage;
+            reached2 = abs(lumaEnd2) >= gradientScaled;
+        }
+    }
+
+    float distance1 = horizontal ? (uv.x - uv1.x) : (uv.y - uv1.y);
+    float distance2 = horizontal ? (uv2.x - uv.x) : (uv2.y - uv.y);
+    bool direction1 = distance1 < distance2;
+    float distanceFinal = min(distance1, distance2);
+    float edgeLength = distance1 + distance2;
+    float pixelOffset = -distanceFinal / edgeLength + 0.5;
+
+    // only blend when the end we stopped at varies the same way as the center
+    bool lumaCenterSmaller = lumaCenter < lumaLocalAverage;
+    bool correctVariation = ((direction1 ? lumaEnd1 : lumaEnd2) < 0.0) != lumaCenterSmaller;
+    float finalOffset = correctVariation ? pixelOffset : 0.0;
+
+    // sub-pixel aliasing from the 3x3 neighborhood
+    float lumaAverage = (1.0 / 12.0) * (2.0 * (lumaDownUp + lumaLeftRight) + lumaLeftCorners + lumaRightCorners);
+    float subPixelOffset1 = clamp(abs(lumaAverage - lumaCenter) / lumaRange, 0.0, 1.0);
+    float subPixelOffset2 = (-2.0 * subPixelOffset1 + 3.0) * subPixelOffset1 * subPixelOffset1;
+    float subPixelOffsetFinal = subPixelOffset2 * subPixelOffset2 * SUBPIXEL_QUALITY;
+    finalOffset = max(finalOffset, subPixelOffsetFinal);
+
+    vec2 finalUv = uv;
+    if (horizontal)
+        finalUv.y += finalOffset * stepLength;
+    else
+        finalUv.x += finalOffset * stepLength;
+    fragColor = vec4(Fetch(finalUv), 1.0);
+}
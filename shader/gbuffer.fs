@@ -0,0 +1,29 @@
+#version 330 core
+in vec3 normal;
+in vec2 texCoord;
+
+// packed g-buffer
+//   0 RGBA8    : albedo.rgb, specular intensity
+//   1 RGB10_A2 : octahedral normal.xy, shininess / 256
+layout (location = 0) out vec4 gAlbedoSpec;
+layout (location = 1) out vec4 gNormal;
+
+struct Material {
+    sampler2D diffuse;
+    sampler2D specular;
+    float shininess;
+};
+uniform Material material;
+
+vec2 EncodeOctahedral(vec3 n) {
+    n /= abs(n.x) + abs(n.y) + abs(n.z);
+    vec2 signs = vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+    vec2 e = n.z >= 0.0 ? n.xy : (1.0 - abs(n.yx)) * signs;
+    return e * 0.5 + 0.5;
+}
+
+void main() {
+    vec3 specColor = texture(material.specular, texCoord).rgb;
+    gAlbedoSpec = vec4(texture(material.diffuse, texCoord).rgb, dot(specColor, vec3(1.0 / 3.0)));
+    gNormal = vec4(EncodeOctahedral(normalize(normal)), clamp(material.shininess / 256.0, 0.0, 1.0), 0.0);
+}
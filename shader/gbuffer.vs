@@ -0,0 +1,16 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aNormal;
+layout (location = 2) in vec2 aTexCoord;
+
+out vec3 normal;
+out vec2 texCoord;
+
+uniform mat4 transform;
+uniform mat4 modelTransform;
+
+void main() {
+    gl_Position = transform * vec4(aPos, 1.0);
+    normal = transpose(inverse(mat3(modelTransform))) * aNormal;
+    texCoord = aTexCoord;
+}
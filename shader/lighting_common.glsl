@@ -0,0 +1,68 @@
+// shadow and clustered light terms of lighting_shadow.fs and
+// deferred_lighting.fs, pulled in with #include (see Shader::CreateFromFile).
+// surface values come in as arguments, forward and deferred read them apart
+uniform sampler2D shadowMap;
+
+// clustered point/spot lights, see LightCluster
+uniform int clusterEnabled;
+uniform mat4 view;
+uniform samplerBuffer clusterLights;
+uniform usamplerBuffer clusterGrid;
+uniform usamplerBuffer clusterIndices;
+uniform vec3 clusterDims;
+uniform vec2 clusterTileSize;
+uniform vec2 clusterDepthParams;
+
+float ShadowCalculation(vec4 fragPosLight, vec3 normal, vec3 lightDir) {
+    // perform perspective divide
+    vec3 projCoords = fragPosLight.xyz / fragPosLight.w;
+    // transform to [0,1] range
+    projCoords = projCoords * 0.5 + 0.5;
+    // get depth of current fragment from light’s perspective
+    float currentDepth = projCoords.z;
+    // check whether current frag pos is in shadow
+    float bias = max(0.01 * (1.0 - dot(normal, lightDir)), 0.001);
+    float shadow = 0.0;
+    vec2 texelSize = 1.0 / textureSize(shadowMap, 0);
+    for (int x = -1; x <= 1; ++x) {
+        for (int y = -1; y <= 1; ++y) {
+            float pcfDepth = texture(shadowMap, projCoords.xy + vec2(x, y) * texelSize).r;
+            shadow += currentDepth - bias > pcfDepth ? 1.0 : 0.0;
+        }
+    }
+    return shadow / 9.0;
+}
+
+vec3 ClusterLighting(vec3 fragPos, vec3 albedo, vec3 specColor, float shininess, vec3 pixelNorm, vec3 viewDir) {
+    float viewDepth = -(view * vec4(fragPos, 1.0)).z;
+    int slice = int(max(log(viewDepth) * clusterDepthParams.x + clusterDepthParams.y, 0.0));
+    ivec3 cell = ivec3(ivec2(gl_FragCoord.xy / clusterTileSize), slice);
+    cell = clamp(cell, ivec3(0), ivec3(clusterDims) - 1);
+    int clusterIndex = cell.x + int(clusterDims.x) * (cell.y + int(clusterDims.y) * cell.z);
+    uvec2 range = texelFetch(clusterGrid, clusterIndex).xy;
+
+    vec3 result = vec3(0.0);
+    for (uint i = 0u; i < range.y; i++) {
+        int lightIndex = int(texelFetch(clusterIndices, int(range.x + i)).r);
+        vec4 positionRadius = texelFetch(clusterLights, 3 * lightIndex);
+        vec4 colorOuter = texelFetch(clusterLights, 3 * lightIndex + 1);
+        vec4 directionInner = texelFetch(clusterLights, 3 * lightIndex + 2);
+
+        vec3 toLight = positionRadius.xyz - fragPos;
+        float dist = length(toLight);
+        if (dist >= positionRadius.w)
+            continue;
+        vec3 lightDir = toLight / dist;
+        float theta = dot(lightDir, -directionInner.xyz);
+        float intensity = clamp((theta - colorOuter.w) / (directionInner.w - colorOuter.w), 0.0, 1.0);
+        // smooth window so the light reaches zero exactly at its cluster radius
+        float window = clamp(1.0 - pow(dist / positionRadius.w, 4.0), 0.0, 1.0);
+        float attenuation = window * window / (dist * dist + 1.0);
+
+        float diff = max(dot(pixelNorm, lightDir), 0.0);
+        vec3 halfDir = normalize(lightDir + viewDir);
+        float spec = pow(max(dot(halfDir, pixelNorm), 0.0), shininess);
+        result += (diff * albedo + spec * specColor) * colorOuter.rgb * attenuation * intensity;
+    }
+    return result;
+}
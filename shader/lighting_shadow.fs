@@ -30,31 +30,9 @@ struct Material {
 };
 uniform Material material;
 uniform int blinn;
-uniform sampler2D shadowMap;
 
-float ShadowCalculation(vec4 fragPosLight,vec3 normal,vec3 lightDir) {
-    // perform perspective divide
-    vec3 projCoords = fragPosLight.xyz / fragPosLight.w;
-    // transform to [0,1] range
-    projCoords = projCoords * 0.5 + 0.5;
-    // get closest depth value from light’s perspective (using
-    // [0,1] range fragPosLight as coords)
-    float closestDepth = texture(shadowMap, projCoords.xy).r;
-    // get depth of current fragment from light’s perspective
-    float currentDepth = projCoords.z;
-    // check whether current frag pos is in shadow
-    float bias = max(0.01*(1.0-dot(normal,lightDir)),0.001);
-    float shadow = 0.0;
-    vec2 texelSize = 1.0 / textureSize(shadowMap, 0);
-    for(int x = -1; x <= 1; ++x) {
-        for (int y = -1; y <= 1; ++y) {
-            float pcfDepth = texture(shadowMap, projCoords.xy + vec2(x, y) * texelSize).r;
-            shadow += currentDepth - bias > pcfDepth ? 1.0 : 0.0;
-        }
-    }
-    shadow /= 9.0;
-    return shadow;
-}
+#include "lighting_common.glsl"
+
 void main() {
     vec3 texColor = texture2D(material.diffuse, fs_in.texCoord).xyz;
     vec3 ambient = texColor * light.ambient;
@@ -98,5 +76,10 @@ void main() {
         result += (diffuse + specular) * intensity * (1.0 - shadow);
     }
     result *= attenuation;
+    if (clusterEnabled == 1) {
+        vec3 specColor = texture2D(material.specular, fs_in.texCoord).xyz;
+        vec3 viewDir = normalize(viewPos - fs_in.fragPos);
+        result += ClusterLighting(fs_in.fragPos, texColor, specColor, material.shininess, normalize(fs_in.normal), viewDir);
+    }
     fragColor = vec4(result, 1.0);
 }
\ No newline at end of file
@@ -0,0 +1,10 @@
+uniform float contrast;
+uniform float saturation;
+uniform vec3 colorFilter;
+
+vec3 ColorGrading(vec3 color, vec2 uv) {
+  color = (color - 0.5) * contrast + 0.5;
+  float luma = dot(color, vec3(0.2126, 0.7152, 0.0722));
+  color = luma + (color - luma) * saturation;
+  return max(color * colorFilter, vec3(0.0));
+}
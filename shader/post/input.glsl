@@ -0,0 +1,84 @@
+// scene input of the post pass. MSAA_SAMPLES > 1 reads the multisample target
+// directly and resolves while shading, which needs the scene at window size.
+// the scene only covers renderSize texels of tex when rendered at a reduced scale
+uniform vec2 renderSize;
+
+#if MSAA_SAMPLES > 1
+uniform sampler2DMS tex;
+
+vec3 LoadScene(ivec2 coord) {
+  coord = clamp(coord, ivec2(0), ivec2(renderSize) - 1);
+  vec3 sum = vec3(0.0);
+  for (int i = 0; i < MSAA_SAMPLES; i++)
+    sum += texelFetch(tex, coord, i).rgb;
+  return sum / float(MSAA_SAMPLES);
+}
+
+vec3 SampleScene() {
+  return LoadScene(ivec2(gl_FragCoord.xy));
+}
+
+// neighbor in scene texels, for effects that filter
+vec3 SampleSceneOffset(ivec2 offset) {
+  return LoadScene(ivec2(gl_FragCoord.xy) + offset);
+}
+#else
+uniform sampler2D tex;
+
+vec2 SceneTexSize() {
+  return vec2(textureSize(tex, 0));
+}
+
+vec2 SceneUv() {
+  return texCoord * renderSize / SceneTexSize();
+}
+
+#ifdef BICUBIC
+// catmull-rom in 9 bilinear taps, the middle weights are folded into one fetch per axis
+vec3 SampleCatmullRom(vec2 uv, vec2 texSize) {
+  vec2 samplePos = uv * texSize;
+  vec2 texPos1 = floor(samplePos - 0.5) + 0.5;
+  vec2 f = samplePos - texPos1;
+
+  vec2 w0 = f * (-0.5 + f * (1.0 - 0.5 * f));
+  vec2 w1 = 1.0 + f * f * (-2.5 + 1.5 * f);
+  vec2 w2 = f * (0.5 + f * (2.0 - 1.5 * f));
+  vec2 w3 = f * f * (-0.5 + 0.5 * f);
+  vec2 w12 = w1 + w2;
+
+  // clamp to the rendered sub-rect so nothing outside it bleeds in
+  vec2 uvMin = 0.5 / texSize;
+  vec2 uvMax = (renderSize - 0.5) / texSize;
+  vec2 uv0 = clamp((texPos1 - 1.0) / texSize, uvMin, uvMax);
+  vec2 uv3 = clamp((texPos1 + 2.0) / texSize, uvMin, uvMax);
+  vec2 uv12 = clamp((texPos1 + w2 / w12) / texSize, uvMin, uvMax);
+
+  vec3 result = vec3(0.0);
+  result += texture(tex, vec2(uv0.x, uv0.y)).rgb * w0.x * w0.y;
+  result += texture(tex, vec2(uv12.x, uv0.y)).rgb * w12.x * w0.y;
+  result += texture(tex, vec2(uv3.x, uv0.y)).rgb * w3.x * w0.y;
+  result += texture(tex, vec2(uv0.x, uv12.y)).rgb * w0.x * w12.y;
+  result += texture(tex, vec2(uv12.x, uv12.y)).rgb * w12.x * w12.y;
+  result += texture(tex, vec2(uv3.x, uv12.y)).rgb * w3.x * w12.y;
+  result += texture(tex, vec2(uv0.x, uv3.y)).rgb * w0.x * w3.y;
+  result += texture(tex, vec2(uv12.x, uv3.y)).rgb * w12.x * w3.y;
+  result += texture(tex, vec2(uv3.x, uv3.y)).rgb * w3.x * w3.y;
+  // negative lobes can undershoot on hard edges
+  return max(result, vec3(0.0));
+}
+
+vec3 SampleScene() {
+  return SampleCatmullRom(SceneUv(), SceneTexSize());
+}
+#else
+vec3 SampleScene() {
+  return texture(tex, min(SceneUv(), (renderSize - 0.5) / SceneTexSize())).rgb;
+}
+#endif
+
+vec3 SampleSceneOffset(ivec2 offset) {
+  vec2 texSize = SceneTexSize();
+  vec2 uv = SceneUv() + vec2(offset) / texSize;
+  return texture(tex, clamp(uv, 0.5 / texSize, (renderSize - 0.5) / texSize)).rgb;
+}
+#endif
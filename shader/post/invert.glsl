@@ -0,0 +1,3 @@
+vec3 Invert(vec3 color, vec2 uv) {
+  return 1.0 - color;
+}
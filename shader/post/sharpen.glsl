@@ -0,0 +1,8 @@
+uniform float sharpenAmount;
+
+// unsharp mask against the 4 direct neighbors
+vec3 Sharpen(vec3 color, vec2 uv) {
+  vec3 neighbors = SampleSceneOffset(ivec2(1, 0)) + SampleSceneOffset(ivec2(-1, 0)) +
+    SampleSceneOffset(ivec2(0, 1)) + SampleSceneOffset(ivec2(0, -1));
+  return max(color + (color * 4.0 - neighbors) * sharpenAmount, vec3(0.0));
+}
@@ -0,0 +1,7 @@
+uniform float exposure;
+
+// narkowicz's fit of the aces filmic curve
+vec3 Tonemap(vec3 color, vec2 uv) {
+  vec3 x = color * exposure;
+  return clamp((x * (2.51 * x + 0.03)) / (x * (2.43 * x + 0.59) + 0.14), 0.0, 1.0);
+}
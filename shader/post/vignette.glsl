@@ -0,0 +1,8 @@
+uniform float vignetteIntensity;
+uniform float vignetteSmoothness;
+
+// uv is the window position in [0, 1]
+vec3 Vignette(vec3 color, vec2 uv) {
+  float distance = length(uv - 0.5) * 1.41421356;
+  return color * (1.0 - vignetteIntensity * smoothstep(1.0 - vignetteSmoothness, 1.0, distance));
+}
@@ -0,0 +1,54 @@
+#version 330 core
+in vec4 vertexColor;
+in vec2 texCoord;
+out vec4 fragColor;
+
+// temporal anti-aliasing: blend the jittered frame into the reprojected history
+uniform sampler2D tex;
+uniform sampler2D depthTex;
+uniform sampler2D history;
+// the scene only covers renderSize texels of tex when rendered at a reduced scale
+uniform vec2 renderSize;
+// size of the rect the history was written at last frame
+uniform vec2 historySize;
+uniform int historyValid;
+uniform float blend;
+// current jittered camera and the previous unjittered one
+uniform mat4 inverseViewProjection;
+uniform mat4 previousViewProjection;
+
+void main() {
+    vec2 texelSize = 1.0 / vec2(textureSize(tex, 0));
+    vec2 uvMax = (renderSize - 0.5) * texelSize;
+    vec2 uv = gl_FragCoord.xy * texelSize;
+    vec3 current = texture(tex, uv).rgb;
+
+    // 3x3 neighborhood bounds reject history that doesn't belong to this pixel
+    vec3 neighborMin = current;
+    vec3 neighborMax = current;
+    for (int y = -1; y <= 1; y++) {
+        for (int x = -1; x <= 1; x++) {
+            vec3 neighbor = texture(tex, clamp(uv + vec2(x, y) * texelSize, vec2(0.0), uvMax)).rgb;
+            neighborMin = min(neighborMin, neighbor);
+            neighborMax = max(neighborMax, neighbor);
+        }
+    }
+
+    // the scene is static, so the motion vector follows from depth and the camera change
+    float depth = texture(depthTex, uv).r;
+    vec2 screen = gl_FragCoord.xy / renderSize;
+    vec4 worldPos = inverseViewProjection * vec4(screen * 2.0 - 1.0, depth * 2.0 - 1.0, 1.0);
+    vec4 previousClip = previousViewProjection * vec4(worldPos.xyz / worldPos.w, 1.0);
+    vec2 previousScreen = previousClip.xy / previousClip.w * 0.5 + 0.5;
+
+    bool onScreen = all(greaterThanEqual(previousScreen, vec2(0.0))) && all(lessThanEqual(previousScreen, vec2(1.0)));
+    if (historyValid == 0 || !onScreen) {
+        fragColor = vec4(current, 1.0);
+        return;
+    }
+
+    vec2 historyTexelSize = 1.0 / vec2(textureSize(history, 0));
+    vec2 historyUv = min(previousScreen * historySize, historySize - 0.5) * historyTexelSize;
+    vec3 previous = clamp(texture(history, historyUv).rgb, neighborMin, neighborMax);
+    fragColor = vec4(previous + (current - previous) * blend, 1.0);
+}
@@ -0,0 +1,331 @@
+#include "async_log.h"
+#include <spdlog/sinks/base_sink.h>
+#include <spdlog/details/null_mutex.h>
+#include <chrono>
+#include <fstream>
+#include <thread>
+#include <unordered_map>
+
+void ParseAsyncLogOptions(int argc, char** args, AsyncLogOptions& options) {
+  for (int i = 1; i < argc; i++) {
+    std::string arg = args[i];
+    if (arg == "--telemetry" && i + 1 < argc)
+      options.telemetryFile = args[++i];
+  }
+}
+
+namespace {
+
+// bounded multi-producer single-consumer queue, each slot carries a sequence
+// number so producers only contend on the enqueue index
+template <typename T, size_t Capacity>
+class MpscRing {
+public:
+  MpscRing() {
+    for (size_t i = 0; i < Capacity; i++)
+      m_slots[i].sequence.store(i, std::memory_order_relaxed);
+  }
+
+  // fill is called with the reserved slot, false when the ring is full
+  template <typename Fill>
+  bool TryPush(Fill&& fill) {
+    size_t position = m_enqueue.load(std::memory_order_relaxed);
+    Slot* slot;
+    while (true) {
+      slot = &m_slots[position % Capacity];
+      size_t sequence = slot->sequence.load(std::memory_order_acquire);
+      intptr_t difference = (intptr_t)sequence - (intptr_t)position;
+      if (difference == 0) {
+        if (m_enqueue.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+          break;
+      }
+      else if (difference < 0) {
+        return false;
+      }
+      else {
+        position = m_enqueue.load(std::memory_order_relaxed);
+      }
+    }
+    fill(slot->value);
+    slot->sequence.store(position + 1, std::memory_order_release);
+    return true;
+  }
+
+  // consumer thread only
+  template <typename Consume>
+  bool TryPop(Consume&& consume) {
+    auto& slot = m_slots[m_dequeue % Capacity];
+    if (slot.sequence.load(std::memory_order_acquire) != m_dequeue + 1)
+      return false;
+    consume(slot.value);
+    slot.sequence.store(m_dequeue + Capacity, std::memory_order_release);
+    m_dequeue++;
+    return true;
+  }
+
+private:
+  struct Slot {
+    std::atomic<size_t> sequence;
+    T value;
+  };
+  Slot m_slots[Capacity];
+  alignas(64) std::atomic<size_t> m_enqueue { 0 };
+  alignas(64) size_t m_dequeue { 0 };
+};
+
+struct LogEntry {
+  static constexpr size_t InlineSize = 224;
+  spdlog::level::level_enum level;
+  spdlog::log_clock::time_point time;
+  size_t threadId;
+  spdlog::source_loc source;
+  size_t length;
+  char* overflow;     // longer messages, e.g. shader compile logs
+  char text[InlineSize];
+};
+
+struct TelemetryEntry {
+  static constexpr size_t MaxValues = 8;
+  const char* event;
+  int64_t time;
+  uint8_t count;
+  float values[MaxValues];
+};
+
+struct AsyncLogState {
+  MpscRing<LogEntry, 4096> log;
+  MpscRing<TelemetryEntry, 16384> telemetry;
+  std::vector<spdlog::sink_ptr> sinks;
+  // entries outlive the logger that queued them when it is replaced
+  std::string loggerName;
+  std::ofstream telemetryFile;
+  std::unordered_map<const char*, uint32_t> telemetryIds;
+  std::atomic<uint64_t> dropped { 0 };
+  std::atomic<uint64_t> droppedTelemetry { 0 };
+  std::atomic<bool> flush { false };
+  std::atomic<bool> stop { false };
+  std::thread writer;
+  // the logger queuing into the ring. SPDLOG_* call sites go through the raw
+  // default logger pointer, a thread may still be inside it after Shutdown
+  std::shared_ptr<spdlog::logger> logger;
+};
+// never deleted: producers may use it at any time up to the end of the process
+std::atomic<AsyncLogState*> s_state { nullptr };
+
+void WriteToSinks(AsyncLogState& state, const spdlog::details::log_msg& message) {
+  for (auto& sink : state.sinks) {
+    if (sink->should_log(message.level))
+      sink->log(message);
+  }
+}
+
+class RingSink : public spdlog::sinks::base_sink<spdlog::details::null_mutex> {
+public:
+  explicit RingSink(AsyncLogState* state) : m_state(state) {}
+
+protected:
+  void sink_it_(const spdlog::details::log_msg& message) override {
+    auto& state = *m_state;
+    // nothing drains the ring any more
+    if (state.stop) {
+      WriteToSinks(state, message);
+      return;
+    }
+    auto fill = [&](LogEntry& entry) {
+      entry.level = message.level;
+      entry.time = message.time;
+      entry.threadId = message.thread_id;
+      entry.source = message.source;
+      entry.length = message.payload.size();
+      entry.overflow = nullptr;
+      if (entry.length <= LogEntry::InlineSize) {
+        memcpy(entry.text, message.payload.data(), entry.length);
+      }
+      else {
+        entry.overflow = new char[entry.length];
+        memcpy(entry.overflow, message.payload.data(), entry.length);
+      }
+    };
+    if (state.log.TryPush(fill))
+      return;
+    if (message.level < spdlog::level::warn) {
+      state.dropped++;
+      return;
+    }
+    while (!state.log.TryPush(fill)) {
+      if (state.stop) {
+        WriteToSinks(state, message);
+        return;
+      }
+      std::this_thread::yield();
+    }
+  }
+
+  void flush_() override {
+    m_state->flush = true;
+  }
+
+private:
+  AsyncLogState* m_state;
+};
+
+void WriteTelemetry(AsyncLogState& state, const TelemetryEntry& entry) {
+  auto& file = state.telemetryFile;
+  auto id = state.telemetryIds.find(entry.event);
+  if (id == state.telemetryIds.end()) {
+    id = state.telemetryIds.emplace(entry.event, (uint32_t)state.telemetryIds.size()).first;
+    uint8_t type = 0;
+    uint16_t length = (uint16_t)strlen(entry.event);
+    file.write((const char*)&type, 1);
+    file.write((const char*)&id->second, sizeof(uint32_t));
+    file.write((const char*)&length, sizeof(uint16_t));
+    file.write(entry.event, length);
+  }
+  uint8_t type = 1;
+  file.write((const char*)&type, 1);
+  file.write((const char*)&id->second, sizeof(uint32_t));
+  file.write((const char*)&entry.time, sizeof(int64_t));
+  file.write((const char*)&entry.count, 1);
+  file.write((const char*)entry.values, entry.count * sizeof(float));
+}
+
+// one consumer at a time, the writer or Shutdown once it joined the writer.
+// returns whether there was anything
+bool DrainLog(AsyncLogState* state, bool& important) {
+  bool wrote = false;
+  while (state->log.TryPop([&](LogEntry& entry) {
+    spdlog::details::log_msg message(entry.time, entry.source, state->loggerName, entry.level,
+      spdlog::string_view_t(entry.overflow ? entry.overflow : entry.text, entry.length));
+    message.thread_id = entry.threadId;
+    WriteToSinks(*state, message);
+    delete[] entry.overflow;
+    important |= entry.level >= spdlog::level::warn;
+    wrote = true;
+  })) {}
+  return wrote;
+}
+
+void WriterLoop(AsyncLogState* state) {
+  uint64_t reportedDrops = 0;
+  while (true) {
+    bool stopping = state->stop.load();
+    bool important = false;
+    bool wrote = DrainLog(state, important);
+    while (state->telemetry.TryPop([&](TelemetryEntry& entry) {
+      if (state->telemetryFile.is_open())
+        WriteTelemetry(*state, entry);
+      wrote = true;
+    })) {}
+
+    uint64_t dropped = state->dropped.load();
+    if (dropped != reportedDrops) {
+      auto text = fmt::format("{} log messages dropped, the log ring was full", dropped - reportedDrops);
+      spdlog::details::log_msg message(state->loggerName, spdlog::level::warn, text);
+      message.thread_id = spdlog::details::os::thread_id();
+      for (auto& sink : state->sinks)
+        sink->log(message);
+      reportedDrops = dropped;
+    }
+
+    // warnings and errors reach the console or file right away
+    if (important || state->flush.exchange(false) || stopping) {
+      for (auto& sink : state->sinks)
+        sink->flush();
+      if (state->telemetryFile.is_open())
+        state->telemetryFile.flush();
+    }
+    if (stopping)
+      break;
+    if (!wrote)
+      std::this_thread::sleep_for(std::chrono::milliseconds(2));
+  }
+}
+
+}
+
+bool AsyncLog::Init(const AsyncLogOptions& options) {
+  auto current = s_state.load();
+  if (current && !current->stop)
+    return true;
+  auto state = std::make_unique<AsyncLogState>();
+  auto previous = spdlog::default_logger();
+  state->sinks = previous->sinks();
+  state->loggerName = previous->name();
+  if (!options.telemetryFile.empty()) {
+    state->telemetryFile.open(options.telemetryFile, std::ios::binary);
+    if (!state->telemetryFile.is_open()) {
+      SPDLOG_ERROR("failed to open telemetry file: {}", options.telemetryFile);
+      return false;
+    }
+    state->telemetryFile.write("TLOG1", 5);
+  }
+  state->logger = std::make_shared<spdlog::logger>(previous->name(), std::make_shared<RingSink>(state.get()));
+  state->logger->set_level(previous->level());
+  state->logger->flush_on(spdlog::level::warn);
+  state->writer = std::thread(WriterLoop, state.get());
+  if (!current)
+    std::atexit(Shutdown);
+  s_state = state.get();
+  spdlog::set_default_logger(state.release()->logger);
+  return true;
+}
+
+void AsyncLog::Shutdown() {
+  auto state = s_state.load();
+  if (!state || state->stop)
+    return;
+  // back to writing directly, then drain whatever is still queued. the state
+  // and its logger stay alive, threads still logging through them write to
+  // the sinks themselves from now on
+  auto logger = std::make_shared<spdlog::logger>(state->loggerName, state->sinks.begin(), state->sinks.end());
+  logger->set_level(state->logger->level());
+  spdlog::set_default_logger(logger);
+  state->stop = true;
+  state->writer.join();
+  // pushed between the writer's last look and stop being seen
+  bool important = false;
+  if (DrainLog(state, important)) {
+    for (auto& sink : state->sinks)
+      sink->flush();
+  }
+}
+
+void AsyncLog::Telemetry(const char* event, std::initializer_list<float> values) {
+  auto state = s_state.load();
+  if (!state || state->stop || !state->telemetryFile.is_open())
+    return;
+  int64_t time = std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+  bool pushed = state->telemetry.TryPush([&](TelemetryEntry& entry) {
+    entry.event = event;
+    entry.time = time;
+    entry.count = (uint8_t)std::min(values.size(), TelemetryEntry::MaxValues);
+    std::copy(values.begin(), values.begin() + entry.count, entry.values);
+  });
+  if (!pushed)
+    state->droppedTelemetry++;
+}
+
+uint64_t AsyncLog::GetDroppedCount() {
+  auto state = s_state.load();
+  return state ? state->dropped.load() : 0;
+}
+
+uint64_t AsyncLog::GetDroppedTelemetryCount() {
+  auto state = s_state.load();
+  return state ? state->droppedTelemetry.load() : 0;
+}
+
+bool LogRateLimiter::Allow(uint32_t& suppressed) {
+  int64_t now = std::chrono::duration_cast<std::chrono::milliseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+  int64_t windowStart = m_windowStart.load(std::memory_order_relaxed);
+  if (now - windowStart >= 1000 && m_windowStart.compare_exchange_strong(windowStart, now))
+    m_count = 0;
+  if (m_count.fetch_add(1, std::memory_order_relaxed) < m_perSecond) {
+    suppressed = m_suppressed.exchange(0, std::memory_order_relaxed);
+    return true;
+  }
+  m_suppressed.fetch_add(1, std::memory_order_relaxed);
+  return false;
+}
@@ -0,0 +1,71 @@
+#ifndef __ASYNC_LOG_H__
+#define __ASYNC_LOG_H__
+
+#include "common.h"
+#include <atomic>
+#include <initializer_list>
+
+// moves log output off the calling threads. AsyncLog::Init() replaces the
+// default spdlog logger with one whose sink copies each formatted message into
+// a lock-free ring; a writer thread drains it into the original sinks, so the
+// SPDLOG_* call sites stay as they are and never wait on the console or a file.
+// when the ring is full, info and below are dropped and counted, warnings and
+// errors wait for space so they are never lost.
+//
+// telemetry is a separate binary channel for high volume numbers (one event
+// per frame and more): records are never formatted, the writer appends them
+// to a file as
+//   header  "TLOG1"
+//   name    u8 0, u32 id, u16 length, chars     first use of an event name
+//   event   u8 1, u32 id, i64 time ns, u8 count, count x f32
+struct AsyncLogOptions {
+  std::string telemetryFile;    // no telemetry when empty
+};
+
+// --telemetry FILE
+void ParseAsyncLogOptions(int argc, char** args, AsyncLogOptions& options);
+
+class AsyncLog {
+public:
+  // flushed and stopped at exit
+  static bool Init(const AsyncLogOptions& options = AsyncLogOptions());
+  static void Shutdown();
+
+  // event must be a string literal, at most 8 values are kept
+  static void Telemetry(const char* event, std::initializer_list<float> values);
+
+  static uint64_t GetDroppedCount();
+  static uint64_t GetDroppedTelemetryCount();
+};
+
+// at most perSecond messages a second from one call site, the rest are
+// counted and reported with the next message that gets through
+class LogRateLimiter {
+public:
+  explicit LogRateLimiter(int perSecond) : m_perSecond(perSecond) {}
+  // suppressed is set to the number of messages skipped since the last one allowed
+  bool Allow(uint32_t& suppressed);
+
+private:
+  int m_perSecond;
+  std::atomic<int64_t> m_windowStart { 0 };
+  std::atomic<int> m_count { 0 };
+  std::atomic<uint32_t> m_suppressed { 0 };
+};
+
+#define LOG_RATE_LIMITED(level, perSecond, ...) \
+  do { \
+    if (spdlog::should_log(level)) { \
+      static LogRateLimiter logRateLimiter(perSecond); \
+      uint32_t logSuppressed = 0; \
+      if (logRateLimiter.Allow(logSuppressed)) { \
+        if (logSuppressed) \
+          SPDLOG_LOGGER_CALL(spdlog::default_logger_raw(), level, "({} similar messages suppressed)", logSuppressed); \
+        SPDLOG_LOGGER_CALL(spdlog::default_logger_raw(), level, __VA_ARGS__); \
+      } \
+    } \
+  } while (0)
+
+#define LOG_TELEMETRY(event, ...) AsyncLog::Telemetry(event, { __VA_ARGS__ })
+
+#endif // __ASYNC_LOG_H__
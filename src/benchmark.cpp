@@ -0,0 +1,274 @@
+#include "benchmark.h"
+#include "context.h"
+#include "mesh.h"
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+
+bool ParseBenchmarkOptions(int argc, char** args, BenchmarkOptions& options) {
+  for (int i = 1; i + 1 < argc; i++) {
+    std::string arg = args[i];
+    if (arg == "--benchmark")
+      options.script = args[++i];
+    else if (arg == "--report")
+      options.report = args[++i];
+    else if (arg == "--baseline")
+      options.baseline = args[++i];
+    else if (arg == "--threshold")
+      options.threshold = (float)atof(args[++i]);
+  }
+  return !options.script.empty();
+}
+
+BenchmarkUPtr Benchmark::Load(const std::string& scriptFilename) {
+  auto benchmark = BenchmarkUPtr(new Benchmark());
+  if (!benchmark->LoadScript(scriptFilename))
+    return nullptr;
+  return std::move(benchmark);
+}
+
+Benchmark::~Benchmark() {
+}
+
+bool Benchmark::LoadScript(const std::string& scriptFilename) {
+  auto text = LoadTextFile(scriptFilename);
+  if (!text.has_value())
+    return false;
+  m_scriptName = scriptFilename;
+
+  std::istringstream lines(text.value());
+  std::string line;
+  int lineNumber = 0;
+  while (std::getline(lines, line)) {
+    lineNumber++;
+    auto comment = line.find('#');
+    if (comment != std::string::npos)
+      line.resize(comment);
+    std::istringstream words(line);
+    std::string command;
+    if (!(words >> command))
+      continue;
+
+    bool valid = true;
+    if (command == "set") {
+      std::string name, value;
+      valid = (bool)(words >> name >> value);
+      if (valid)
+        m_settings.push_back({ name, value });
+    }
+    else if (command == "warmup") {
+      valid = (bool)(words >> m_warmupFrames) && m_warmupFrames >= 0;
+    }
+    else if (command == "frames") {
+      valid = (bool)(words >> m_measureFrames) && m_measureFrames > 0;
+    }
+    else if (command == "camera") {
+      Keyframe key;
+      valid = (bool)(words >> key.time >> key.position.x >> key.position.y >> key.position.z >> key.yaw >> key.pitch);
+      if (valid)
+        m_keyframes.push_back(key);
+    }
+    else {
+      valid = false;
+    }
+    if (!valid) {
+      SPDLOG_ERROR("{}:{}: can't parse '{}'", scriptFilename, lineNumber, line);
+      return false;
+    }
+  }
+
+  if (m_keyframes.empty()) {
+    SPDLOG_ERROR("{}: no camera keyframes", scriptFilename);
+    return false;
+  }
+  std::stable_sort(m_keyframes.begin(), m_keyframes.end(),
+    [](const Keyframe& a, const Keyframe& b) { return a.time < b.time; });
+  if (m_measureFrames == 0)
+    m_measureFrames = std::max((int)(m_keyframes.back().time * 60.0f), 1);
+  return true;
+}
+
+bool Benchmark::Apply(Context* context) const {
+  for (auto& setting : m_settings) {
+    if (!context->SetOption(setting.first, setting.second)) {
+      SPDLOG_ERROR("benchmark: invalid setting {} {}", setting.first, setting.second);
+      return false;
+    }
+  }
+  return true;
+}
+
+void Benchmark::BeginFrame(Context* context) {
+  if (m_gpuTimers.empty()) {
+    m_gpuTimers.resize(4);
+    for (auto& timer : m_gpuTimers) {
+      timer.begin = Query::Create(GL_TIMESTAMP);
+      timer.end = Query::Create(GL_TIMESTAMP);
+    }
+    m_renderer = reinterpret_cast<const char*>(glGetString(GL_RENDERER));
+  }
+
+  // warm-up frames hold the first keyframe, measured frames walk the path
+  float time = std::max(m_frameIndex - m_warmupFrames, 0) / 60.0f;
+  auto next = std::upper_bound(m_keyframes.begin(), m_keyframes.end(), time,
+    [](float t, const Keyframe& key) { return t < key.time; });
+  Keyframe key;
+  if (next == m_keyframes.begin()) {
+    key = m_keyframes.front();
+  }
+  else if (next == m_keyframes.end()) {
+    key = m_keyframes.back();
+  }
+  else {
+    auto& a = *(next - 1);
+    auto& b = *next;
+    float t = (time - a.time) / std::max(b.time - a.time, 1e-6f);
+    key.position = a.position + (b.position - a.position) * t;
+    key.yaw = a.yaw + (b.yaw - a.yaw) * t;
+    key.pitch = a.pitch + (b.pitch - a.pitch) * t;
+  }
+  context->SetCamera(key.position, key.yaw, key.pitch);
+
+  m_measuring = m_frameIndex >= m_warmupFrames;
+  CollectGpuTimes(false);
+  auto& timer = m_gpuTimers[m_frameIndex % m_gpuTimers.size()];
+  if (timer.pending)
+    CollectGpuTimes(true);
+  timer.begin->Timestamp();
+  timer.measured = m_measuring;
+  Mesh::ResetDrawStats();
+  m_frameStart = Clock::now();
+}
+
+void Benchmark::EndCpuFrame() {
+  auto& timer = m_gpuTimers[m_frameIndex % m_gpuTimers.size()];
+  timer.end->Timestamp();
+  timer.pending = true;
+  if (!m_measuring)
+    return;
+  m_cpuTimes.push_back(std::chrono::duration<double, std::milli>(Clock::now() - m_frameStart).count());
+  m_drawCalls.push_back((double)Mesh::GetDrawStats().drawCalls);
+  m_triangles.push_back((double)Mesh::GetDrawStats().triangles);
+}
+
+void Benchmark::EndFrame() {
+  if (m_measuring)
+    m_frameTimes.push_back(std::chrono::duration<double, std::milli>(Clock::now() - m_frameStart).count());
+  m_frameIndex++;
+  if (IsFinished())
+    CollectGpuTimes(true);
+}
+
+void Benchmark::CollectGpuTimes(bool wait) {
+  for (auto& timer : m_gpuTimers) {
+    if (!timer.pending)
+      continue;
+    if (!wait && !timer.end->IsResultAvailable())
+      continue;
+    if (timer.measured)
+      m_gpuTimes.push_back((double)(timer.end->GetResult() - timer.begin->GetResult()) / 1000000.0);
+    timer.pending = false;
+  }
+}
+
+Benchmark::Percentiles Benchmark::ComputePercentiles(std::vector<double> samples) {
+  Percentiles result;
+  if (samples.empty())
+    return result;
+  std::sort(samples.begin(), samples.end());
+  // nearest rank
+  auto rank = [&](double percentile) {
+    size_t index = (size_t)std::ceil(percentile / 100.0 * samples.size());
+    return samples[std::min(std::max(index, (size_t)1), samples.size()) - 1];
+  };
+  double sum = 0.0;
+  for (double sample : samples)
+    sum += sample;
+  result.average = sum / samples.size();
+  result.p50 = rank(50.0);
+  result.p95 = rank(95.0);
+  result.p99 = rank(99.0);
+  return result;
+}
+
+std::string Benchmark::BuildReport() const {
+  auto percentiles = [](const Percentiles& p) {
+    char text[160];
+    snprintf(text, sizeof(text), "{ \"avg\": %.4f, \"p50\": %.4f, \"p95\": %.4f, \"p99\": %.4f }",
+      p.average, p.p50, p.p95, p.p99);
+    return std::string(text);
+  };
+  auto escape = [](const std::string& text) {
+    std::string result;
+    for (char c : text) {
+      if (c == '"' || c == '\\')
+        result += '\\';
+      result += c;
+    }
+    return result;
+  };
+  std::string report = "{\n";
+  report += "  \"script\": \"" + escape(m_scriptName) + "\",\n";
+  report += "  \"renderer\": \"" + escape(m_renderer) + "\",\n";
+  report += "  \"frames\": " + std::to_string(m_cpuTimes.size()) + ",\n";
+  report += "  \"cpu_ms\": " + percentiles(ComputePercentiles(m_cpuTimes)) + ",\n";
+  report += "  \"gpu_ms\": " + percentiles(ComputePercentiles(m_gpuTimes)) + ",\n";
+  report += "  \"frame_ms\": " + percentiles(ComputePercentiles(m_frameTimes)) + ",\n";
+  report += "  \"draw_calls\": " + percentiles(ComputePercentiles(m_drawCalls)) + ",\n";
+  report += "  \"triangles\": " + percentiles(ComputePercentiles(m_triangles)) + "\n";
+  report += "}\n";
+  return report;
+}
+
+bool Benchmark::WriteReport(const std::string& filename) const {
+  std::ofstream file(filename);
+  if (!file.is_open()) {
+    SPDLOG_ERROR("failed to write benchmark report: {}", filename);
+    return false;
+  }
+  file << BuildReport();
+  SPDLOG_INFO("benchmark report written to {}", filename);
+  return true;
+}
+
+bool Benchmark::CompareWithBaseline(const std::string& filename, float thresholdPercent) const {
+  auto baseline = LoadTextFile(filename);
+  if (!baseline.has_value())
+    return false;
+  // the report layout is our own, so a value is found by its section and key
+  auto readValue = [](const std::string& text, const std::string& section, const std::string& key, double& value) {
+    auto sectionPos = text.find("\"" + section + "\"");
+    if (sectionPos == std::string::npos)
+      return false;
+    auto keyPos = text.find("\"" + key + "\":", sectionPos);
+    if (keyPos == std::string::npos)
+      return false;
+    value = atof(text.c_str() + keyPos + key.size() + 3);
+    return true;
+  };
+  auto current = BuildReport();
+
+  bool passed = true;
+  for (auto section : { "cpu_ms", "gpu_ms", "frame_ms" }) {
+    for (auto key : { "p50", "p95", "p99" }) {
+      double before = 0.0, after = 0.0;
+      if (!readValue(baseline.value(), section, key, before) || !readValue(current, section, key, after))
+        continue;
+      double change = before > 0.0 ? (after - before) / before * 100.0 : 0.0;
+      bool regressed = change > thresholdPercent;
+      passed = passed && !regressed;
+      if (regressed)
+        SPDLOG_ERROR("regression {}.{}: {:.3f} -> {:.3f} ms ({:+.1f}%)", section, key, before, after, change);
+      else
+        SPDLOG_INFO("{}.{}: {:.3f} -> {:.3f} ms ({:+.1f}%)", section, key, before, after, change);
+    }
+  }
+  // the workload itself should not change between runs of the same script
+  for (auto section : { "draw_calls", "triangles" }) {
+    double before = 0.0, after = 0.0;
+    if (readValue(baseline.value(), section, "avg", before) && readValue(current, section, "avg", after) &&
+        before != after)
+      SPDLOG_WARN("{} changed: {:.0f} -> {:.0f} per frame", section, before, after);
+  }
+  return passed;
+}
@@ -0,0 +1,93 @@
+#ifndef __BENCHMARK_H__
+#define __BENCHMARK_H__
+
+#include "common.h"
+#include "query.h"
+#include <chrono>
+
+class Context;
+
+struct BenchmarkOptions {
+  std::string script;
+  std::string report { "benchmark.json" };
+  std::string baseline;
+  float threshold { 5.0f };   // percent slowdown that counts as a regression
+};
+
+// true when the command line asks for a benchmark run:
+//   --benchmark SCRIPT [--report FILE] [--baseline FILE] [--threshold PERCENT]
+bool ParseBenchmarkOptions(int argc, char** args, BenchmarkOptions& options);
+
+// replays a scripted camera path with fixed settings and collects cpu, gpu and
+// whole-frame times. script lines:
+//   set <option> <value>     see Context::SetOption
+//   warmup <frames>          frames rendered at the first keyframe, not measured
+//   frames <count>           measured frames, default: the path length at 60 fps
+//   camera <time> <x> <y> <z> <yaw> <pitch>
+// the path is sampled at a fixed 1/60 s per frame, so runs see identical frames
+CLASS_PTR(Benchmark)
+class Benchmark {
+public:
+  static BenchmarkUPtr Load(const std::string& scriptFilename);
+  ~Benchmark();
+
+  bool Apply(Context* context) const;
+  // wraps Context::Render and the buffer swap of one frame
+  void BeginFrame(Context* context);
+  void EndCpuFrame();
+  void EndFrame();
+  bool IsFinished() const { return m_frameIndex >= m_warmupFrames + m_measureFrames; }
+  float GetFrameDeltaTime() const { return 1.0f / 60.0f; }
+
+  bool WriteReport(const std::string& filename) const;
+  // false when a frame time percentile got slower than the baseline by more than threshold
+  bool CompareWithBaseline(const std::string& filename, float thresholdPercent) const;
+
+private:
+  Benchmark() {}
+  bool LoadScript(const std::string& scriptFilename);
+  void CollectGpuTimes(bool wait);
+
+  struct Keyframe {
+    float time;
+    glm::vec3 position;
+    float yaw;
+    float pitch;
+  };
+  struct Percentiles {
+    double average { 0.0 };
+    double p50 { 0.0 };
+    double p95 { 0.0 };
+    double p99 { 0.0 };
+  };
+  static Percentiles ComputePercentiles(std::vector<double> samples);
+  std::string BuildReport() const;
+
+  std::string m_scriptName;
+  std::vector<std::pair<std::string, std::string>> m_settings;
+  std::vector<Keyframe> m_keyframes;
+  int m_warmupFrames { 60 };
+  int m_measureFrames { 0 };
+  int m_frameIndex { 0 };
+
+  using Clock = std::chrono::steady_clock;
+  Clock::time_point m_frameStart;
+  bool m_measuring { false };
+  std::vector<double> m_cpuTimes;
+  std::vector<double> m_frameTimes;
+  std::vector<double> m_gpuTimes;
+  std::vector<double> m_drawCalls;
+  std::vector<double> m_triangles;
+
+  // begin/end timestamp pairs, read back a few frames later
+  struct GpuTimer {
+    QueryUPtr begin;
+    QueryUPtr end;
+    bool pending { false };
+    bool measured { false };
+  };
+  std::vector<GpuTimer> m_gpuTimers;
+  std::string m_renderer;
+};
+
+#endif // __BENCHMARK_H__
@@ -0,0 +1,537 @@
+#include "block_compressor.h"
+#include <algorithm>
+#include <cfloat>
+#include <climits>
+#include <cmath>
+#include <cstring>
+
+namespace {
+
+// one 4x4 block, texel y * 4 + x
+struct Block {
+  uint8_t texels[16][4];
+};
+
+void ReadBlock(const uint8_t* rgba, int width, int height, int blockX, int blockY, Block& block) {
+  for (int y = 0; y < 4; y++) {
+    int sourceY = std::min(blockY * 4 + y, height - 1);
+    for (int x = 0; x < 4; x++) {
+      int sourceX = std::min(blockX * 4 + x, width - 1);
+      memcpy(block.texels[y * 4 + x], rgba + ((size_t)sourceY * width + sourceX) * 4, 4);
+    }
+  }
+}
+
+int Clamp255(int value) {
+  return std::min(std::max(value, 0), 255);
+}
+
+int Distance(const uint8_t* texel, const int* color, int channelCount) {
+  int distance = 0;
+  for (int c = 0; c < channelCount; c++) {
+    int d = texel[c] - color[c];
+    distance += d * d;
+  }
+  return distance;
+}
+
+void WriteBigEndian(uint64_t bits, uint8_t* out) {
+  for (int i = 0; i < 8; i++)
+    out[i] = (uint8_t)(bits >> (56 - 8 * i));
+}
+
+// endpoints at the ends of the texels projected on their principal axis,
+// over the first channelCount channels
+void FitPrincipalAxis(const Block& block, int channelCount, float e0[4], float e1[4]) {
+  float mean[4] = {};
+  for (auto& texel : block.texels) {
+    for (int c = 0; c < channelCount; c++)
+      mean[c] += texel[c] / 16.0f;
+  }
+  float covariance[4][4] = {};
+  for (auto& texel : block.texels) {
+    for (int i = 0; i < channelCount; i++) {
+      for (int j = 0; j < channelCount; j++)
+        covariance[i][j] += (texel[i] - mean[i]) * (texel[j] - mean[j]);
+    }
+  }
+
+  // power iteration, starting from the row of the widest channel
+  int widest = 0;
+  for (int c = 1; c < channelCount; c++) {
+    if (covariance[c][c] > covariance[widest][widest])
+      widest = c;
+  }
+  float axis[4] = {};
+  for (int c = 0; c < channelCount; c++)
+    axis[c] = covariance[widest][c];
+  for (int iteration = 0; iteration < 8; iteration++) {
+    float next[4] = {};
+    float length = 0.0f;
+    for (int i = 0; i < channelCount; i++) {
+      for (int j = 0; j < channelCount; j++)
+        next[i] += covariance[i][j] * axis[j];
+      length += next[i] * next[i];
+    }
+    length = sqrtf(length);
+    if (length < 1e-6f) {
+      // a single color
+      for (int c = 0; c < 4; c++)
+        e0[c] = e1[c] = c < channelCount ? mean[c] : 0.0f;
+      return;
+    }
+    for (int c = 0; c < channelCount; c++)
+      axis[c] = next[c] / length;
+  }
+
+  float low = FLT_MAX, high = -FLT_MAX;
+  for (auto& texel : block.texels) {
+    float projection = 0.0f;
+    for (int c = 0; c < channelCount; c++)
+      projection += (texel[c] - mean[c]) * axis[c];
+    low = std::min(low, projection);
+    high = std::max(high, projection);
+  }
+  for (int c = 0; c < 4; c++) {
+    e0[c] = c < channelCount ? std::min(std::max(mean[c] + axis[c] * high, 0.0f), 255.0f) : 0.0f;
+    e1[c] = c < channelCount ? std::min(std::max(mean[c] + axis[c] * low, 0.0f), 255.0f) : 0.0f;
+  }
+}
+
+// least squares endpoints for fixed weights (0 at e0, 1 at e1). false when
+// the weights leave them undetermined
+bool Refit(const Block& block, int channelCount, const float weights[16], float e0[4], float e1[4]) {
+  float aa = 0.0f, ab = 0.0f, bb = 0.0f;
+  float ax[4] = {}, bx[4] = {};
+  for (int i = 0; i < 16; i++) {
+    float b = weights[i], a = 1.0f - b;
+    aa += a * a;
+    ab += a * b;
+    bb += b * b;
+    for (int c = 0; c < channelCount; c++) {
+      ax[c] += a * block.texels[i][c];
+      bx[c] += b * block.texels[i][c];
+    }
+  }
+  float determinant = aa * bb - ab * ab;
+  if (fabsf(determinant) < 1e-6f)
+    return false;
+  for (int c = 0; c < channelCount; c++) {
+    e0[c] = std::min(std::max((bb * ax[c] - ab * bx[c]) / determinant, 0.0f), 255.0f);
+    e1[c] = std::min(std::max((aa * bx[c] - ab * ax[c]) / determinant, 0.0f), 255.0f);
+  }
+  return true;
+}
+
+//bc1
+uint16_t To565(const float color[4]) {
+  int r = (int)lroundf(color[0] * 31.0f / 255.0f);
+  int g = (int)lroundf(color[1] * 63.0f / 255.0f);
+  int b = (int)lroundf(color[2] * 31.0f / 255.0f);
+  return (uint16_t)((r << 11) | (g << 5) | b);
+}
+
+void From565(uint16_t value, int color[3]) {
+  int r = value >> 11, g = (value >> 5) & 63, b = value & 31;
+  color[0] = (r << 3) | (r >> 2);
+  color[1] = (g << 2) | (g >> 4);
+  color[2] = (b << 3) | (b >> 2);
+}
+
+// nearest of c0, c1 and the two colors between them, c0 > c1. returns the
+// squared error
+int Bc1Indices(const Block& block, uint16_t c0, uint16_t c1, uint32_t& bits, float weights[16]) {
+  static const float Weights[4] = { 0.0f, 1.0f, 1.0f / 3.0f, 2.0f / 3.0f };
+  int palette[4][3];
+  From565(c0, palette[0]);
+  From565(c1, palette[1]);
+  for (int c = 0; c < 3; c++) {
+    palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+    palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+  }
+  // equal endpoints decode in the 3 color mode, where index 3 is black
+  int paletteSize = c0 == c1 ? 1 : 4;
+  bits = 0;
+  int error = 0;
+  for (int i = 0; i < 16; i++) {
+    int best = 0, bestDistance = INT_MAX;
+    for (int index = 0; index < paletteSize; index++) {
+      int distance = Distance(block.texels[i], palette[index], 3);
+      if (distance < bestDistance) {
+        best = index;
+        bestDistance = distance;
+      }
+    }
+    bits |= (uint32_t)best << (2 * i);
+    weights[i] = Weights[best];
+    error += bestDistance;
+  }
+  return error;
+}
+
+void EncodeBc1(const Block& block, uint8_t* out) {
+  float e0[4], e1[4];
+  FitPrincipalAxis(block, 3, e0, e1);
+  uint16_t c0 = To565(e0), c1 = To565(e1);
+  if (c0 < c1)
+    std::swap(c0, c1);
+  uint32_t bits;
+  float weights[16];
+  int error = Bc1Indices(block, c0, c1, bits, weights);
+  if (error > 0 && c0 != c1 && Refit(block, 3, weights, e0, e1)) {
+    uint16_t r0 = To565(e0), r1 = To565(e1);
+    if (r0 < r1)
+      std::swap(r0, r1);
+    uint32_t refitBits;
+    if (Bc1Indices(block, r0, r1, refitBits, weights) < error) {
+      c0 = r0;
+      c1 = r1;
+      bits = refitBits;
+    }
+  }
+  out[0] = (uint8_t)c0;
+  out[1] = (uint8_t)(c0 >> 8);
+  out[2] = (uint8_t)c1;
+  out[3] = (uint8_t)(c1 >> 8);
+  for (int i = 0; i < 4; i++)
+    out[4 + i] = (uint8_t)(bits >> (8 * i));
+}
+
+//bc4, one channel of bc3 and bc5
+void EncodeBc4(const Block& block, int channel, uint8_t* out) {
+  int low = 255, high = 0;
+  for (auto& texel : block.texels) {
+    low = std::min(low, (int)texel[channel]);
+    high = std::max(high, (int)texel[channel]);
+  }
+  // high > low selects the 8 value mode, equal endpoints only use index 0
+  int palette[8] = { high, low };
+  for (int k = 1; k < 7; k++)
+    palette[k + 1] = ((7 - k) * high + k * low + 3) / 7;
+  int paletteSize = high == low ? 1 : 8;
+  uint64_t bits = 0;
+  for (int i = 0; i < 16; i++) {
+    int value = block.texels[i][channel];
+    int best = 0;
+    for (int index = 1; index < paletteSize; index++) {
+      if (abs(palette[index] - value) < abs(palette[best] - value))
+        best = index;
+    }
+    bits |= (uint64_t)best << (3 * i);
+  }
+  out[0] = (uint8_t)high;
+  out[1] = (uint8_t)low;
+  for (int i = 0; i < 6; i++)
+    out[2 + i] = (uint8_t)(bits >> (8 * i));
+}
+
+//bc7 mode 6
+const int Bc7Weights[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+struct Bc7Candidate {
+  int endpoints[2][4];   // 7 bits, the p bit goes below
+  int pBits[2];
+  uint8_t indices[16];
+  int error { INT_MAX };
+};
+
+void Bc7Evaluate(const Block& block, const float e0[4], const float e1[4], int p0, int p1, Bc7Candidate& candidate) {
+  candidate.pBits[0] = p0;
+  candidate.pBits[1] = p1;
+  int value0[4], value1[4];
+  for (int c = 0; c < 4; c++) {
+    candidate.endpoints[0][c] = std::min(std::max((int)lroundf((e0[c] - p0) / 2.0f), 0), 127);
+    candidate.endpoints[1][c] = std::min(std::max((int)lroundf((e1[c] - p1) / 2.0f), 0), 127);
+    value0[c] = (candidate.endpoints[0][c] << 1) | p0;
+    value1[c] = (candidate.endpoints[1][c] << 1) | p1;
+  }
+  int palette[16][4];
+  for (int index = 0; index < 16; index++) {
+    for (int c = 0; c < 4; c++)
+      palette[index][c] = ((64 - Bc7Weights[index]) * value0[c] + Bc7Weights[index] * value1[c] + 32) >> 6;
+  }
+  candidate.error = 0;
+  for (int i = 0; i < 16; i++) {
+    int best = 0, bestDistance = INT_MAX;
+    for (int index = 0; index < 16; index++) {
+      int distance = Distance(block.texels[i], palette[index], 4);
+      if (distance < bestDistance) {
+        best = index;
+        bestDistance = distance;
+      }
+    }
+    candidate.indices[i] = (uint8_t)best;
+    candidate.error += bestDistance;
+  }
+}
+
+struct BitWriter {
+  uint8_t* out;
+  int position { 0 };
+  void Write(uint32_t value, int count) {
+    for (int i = 0; i < count; i++, position++) {
+      if (value & (1u << i))
+        out[position / 8] |= (uint8_t)(1u << (position % 8));
+    }
+  }
+};
+
+void EncodeBc7(const Block& block, uint8_t* out) {
+  float e0[4], e1[4];
+  FitPrincipalAxis(block, 4, e0, e1);
+  Bc7Candidate best;
+  for (int pass = 0; pass < 2; pass++) {
+    for (int pBits = 0; pBits < 4; pBits++) {
+      Bc7Candidate candidate;
+      Bc7Evaluate(block, e0, e1, pBits & 1, pBits >> 1, candidate);
+      if (candidate.error < best.error)
+        best = candidate;
+    }
+    float weights[16];
+    for (int i = 0; i < 16; i++)
+      weights[i] = Bc7Weights[best.indices[i]] / 64.0f;
+    if (best.error == 0 || !Refit(block, 4, weights, e0, e1))
+      break;
+  }
+
+  // the msb of texel 0's index is implied zero, the palette is symmetric
+  if (best.indices[0] & 8) {
+    for (int c = 0; c < 4; c++)
+      std::swap(best.endpoints[0][c], best.endpoints[1][c]);
+    std::swap(best.pBits[0], best.pBits[1]);
+    for (auto& index : best.indices)
+      index = (uint8_t)(15 - index);
+  }
+  memset(out, 0, 16);
+  BitWriter writer { out };
+  writer.Write(1 << 6, 7);
+  for (int c = 0; c < 4; c++) {
+    writer.Write(best.endpoints[0][c], 7);
+    writer.Write(best.endpoints[1][c], 7);
+  }
+  writer.Write(best.pBits[0], 1);
+  writer.Write(best.pBits[1], 1);
+  for (int i = 0; i < 16; i++)
+    writer.Write(best.indices[i], i == 0 ? 3 : 4);
+}
+
+//etc1 compatible etc2 rgb
+const int EtcModifiers[8][2] = {
+  { 2, 8 }, { 5, 17 }, { 9, 29 }, { 13, 42 }, { 18, 60 }, { 24, 80 }, { 33, 106 }, { 47, 183 },
+};
+
+// table and per texel modifier for the 8 texels of one half block around
+// base, index 0: +a, 1: +b, 2: -a, 3: -b. returns the squared error
+int FitEtcHalf(const Block& block, const int texels[8], const int base[3], int& table, int modifiers[8]) {
+  int bestError = INT_MAX;
+  for (int t = 0; t < 8; t++) {
+    int palette[4][3];
+    for (int index = 0; index < 4; index++) {
+      int delta = EtcModifiers[t][index & 1] * (index & 2 ? -1 : 1);
+      for (int c = 0; c < 3; c++)
+        palette[index][c] = Clamp255(base[c] + delta);
+    }
+    int error = 0, chosen[8];
+    for (int k = 0; k < 8; k++) {
+      int bestDistance = INT_MAX;
+      for (int index = 0; index < 4; index++) {
+        int distance = Distance(block.texels[texels[k]], palette[index], 3);
+        if (distance < bestDistance) {
+          chosen[k] = index;
+          bestDistance = distance;
+        }
+      }
+      error += bestDistance;
+    }
+    if (error < bestError) {
+      bestError = error;
+      table = t;
+      memcpy(modifiers, chosen, sizeof(chosen));
+    }
+  }
+  return bestError;
+}
+
+void EncodeEtc(const Block& block, uint8_t* out) {
+  uint64_t bestBits = 0;
+  int bestError = INT_MAX;
+  for (int flip = 0; flip < 2; flip++) {
+    // two 2x4 halves side by side, or two 4x2 halves on top of each other
+    int texels[2][8];
+    float average[2][3] = {};
+    for (int half = 0; half < 2; half++) {
+      for (int k = 0; k < 8; k++) {
+        int x = flip ? k % 4 : half * 2 + k % 2;
+        int y = flip ? half * 2 + k / 4 : k / 2;
+        texels[half][k] = y * 4 + x;
+        for (int c = 0; c < 3; c++)
+          average[half][c] += block.texels[y * 4 + x][c] / 8.0f;
+      }
+    }
+
+    int base5[2][3], base4[2][3];
+    bool canDiffer = true;
+    for (int half = 0; half < 2; half++) {
+      for (int c = 0; c < 3; c++) {
+        base5[half][c] = (int)lroundf(average[half][c] * 31.0f / 255.0f);
+        base4[half][c] = (int)lroundf(average[half][c] * 15.0f / 255.0f);
+      }
+    }
+    for (int c = 0; c < 3; c++) {
+      int delta = base5[1][c] - base5[0][c];
+      canDiffer = canDiffer && delta >= -4 && delta <= 3;
+    }
+
+    // differential: 5 bit bases, the second one as a 3 bit delta. individual: 4 bit bases
+    for (int differential = canDiffer ? 1 : 0; differential >= 0; differential--) {
+      int base[2][3];
+      for (int half = 0; half < 2; half++) {
+        for (int c = 0; c < 3; c++) {
+          base[half][c] = differential ? (base5[half][c] << 3) | (base5[half][c] >> 2) : base4[half][c] * 17;
+        }
+      }
+      int tables[2], modifiers[2][8];
+      int error = FitEtcHalf(block, texels[0], base[0], tables[0], modifiers[0]) +
+        FitEtcHalf(block, texels[1], base[1], tables[1], modifiers[1]);
+      if (error >= bestError)
+        continue;
+
+      uint64_t bits = 0;
+      for (int c = 0; c < 3; c++) {
+        if (differential) {
+          bits |= (uint64_t)base5[0][c] << (59 - 8 * c);
+          bits |= (uint64_t)((base5[1][c] - base5[0][c]) & 7) << (56 - 8 * c);
+        }
+        else {
+          bits |= (uint64_t)base4[0][c] << (60 - 8 * c);
+          bits |= (uint64_t)base4[1][c] << (56 - 8 * c);
+        }
+      }
+      bits |= (uint64_t)tables[0] << 37 | (uint64_t)tables[1] << 34;
+      bits |= (uint64_t)differential << 33 | (uint64_t)flip << 32;
+      for (int half = 0; half < 2; half++) {
+        for (int k = 0; k < 8; k++) {
+          // pixel index bits go column by column
+          int x = texels[half][k] % 4, y = texels[half][k] / 4;
+          int position = x * 4 + y;
+          bits |= (uint64_t)(modifiers[half][k] >> 1) << (16 + position);
+          bits |= (uint64_t)(modifiers[half][k] & 1) << position;
+        }
+      }
+      bestBits = bits;
+      bestError = error;
+    }
+  }
+  WriteBigEndian(bestBits, out);
+}
+
+//eac alpha of etc2 rgba
+const int EacModifiers[16][8] = {
+  { -3, -6, -9, -15, 2, 5, 8, 14 }, { -3, -7, -10, -13, 2, 6, 9, 12 },
+  { -2, -5, -8, -13, 1, 4, 7, 12 }, { -2, -4, -6, -13, 1, 3, 5, 12 },
+  { -3, -6, -8, -12, 2, 5, 7, 11 }, { -3, -7, -9, -11, 2, 6, 8, 10 },
+  { -4, -7, -8, -11, 3, 6, 7, 10 }, { -3, -5, -8, -11, 2, 4, 7, 10 },
+  { -2, -6, -8, -10, 1, 5, 7, 9 }, { -2, -5, -8, -10, 1, 4, 7, 9 },
+  { -2, -4, -8, -10, 1, 3, 7, 9 }, { -2, -5, -7, -10, 1, 4, 6, 9 },
+  { -3, -4, -7, -10, 2, 3, 6, 9 }, { -1, -2, -3, -10, 0, 1, 2, 9 },
+  { -4, -6, -8, -9, 3, 5, 7, 8 }, { -3, -5, -7, -9, 2, 4, 6, 8 },
+};
+
+void EncodeEac(const Block& block, uint8_t* out) {
+  int low = 255, high = 0;
+  for (auto& texel : block.texels) {
+    low = std::min(low, (int)texel[3]);
+    high = std::max(high, (int)texel[3]);
+  }
+  // table 13 has a zero modifier at index 4 for flat blocks
+  int bestBase = low, bestMultiplier = 1, bestTable = 13;
+  int bestIndices[16];
+  std::fill(bestIndices, bestIndices + 16, 4);
+  if (high > low) {
+    int bestError = INT_MAX;
+    for (int table = 0; table < 16; table++) {
+      const int* modifiers = EacModifiers[table];
+      int modifierRange = modifiers[7] - modifiers[3];
+      // the multiplier that spans the block and the base that centers it, and their neighbors
+      int multiplierEstimate = (int)lroundf((high - low) / (float)modifierRange);
+      for (int multiplier = std::max(multiplierEstimate - 1, 1); multiplier <= std::min(multiplierEstimate + 1, 15); multiplier++) {
+        int baseEstimate = (int)lroundf((low + high) / 2.0f - (modifiers[7] + modifiers[3]) * multiplier / 2.0f);
+        for (int base = Clamp255(baseEstimate - 1); base <= Clamp255(baseEstimate + 1); base++) {
+          int palette[8];
+          for (int index = 0; index < 8; index++)
+            palette[index] = Clamp255(base + modifiers[index] * multiplier);
+          int error = 0, indices[16];
+          for (int i = 0; i < 16 && error < bestError; i++) {
+            int value = block.texels[i][3];
+            int best = 0;
+            for (int index = 1; index < 8; index++) {
+              if (abs(palette[index] - value) < abs(palette[best] - value))
+                best = index;
+            }
+            indices[i] = best;
+            error += (palette[best] - value) * (palette[best] - value);
+          }
+          if (error < bestError) {
+            bestError = error;
+            bestBase = base;
+            bestMultiplier = multiplier;
+            bestTable = table;
+            memcpy(bestIndices, indices, sizeof(indices));
+          }
+        }
+      }
+    }
+  }
+  uint64_t bits = (uint64_t)bestBase << 56 | (uint64_t)bestMultiplier << 52 | (uint64_t)bestTable << 48;
+  for (int i = 0; i < 16; i++) {
+    int position = (i % 4) * 4 + i / 4;
+    bits |= (uint64_t)bestIndices[i] << (45 - 3 * position);
+  }
+  WriteBigEndian(bits, out);
+}
+
+}
+
+std::vector<uint8_t> BlockCompressor::Compress(const uint8_t* rgba, int width, int height,
+  CompressedImage::Format format, ThreadPool* threadPool) {
+  int blocksX = (width + 3) / 4, blocksY = (height + 3) / 4;
+  int blockSize = CompressedImage::GetBlockSize(format);
+  std::vector<uint8_t> blocks((size_t)blocksX * blocksY * blockSize);
+  auto compressRow = [&](int blockY) {
+    Block block;
+    for (int blockX = 0; blockX < blocksX; blockX++) {
+      ReadBlock(rgba, width, height, blockX, blockY, block);
+      uint8_t* out = blocks.data() + ((size_t)blockY * blocksX + blockX) * blockSize;
+      switch (format) {
+      case CompressedImage::Format::BC1:
+        EncodeBc1(block, out);
+        break;
+      case CompressedImage::Format::BC3:
+        EncodeBc4(block, 3, out);
+        EncodeBc1(block, out + 8);
+        break;
+      case CompressedImage::Format::BC5:
+        EncodeBc4(block, 0, out);
+        EncodeBc4(block, 1, out + 8);
+        break;
+      case CompressedImage::Format::BC7:
+        EncodeBc7(block, out);
+        break;
+      case CompressedImage::Format::ETC2_RGB:
+        EncodeEtc(block, out);
+        break;
+      case CompressedImage::Format::ETC2_RGBA:
+        EncodeEac(block, out);
+        EncodeEtc(block, out + 8);
+        break;
+      }
+    }
+  };
+  if (threadPool)
+    threadPool->ParallelFor(blocksY, compressRow);
+  else {
+    for (int blockY = 0; blockY < blocksY; blockY++)
+      compressRow(blockY);
+  }
+  return blocks;
+}
@@ -0,0 +1,22 @@
+#ifndef __BLOCK_COMPRESSOR_H__
+#define __BLOCK_COMPRESSOR_H__
+
+#include "common.h"
+#include "image.h"
+#include "thread_pool.h"
+#include <vector>
+
+// encodes rgba8 pixels into the 4x4 blocks of the CompressedImage formats.
+// built for a quick offline cook rather than the last bit of quality: bc1 and
+// bc7 fit their endpoints along the principal axis and refit them once by
+// least squares, bc7 only uses mode 6 (one subset, rgba endpoints), etc2 only
+// the etc1 compatible individual and differential modes plus eac alpha.
+class BlockCompressor {
+public:
+  // rgba is width * height * 4 bytes, the last row and column repeat into
+  // partial blocks. block rows are spread over threadPool when there is one
+  static std::vector<uint8_t> Compress(const uint8_t* rgba, int width, int height,
+    CompressedImage::Format format, ThreadPool* threadPool = nullptr);
+};
+
+#endif // __BLOCK_COMPRESSOR_H__
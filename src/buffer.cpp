@@ -23,6 +23,13 @@ void Buffer::Bind() const
     glBindBuffer(m_bufferType, m_buffer);
 }
 
+void Buffer::SetData(const void *data, size_t count)
+{
+    m_count = count;
+    Bind();
+    glBufferData(m_bufferType, m_count * m_stride, data, m_usage);
+}
+
 bool Buffer::Init(uint32_t bufferType, uint32_t usage, const void *data, size_t stride, size_t count)
 {
     m_bufferType = bufferType;
@@ -13,6 +13,8 @@ public:
     size_t GetStride() const { return m_stride; }
     size_t GetCount() const { return m_count; }
     void Bind() const;
+    // re-specifies the whole store, letting the driver orphan the old one
+    void SetData(const void *data, size_t count);
 
 private:
     Buffer() {}
@@ -1,14 +1,18 @@
 #include "context.h"
 #include "image.h"
+#include "cpu_profiler.h"
 #include <imgui.h>
+#include <imgui_impl_opengl3.h>
+#include <random>
 
 Context::~Context()
 {
 }
 
-ContextUPtr Context::Create()
+ContextUPtr Context::Create(ResourceLoaderPtr resourceLoader)
 {
     auto context = ContextUPtr(new Context());
+    context->m_resourceLoader = resourceLoader ? resourceLoader : ResourceLoaderPtr(ResourceLoader::CreateImmediate());
     if (!context->Init())
     {
         return nullptr;
@@ -17,13 +21,9 @@ ContextUPtr Context::Create()
 }
 void Context::Reshape(int width, int height)
 {
-    m_width = width;
-    m_height = height;
-    glViewport(0, 0, m_width, m_height);
-
-    // Create MSAA framebuffer
-    m_framebufferMSAA = Framebuffer::CreateMSAA(width, height, GL_RGBA);  // using 4x MSAA
-    m_framebuffer = Framebuffer::Create(Texture::Create(width, height, GL_RGBA));
+    // picked up by the next captured frame, RenderFrame applies it
+    m_windowWidth = width;
+    m_windowHeight = height;
 }
 void Context::MouseMove(double x, double y)
 {
@@ -66,10 +66,15 @@ void Context::MouseButton(int button, int action, double x, double y)
 }
 bool Context::Init()
 {
+    CPU_ZONE("context init");
     glEnable(GL_DEPTH_TEST);
     glEnable(GL_MULTISAMPLE);
     glClearColor(m_clearColor.r, m_clearColor.g, m_clearColor.b, m_clearColor.a);
     m_shadowMap=ShadowMap::Create(1024,1024);
+    m_renderTargetPool = RenderTargetPool::Create();
+    m_renderGraph = RenderGraph::Create(m_renderTargetPool);
+    m_gpuProfiler = GpuProfiler::Create();
+    m_renderGraph->SetProfiler(m_gpuProfiler.get());
     m_box=Mesh::CreateBox();
     m_smallBox=Mesh::CreateBox();
 
@@ -87,7 +92,7 @@ bool Context::Init()
         return false;
 
     SPDLOG_INFO("program ID: {}", m_program->Get());
-    m_model = Model::Load("../../model/backpack.obj");
+    m_model = Model::Load("../../model/backpack.obj", m_resourceLoader.get());
     if (!m_model){
          return false;
     }
@@ -97,8 +102,29 @@ bool Context::Init()
     if (!m_textureProgram)
       return false;
 
-    m_postProgram = Program::Create("../../shader/texture.vs", "../../shader/gamma.fs");
-    if (!m_postProgram)
+    // effects run in this order, gamma is applied after the last one
+    m_postProcess = PostProcessStack::Create("../../shader/texture.vs", "../../shader/post/input.glsl");
+    if (!m_postProcess)
+        return false;
+    bool effectsLoaded =
+        m_postProcess->AddEffect("sharpen", "../../shader/post/sharpen.glsl", "Sharpen", [this](const Program* program) {
+            program->SetUniform("sharpenAmount", m_sharpenAmount);
+        }) &&
+        m_postProcess->AddEffect("tonemap", "../../shader/post/tonemap.glsl", "Tonemap", [this](const Program* program) {
+            program->SetUniform("exposure", m_exposure);
+        }) &&
+        m_postProcess->AddEffect("color grading", "../../shader/post/color_grading.glsl", "ColorGrading",
+            [this](const Program* program) {
+                program->SetUniform("contrast", m_contrast);
+                program->SetUniform("saturation", m_saturation);
+                program->SetUniform("colorFilter", m_colorFilter);
+            }) &&
+        m_postProcess->AddEffect("vignette", "../../shader/post/vignette.glsl", "Vignette", [this](const Program* program) {
+            program->SetUniform("vignetteIntensity", m_vignetteIntensity);
+            program->SetUniform("vignetteSmoothness", m_vignetteSmoothness);
+        }) &&
+        m_postProcess->AddEffect("invert", "../../shader/post/invert.glsl", "Invert");
+    if (!effectsLoaded)
         return false;
     
     m_grassProgram=Program::Create("../../shader/grass.vs", "../../shader/grass.fs");
@@ -109,41 +135,96 @@ bool Context::Init()
     if(!m_lightingShadowProgram){
         return false;
     }
+    m_depthProgram = Program::Create("../../shader/depth.vs", "../../shader/depth.fs");
+    if (!m_depthProgram)
+        return false;
+    if (GLAD_GL_ARB_pipeline_statistics_query) {
+        m_litPassQueries.resize(3);
+        for (auto& slot : m_litPassQueries)
+            slot.query = Query::Create(GL_FRAGMENT_SHADER_INVOCATIONS_ARB);
+    }
+    m_sceneTimerQueries.resize(3);
+    for (auto& slot : m_sceneTimerQueries)
+        slot.query = Query::Create(GL_TIME_ELAPSED);
+    m_gbufferProgram = Program::Create("../../shader/gbuffer.vs", "../../shader/gbuffer.fs");
+    if (!m_gbufferProgram)
+        return false;
+    m_deferredLightProgram = Program::Create("../../shader/texture.vs", "../../shader/deferred_lighting.fs");
+    if (!m_deferredLightProgram)
+        return false;
+    m_fxaaProgram = Program::Create("../../shader/texture.vs", "../../shader/fxaa.fs");
+    if (!m_fxaaProgram)
+        return false;
+    m_taaProgram = Program::Create("../../shader/texture.vs", "../../shader/taa.fs");
+    if (!m_taaProgram)
+        return false;
+
+    // the scene targets are multisample textures, so their limits apply as well
+    GLint maxSamples = 1, maxColorSamples = 1, maxDepthSamples = 1;
+    glGetIntegerv(GL_MAX_SAMPLES, &maxSamples);
+    glGetIntegerv(GL_MAX_COLOR_TEXTURE_SAMPLES, &maxColorSamples);
+    glGetIntegerv(GL_MAX_DEPTH_TEXTURE_SAMPLES, &maxDepthSamples);
+    m_maxSamples = std::max(std::min(maxSamples, std::min(maxColorSamples, maxDepthSamples)), 1);
+    while (m_msaaSamples > m_maxSamples)
+        m_msaaSamples /= 2;
+    SPDLOG_INFO("max msaa samples: {}", m_maxSamples);
     
-    //load texture
-    auto cubeRight = Image::Load("../../image/skybox/right.jpg", false);
-    auto cubeLeft = Image::Load("../../image/skybox/left.jpg", false);
-    auto cubeTop = Image::Load("../../image/skybox/top.jpg", false);
-    auto cubeBottom = Image::Load("../../image/skybox/bottom.jpg", false);
-    auto cubeFront = Image::Load("../../image/skybox/front.jpg", false);
-    auto cubeBack = Image::Load("../../image/skybox/back.jpg", false);
-    m_cubeTexture = CubeTexture::CreateFromImages({
-        cubeRight.get(),
-        cubeLeft.get(),
-        cubeTop.get(),
-        cubeBottom.get(),
-        cubeFront.get(),
-        cubeBack.get(),
-    });
+    //load texture, decoded and uploaded by the resource loader. the placeholder
+    //shows until a texture is handed over, the skybox is skipped
+    m_resourceLoader->Load<CubeTexture>("skybox", []() -> CubeTexturePtr {
+        const char* faces[] = { "right", "left", "top", "bottom", "front", "back" };
+        std::vector<ImageUPtr> images;
+        for (auto face : faces) {
+            images.push_back(Image::Load(fmt::format("../../image/skybox/{}.jpg", face), false));
+            if (!images.back())
+                return nullptr;
+        }
+        return CubeTexture::CreateFromImages({
+            images[0].get(), images[1].get(), images[2].get(),
+            images[3].get(), images[4].get(), images[5].get(),
+        });
+    }, [this](CubeTexturePtr cubeTexture) { m_cubeTexture = cubeTexture; });
     m_skyboxProgram = Program::Create("../../shader/skybox.vs", "../../shader/skybox.fs");
-    m_windowTexture = Texture::CreateFromImage(Image::Load("../../image/blending_transparent_window.png").get());
-    m_grassTexture=Texture::CreateFromImage(Image::Load("../../image/grass.png").get());
+    TexturePtr grayTexture = m_resourceLoader->GetPlaceholderTexture();
+    m_windowTexture = grayTexture;
+    m_resourceLoader->LoadTexture("../../image/blending_transparent_window.png",
+        [this](TexturePtr texture) { m_windowTexture = texture; });
+    m_grassTexture = grayTexture;
+    m_resourceLoader->LoadTexture("../../image/grass.png", [this](TexturePtr texture) { m_grassTexture = texture; });
 
-    TexturePtr grayTexture = Texture::CreateFromImage(Image::CreateSingleColorImage(4, 4, glm::vec4(0.5f, 0.5f, 0.5f, 1.0f)).get());
     m_material = Material::Create();
     m_material->diffuse = Texture::CreateFromImage( Image::CreateSingleColorImage(4, 4, glm::vec4(1.0f, 1.0f, 1.0f, 1.0f)).get()); //gen & bind
     m_material->specular = grayTexture;
 
 
     m_planeMaterial = Material::Create();
-    m_planeMaterial->diffuse = Texture::CreateFromImage(Image::Load("../../image/marble.jpg").get());
+    m_planeMaterial->diffuse = grayTexture;
     m_planeMaterial->specular = grayTexture;
     m_planeMaterial->shininess = 128.0f;
+    auto planeMaterial = m_planeMaterial;
+    m_resourceLoader->LoadTexture("../../image/marble.jpg",
+        [planeMaterial](TexturePtr texture) { planeMaterial->diffuse = texture; });
 
     m_smallBoxMaterial = Material::Create();
-    m_smallBoxMaterial->diffuse = Texture::CreateFromImage(Image::Load("../../image/container2.png").get());
-    m_smallBoxMaterial->specular = Texture::CreateFromImage(Image::Load("../../image/container2_specular.png").get());
+    m_smallBoxMaterial->diffuse = grayTexture;
+    m_smallBoxMaterial->specular = grayTexture;
     m_smallBoxMaterial->shininess = 60.0f;
+    auto smallBoxMaterial = m_smallBoxMaterial;
+    m_resourceLoader->LoadTexture("../../image/container2.png",
+        [smallBoxMaterial](TexturePtr texture) { smallBoxMaterial->diffuse = texture; });
+    m_resourceLoader->LoadTexture("../../image/container2_specular.png",
+        [smallBoxMaterial](TexturePtr texture) { smallBoxMaterial->specular = texture; });
+
+    m_threadPool = ThreadPool::Create();
+    m_lightCluster = LightCluster::Create(m_threadPool);
+    if (!m_lightCluster)
+        return false;
+    GenerateClusterLights(1024);
+
+    m_occlusionCuller = OcclusionCuller::Create(m_threadPool);
+    if (!m_occlusionCuller)
+        return false;
+    BuildScene();
 
     m_grassPos.resize(10000);
     for (size_t i = 0; i < m_grassPos.size(); i++) {
@@ -158,16 +239,34 @@ bool Context::Init()
     m_grassInstance->SetAttrib(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), offsetof(Vertex, normal));
     m_grassInstance->SetAttrib(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), offsetof(Vertex, texCoord));
     
-    m_grassPosBuffer = Buffer::CreateWithData(GL_ARRAY_BUFFER, GL_STATIC_DRAW, m_grassPos.data(), sizeof(glm::vec3), m_grassPos.size());
-    m_grassPosBuffer->Bind();
-    m_grassInstance->SetAttrib(3, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), 0);
-    glVertexAttribDivisor(3, 1);
     m_plane->GetIndexBuffer()->Bind();
+    glBindVertexArray(0);
+
+    // the buffer uploads on the loader context, vertex arrays are not shared so
+    // the instance attribute is set up on the render context
+    m_resourceLoader->Load<Buffer>("grass positions", [grassPos = m_grassPos]() -> BufferPtr {
+        return Buffer::CreateWithData(GL_ARRAY_BUFFER, GL_STATIC_DRAW, grassPos.data(), sizeof(glm::vec3), grassPos.size());
+    }, [this](BufferPtr buffer) {
+        m_grassPosBuffer = buffer;
+        m_grassInstance->Bind();
+        m_grassPosBuffer->Bind();
+        m_grassInstance->SetAttrib(3, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), 0);
+        glVertexAttribDivisor(3, 1);
+        glBindVertexArray(0);
+    });
 
     return true;
 }
 void Context::Render()
 {
+    DrawUI();
+    RenderFrame(CaptureFrame());
+}
+
+void Context::DrawUI()
+{
+    CPU_ZONE("context ui");
+    std::lock_guard<std::mutex> lock(m_mutex);
     if (ImGui::Begin("ui window")) {
         if (ImGui::CollapsingHeader("light", ImGuiTreeNodeFlags_DefaultOpen)) {
             ImGui::DragFloat3("l.position", glm::value_ptr(m_light.position), 0.01f);
@@ -185,15 +284,150 @@ void Context::Render()
             ImGui::DragFloat("m.shininess", &m_material->shininess, 1.0f, 1.0f, 256.0f);
         }
 
-        ImGui::Checkbox("animation", &m_animation);
+        const char* renderPaths[] = { "forward", "deferred" };
+        int renderPath = (int)m_renderPath;
+        if (ImGui::Combo("render path", &renderPath, renderPaths, IM_ARRAYSIZE(renderPaths))) {
+            m_renderPath = (RenderPath)renderPath;
+            m_taaHistoryValid = false;
+        }
+
+        if (ImGui::CollapsingHeader("anti-aliasing")) {
+            const char* sampleNames[] = { "off", "2x", "4x", "8x" };
+            if (ImGui::BeginCombo("a.msaa", sampleNames[(int)log2f((float)m_msaaSamples)])) {
+                for (int samples = 1, i = 0; samples <= 8 && samples <= m_maxSamples; samples *= 2, i++) {
+                    if (ImGui::Selectable(sampleNames[i], samples == m_msaaSamples))
+                        m_msaaSamples = samples;
+                }
+                ImGui::EndCombo();
+            }
+            if (m_renderPath == RenderPath::Deferred)
+                ImGui::TextDisabled("msaa only applies to the forward path");
+            const char* postNames[] = { "none", "fxaa", "taa" };
+            int postAntiAliasing = (int)m_postAntiAliasing;
+            if (ImGui::Combo("a.post", &postAntiAliasing, postNames, IM_ARRAYSIZE(postNames))) {
+                m_postAntiAliasing = (PostAntiAliasing)postAntiAliasing;
+                m_taaHistoryValid = false;
+            }
+            if (m_postAntiAliasing == PostAntiAliasing::TAA)
+                ImGui::SliderFloat("a.taa blend", &m_taaBlend, 0.02f, 0.5f);
+        }
+
+        if (ImGui::CollapsingHeader("post process")) {
+            for (int i = 0; i < m_postProcess->GetEffectCount(); i++)
+                ImGui::Checkbox(("p." + m_postProcess->GetEffectName(i)).c_str(), &m_postProcess->EffectEnabled(i));
+            ImGui::DragFloat("p.sharpen amount", &m_sharpenAmount, 0.01f, 0.0f, 2.0f);
+            ImGui::DragFloat("p.exposure", &m_exposure, 0.01f, 0.0f, 10.0f);
+            ImGui::DragFloat("p.contrast", &m_contrast, 0.01f, 0.0f, 2.0f);
+            ImGui::DragFloat("p.saturation", &m_saturation, 0.01f, 0.0f, 2.0f);
+            ImGui::ColorEdit3("p.color filter", glm::value_ptr(m_colorFilter));
+            ImGui::SliderFloat("p.vignette intensity", &m_vignetteIntensity, 0.0f, 1.0f);
+            ImGui::SliderFloat("p.vignette smoothness", &m_vignetteSmoothness, 0.01f, 1.0f);
+            ImGui::Text("%d shader variants compiled", m_postProcess->GetVariantCount());
+        }
+
+        if (ImGui::CollapsingHeader("dynamic resolution")) {
+            ImGui::Checkbox("r.enable", &m_dynamicResolution);
+            ImGui::DragFloat("r.target gpu ms", &m_targetGpuTime, 0.1f, 1.0f, 100.0f);
+            ImGui::SliderFloat("r.min scale", &m_minRenderScale, 0.25f, 1.0f);
+            // manual override while the controller is off
+            if (!m_dynamicResolution)
+                ImGui::SliderFloat("r.scale", &m_renderScale, m_minRenderScale, 1.0f);
+            ImGui::Checkbox("r.bicubic upscale", &m_bicubicUpscale);
+            ImGui::Text("scene %dx%d (%.0f%%), gpu %.3f ms", m_renderWidth, m_renderHeight,
+                m_renderScale * 100.0f, m_gpuSceneTime);
+        }
+
+        if (ImGui::CollapsingHeader("render targets")) {
+            ImGui::Text("targets %dx%d, window %dx%d", m_targetWidth, m_targetHeight, m_width, m_height);
+            ImGui::Text("pool: %d textures, %.1f MB (high-water %.1f MB)", m_renderTargetPool->GetTextureCount(),
+                m_renderTargetPool->GetAllocatedBytes() / (1024.0f * 1024.0f),
+                m_renderTargetPool->GetHighWaterBytes() / (1024.0f * 1024.0f));
+            ImGui::Text("allocations %d, reuses %d", m_renderTargetPool->GetAllocationCount(),
+                m_renderTargetPool->GetReuseCount());
+        }
+
+        if (ImGui::CollapsingHeader("gpu profiler")) {
+            m_gpuProfiler->DrawUI();
+        }
+
+        if (ImGui::CollapsingHeader("cpu profiler")) {
+            CpuProfiler::DrawUI();
+        }
+
+        if (m_frameLoop && ImGui::CollapsingHeader("frame loop")) {
+            m_frameLoop->DrawUI();
+            ImGui::DragFloat("f.camera speed", &m_cameraSpeed, 0.1f, 0.1f, 50.0f);
+            if (m_frameLatencyLimiter) {
+                ImGui::Separator();
+                m_frameLatencyLimiter->DrawUI();
+            }
+        }
+
+        if (ImGui::CollapsingHeader("resource loader")) {
+            m_resourceLoader->DrawUI();
+        }
+
+        if (ImGui::CollapsingHeader("render graph")) {
+            m_renderGraph->DrawDebugUI();
+        }
+
+        if (ImGui::CollapsingHeader("depth pre-pass")) {
+            ImGui::Checkbox("z.enable", &m_depthPrepass);
+            ImGui::Checkbox("z.alternate every frame", &m_depthPrepassAlternate);
+            if (m_litPassQueries.empty()) {
+                ImGui::Text("pipeline statistics unavailable");
+            }
+            else {
+                auto without = m_litPassInvocations[0];
+                auto with = m_litPassInvocations[1];
+                ImGui::Text("lit pass fs invocations: %llu without, %llu with pre-pass",
+                    (unsigned long long)without, (unsigned long long)with);
+                if (without > 0 && with > 0) {
+                    ImGui::Text("saved: %lld (%.1f%%)", (long long)without - (long long)with,
+                        100.0f * (1.0f - (float)with / (float)without));
+                }
+            }
+        }
+
+        if (ImGui::CollapsingHeader("clustered lights")) {
+            ImGui::Checkbox("c.enable", &m_clusterEnabled);
+            ImGui::SliderInt("c.light count", &m_clusterLightCount, 0, (int)m_clusterLightOrbits.size());
+            if (ImGui::Checkbox("c.ramp benchmark", &m_clusterRamp) && m_clusterRamp) {
+                m_clusterEnabled = true;
+                m_clusterLightCount = 0;
+                m_clusterRampFrameTimes.clear();
+            }
+            ImGui::Text("assign %.3f ms, %d clusters, %d indices", m_lightCluster->GetAssignTime(),
+                m_lightCluster->GetClusterCount(), (int)m_lightCluster->GetIndexCount());
+            if (!m_clusterRampFrameTimes.empty()) {
+                ImGui::PlotLines("frame ms", m_clusterRampFrameTimes.data(), (int)m_clusterRampFrameTimes.size(),
+                    0, "0 .. max lights", 0.0f, FLT_MAX, ImVec2(0, 80));
+            }
+        }
 
-        if (ImGui::ColorEdit4("clear color", glm::value_ptr(m_clearColor))) {
-            glClearColor(m_clearColor.r, m_clearColor.g, m_clearColor.b, m_clearColor.a);
+        if (ImGui::CollapsingHeader("occlusion culling")) {
+            ImGui::Checkbox("o.software occlusion", &m_softwareOcclusion);
+            if (ImGui::Checkbox("o.test scene", &m_occlusionTestScene))
+                m_sceneDirty = true;
+            ImGui::Text("occluders: %d triangles, raster %.3f ms", m_occlusionCuller->GetTriangleCount(),
+                m_occlusionCuller->GetRasterizeTime());
+            ImGui::Text("tested %d, occluded %d, outside %d", m_occlusionCuller->GetTestedCount(),
+                m_occlusionCuller->GetOccludedCount(), m_occlusionCuller->GetOutsideCount());
+            ImGui::Separator();
+            ImGui::Checkbox("o.hardware queries", &m_hardwareOcclusion);
+            ImGui::SliderInt("o.requery interval", &m_occlusionQueryInterval, 1, 30);
+            ImGui::Text("queries issued %d, visible %d, culled %d", m_occlusionQueryCount,
+                m_occlusionQueryVisibleCount, m_occlusionQueryCulledCount);
         }
+
+        ImGui::Checkbox("animation", &m_animation);
+
+        ImGui::ColorEdit4("clear color", glm::value_ptr(m_clearColor));
         ImGui::DragFloat("gamma", &m_gamma, 0.01f, 0.0f, 2.0f);
 
         ImGui::Separator();
-        ImGui::DragFloat3("camera pos", glm::value_ptr(m_cameraPos), 0.01f);
+        if (ImGui::DragFloat3("camera pos", glm::value_ptr(m_cameraPos), 0.01f))
+            m_prevCameraPos = m_cameraPos;
         ImGui::DragFloat("camera yaw", &m_cameraYaw, 0.5f);
         ImGui::DragFloat("camera pitch", &m_cameraPitch, 0.5f, -89.0f, 89.0f);
         ImGui::Separator();
@@ -201,83 +435,498 @@ void Context::Render()
             m_cameraYaw = 0.0f;
             m_cameraPitch = 0.0f;
             m_cameraPos = glm::vec3(0.0f, 0.0f, 3.0f);
+            m_prevCameraPos = m_cameraPos;
         }
         ImGui::Image((ImTextureID)m_shadowMap->GetShadowMap()->Get(),ImVec2(256, 256), ImVec2(0, 1), ImVec2(1, 0));
     }
     ImGui::End();
+    // the renderer ends the ramp, IsAnimating() reads it without the lock
+    m_clusterRampActive = m_clusterRamp;
+}
+
+glm::vec3 Context::GetCameraFront() const
+{
+    return glm::rotate(glm::mat4(1.0f), glm::radians(m_cameraYaw), glm::vec3(0.0f, 1.0f, 0.0f)) *
+        glm::rotate(glm::mat4(1.0f), glm::radians(m_cameraPitch), glm::vec3(1.0f, 0.0f, 0.0f)) *
+        glm::vec4(0.0f, 0.0f, -1.0f, 0.0f);
+}
+
+Context::Frame Context::CaptureFrame()
+{
+    Frame frame;
+    frame.index = m_frameCount++;
+    frame.time = ImGui::GetTime();
+    frame.deltaTime = ImGui::GetIO().DeltaTime;
+    frame.width = m_windowWidth;
+    frame.height = m_windowHeight;
+    // between the last two simulation ticks, so motion is smooth at any frame rate
+    float alpha = m_frameLoop ? m_frameLoop->GetTime().alpha : 1.0f;
+    frame.cameraPos = glm::mix(m_prevCameraPos, m_cameraPos, alpha);
+    frame.cameraFront = GetCameraFront();
+    frame.light = m_light;
+    frame.clearColor = m_clearColor;
+    frame.clusterTime = glm::mix(m_prevClusterTime, m_clusterTime, alpha);
+    frame.inputTime = m_inputTime;
+    frame.eventTime = m_pendingEventTime;
+    m_pendingEventTime = 0.0;
+    return frame;
+}
+
+void Context::RenderFrame(const Frame& frame, ImDrawData* drawData)
+{
+    CPU_ZONE("context render");
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (frame.width != m_width || frame.height != m_height) {
+        m_width = frame.width;
+        m_height = frame.height;
+        glViewport(0, 0, m_width, m_height);
+        // targets are reallocated in UpdateRenderTargets() once the size settles
+        m_resizeTime = frame.time;
+    }
+    // the scene's queries are gl objects, they are made and deleted here
+    bool sceneRebuilt = m_sceneDirty.exchange(false);
+    if (sceneRebuilt)
+        BuildScene();
+    // without a kept copy of this size the scene is rendered again, minus the ui
+    if (frame.represent && !sceneRebuilt && RepresentFrame())
+        return;
+    m_frame = frame;
+    m_gpuProfiler->NewFrame();
+    {
+        GpuProfiler::Scope scope(m_gpuProfiler.get(), "resource uploads");
+        m_resourceLoader->Update();
+    }
+    UpdateRenderTargets();
 
     //shadow mapping
-    auto lightView = glm::lookAt(m_light.position, m_light.position + m_light.direction,glm::vec3(0.0f, 1.0f, 0.0f));
-    auto lightProjection = m_light.directional ?
+    const auto& light = m_frame.light;
+    auto lightView = glm::lookAt(light.position, light.position + light.direction,glm::vec3(0.0f, 1.0f, 0.0f));
+    auto lightProjection = light.directional ?
         glm::ortho(-10.0f,10.0f,-10.0f,10.0f , 1.0f, 30.0f):
-        glm::perspective(glm::radians((m_light.cutoff[0] + m_light.cutoff[1]) * 2.0f), 1.0f, 1.0f, 20.0f);
-    m_shadowMap->Bind();
-    glClear(GL_DEPTH_BUFFER_BIT);
-    glViewport(0, 0,m_shadowMap->GetShadowMap()->GetWidth(),m_shadowMap->GetShadowMap()->GetHeight());
-    m_simpleProgram->Use();
-    m_simpleProgram->SetUniform("color", glm::vec4(1.0f, 1.0f, 1.0f, 1.0f));
-    DrawScene(lightView, lightProjection, m_simpleProgram.get());
+        glm::perspective(glm::radians((light.cutoff[0] + light.cutoff[1]) * 2.0f), 1.0f, 1.0f, 20.0f);
+    auto lightTransform = lightProjection * lightView;
+
+    m_renderScale = glm::clamp(m_renderScale, m_minRenderScale, 1.0f);
+    m_renderWidth = std::min(std::max((int)(m_width * m_renderScale), 1), m_targetWidth);
+    m_renderHeight = std::min(std::max((int)(m_height * m_renderScale), 1), m_targetHeight);
 
+    auto view = glm::lookAt(m_frame.cameraPos, m_frame.cameraPos + m_frame.cameraFront, m_cameraUp);
+    auto projection = glm::perspective(glm::radians(45.0f), (float)(m_width / m_height), 0.01f, 100.0f);
+
+    CullScene(projection * view);
+
+    // taa: sub-pixel halton(2, 3) offsets so consecutive frames sample different positions
+    auto sceneProjection = projection;
+    if (m_postAntiAliasing == PostAntiAliasing::TAA) {
+        auto halton = [](int index, int base) {
+            float result = 0.0f, fraction = 1.0f / base;
+            for (; index > 0; index /= base, fraction /= base)
+                result += fraction * (index % base);
+            return result;
+        };
+        int sample = (int)(m_frameIndex % 8) + 1;
+        sceneProjection[2][0] += (halton(sample, 2) - 0.5f) * 2.0f / m_renderWidth;
+        sceneProjection[2][1] += (halton(sample, 3) - 0.5f) * 2.0f / m_renderHeight;
+    }
+
+    // clustered lights: ramp mode adds lights every frame and records the frame time at each step
+    if (m_clusterRamp) {
+        m_clusterRampFrameTimes.push_back(m_frame.deltaTime * 1000.0f);
+        m_clusterLightCount += 4;
+        if (m_clusterLightCount >= (int)m_clusterLightOrbits.size()) {
+            m_clusterLightCount = (int)m_clusterLightOrbits.size();
+            m_clusterRamp = false;
+        }
+    }
+    if (m_clusterEnabled) {
+        UpdateClusterLights(m_frame.clusterTime);
+        m_lightCluster->Update(m_clusterLights, view, projection, 0.01f, 100.0f);
+    }
+
+    // describe the frame, the graph works out order, targets and resolves
+    m_renderGraph->Reset();
+    m_renderGraph->SetViewport(m_renderWidth, m_renderHeight);
+    m_renderGraph->SetClearColor(m_frame.clearColor);
+    int shadowMap = m_renderGraph->ImportTexture("shadow map", m_shadowMap->GetShadowMap());
+    m_renderGraph->MarkOutput(shadowMap);   // shown in the ui
+    int backbuffer = -1;
+    if (m_outputTexture) {
+        backbuffer = m_renderGraph->ImportTexture("output", m_outputTexture);
+        m_renderGraph->MarkOutput(backbuffer);
+    }
+    else {
+        backbuffer = m_renderGraph->ImportBackbuffer("backbuffer", m_width, m_height);
+    }
+
+    m_renderGraph->AddPass("shadow", [=](const RenderGraph::PassContext&) {
+        m_simpleProgram->Use();
+        m_simpleProgram->SetUniform("color", glm::vec4(1.0f, 1.0f, 1.0f, 1.0f));
+        DrawScene(lightView, lightProjection, m_simpleProgram.get(), true);
+    }).Write(shadowMap);
+
+    int sceneDepth = -1;
+    int sceneColor = m_renderPath == RenderPath::Deferred ?
+        AddDeferredPasses(view, sceneProjection, lightTransform, shadowMap, sceneDepth) :
+        AddForwardPasses(view, sceneProjection, lightTransform, shadowMap, sceneDepth);
+    if (m_postAntiAliasing == PostAntiAliasing::FXAA) {
+        sceneColor = AddFxaaPass(sceneColor);
+    }
+    else if (m_postAntiAliasing == PostAntiAliasing::TAA) {
+        sceneColor = AddTaaPass(sceneColor, sceneDepth, glm::inverse(sceneProjection * view));
+        m_taaPreviousViewProjection = projection * view;
+    }
+
+    // post pass upscales to the window, ui is drawn after this at native resolution.
+    // at full resolution a multisampled scene is resolved inside the post shader
+    // instead of by a separate blit
+    int sceneSamples = m_renderPath == RenderPath::Forward && m_postAntiAliasing == PostAntiAliasing::None ?
+        m_msaaSamples : 1;
+    bool fusedResolve = sceneSamples > 1 && m_renderWidth == m_width && m_renderHeight == m_height;
+    auto post = m_renderGraph->AddPass("post", [=](const RenderGraph::PassContext& context) {
+        auto program = m_postProcess->Use(fusedResolve ? sceneSamples : 1, m_bicubicUpscale && m_renderScale < 1.0f);
+        if (!program)
+            return;
+        program->SetUniform("transform", glm::scale(glm::mat4(1.0f), glm::vec3(2.0f, 2.0f, 1.0f)));
+        program->SetUniform("gamma", m_gamma);
+        program->SetUniform("renderSize", glm::vec2((float)m_renderWidth, (float)m_renderHeight));
+        if (fusedResolve) {
+            context.GetMultisampleTexture(sceneColor)->Bind();
+        }
+        else {
+            auto color = context.GetTexture(sceneColor);
+            color->Bind();
+            color->SetFilter(GL_LINEAR, GL_LINEAR);
+        }
+        program->SetUniform("tex", 0);
+        m_plane->Draw(program);
+    });
+    if (fusedResolve)
+        post.ReadSamples(sceneColor);
+    else
+        post.Read(sceneColor);
+    post.Write(backbuffer);
+
+    m_renderGraph->Compile();
+    // around the whole graph, whatever passes it culls or reorders. shadow and
+    // post are in it too, the render scale controller only sees their sum
+    BeginSceneTimer();
+    m_renderGraph->Execute();
+    EndSceneTimer();
+    m_frameIndex++;
+
+    if (drawData) {
+        CPU_ZONE("imgui render");
+        GpuProfiler::Scope scope(m_gpuProfiler.get(), "imgui");
+        ImGui_ImplOpenGL3_RenderDrawData(drawData);
+    }
+    if (frame.keepForRepresent)
+        KeepFrameForRepresent();
+}
+
+void Context::RecordInputEvent(double time)
+{
+    if (m_pendingEventTime == 0.0)
+        m_pendingEventTime = time;
+}
+
+bool Context::IsAnimating() const
+{
+    return (m_clusterEnabled && m_animation) || m_clusterRampActive || m_cameraMove != glm::vec3(0.0f) ||
+        m_sceneDirty || m_resourceLoader->IsBusy();
+}
+
+void Context::KeepFrameForRepresent()
+{
+    if (m_outputTexture)
+        return;
+    if (!m_representTexture || m_representTexture->GetWidth() != m_width ||
+        m_representTexture->GetHeight() != m_height) {
+        m_representTexture = Texture::Create(m_width, m_height, GL_RGBA8);
+        m_representFramebuffer = Framebuffer::Create({ m_representTexture }, nullptr, false);
+    }
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, m_representFramebuffer->Get());
+    glBlitFramebuffer(0, 0, m_width, m_height, 0, 0, m_width, m_height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+    Framebuffer::BindToDefault();
+}
+
+bool Context::RepresentFrame()
+{
+    if (m_outputTexture || !m_representTexture || m_representTexture->GetWidth() != m_width ||
+        m_representTexture->GetHeight() != m_height)
+        return false;
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, m_representFramebuffer->Get());
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+    glBlitFramebuffer(0, 0, m_width, m_height, 0, 0, m_width, m_height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
     Framebuffer::BindToDefault();
-    glViewport(0, 0, m_width, m_height);
+    return true;
+}
 
-    //draw on MSAA frame buffer
-    m_framebufferMSAA->Bind(); 
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+int Context::AddForwardPasses(const glm::mat4& view, const glm::mat4& projection, const glm::mat4& lightTransform,
+    int shadowMap, int& sceneDepth)
+{
+    RenderGraphTextureDesc colorDesc;
+    colorDesc.width = m_targetWidth;
+    colorDesc.height = m_targetHeight;
+    colorDesc.samples = m_msaaSamples;
+    auto depthDesc = colorDesc;
+    depthDesc.format = GL_DEPTH24_STENCIL8;
+    depthDesc.type = GL_UNSIGNED_INT_24_8;
+    // later passes sample these, so the graph resolves them in between when multisampled
+    int sceneColor = m_renderGraph->CreateTexture("scene color", colorDesc);
+    sceneDepth = m_renderGraph->CreateTexture("scene depth", depthDesc);
 
-    m_cameraFront = glm::rotate(glm::mat4(1.0f), glm::radians(m_cameraYaw), glm::vec3(0.0f, 1.0f, 0.0f)) *
-                    glm::rotate(glm::mat4(1.0f), glm::radians(m_cameraPitch), glm::vec3(1.0f, 0.0f, 0.0f)) *
-                    glm::vec4(0.0f, 0.0f, -1.0f, 0.0f);
+    // depth pre-pass: lay down opaque depth with a position-only stream so the
+    // lit pass below shades each visible pixel once
+    bool depthPrepass = m_depthPrepass;
+    if (m_depthPrepassAlternate)
+        depthPrepass = (m_frameIndex & 1) == 0;
+    if (depthPrepass) {
+        m_renderGraph->AddPass("depth pre-pass", [=](const RenderGraph::PassContext&) {
+            DrawScene(view, projection, m_depthProgram.get(), true, true);
+        }).Write(sceneDepth);
+    }
 
-    auto view = glm::lookAt(m_cameraPos, m_cameraPos + m_cameraFront, m_cameraUp);
-    auto projection = glm::perspective(glm::radians(45.0f), (float)(m_width / m_height), 0.01f, 100.0f);
-    
+    m_renderGraph->AddPass("forward", [=](const RenderGraph::PassContext&) {
+        {
+            GpuProfiler::Scope scope(m_gpuProfiler.get(), "skybox");
+            DrawSkybox(view, projection);
+        }
+
+        {
+            GpuProfiler::Scope scope(m_gpuProfiler.get(), "opaque");
+            SetLightingUniforms(m_lightingShadowProgram.get(), view, lightTransform);
+            if (depthPrepass) {
+                glDepthFunc(GL_EQUAL);
+                glDepthMask(GL_FALSE);
+            }
+            BeginPipelineStatistics(depthPrepass);
+            DrawScene(view, projection, m_lightingShadowProgram.get(), false, true);
+            EndPipelineStatistics();
+            if (depthPrepass) {
+                glDepthFunc(GL_LESS);
+                glDepthMask(GL_TRUE);
+            }
+        }
+
+        GpuProfiler::Scope scope(m_gpuProfiler.get(), "transparent");
+        DrawTransparents(view, projection);
+    }).Read(shadowMap).Write(sceneColor).Write(sceneDepth, depthPrepass);
+    return sceneColor;
+}
+
+int Context::AddDeferredPasses(const glm::mat4& view, const glm::mat4& projection, const glm::mat4& lightTransform,
+    int shadowMap, int& sceneDepth)
+{
+    // packed g-buffer, depth is a texture so the lighting pass can rebuild positions
+    RenderGraphTextureDesc desc;
+    desc.width = m_targetWidth;
+    desc.height = m_targetHeight;
+    auto normalDesc = desc;
+    normalDesc.format = GL_RGB10_A2;
+    normalDesc.type = GL_UNSIGNED_INT_2_10_10_10_REV;
+    auto depthDesc = desc;
+    depthDesc.format = GL_DEPTH24_STENCIL8;
+    depthDesc.type = GL_UNSIGNED_INT_24_8;
+    int albedoSpec = m_renderGraph->CreateTexture("g albedo/spec", desc);
+    int normal = m_renderGraph->CreateTexture("g normal", normalDesc);
+    int gbufferDepth = m_renderGraph->CreateTexture("g depth", depthDesc);
+    int sceneColor = m_renderGraph->CreateTexture("scene color", desc);
+    sceneDepth = m_renderGraph->CreateTexture("scene depth", depthDesc);
+
+    // geometry pass: fill the packed g-buffer
+    m_renderGraph->AddPass("gbuffer", [=](const RenderGraph::PassContext&) {
+        DrawScene(view, projection, m_gbufferProgram.get(), false, true);
+    }).Write(albedoSpec).Write(normal).Write(gbufferDepth);
+
+    // copy scene depth so forward geometry is still depth tested against it
+    m_renderGraph->AddBlitPass("depth copy", gbufferDepth, sceneDepth, GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+
+    m_renderGraph->AddPass("deferred lighting", [=](const RenderGraph::PassContext& context) {
+        // lighting pass: one full-screen quad, background pixels are discarded
+        SetLightingUniforms(m_deferredLightProgram.get(), view, lightTransform);
+        m_deferredLightProgram->SetUniform("transform", glm::scale(glm::mat4(1.0f), glm::vec3(2.0f, 2.0f, 1.0f)));
+        m_deferredLightProgram->SetUniform("inverseViewProjection", glm::inverse(projection * view));
+        const char* samplers[] = { "gAlbedoSpec", "gNormal", "gDepth" };
+        int inputs[] = { albedoSpec, normal, gbufferDepth };
+        for (int i = 0; i < 3; i++) {
+            glActiveTexture(GL_TEXTURE0 + i);
+            auto texture = context.GetTexture(inputs[i]);
+            texture->Bind();
+            texture->SetFilter(GL_NEAREST, GL_NEAREST);
+            m_deferredLightProgram->SetUniform(samplers[i], i);
+        }
+        glActiveTexture(GL_TEXTURE0);
+        glDepthMask(GL_FALSE);
+        glDisable(GL_DEPTH_TEST);
+        {
+            GpuProfiler::Scope scope(m_gpuProfiler.get(), "lighting");
+            m_plane->Draw(m_deferredLightProgram.get());
+        }
+        glEnable(GL_DEPTH_TEST);
+        glDepthMask(GL_TRUE);
+
+        // forward path for everything the g-buffer can't hold
+        {
+            GpuProfiler::Scope scope(m_gpuProfiler.get(), "skybox");
+            DrawSkybox(view, projection);
+        }
+        GpuProfiler::Scope scope(m_gpuProfiler.get(), "transparent");
+        DrawTransparents(view, projection);
+    }).Read(albedoSpec).Read(normal).Read(gbufferDepth).Read(shadowMap).Write(sceneColor).Write(sceneDepth, true);
+    return sceneColor;
+}
+
+int Context::AddFxaaPass(int sceneColor)
+{
+    RenderGraphTextureDesc desc;
+    desc.width = m_targetWidth;
+    desc.height = m_targetHeight;
+    int antiAliased = m_renderGraph->CreateTexture("fxaa color", desc);
+    m_renderGraph->AddPass("fxaa", [=](const RenderGraph::PassContext& context) {
+        m_fxaaProgram->Use();
+        m_fxaaProgram->SetUniform("transform", glm::scale(glm::mat4(1.0f), glm::vec3(2.0f, 2.0f, 1.0f)));
+        m_fxaaProgram->SetUniform("renderSize", glm::vec2((float)m_renderWidth, (float)m_renderHeight));
+        auto color = context.GetTexture(sceneColor);
+        color->Bind();
+        color->SetFilter(GL_LINEAR, GL_LINEAR);
+        m_fxaaProgram->SetUniform("tex", 0);
+        glDisable(GL_DEPTH_TEST);
+        m_plane->Draw(m_fxaaProgram.get());
+        glEnable(GL_DEPTH_TEST);
+    }).Read(sceneColor).Write(antiAliased, true);
+    return antiAliased;
+}
+
+int Context::AddTaaPass(int sceneColor, int sceneDepth, const glm::mat4& inverseViewProjection)
+{
+    // the history outlives the frame, so it is held here and imported; the blend
+    // goes to a transient target and is copied back for the next frame
+    if (!m_taaHistory || m_taaHistory->GetWidth() != m_targetWidth || m_taaHistory->GetHeight() != m_targetHeight) {
+        m_taaHistory = m_renderTargetPool->Acquire(m_targetWidth, m_targetHeight, GL_RGBA16F, GL_FLOAT);
+        m_taaHistoryValid = false;
+    }
+    RenderGraphTextureDesc desc;
+    desc.width = m_targetWidth;
+    desc.height = m_targetHeight;
+    desc.format = GL_RGBA16F;
+    desc.type = GL_FLOAT;
+    int antiAliased = m_renderGraph->CreateTexture("taa color", desc);
+    int history = m_renderGraph->ImportTexture("taa history", m_taaHistory);
+    m_renderGraph->MarkOutput(history);
+
+    bool historyValid = m_taaHistoryValid;
+    auto historySize = m_taaHistorySize;
+    auto previousViewProjection = m_taaPreviousViewProjection;
+    m_renderGraph->AddPass("taa", [=](const RenderGraph::PassContext& context) {
+        m_taaProgram->Use();
+        m_taaProgram->SetUniform("transform", glm::scale(glm::mat4(1.0f), glm::vec3(2.0f, 2.0f, 1.0f)));
+        m_taaProgram->SetUniform("renderSize", glm::vec2((float)m_renderWidth, (float)m_renderHeight));
+        m_taaProgram->SetUniform("historySize", historySize);
+        m_taaProgram->SetUniform("historyValid", historyValid ? 1 : 0);
+        m_taaProgram->SetUniform("blend", m_taaBlend);
+        m_taaProgram->SetUniform("inverseViewProjection", inverseViewProjection);
+        m_taaProgram->SetUniform("previousViewProjection", previousViewProjection);
+        const char* samplers[] = { "tex", "depthTex", "history" };
+        int inputs[] = { sceneColor, sceneDepth, history };
+        for (int i = 0; i < 3; i++) {
+            glActiveTexture(GL_TEXTURE0 + i);
+            auto texture = context.GetTexture(inputs[i]);
+            texture->Bind();
+            texture->SetFilter(i == 1 ? GL_NEAREST : GL_LINEAR, i == 1 ? GL_NEAREST : GL_LINEAR);
+            m_taaProgram->SetUniform(samplers[i], i);
+        }
+        glActiveTexture(GL_TEXTURE0);
+        glDisable(GL_DEPTH_TEST);
+        m_plane->Draw(m_taaProgram.get());
+        glEnable(GL_DEPTH_TEST);
+    }).Read(sceneColor).Read(sceneDepth).Read(history).Write(antiAliased, true);
+    m_renderGraph->AddBlitPass("taa history copy", antiAliased, history, GL_COLOR_BUFFER_BIT);
+
+    m_taaHistoryValid = true;
+    m_taaHistorySize = glm::vec2((float)m_renderWidth, (float)m_renderHeight);
+    return antiAliased;
+}
+
+void Context::UpdateRenderTargets()
+{
+    // a window drag fires a resize every few milliseconds: keep rendering into a
+    // sub-rect of the current targets and resize them once the size has settled,
+    // or right away when the window outgrew them. the graph picks up the new size
+    // and reallocates from the pool
+    const double resizeSettleTime = 0.25;
+    bool fits = m_width <= m_targetWidth && m_height <= m_targetHeight;
+    bool settled = m_frame.time - m_resizeTime > resizeSettleTime;
+    bool sameBucket = m_renderTargetPool->GetBucketSize(m_width) == m_targetWidth &&
+        m_renderTargetPool->GetBucketSize(m_height) == m_targetHeight;
+    if (!fits || (settled && !sameBucket)) {
+        m_targetWidth = m_renderTargetPool->GetBucketSize(m_width);
+        m_targetHeight = m_renderTargetPool->GetBucketSize(m_height);
+    }
+    m_renderTargetPool->Trim(m_frameIndex, 120);
+}
+
+void Context::SetLightingUniforms(const Program* program, const glm::mat4& view, const glm::mat4& lightTransform)
+{
+    program->Use();
+    program->SetUniform("viewPos", m_frame.cameraPos);
+    program->SetUniform("light.position", m_frame.light.position);
+    program->SetUniform("light.direction", m_frame.light.direction);
+    program->SetUniform("light.cutoff", glm::vec2(
+        cosf(glm::radians(m_frame.light.cutoff[0])),
+        cosf(glm::radians(m_frame.light.cutoff[0] + m_frame.light.cutoff[1]))));
+    program->SetUniform("light.attenuation", GetAttenuationCoeff(m_frame.light.distance));
+    program->SetUniform("light.ambient", m_frame.light.ambient);
+    program->SetUniform("light.diffuse", m_frame.light.diffuse);
+    program->SetUniform("light.specular", m_frame.light.specular);
+    program->SetUniform("blinn", (m_blinn ? 1 : 0));
+    program->SetUniform("lightTransform", lightTransform);
+    program->SetUniform("light.directional", m_frame.light.directional ? 1 : 0);//Todo: oversampling
+    glActiveTexture(GL_TEXTURE3);
+    m_shadowMap->GetShadowMap()->Bind();
+    program->SetUniform("shadowMap", 3);
+    glActiveTexture(GL_TEXTURE0);
+    program->SetUniform("clusterEnabled", m_clusterEnabled ? 1 : 0);
+    program->SetUniform("view", view);
+    m_lightCluster->SetToProgram(program, 4, glm::vec2((float)m_renderWidth, (float)m_renderHeight));
+}
+
+void Context::DrawSkybox(const glm::mat4& view, const glm::mat4& projection)
+{
     //skybox
-    auto skyboxModelTransform =glm::translate(glm::mat4(1.0), m_cameraPos) * glm::scale(glm::mat4(1.0), glm::vec3(50.0f));
-    m_skyboxProgram->Use();
-    m_cubeTexture->Bind();
-    m_skyboxProgram->SetUniform("skybox", 0);
-    m_skyboxProgram->SetUniform("transform", projection * view * skyboxModelTransform);
-    m_box->Draw(m_skyboxProgram.get());
-    
+    if (m_cubeTexture) {
+        auto skyboxModelTransform =glm::translate(glm::mat4(1.0), m_frame.cameraPos) * glm::scale(glm::mat4(1.0), glm::vec3(50.0f));
+        m_skyboxProgram->Use();
+        m_cubeTexture->Bind();
+        m_skyboxProgram->SetUniform("skybox", 0);
+        m_skyboxProgram->SetUniform("transform", projection * view * skyboxModelTransform);
+        m_box->Draw(m_skyboxProgram.get());
+    }
+
     //  light cube
     auto lightModelTransform =
-        glm::translate(glm::mat4(1.0), m_light.position) *
+        glm::translate(glm::mat4(1.0), m_frame.light.position) *
         glm::scale(glm::mat4(1.0), glm::vec3(0.1f));
     m_simpleProgram->Use();
-    m_simpleProgram->SetUniform("color", glm::vec4(m_light.ambient + m_light.diffuse, 1.0f));
+    m_simpleProgram->SetUniform("color", glm::vec4(m_frame.light.ambient + m_frame.light.diffuse, 1.0f));
     m_simpleProgram->SetUniform("transform", projection * view * lightModelTransform);
     m_box->Draw(m_simpleProgram.get());
-    
-    //setup lighting shader var
-    m_lightingShadowProgram->Use();
-    m_lightingShadowProgram->SetUniform("viewPos", m_cameraPos);
-    m_lightingShadowProgram->SetUniform("light.position", m_light.position);
-    m_lightingShadowProgram->SetUniform("light.direction", m_light.direction);
-    m_lightingShadowProgram->SetUniform("light.cutoff", glm::vec2(
-        cosf(glm::radians(m_light.cutoff[0])),
-        cosf(glm::radians(m_light.cutoff[0] + m_light.cutoff[1]))));
-    m_lightingShadowProgram->SetUniform("light.attenuation", GetAttenuationCoeff(m_light.distance));
-    m_lightingShadowProgram->SetUniform("light.ambient", m_light.ambient);
-    m_lightingShadowProgram->SetUniform("light.diffuse", m_light.diffuse);
-    m_lightingShadowProgram->SetUniform("light.specular", m_light.specular);
-    m_lightingShadowProgram->SetUniform("blinn", (m_blinn ? 1 : 0));
-    m_lightingShadowProgram->SetUniform("lightTransform", lightProjection * lightView);
-    m_lightingShadowProgram->SetUniform("light.directional", m_light.directional ? 1 : 0);//Todo: oversampling
-    glActiveTexture(GL_TEXTURE3);
-    m_shadowMap->GetShadowMap()->Bind();
-    m_lightingShadowProgram->SetUniform("shadowMap", 3);
-    glActiveTexture(GL_TEXTURE0);
-
-    DrawScene(view, projection, m_lightingShadowProgram.get());
-
+}
 
+void Context::DrawTransparents(const glm::mat4& view, const glm::mat4& projection)
+{
     // window with blending
     glEnable(GL_BLEND);
     glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
     m_textureProgram->Use();
     m_windowTexture->Bind();
+    // the nearer of the two unit quads below
+    auto eye = glm::vec3(glm::inverse(view)[3]);
+    float quadRadius = glm::sqrt(0.5f);
+    m_windowTexture->MarkUsed(std::max(
+        PixelsAcross(eye, projection, glm::vec3(0.0f, 1.5f, 4.0f), quadRadius),
+        PixelsAcross(eye, projection, glm::vec3(0.3f, 1.5f, 5.0f), quadRadius)));
     m_textureProgram->SetUniform("tex", 0);
 
     auto modelTransform = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 1.5f, 4.0f));
@@ -289,7 +938,7 @@ void Context::Render()
     transform = projection * view * modelTransform;
     m_textureProgram->SetUniform("transform", transform);
     m_plane->Draw(m_textureProgram.get());
-    
+
     //grass
     // m_grassProgram->Use();
     // m_grassProgram->SetUniform("tex", 0);
@@ -299,69 +948,401 @@ void Context::Render()
     // transform = projection * view * modelTransform;
     // m_grassProgram->SetUniform("transform", transform);
     // glDrawElementsInstanced(GL_TRIANGLES, m_plane->GetIndexBuffer()->GetCount(),GL_UNSIGNED_INT, 0, m_grassPosBuffer->GetCount());
-
-    Framebuffer::BindToDefault();
-    // Resolve MSAA framebuffer to regular framebuffer
-    glBindFramebuffer(GL_READ_FRAMEBUFFER, m_framebufferMSAA->Get());
-    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, m_framebuffer->Get());
-    glBlitFramebuffer(0, 0, m_width, m_height, 0, 0, m_width, m_height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
-
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
     glDisable(GL_BLEND);
+}
 
-    m_postProgram->Use();
-    m_postProgram->SetUniform("transform", glm::scale(glm::mat4(1.0f), glm::vec3(2.0f, 2.0f, 1.0f)));
-    m_postProgram->SetUniform("gamma", m_gamma);
-    m_framebuffer->GetColorAttachment()->Bind();
-    m_postProgram->SetUniform("tex", 0);
-    m_plane->Draw(m_postProgram.get());
+void Context::SetCamera(const glm::vec3& position, float yaw, float pitch)
+{
+    m_cameraPos = position;
+    m_prevCameraPos = position;
+    m_cameraYaw = yaw;
+    m_cameraPitch = glm::clamp(pitch, -89.0f, 89.0f);
+}
+
+bool Context::SetOption(const std::string& name, const std::string& value)
+{
+    auto flag = [&](bool& target) {
+        target = value == "1" || value == "on" || value == "true";
+        return true;
+    };
+    int number = atoi(value.c_str());
+    if (name == "render_path") {
+        if (value != "forward" && value != "deferred")
+            return false;
+        m_renderPath = value == "deferred" ? RenderPath::Deferred : RenderPath::Forward;
+        return true;
+    }
+    if (name == "msaa") {
+        if (number < 1 || number > m_maxSamples || (number & (number - 1)) != 0) {
+            SPDLOG_ERROR("msaa {} not supported, max is {}", number, m_maxSamples);
+            return false;
+        }
+        m_msaaSamples = number;
+        return true;
+    }
+    if (name == "post_aa") {
+        if (value == "none") m_postAntiAliasing = PostAntiAliasing::None;
+        else if (value == "fxaa") m_postAntiAliasing = PostAntiAliasing::FXAA;
+        else if (value == "taa") m_postAntiAliasing = PostAntiAliasing::TAA;
+        else return false;
+        m_taaHistoryValid = false;
+        return true;
+    }
+    if (name == "depth_prepass")
+        return flag(m_depthPrepass);
+    if (name == "dynamic_resolution")
+        return flag(m_dynamicResolution);
+    if (name == "render_scale") {
+        m_renderScale = (float)atof(value.c_str());
+        return true;
+    }
+    if (name == "software_occlusion")
+        return flag(m_softwareOcclusion);
+    if (name == "hardware_occlusion")
+        return flag(m_hardwareOcclusion);
+    if (name == "occlusion_test_scene") {
+        flag(m_occlusionTestScene);
+        m_sceneDirty = true;
+        return true;
+    }
+    if (name == "cluster_lights") {
+        m_clusterEnabled = number > 0;
+        m_clusterLightCount = glm::clamp(number, 0, (int)m_clusterLightOrbits.size());
+        return true;
+    }
+    if (name == "animation")
+        return flag(m_animation);
+    return false;
 }
 
 void Context::ProcessInput(GLFWwindow *window)
 {
+    m_inputTime = glfwGetTime();
+    m_cameraMove = glm::vec3(0.0f);
     if (!m_cameraControl)
         return;
-    const float cameraSpeed = 0.05f;
-    if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS)
-        m_cameraPos += cameraSpeed * m_cameraFront;
-    if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS)
-        m_cameraPos -= cameraSpeed * m_cameraFront;
-
-    auto cameraRight = glm::normalize(glm::cross(m_cameraUp, -m_cameraFront));
-    if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS)
-        m_cameraPos += cameraSpeed * cameraRight;
-    if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS)
-        m_cameraPos -= cameraSpeed * cameraRight;
-
-    auto cameraUp = glm::normalize(glm::cross(-m_cameraFront, cameraRight));
-    if (glfwGetKey(window, GLFW_KEY_E) == GLFW_PRESS)
-        m_cameraPos += cameraSpeed * cameraUp;
-    if (glfwGetKey(window, GLFW_KEY_Q) == GLFW_PRESS)
-        m_cameraPos -= cameraSpeed * cameraUp;
-}
-
-void Context::DrawScene(const glm::mat4& view,const glm::mat4& projection, const Program* program) {
-    program->Use();
+    auto axis = [&](int positive, int negative) {
+        return (glfwGetKey(window, positive) == GLFW_PRESS ? 1.0f : 0.0f) -
+            (glfwGetKey(window, negative) == GLFW_PRESS ? 1.0f : 0.0f);
+    };
+    m_cameraMove = glm::vec3(axis(GLFW_KEY_W, GLFW_KEY_S), axis(GLFW_KEY_D, GLFW_KEY_A), axis(GLFW_KEY_E, GLFW_KEY_Q));
+}
+
+void Context::Update(float dt)
+{
+    // keep the previous state for interpolation, then advance by one fixed step
+    m_prevCameraPos = m_cameraPos;
+    auto cameraFront = GetCameraFront();
+    auto cameraRight = glm::normalize(glm::cross(m_cameraUp, -cameraFront));
+    auto cameraUp = glm::normalize(glm::cross(-cameraFront, cameraRight));
+    m_cameraPos += m_cameraSpeed * dt *
+        (m_cameraMove.x * cameraFront + m_cameraMove.y * cameraRight + m_cameraMove.z * cameraUp);
+
+    m_prevClusterTime = m_clusterTime;
+    if (m_clusterEnabled && m_animation)
+        m_clusterTime += dt;
+}
+
+void Context::BuildScene() {
+    m_sceneObjects.clear();
     // model
     auto modelTransform = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 2.5f, 0.0f));
-    auto transform = projection * view * modelTransform;
-    program->SetUniform("transform", transform);
-    program->SetUniform("modelTransform", modelTransform);
-    m_model->Draw(program);
-    
+    for (int i = 0; i < m_model->GetMeshCount(); i++) {
+        SceneObject object;
+        object.mesh = m_model->GetMesh(i).get();
+        object.transform = modelTransform;
+        object.occluder = true;
+        m_sceneObjects.push_back(object);
+    }
     // floor
-    auto floorTransform = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, -0.5f, 0.0f)) * glm::scale(glm::mat4(1.0f), glm::vec3(50.0f, 1.0f, 50.0f));
-    transform = projection * view * floorTransform;
-    program->SetUniform("transform", transform);
-    program->SetUniform("modelTransform", floorTransform);
-    m_planeMaterial->SetToProgram(program);
-    m_box->Draw(program);
+    SceneObject floor;
+    floor.mesh = m_box.get();
+    floor.material = m_planeMaterial;
+    floor.transform = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, -0.5f, 0.0f)) * glm::scale(glm::mat4(1.0f), glm::vec3(50.0f, 1.0f, 50.0f));
+    floor.occluder = true;
+    m_sceneObjects.push_back(floor);
     //small box
-    auto smallBoxTransform=glm::translate(glm::mat4(1.0f), glm::vec3(-1.0f, 3.5f, 3.0f));
-    transform = projection * view * smallBoxTransform;
-    program->SetUniform("transform", transform);
-    program->SetUniform("modelTransform", smallBoxTransform);
-    m_smallBoxMaterial->SetToProgram(program);
-    m_smallBox->Draw(program);
+    SceneObject smallBox;
+    smallBox.mesh = m_smallBox.get();
+    smallBox.material = m_smallBoxMaterial;
+    smallBox.transform = glm::translate(glm::mat4(1.0f), glm::vec3(-1.0f, 3.5f, 3.0f));
+    smallBox.occlusionTest = true;
+    m_sceneObjects.push_back(smallBox);
+
+    if (m_occlusionTestScene) {
+        // hidden geometry: a grid under the floor, a stack behind the backpack
+        // and a dense block behind a wall
+        SceneObject testBox = smallBox;
+        for (int z = 0; z < 16; z++) {
+            for (int x = 0; x < 16; x++) {
+                testBox.transform = glm::translate(glm::mat4(1.0f), glm::vec3(x * 1.5f - 11.25f, -2.0f, z * 1.5f - 11.25f));
+                m_sceneObjects.push_back(testBox);
+            }
+        }
+        for (int y = 0; y < 4; y++) {
+            for (int x = 0; x < 4; x++) {
+                testBox.transform = glm::translate(glm::mat4(1.0f), glm::vec3(x * 0.3f - 0.45f, 1.8f + y * 0.3f, -1.5f)) *
+                    glm::scale(glm::mat4(1.0f), glm::vec3(0.25f));
+                m_sceneObjects.push_back(testBox);
+            }
+        }
+        SceneObject wall = floor;
+        wall.transform = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 3.0f, -4.0f)) * glm::scale(glm::mat4(1.0f), glm::vec3(24.0f, 6.0f, 0.5f));
+        m_sceneObjects.push_back(wall);
+        for (int z = 0; z < 6; z++) {
+            for (int y = 0; y < 4; y++) {
+                for (int x = 0; x < 12; x++) {
+                    testBox.transform = glm::translate(glm::mat4(1.0f), glm::vec3(x * 1.5f - 8.25f, 0.5f + y * 1.2f, -5.5f - z * 1.5f));
+                    m_sceneObjects.push_back(testBox);
+                }
+            }
+        }
+    }
+
+    for (auto& object : m_sceneObjects) {
+        auto meshMin = object.mesh->GetBoundsMin();
+        auto meshMax = object.mesh->GetBoundsMax();
+        object.boundsMin = glm::vec3(std::numeric_limits<float>::max());
+        object.boundsMax = -object.boundsMin;
+        for (int i = 0; i < 8; i++) {
+            auto corner = glm::vec3(object.transform * glm::vec4(
+                (i & 1) ? meshMax.x : meshMin.x,
+                (i & 2) ? meshMax.y : meshMin.y,
+                (i & 4) ? meshMax.z : meshMin.z, 1.0f));
+            object.boundsMin = glm::min(object.boundsMin, corner);
+            object.boundsMax = glm::max(object.boundsMax, corner);
+        }
+        if (object.occlusionTest)
+            object.occlusionQuery = Query::Create(GL_ANY_SAMPLES_PASSED);
+    }
+}
+
+void Context::CullScene(const glm::mat4& viewProjection) {
+    CPU_ZONE("cull scene");
+    m_occlusionQueriesIssued = false;
+    for (auto& object : m_sceneObjects)
+        object.visible = true;
+    if (!m_softwareOcclusion)
+        return;
+    m_occlusionCuller->BeginFrame(viewProjection);
+    for (auto& object : m_sceneObjects) {
+        if (object.occluder)
+            m_occlusionCuller->AddOccluder(object.mesh->GetPositions(), object.mesh->GetIndices(), object.transform);
+    }
+    m_occlusionCuller->Rasterize();
+    for (auto& object : m_sceneObjects) {
+        if (object.occlusionTest)
+            object.visible = m_occlusionCuller->TestBox(object.mesh->GetBoundsMin(), object.mesh->GetBoundsMax(), object.transform);
+    }
+}
+
+void Context::IssueOcclusionQueries(const glm::mat4& viewProjection) {
+    // proxies only test depth, keep whatever masks the current pass uses
+    GLboolean colorMask[4];
+    GLboolean depthMask;
+    glGetBooleanv(GL_COLOR_WRITEMASK, colorMask);
+    glGetBooleanv(GL_DEPTH_WRITEMASK, &depthMask);
+    glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+    glDepthMask(GL_FALSE);
+    m_depthProgram->Use();
+
+    m_occlusionQueryCount = 0;
+    m_occlusionQueryVisibleCount = 0;
+    m_occlusionQueryCulledCount = 0;
+    for (size_t i = 0; i < m_sceneObjects.size(); i++) {
+        auto& object = m_sceneObjects[i];
+        object.conditional = false;
+        if (!object.occlusionQuery || !object.visible)
+            continue;
+        // never wait, a result that isn't back yet is picked up next frame
+        if (object.queryPending && object.occlusionQuery->IsResultAvailable()) {
+            object.queryVisible = object.occlusionQuery->GetResult() != 0;
+            object.queryPending = false;
+        }
+        // the proxy is clipped away by the near plane when the camera is inside it
+        auto margin = glm::vec3(0.1f);
+        if (glm::all(glm::greaterThanEqual(m_frame.cameraPos, object.boundsMin - margin)) &&
+            glm::all(glm::lessThanEqual(m_frame.cameraPos, object.boundsMax + margin))) {
+            object.queryVisible = true;
+        }
+        else if (!object.queryPending) {
+            // occluded objects are queried every frame, visible ones only every few
+            // frames, staggered so the requeries spread out
+            bool requery = !object.queryVisible || (m_frameIndex + i) % m_occlusionQueryInterval == 0;
+            if (requery) {
+                auto center = (object.boundsMin + object.boundsMax) * 0.5f;
+                auto size = object.boundsMax - object.boundsMin;
+                m_depthProgram->SetUniform("transform", viewProjection *
+                    glm::translate(glm::mat4(1.0f), center) * glm::scale(glm::mat4(1.0f), size));
+                object.occlusionQuery->Begin();
+                m_box->DrawDepthOnly();
+                object.occlusionQuery->End();
+                object.queryPending = true;
+                m_occlusionQueryCount++;
+            }
+            object.conditional = !object.queryVisible && object.queryPending;
+        }
+        else {
+            object.conditional = !object.queryVisible;
+        }
+        if (object.queryVisible)
+            m_occlusionQueryVisibleCount++;
+        else
+            m_occlusionQueryCulledCount++;
+    }
+
+    glColorMask(colorMask[0], colorMask[1], colorMask[2], colorMask[3]);
+    glDepthMask(depthMask);
+}
+
+float Context::PixelsAcross(const glm::vec3& eye, const glm::mat4& projection, const glm::vec3& center, float radius) const {
+    float distance = std::max(glm::length(center - eye) - radius, 0.1f);
+    return radius * projection[1][1] * m_renderHeight / distance;
+}
+
+void Context::DrawScene(const glm::mat4& view,const glm::mat4& projection, const Program* program, bool depthOnly, bool cull) {
+    // the bounding sphere's screen size picks the mip levels kept resident
+    auto eye = glm::vec3(glm::inverse(view)[3]);
+    auto pixelsAcross = [&](const SceneObject& object) {
+        auto center = (object.boundsMin + object.boundsMax) * 0.5f;
+        float radius = glm::length(object.boundsMax - object.boundsMin) * 0.5f;
+        return PixelsAcross(eye, projection, center, radius);
+    };
+    auto drawObject = [&](const SceneObject& object) {
+        program->SetUniform("transform", projection * view * object.transform);
+        program->SetUniform("modelTransform", object.transform);
+        if (depthOnly) {
+            object.mesh->DrawDepthOnly();
+        }
+        else {
+            // the footprint goes to whichever material binds the textures:
+            // objects with their own draw a material-less shape mesh
+            float pixels = pixelsAcross(object);
+            if (object.material) {
+                object.material->SetToProgram(program, pixels);
+                object.mesh->Draw(program);
+            }
+            else {
+                object.mesh->Draw(program, pixels);
+            }
+        }
+    };
+
+    program->Use();
+    bool hardwareOcclusion = cull && m_hardwareOcclusion;
+    for (auto& object : m_sceneObjects) {
+        if (cull && !object.visible)
+            continue;
+        // queried objects go last so their proxies test against the occluders
+        if (hardwareOcclusion && object.occlusionQuery)
+            continue;
+        drawObject(object);
+    }
+    if (!hardwareOcclusion)
+        return;
+
+    // once per frame, later passes reuse the same queries
+    if (!m_occlusionQueriesIssued) {
+        IssueOcclusionQueries(projection * view);
+        m_occlusionQueriesIssued = true;
+        program->Use();
+    }
+    for (auto& object : m_sceneObjects) {
+        if (!object.occlusionQuery || !object.visible)
+            continue;
+        if (object.conditional)
+            glBeginConditionalRender(object.occlusionQuery->Get(), GL_QUERY_NO_WAIT);
+        drawObject(object);
+        if (object.conditional)
+            glEndConditionalRender();
+    }
+}
+
+void Context::GenerateClusterLights(int count) {
+    // fixed seed so benchmark runs see the same light layout
+    std::mt19937 random(42);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    m_clusterLightOrbits.resize(count);
+    m_clusterLightPool.resize(count);
+    for (int i = 0; i < count; i++) {
+        m_clusterLightOrbits[i] = glm::vec4(
+            0.5f + unit(random) * 11.5f,
+            unit(random) * glm::two_pi<float>(),
+            0.1f + unit(random) * 3.9f,
+            (unit(random) < 0.5f ? -1.0f : 1.0f) * (0.1f + unit(random) * 0.5f));
+        auto& light = m_clusterLightPool[i];
+        light.color = glm::normalize(glm::vec3(unit(random), unit(random), unit(random)) + 0.2f) * 2.0f;
+        light.radius = 1.5f + unit(random) * 2.5f;
+        light.spot = (i % 4) == 3;
+        light.direction = glm::vec3(0.0f, -1.0f, 0.0f);
+        light.cutoff = glm::vec2(25.0f, 10.0f);
+    }
+    m_clusterLightCount = std::min(m_clusterLightCount, count);
+}
+
+void Context::UpdateClusterLights(float time) {
+    int count = std::min(m_clusterLightCount, (int)m_clusterLightPool.size());
+    m_clusterLights.assign(m_clusterLightPool.begin(), m_clusterLightPool.begin() + count);
+    for (int i = 0; i < count; i++) {
+        auto& orbit = m_clusterLightOrbits[i];
+        float angle = orbit.y + orbit.w * time;
+        m_clusterLights[i].position = glm::vec3(cosf(angle) * orbit.x, orbit.z, sinf(angle) * orbit.x);
+    }
+}
+
+void Context::BeginSceneTimer() {
+    // same ring scheme as the pipeline statistics, results arrive a few frames late
+    auto& slot = m_sceneTimerQueries[m_frameIndex % m_sceneTimerQueries.size()];
+    if (slot.pending) {
+        if (!slot.query->IsResultAvailable())
+            return;
+        UpdateRenderScale((float)((double)slot.query->GetResult() / 1000000.0));
+        slot.pending = false;
+    }
+    slot.query->Begin();
+    slot.pending = true;
+    m_sceneTimerActive = true;
+}
+
+void Context::EndSceneTimer() {
+    if (!m_sceneTimerActive)
+        return;
+    m_sceneTimerQueries[m_frameIndex % m_sceneTimerQueries.size()].query->End();
+    m_sceneTimerActive = false;
+}
+
+void Context::UpdateRenderScale(float gpuTime) {
+    m_gpuSceneTime = gpuTime;
+    if (!m_dynamicResolution)
+        return;
+    // small dead band so the scale doesn't hunt around the target
+    if (fabsf(gpuTime - m_targetGpuTime) < m_targetGpuTime * 0.05f)
+        return;
+    // scene cost is mostly per pixel, so it scales with the square of the factor
+    float scale = m_renderScale * sqrtf(m_targetGpuTime / std::max(gpuTime, 0.01f));
+    m_renderScale = glm::clamp(glm::mix(m_renderScale, scale, 0.25f), m_minRenderScale, 1.0f);
+}
+
+void Context::BeginPipelineStatistics(bool depthPrepass) {
+    if (m_litPassQueries.empty())
+        return;
+    // collect the oldest query in the ring, it was issued a few frames ago and should be ready
+    auto& slot = m_litPassQueries[m_frameIndex % m_litPassQueries.size()];
+    if (slot.pending) {
+        if (!slot.query->IsResultAvailable())
+            return;
+        m_litPassInvocations[slot.depthPrepass ? 1 : 0] = slot.query->GetResult();
+        slot.pending = false;
+    }
+    slot.depthPrepass = depthPrepass;
+    slot.query->Begin();
+    slot.pending = true;
+    m_litPassQueryActive = true;
+}
+
+void Context::EndPipelineStatistics() {
+    if (!m_litPassQueryActive)
+        return;
+    m_litPassQueries[m_frameIndex % m_litPassQueries.size()].query->End();
+    m_litPassQueryActive = false;
 }
\ No newline at end of file
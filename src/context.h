@@ -11,29 +11,103 @@
 #include "model.h"
 #include "framebuffer.h"
 #include "shadow_map.h"
+#include "light_cluster.h"
+#include "thread_pool.h"
+#include "query.h"
+#include "occlusion_culler.h"
+#include "render_target_pool.h"
+#include "render_graph.h"
+#include "post_process.h"
+#include "frame_loop.h"
+#include "frame_latency_limiter.h"
+#include "resource_loader.h"
 #include <time.h>
+#include <atomic>
+#include <mutex>
+
+struct ImDrawData;
 
 CLASS_PTR(Context)
 
 class Context
 {
   public:
+    struct Light
+    {
+        bool directional { false };
+        glm::vec3 position { glm::vec3(2.0f, 4.0f, 4.0f) };
+        glm::vec3 direction { glm::vec3(-0.5f, -1.5f, -1.0f) };
+        glm::vec2 cutoff { glm::vec2(50.0f, 5.0f) };
+        float distance { 150.0f };
+        glm::vec3 ambient { glm::vec3(0.1f, 0.1f, 0.1f) };
+        glm::vec3 diffuse { glm::vec3(0.8f, 0.8f, 0.8f) };
+        glm::vec3 specular { glm::vec3(1.0f, 1.0f, 1.0f) };
+    };
+    // the game side state one frame is rendered from. captured on the main thread
+    // and only read afterwards, so it can be rendered on another thread while the
+    // next frame is simulated
+    struct Frame
+    {
+        uint64_t index { 0 };
+        double time { 0.0 };        // ui clock, seconds
+        float deltaTime { 0.0f };
+        int width { 640 };
+        int height { 480 };
+        glm::vec3 cameraPos { glm::vec3(0.0f) };   // interpolated between ticks
+        glm::vec3 cameraFront { glm::vec3(0.0f, 0.0f, -1.0f) };
+        Light light;
+        glm::vec4 clearColor { glm::vec4(0.0f) };
+        float clusterTime { 0.0f };
+        double inputTime { 0.0 };   // glfwGetTime() when the input was sampled
+        double eventTime { 0.0 };   // oldest input event picked up by this frame, 0: none
+        bool keepForRepresent { false };  // copy the finished frame, idle mode shows it again
+        bool represent { false };         // only present the kept copy again
+    };
+
     ~Context();
-    static ContextUPtr Create();
+    // textures and buffers are created through resourceLoader; without one they
+    // are created right away on the calling thread
+    static ContextUPtr Create(ResourceLoaderPtr resourceLoader = nullptr);
+    // DrawUI, CaptureFrame and RenderFrame in one go
     void Render();
+    // ui and game state live on the main thread, RenderFrame only touches gl and
+    // the frame. the ui edits render settings under a lock RenderFrame also holds
+    void DrawUI();
+    Frame CaptureFrame();
+    // drawData: the imgui frame to draw on top, if any
+    void RenderFrame(const Frame& frame, ImDrawData* drawData = nullptr);
+    // input is sampled once per frame and applied by the fixed steps of Update(),
+    // Render() draws the state interpolated by the frame loop's alpha
     void ProcessInput(GLFWwindow *window);
+    void Update(float dt);
+    void SetFrameLoop(FrameLoop* frameLoop) { m_frameLoop = frameLoop; }
+    // shown in the frame loop ui
+    void SetFrameLatencyLimiter(FrameLatencyLimiter* limiter) { m_frameLatencyLimiter = limiter; }
+    // glfwGetTime() of an input event, the next captured frame carries the oldest one
+    void RecordInputEvent(double time);
+    // frames keep changing without input: animation, held movement keys
+    bool IsAnimating() const;
     void Reshape(int width, int height);
     void MouseMove(double x, double y);
     void MouseButton(int button, int action, double x, double y);
+    // open scopes on it to time work done outside Render(), e.g. the ui
+    GpuProfiler* GetGpuProfiler() const { return m_gpuProfiler.get(); }
+    // scripted control for benchmarks: camera placement and named render options
+    void SetCamera(const glm::vec3& position, float yaw, float pitch);
+    bool SetOption(const std::string& name, const std::string& value);
+    // render the final image into texture instead of the default framebuffer, null to go back
+    void SetOutputTexture(TexturePtr texture) { m_outputTexture = texture; }
 
   private:
     Context(){};
     bool Init();
 
+    // RenderFrame hands over finished loads, IsAnimating() reports pending ones
+    ResourceLoaderPtr m_resourceLoader;
+
     ProgramUPtr m_program;
     ProgramUPtr m_simpleProgram;
     ProgramUPtr m_textureProgram;
-    ProgramUPtr m_postProgram;
     ProgramUPtr m_lightingShadowProgram;
     float m_gamma {1.0f};
 
@@ -44,42 +118,180 @@ class Context
     MeshUPtr m_smallBox;
     MaterialPtr m_smallBoxMaterial;
 
-    void DrawScene(const glm::mat4& view, const glm::mat4& projection,const Program* program);
+    // opaque scene as a flat draw list so passes can skip culled entries
+    struct SceneObject {
+        const Mesh* mesh { nullptr };
+        MaterialPtr material;       // null: the mesh's own material
+        glm::mat4 transform { glm::mat4(1.0f) };
+        bool occluder { false };    // rasterized into the software depth buffer
+        bool occlusionTest { false };
+        bool visible { true };
+        glm::vec3 boundsMin { glm::vec3(0.0f) };   // world space
+        glm::vec3 boundsMax { glm::vec3(0.0f) };
+        // hardware occlusion query state, carried across frames
+        QueryPtr occlusionQuery;
+        bool queryPending { false };
+        bool queryVisible { true };  // last result read back
+        bool conditional { false };  // drawn under conditional render this frame
+    };
+    std::vector<SceneObject> m_sceneObjects;
+    void BuildScene();
+    void CullScene(const glm::mat4& viewProjection);
+    void IssueOcclusionQueries(const glm::mat4& viewProjection);
+
+    void DrawScene(const glm::mat4& view, const glm::mat4& projection,const Program* program, bool depthOnly = false, bool cull = false);
+    // how many pixels a sphere spans on screen, the texture residency picks
+    // the mip levels to keep from it
+    float PixelsAcross(const glm::vec3& eye, const glm::mat4& projection, const glm::vec3& center, float radius) const;
+    // add the scene passes to the render graph, return the scene color resource
+    int AddForwardPasses(const glm::mat4& view, const glm::mat4& projection, const glm::mat4& lightTransform,
+        int shadowMap, int& sceneDepth);
+    int AddDeferredPasses(const glm::mat4& view, const glm::mat4& projection, const glm::mat4& lightTransform,
+        int shadowMap, int& sceneDepth);
+    int AddFxaaPass(int sceneColor);
+    int AddTaaPass(int sceneColor, int sceneDepth, const glm::mat4& inverseViewProjection);
+    void SetLightingUniforms(const Program* program, const glm::mat4& view, const glm::mat4& lightTransform);
+    void UpdateRenderTargets();
+    void DrawSkybox(const glm::mat4& view, const glm::mat4& projection);
+    void DrawTransparents(const glm::mat4& view, const glm::mat4& projection);
+    void BeginSceneTimer();
+    void EndSceneTimer();
+    void UpdateRenderScale(float gpuTime);
+    void BeginPipelineStatistics(bool depthPrepass);
+    void EndPipelineStatistics();
+    void GenerateClusterLights(int count);
+    void UpdateClusterLights(float time);
 
     //  animation
     bool m_animation{true};
+    FrameLoop* m_frameLoop { nullptr };
+    FrameLatencyLimiter* m_frameLatencyLimiter { nullptr };
+    double m_pendingEventTime { 0.0 };
+    // main thread side
+    int m_windowWidth { 640 };
+    int m_windowHeight { 480 };
+    uint64_t m_frameCount { 0 };
+    double m_inputTime { 0.0 };
+    // render thread side: the frame being rendered
+    Frame m_frame;
+    std::mutex m_mutex;
 
     // camera parameter
     glm::vec3 m_cameraPos{glm::vec3(0.0f, 2.5f, 8.0f)};
-    glm::vec3 m_cameraFront{glm::vec3(0.0f, 0.0f, -1.0f)};
     glm::vec3 m_cameraUp{glm::vec3(0.0f, 1.0f, 0.0f)};
     bool m_cameraControl{false};
+    glm::vec3 m_cameraMove { glm::vec3(0.0f) };  // held keys: forward, right, up
+    float m_cameraSpeed { 3.0f };                // units per second
+    glm::vec3 m_prevCameraPos { m_cameraPos };   // before the last tick
+    glm::vec3 GetCameraFront() const;
     
     glm::vec2 m_prevMousePos{glm::vec2(0.0f)};
     float m_cameraPitch{-20.0f};
     float m_cameraYaw{0.0f};
-    // framebuffer
-    FramebufferUPtr m_framebuffer;
-    FramebufferUPtr m_framebufferMSAA;
+    // frame passes; their targets come from the pool and may be larger than the window
+    RenderTargetPoolPtr m_renderTargetPool;
+    RenderGraphUPtr m_renderGraph;
+    GpuProfilerUPtr m_gpuProfiler;
+    int m_targetWidth { 0 };
+    int m_targetHeight { 0 };
+    double m_resizeTime { 0.0 };
     //shadow map
     ShadowMapUPtr m_shadowMap;
+
+    // deferred shading
+    enum class RenderPath { Forward, Deferred };
+    RenderPath m_renderPath { RenderPath::Forward };
+    ProgramUPtr m_gbufferProgram;
+    ProgramUPtr m_deferredLightProgram;
+
+    // post effects fused into the final pass
+    PostProcessStackUPtr m_postProcess;
+    float m_sharpenAmount { 0.2f };
+    float m_exposure { 1.0f };
+    float m_contrast { 1.0f };
+    float m_saturation { 1.0f };
+    glm::vec3 m_colorFilter { glm::vec3(1.0f) };
+    float m_vignetteIntensity { 0.5f };
+    float m_vignetteSmoothness { 0.5f };
+
+    // anti-aliasing: msaa applies to the forward scene targets, fxaa/taa run before the post pass
+    enum class PostAntiAliasing { None, FXAA, TAA };
+    PostAntiAliasing m_postAntiAliasing { PostAntiAliasing::None };
+    int m_msaaSamples { 4 };
+    int m_maxSamples { 1 };     // what the driver allows for multisample color and depth textures
+    ProgramUPtr m_fxaaProgram;
+    ProgramUPtr m_taaProgram;
+    float m_taaBlend { 0.1f };
+    TexturePtr m_taaHistory;
+    bool m_taaHistoryValid { false };
+    glm::vec2 m_taaHistorySize { glm::vec2(0.0f) };
+    glm::mat4 m_taaPreviousViewProjection { glm::mat4(1.0f) };
+
+    // depth pre-pass
+    ProgramUPtr m_depthProgram;
+    bool m_depthPrepass { false };
+    bool m_depthPrepassAlternate { false };
+    struct PipelineStatisticsQuery {
+        QueryUPtr query;
+        bool pending { false };
+        bool depthPrepass { false };
+    };
+    std::vector<PipelineStatisticsQuery> m_litPassQueries;
+    bool m_litPassQueryActive { false };
+    uint64_t m_litPassInvocations[2] { 0, 0 }; // lit pass without / with pre-pass
+    uint64_t m_frameIndex { 0 };
+
+    // dynamic resolution: the scene renders into the bottom-left renderWidth x renderHeight
+    // of the window sized targets and is upscaled by the post pass
+    bool m_dynamicResolution { false };
+    bool m_bicubicUpscale { true };
+    float m_renderScale { 1.0f };
+    float m_minRenderScale { 0.5f };
+    float m_targetGpuTime { 12.0f };   // ms
+    float m_gpuSceneTime { 0.0f };
+    int m_renderWidth { 640 };
+    int m_renderHeight { 480 };
+    struct TimerQuery {
+        QueryUPtr query;
+        bool pending { false };
+    };
+    std::vector<TimerQuery> m_sceneTimerQueries;
+    bool m_sceneTimerActive { false };
+
+    // software occlusion culling
+    OcclusionCullerUPtr m_occlusionCuller;
+    bool m_softwareOcclusion { false };
+    bool m_occlusionTestScene { false };
+    // set from the ui or SetOption, BuildScene runs at the next RenderFrame on
+    // the render context
+    std::atomic<bool> m_sceneDirty { false };
+    // hardware occlusion queries
+    bool m_hardwareOcclusion { false };
+    bool m_occlusionQueriesIssued { false };
+    int m_occlusionQueryInterval { 8 };    // frames between re-queries of visible objects
+    int m_occlusionQueryCount { 0 };
+    int m_occlusionQueryVisibleCount { 0 };
+    int m_occlusionQueryCulledCount { 0 };
     
     // clear color
     glm::vec4 m_clearColor{glm::vec4(0.1f, 0.2f, 0.3f, 0.0f)};
     // light parameter
-    struct Light
-    {
-        bool directional { false };
-        glm::vec3 position { glm::vec3(2.0f, 4.0f, 4.0f) };
-        glm::vec3 direction { glm::vec3(-0.5f, -1.5f, -1.0f) };
-        glm::vec2 cutoff { glm::vec2(50.0f, 5.0f) };
-        float distance { 150.0f };
-        glm::vec3 ambient { glm::vec3(0.1f, 0.1f, 0.1f) };
-        glm::vec3 diffuse { glm::vec3(0.8f, 0.8f, 0.8f) };
-        glm::vec3 specular { glm::vec3(1.0f, 1.0f, 1.0f) };
-    };
     Light m_light;
 
+    // clustered lights
+    ThreadPoolPtr m_threadPool;
+    LightClusterUPtr m_lightCluster;
+    std::vector<ClusterLight> m_clusterLightPool;
+    std::vector<ClusterLight> m_clusterLights;
+    std::vector<glm::vec4> m_clusterLightOrbits; // (orbit radius, phase, height, angular speed)
+    bool m_clusterEnabled { false };
+    int m_clusterLightCount { 256 };
+    float m_clusterTime { 0.0f };
+    float m_prevClusterTime { 0.0f };
+    bool m_clusterRamp { false };
+    bool m_clusterRampActive { false };   // main thread copy
+    std::vector<float> m_clusterRampFrameTimes;
+
     bool m_blinn{true};
     // material parameter
     MaterialPtr m_material;
@@ -87,16 +299,22 @@ class Context
 
     TexturePtr m_windowTexture;
     // cubemap
-    CubeTextureUPtr m_cubeTexture;
+    CubeTexturePtr m_cubeTexture;   // null until loaded
     ProgramUPtr m_skyboxProgram;
     //grass instance
     TexturePtr m_grassTexture;
     ProgramUPtr m_grassProgram;
     std::vector<glm::vec3> m_grassPos;
-    BufferUPtr m_grassPosBuffer;
+    BufferPtr m_grassPosBuffer;
     VertexLayoutUPtr m_grassInstance;
     
 
+    TexturePtr m_outputTexture;
+    // last frame before idling, re-presented when the window needs a repaint
+    TexturePtr m_representTexture;
+    FramebufferUPtr m_representFramebuffer;
+    bool RepresentFrame();
+    void KeepFrameForRepresent();
     int m_width{640};
     int m_height{480};
 };
@@ -0,0 +1,205 @@
+#include "cpu_profiler.h"
+#include <imgui.h>
+#include <algorithm>
+#include <fstream>
+#include <mutex>
+#include <unordered_map>
+
+std::atomic<bool> CpuProfiler::s_enabled { true };
+
+namespace {
+
+struct ZoneEvent {
+  const char* name;
+  uint64_t begin;
+  uint64_t end;
+  uint32_t depth;
+};
+
+// single writer (the owning thread), readers only look at entries below count
+struct ThreadBuffer {
+  static const size_t Capacity = 1 << 16;
+  ZoneEvent events[Capacity];
+  std::atomic<uint64_t> count { 0 };
+  uint32_t depth { 0 };
+  uint32_t threadIndex { 0 };
+  std::string name;
+};
+
+struct Registry {
+  std::mutex mutex;
+  // buffers live until exit so traces can still show threads that finished
+  std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+  static const size_t FrameCapacity = 1024;
+  uint64_t frames[FrameCapacity];
+  std::atomic<uint64_t> frameCount { 0 };
+};
+
+Registry& GetRegistry() {
+  static Registry registry;
+  return registry;
+}
+
+ThreadBuffer* GetThreadBuffer() {
+  thread_local ThreadBuffer* buffer = nullptr;
+  if (!buffer) {
+    auto& registry = GetRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    registry.buffers.push_back(std::make_unique<ThreadBuffer>());
+    buffer = registry.buffers.back().get();
+    buffer->threadIndex = (uint32_t)registry.buffers.size() - 1;
+    buffer->name = "thread " + std::to_string(buffer->threadIndex);
+  }
+  return buffer;
+}
+
+// entries this close to being overwritten may be torn, readers skip them
+const uint64_t ReadMargin = 1024;
+
+template <typename Func>
+void ForEachEvent(const ThreadBuffer& buffer, Func&& func) {
+  uint64_t count = buffer.count.load(std::memory_order_acquire);
+  uint64_t first = count > ThreadBuffer::Capacity - ReadMargin ? count - (ThreadBuffer::Capacity - ReadMargin) : 0;
+  for (uint64_t i = first; i < count; i++)
+    func(buffer.events[i % ThreadBuffer::Capacity]);
+}
+
+struct ZoneSummary {
+  double totalMs { 0.0 };
+  uint64_t calls { 0 };
+};
+std::unordered_map<const char*, ZoneSummary> s_summary;
+uint64_t s_lastSummaryFrame { 0 };
+
+}
+
+uint64_t CpuProfiler::Begin() {
+  GetThreadBuffer()->depth++;
+  return Now();
+}
+
+void CpuProfiler::End(const char* name, uint64_t begin) {
+  uint64_t end = Now();
+  auto buffer = GetThreadBuffer();
+  buffer->depth--;
+  uint64_t index = buffer->count.load(std::memory_order_relaxed);
+  buffer->events[index % ThreadBuffer::Capacity] = { name, begin, end, buffer->depth };
+  buffer->count.store(index + 1, std::memory_order_release);
+}
+
+void CpuProfiler::SetThreadName(const char* name) {
+  auto buffer = GetThreadBuffer();
+  std::lock_guard<std::mutex> lock(GetRegistry().mutex);
+  buffer->name = name;
+}
+
+void CpuProfiler::FrameMark() {
+  auto& registry = GetRegistry();
+  uint64_t index = registry.frameCount.load(std::memory_order_relaxed);
+  registry.frames[index % Registry::FrameCapacity] = Now();
+  registry.frameCount.store(index + 1, std::memory_order_release);
+}
+
+void CpuProfiler::DrawUI(int topCount) {
+  auto& registry = GetRegistry();
+  bool enabled = s_enabled;
+  if (ImGui::Checkbox("cpu.enable", &enabled))
+    s_enabled = enabled;
+  ImGui::SameLine();
+  if (ImGui::Button("cpu.export trace"))
+    ExportChromeTrace("cpu_trace.json");
+
+  // fold the frames completed since the last call into running averages
+  uint64_t frameCount = registry.frameCount.load(std::memory_order_acquire);
+  if (frameCount >= 2 && frameCount - 1 > s_lastSummaryFrame) {
+    uint64_t firstFrame = std::max(s_lastSummaryFrame, frameCount - std::min<uint64_t>(frameCount, 60));
+    uint64_t rangeBegin = registry.frames[firstFrame % Registry::FrameCapacity];
+    uint64_t rangeEnd = registry.frames[(frameCount - 1) % Registry::FrameCapacity];
+    uint64_t frames = frameCount - 1 - firstFrame;
+    std::unordered_map<const char*, ZoneSummary> summary;
+    {
+      std::lock_guard<std::mutex> lock(registry.mutex);
+      for (auto& buffer : registry.buffers) {
+        ForEachEvent(*buffer, [&](const ZoneEvent& event) {
+          if (event.begin < rangeBegin || event.begin >= rangeEnd)
+            return;
+          auto& zone = summary[event.name];
+          zone.totalMs += (double)(event.end - event.begin) / 1000000.0;
+          zone.calls++;
+        });
+      }
+    }
+    // exponential average per frame so the list doesn't jump around
+    for (auto& entry : s_summary) {
+      entry.second.totalMs *= 0.9;
+      entry.second.calls = 0;
+    }
+    for (auto& entry : summary) {
+      auto& zone = s_summary[entry.first];
+      zone.totalMs += entry.second.totalMs / frames * 0.1;
+      zone.calls = entry.second.calls / std::max<uint64_t>(frames, 1);
+    }
+    s_lastSummaryFrame = frameCount - 1;
+  }
+
+  std::vector<std::pair<const char*, ZoneSummary>> zones(s_summary.begin(), s_summary.end());
+  std::sort(zones.begin(), zones.end(), [](const auto& a, const auto& b) { return a.second.totalMs > b.second.totalMs; });
+  if ((int)zones.size() > topCount)
+    zones.resize(topCount);
+  ImGui::Text("%-28s %9s %7s", "zone", "ms/frame", "calls");
+  for (auto& zone : zones)
+    ImGui::Text("%-28s %9.3f %7llu", zone.first, zone.second.totalMs, (unsigned long long)zone.second.calls);
+}
+
+bool CpuProfiler::ExportChromeTrace(const std::string& filename) {
+  std::ofstream file(filename);
+  if (!file.is_open()) {
+    SPDLOG_ERROR("failed to write cpu trace: {}", filename);
+    return false;
+  }
+  auto& registry = GetRegistry();
+  auto escape = [](const std::string& text) {
+    std::string result;
+    for (char c : text) {
+      if (c == '"' || c == '\\')
+        result += '\\';
+      result += c;
+    }
+    return result;
+  };
+
+  std::lock_guard<std::mutex> lock(registry.mutex);
+  uint64_t origin = UINT64_MAX;
+  for (auto& buffer : registry.buffers)
+    ForEachEvent(*buffer, [&](const ZoneEvent& event) { origin = std::min(origin, event.begin); });
+  if (origin == UINT64_MAX)
+    origin = 0;
+
+  file << "{ \"traceEvents\": [\n";
+  size_t eventCount = 0;
+  char text[160];
+  for (auto& buffer : registry.buffers) {
+    file << (eventCount++ ? ",\n" : "") << "  { \"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 0, \"tid\": "
+      << buffer->threadIndex << ", \"args\": { \"name\": \"" << escape(buffer->name) << "\" } }";
+    ForEachEvent(*buffer, [&](const ZoneEvent& event) {
+      snprintf(text, sizeof(text), "\"ph\": \"X\", \"pid\": 0, \"tid\": %u, \"ts\": %.3f, \"dur\": %.3f",
+        buffer->threadIndex, (double)(event.begin - origin) / 1000.0, (double)(event.end - event.begin) / 1000.0);
+      file << ",\n  { \"name\": \"" << escape(event.name) << "\", " << text << " }";
+      eventCount++;
+    });
+  }
+  // frame boundaries as global instant events
+  uint64_t frameCount = registry.frameCount.load(std::memory_order_acquire);
+  uint64_t firstFrame = frameCount > Registry::FrameCapacity ? frameCount - Registry::FrameCapacity : 0;
+  for (uint64_t i = firstFrame; i < frameCount; i++) {
+    uint64_t time = registry.frames[i % Registry::FrameCapacity];
+    if (time < origin)
+      continue;
+    snprintf(text, sizeof(text), "{ \"name\": \"frame %llu\", \"ph\": \"i\", \"s\": \"g\", \"pid\": 0, \"tid\": 0, \"ts\": %.3f }",
+      (unsigned long long)i, (double)(time - origin) / 1000.0);
+    file << (eventCount++ ? ",\n  " : "  ") << text;
+  }
+  file << "\n], \"displayTimeUnit\": \"ms\" }\n";
+  SPDLOG_INFO("cpu trace with {} events written to {}", eventCount, filename);
+  return true;
+}
@@ -0,0 +1,58 @@
+#ifndef __CPU_PROFILER_H__
+#define __CPU_PROFILER_H__
+
+#include "common.h"
+#include <atomic>
+#include <chrono>
+
+// scoped cpu zones. each thread appends finished zones to its own ring buffer,
+// so recording takes two clock reads and no locks; only the first zone on a
+// thread registers its buffer. names must be string literals (or otherwise
+// outlive the profiler) since only the pointer is stored.
+//   CPU_ZONE("load model");
+//   CpuProfiler::FrameMark();   once per frame on the main thread
+class CpuProfiler {
+public:
+  class Zone {
+  public:
+    explicit Zone(const char* name) : m_name(name) {
+      if (s_enabled.load(std::memory_order_relaxed))
+        m_begin = Begin();
+    }
+    ~Zone() {
+      if (m_begin)
+        End(m_name, m_begin);
+    }
+  private:
+    const char* m_name;
+    uint64_t m_begin { 0 };
+  };
+
+  static void SetEnabled(bool enabled) { s_enabled = enabled; }
+  static bool IsEnabled() { return s_enabled; }
+  // shows up as the thread's name in traces
+  static void SetThreadName(const char* name);
+  static void FrameMark();
+
+  // top zones by time per frame, averaged over the last frames
+  static void DrawUI(int topCount = 12);
+  // chrome://tracing / perfetto json of everything still in the buffers
+  static bool ExportChromeTrace(const std::string& filename);
+
+  static uint64_t Now() {
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+  }
+
+private:
+  static uint64_t Begin();
+  static void End(const char* name, uint64_t begin);
+
+  static std::atomic<bool> s_enabled;
+};
+
+#define CPU_ZONE_CONCAT_INNER(a, b) a##b
+#define CPU_ZONE_CONCAT(a, b) CPU_ZONE_CONCAT_INNER(a, b)
+#define CPU_ZONE(name) CpuProfiler::Zone CPU_ZONE_CONCAT(cpuZone, __LINE__)(name)
+
+#endif // __CPU_PROFILER_H__
@@ -0,0 +1,112 @@
+#include "egl_context.h"
+
+#ifdef HEADLESS_EGL
+#include <cstring>
+
+static bool HasExtension(const char* extensions, const char* name) {
+  if (!extensions)
+    return false;
+  size_t length = strlen(name);
+  for (const char* p = strstr(extensions, name); p; p = strstr(p + length, name)) {
+    if ((p == extensions || p[-1] == ' ') && (p[length] == ' ' || p[length] == '\0'))
+      return true;
+  }
+  return false;
+}
+
+EglContextUPtr EglContext::Create(const EglContext* share) {
+  auto context = EglContextUPtr(new EglContext());
+  if (!context->Init(share))
+    return nullptr;
+  return std::move(context);
+}
+
+EglContext::~EglContext() {
+  if (m_context != EGL_NO_CONTEXT) {
+    // a shared context may be destroyed on a thread that renders with another one
+    if (eglGetCurrentContext() == m_context)
+      ReleaseCurrent();
+    eglDestroyContext(m_display, m_context);
+  }
+  if (m_display != EGL_NO_DISPLAY && m_ownsDisplay)
+    eglTerminate(m_display);
+}
+
+bool EglContext::MakeCurrent() const {
+  // the bound api is per thread and eglMakeCurrent goes by it
+  eglBindAPI(EGL_OPENGL_API);
+  if (!eglMakeCurrent(m_display, EGL_NO_SURFACE, EGL_NO_SURFACE, m_context)) {
+    SPDLOG_ERROR("failed to make egl context current: 0x{:x}", eglGetError());
+    return false;
+  }
+  return true;
+}
+
+void EglContext::ReleaseCurrent() const {
+  eglMakeCurrent(m_display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+}
+
+bool EglContext::Init(const EglContext* share) {
+  if (share) {
+    // same display and api, only the context is new
+    m_display = share->m_display;
+    m_ownsDisplay = false;
+    return CreateContext(share->m_context);
+  }
+  auto clientExtensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+  if (HasExtension(clientExtensions, "EGL_MESA_platform_surfaceless")) {
+    auto getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+    if (getPlatformDisplay)
+      m_display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+  }
+  if (m_display == EGL_NO_DISPLAY)
+    m_display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+  EGLint major = 0, minor = 0;
+  if (m_display == EGL_NO_DISPLAY || !eglInitialize(m_display, &major, &minor)) {
+    SPDLOG_ERROR("failed to initialize egl: 0x{:x}", eglGetError());
+    return false;
+  }
+  SPDLOG_INFO("egl {}.{} ({})", major, minor, eglQueryString(m_display, EGL_VENDOR));
+  if (!HasExtension(eglQueryString(m_display, EGL_EXTENSIONS), "EGL_KHR_surfaceless_context")) {
+    SPDLOG_ERROR("egl display has no EGL_KHR_surfaceless_context");
+    return false;
+  }
+  if (!eglBindAPI(EGL_OPENGL_API)) {
+    SPDLOG_ERROR("egl has no desktop opengl");
+    return false;
+  }
+
+  if (!CreateContext(EGL_NO_CONTEXT))
+    return false;
+  return MakeCurrent();
+}
+
+bool EglContext::CreateContext(EGLContext share) {
+  EGLConfig config = EGL_NO_CONFIG_KHR;
+  if (!HasExtension(eglQueryString(m_display, EGL_EXTENSIONS), "EGL_KHR_no_config_context")) {
+    const EGLint configAttributes[] = {
+      EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+      EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+      EGL_NONE,
+    };
+    EGLint configCount = 0;
+    if (!eglChooseConfig(m_display, configAttributes, &config, 1, &configCount) || configCount == 0) {
+      SPDLOG_ERROR("no egl config for opengl");
+      return false;
+    }
+  }
+  const EGLint contextAttributes[] = {
+    EGL_CONTEXT_MAJOR_VERSION, 3,
+    EGL_CONTEXT_MINOR_VERSION, 3,
+    EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+    EGL_NONE,
+  };
+  m_context = eglCreateContext(m_display, config, share, contextAttributes);
+  if (m_context == EGL_NO_CONTEXT) {
+    SPDLOG_ERROR("failed to create egl context: 0x{:x}", eglGetError());
+    return false;
+  }
+  return true;
+}
+
+#endif // HEADLESS_EGL
@@ -0,0 +1,39 @@
+#ifndef __EGL_CONTEXT_H__
+#define __EGL_CONTEXT_H__
+
+#include "common.h"
+
+#ifdef HEADLESS_EGL
+#define EGL_NO_X11
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+// opengl 3.3 core context without a window system. surfaceless needs no
+// x11/wayland server and falls back to mesa's software rasterizer when there
+// is no gpu. the context is current on the calling thread after Create().
+// a context created with share sees the objects of share and is not made
+// current, e.g. for a loader thread to call MakeCurrent() on.
+CLASS_PTR(EglContext)
+class EglContext {
+public:
+  static EglContextUPtr Create(const EglContext* share = nullptr);
+  ~EglContext();
+
+  bool MakeCurrent() const;
+  void ReleaseCurrent() const;
+
+  static void* GetProcAddress(const char* name) { return (void*)eglGetProcAddress(name); }
+
+private:
+  EglContext() {}
+  bool Init(const EglContext* share);
+  bool CreateContext(EGLContext share);
+
+  EGLDisplay m_display { EGL_NO_DISPLAY };
+  EGLContext m_context { EGL_NO_CONTEXT };
+  bool m_ownsDisplay { true };   // shared contexts use the display of the first one
+};
+
+#endif // HEADLESS_EGL
+
+#endif // __EGL_CONTEXT_H__
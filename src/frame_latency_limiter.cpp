@@ -0,0 +1,125 @@
+#include "frame_latency_limiter.h"
+#include "async_log.h"
+#include "cpu_profiler.h"
+#include <imgui.h>
+
+int ParseMaxFramesInFlight(int argc, char** args, int defaultCount) {
+  for (int i = 1; i + 1 < argc; i++) {
+    if (std::string(args[i]) == "--max-frames-in-flight")
+      return glm::clamp(atoi(args[i + 1]), 0, 4);
+  }
+  return defaultCount;
+}
+
+FrameLatencyLimiterUPtr FrameLatencyLimiter::Create(int maxFramesInFlight) {
+  auto limiter = FrameLatencyLimiterUPtr(new FrameLatencyLimiter());
+  limiter->SetMaxFramesInFlight(maxFramesInFlight);
+  return std::move(limiter);
+}
+
+FrameLatencyLimiter::~FrameLatencyLimiter() {
+  for (auto& frame : m_pending)
+    glDeleteSync(frame.fence);
+}
+
+void FrameLatencyLimiter::SetMaxFramesInFlight(int count) {
+  m_maxFramesInFlight = glm::clamp(count, 0, 4);
+}
+
+void FrameLatencyLimiter::EndFrame(double eventTime) {
+  CPU_ZONE("frame latency limiter");
+  PendingFrame frame;
+  frame.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  frame.eventTime = eventTime;
+  if (eventTime > 0.0) {
+    if (m_freeQueries.empty())
+      m_freeQueries.push_back(Query::Create(GL_TIMESTAMP));
+    frame.done = std::move(m_freeQueries.back());
+    m_freeQueries.pop_back();
+    frame.done->Timestamp();
+    // the gpu clock has its own origin, paired with the cpu clock every frame
+    GLint64 gpuNow = 0;
+    glGetInteger64v(GL_TIMESTAMP, &gpuNow);
+    frame.gpuToCpu = glfwGetTime() - gpuNow * 1e-9;
+  }
+  m_pending.push_back(std::move(frame));
+
+  // frames that already finished, without waiting
+  while (!m_pending.empty()) {
+    GLint status = GL_UNSIGNALED;
+    glGetSynciv(m_pending.front().fence, GL_SYNC_STATUS, sizeof(status), nullptr, &status);
+    if (status != GL_SIGNALED)
+      break;
+    Retire(false);
+  }
+  // with no limit the fences are only kept for the latency numbers, the cap
+  // just bounds the queue if the driver lets the cpu run far ahead
+  int maxFramesInFlight = m_maxFramesInFlight;
+  int limit = maxFramesInFlight > 0 ? maxFramesInFlight : 8;
+  while ((int)m_pending.size() > limit)
+    Retire(true);
+}
+
+void FrameLatencyLimiter::Retire(bool wait) {
+  auto frame = std::move(m_pending.front());
+  m_pending.pop_front();
+  double waitStart = glfwGetTime();
+  if (wait) {
+    // the flush bit makes sure the fence was submitted, then wait in 100 ms slices
+    GLbitfield flags = GL_SYNC_FLUSH_COMMANDS_BIT;
+    while (true) {
+      GLenum result = glClientWaitSync(frame.fence, flags, 100000000);
+      if (result == GL_ALREADY_SIGNALED || result == GL_CONDITION_SATISFIED || result == GL_WAIT_FAILED)
+        break;
+      flags = 0;
+    }
+  }
+  glDeleteSync(frame.fence);
+
+  double now = glfwGetTime();
+  double doneTime = now;
+  if (frame.done) {
+    // the timestamp is behind the fence, its result is there once the fence signaled
+    doneTime = std::min(frame.gpuToCpu + frame.done->GetResult() * 1e-9, now);
+    m_freeQueries.push_back(std::move(frame.done));
+  }
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_waitTime += (now - waitStart) * 1000.0;
+  if (now - m_statsStart >= 1.0) {
+    m_waitPerSecond = (float)(m_waitTime / (now - m_statsStart));
+    m_waitTime = 0.0;
+    m_statsStart = now;
+  }
+  if (frame.eventTime > 0.0) {
+    float latency = (float)((doneTime - frame.eventTime) * 1000.0);
+    LOG_TELEMETRY("event to gpu done ms", latency, (float)m_maxFramesInFlight);
+    m_latencyHistory[m_historyIndex] = latency;
+    m_historyIndex = (m_historyIndex + 1) % HistorySize;
+    m_historyCount = std::min(m_historyCount + 1, HistorySize);
+  }
+}
+
+void FrameLatencyLimiter::DrawUI() {
+  const char* modes[] = { "driver default", "1: lowest latency", "2: balanced", "3: throughput", "4" };
+  int maxFrames = m_maxFramesInFlight;
+  if (ImGui::Combo("fl.max frames in flight", &maxFrames, modes, IM_ARRAYSIZE(modes)))
+    SetMaxFramesInFlight(maxFrames);
+
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if (m_historyCount == 0) {
+    ImGui::Text("move the mouse to measure input latency");
+  }
+  else {
+    std::vector<float> sorted(m_latencyHistory, m_latencyHistory + m_historyCount);
+    std::sort(sorted.begin(), sorted.end());
+    float average = 0.0f;
+    for (auto latency : sorted)
+      average += latency;
+    average /= sorted.size();
+    ImGui::Text("event to gpu done: %.1f ms avg, %.1f ms p95, %.1f ms max", average,
+      sorted[(size_t)(sorted.size() * 0.95f)], sorted.back());
+    ImGui::PlotLines("fl.latency ms", m_latencyHistory, m_historyCount,
+      m_historyCount == HistorySize ? m_historyIndex : 0, nullptr, 0.0f, FLT_MAX, ImVec2(0, 60));
+  }
+  ImGui::Text("cpu waiting on the gpu: %.1f ms/s", m_waitPerSecond);
+}
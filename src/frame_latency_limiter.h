@@ -0,0 +1,63 @@
+#ifndef __FRAME_LATENCY_LIMITER_H__
+#define __FRAME_LATENCY_LIMITER_H__
+
+#include "common.h"
+#include "query.h"
+#include <atomic>
+#include <deque>
+#include <mutex>
+
+// caps how many frames the driver may queue ahead of the gpu. a fence goes in
+// right after each swap; once more than maxFramesInFlight fences are pending
+// the cpu waits for the oldest, so a new frame starts at most that many frames
+// ahead of what the gpu finished. 1 has the lowest latency, the cpu prepares
+// one frame while the gpu renders the previous; 3 absorbs more cpu and gpu
+// spikes at the cost of latency; 0 leaves queueing to the driver.
+//
+// it also measures input latency: the time of the first input event a frame
+// consumed (see Context::RecordInputEvent) up to the moment the gpu finished
+// it. that is a timestamp query next to its fence, mapped to the cpu clock,
+// not when the fence was seen signaled, which is up to a frame later.
+// EndFrame is called on the thread that presents, the ui may run on another.
+CLASS_PTR(FrameLatencyLimiter)
+class FrameLatencyLimiter {
+public:
+  static FrameLatencyLimiterUPtr Create(int maxFramesInFlight = 2);
+  ~FrameLatencyLimiter();
+
+  // after glfwSwapBuffers. eventTime: glfwGetTime() of the oldest input event
+  // the frame used, 0 when it used none
+  void EndFrame(double eventTime);
+  void SetMaxFramesInFlight(int count);
+  int GetMaxFramesInFlight() const { return m_maxFramesInFlight; }
+  void DrawUI();
+
+private:
+  FrameLatencyLimiter() {}
+  void Retire(bool wait);
+
+  struct PendingFrame {
+    GLsync fence { nullptr };
+    double eventTime { 0.0 };
+    QueryUPtr done;             // GL_TIMESTAMP, only for frames with an event
+    double gpuToCpu { 0.0 };    // seconds, gpu timestamp to glfwGetTime()
+  };
+  std::deque<PendingFrame> m_pending;
+  std::vector<QueryUPtr> m_freeQueries;
+  std::atomic<int> m_maxFramesInFlight { 2 };   // set from the ui thread
+
+  // stats, shared with the ui thread
+  std::mutex m_mutex;
+  static const int HistorySize = 120;
+  float m_latencyHistory[HistorySize] {};   // ms, event to gpu completion
+  int m_historyIndex { 0 };
+  int m_historyCount { 0 };
+  double m_waitTime { 0.0 };   // ms spent waiting in the last second
+  double m_statsStart { 0.0 };
+  float m_waitPerSecond { 0.0f };
+};
+
+// --max-frames-in-flight N, returns the default when not given
+int ParseMaxFramesInFlight(int argc, char** args, int defaultCount);
+
+#endif // __FRAME_LATENCY_LIMITER_H__
@@ -0,0 +1,119 @@
+#include "frame_loop.h"
+#include "async_log.h"
+#include <imgui.h>
+
+FrameLoopUPtr FrameLoop::Create(float tickRate) {
+  auto loop = FrameLoopUPtr(new FrameLoop());
+  loop->SetTickRate(tickRate);
+  return std::move(loop);
+}
+
+void FrameLoop::SetTickRate(float tickRate) {
+  m_tickRate = glm::clamp(tickRate, 1.0f, 1000.0f);
+  m_step = 1.0 / m_tickRate;
+  m_time.dt = (float)m_step;
+}
+
+void FrameLoop::BeginFrame(double elapsed) {
+  // a debugger break or a long load should not replay seconds of simulation
+  elapsed = glm::clamp(elapsed, 0.0, 0.25);
+  m_time.frameDelta = (float)elapsed;
+  m_accumulator += elapsed;
+  m_ticksThisFrame = 0;
+  m_totalTime += elapsed;
+  if (IsIdle())
+    m_idleTime += elapsed;
+
+  m_statsTime += elapsed;
+  m_statsFrames++;
+  if (m_statsTime >= 1.0) {
+    m_ticksPerSecond = (float)(m_statsTicks / m_statsTime);
+    m_framesPerSecond = (float)(m_statsFrames / m_statsTime);
+    m_rendersPerSecond = (float)(m_statsRendered / m_statsTime);
+    {
+      std::lock_guard<std::mutex> lock(m_presentMutex);
+      m_presentsPerSecond = (float)(m_statsPresents / m_statsTime);
+      m_latencyAverage = m_statsPresents ? (float)(m_statsLatencySum / m_statsPresents * 1000.0) : 0.0f;
+      m_latencyMax = (float)(m_statsLatencyMax * 1000.0);
+      m_statsPresents = 0;
+      m_statsLatencySum = m_statsLatencyMax = 0.0;
+    }
+    m_statsTime = 0.0;
+    m_statsTicks = m_statsFrames = m_statsRendered = 0;
+  }
+}
+
+bool FrameLoop::Tick() {
+  double dt = m_step;
+  if (m_accumulator >= dt && m_ticksThisFrame >= m_maxTicksPerFrame) {
+    double dropped = m_accumulator - std::fmod(m_accumulator, dt);
+    m_droppedTime += dropped;
+    m_accumulator -= dropped;
+  }
+  if (m_accumulator < dt) {
+    m_time.alpha = (float)(m_accumulator / dt);
+    return false;
+  }
+  m_accumulator -= dt;
+  m_time.simulationTime += dt;
+  m_time.tick++;
+  m_ticksThisFrame++;
+  m_statsTicks++;
+  return true;
+}
+
+bool FrameLoop::ShouldRender(double now) {
+  if (IsIdle() || GetTimeToNextRender(now) > 0.0) {
+    m_skippedTotal++;
+    return false;
+  }
+  if (m_activeFrames > 0)
+    m_activeFrames--;
+  m_lastRender = now;
+  m_statsRendered++;
+  m_renderedTotal++;
+  return true;
+}
+
+void FrameLoop::RecordPresent(double inputTime, double presentTime) {
+  double latency = std::max(presentTime - inputTime, 0.0);
+  LOG_TELEMETRY("input latency ms", (float)(latency * 1000.0));
+  std::lock_guard<std::mutex> lock(m_presentMutex);
+  m_statsPresents++;
+  m_statsLatencySum += latency;
+  m_statsLatencyMax = std::max(m_statsLatencyMax, latency);
+}
+
+double FrameLoop::GetTimeToNextRender(double now) const {
+  if (m_maxRenderRate <= 0.0f || m_lastRender < 0.0)
+    return 0.0;
+  return std::max(m_lastRender + 1.0 / m_maxRenderRate - now, 0.0);
+}
+
+void FrameLoop::LogStats() const {
+  SPDLOG_INFO("frames rendered {}, skipped {}, re-presented {}, idle {:.0f}% of {:.1f} s",
+    m_renderedTotal, m_skippedTotal, m_representedTotal,
+    m_totalTime > 0.0 ? 100.0 * m_idleTime / m_totalTime : 0.0, m_totalTime);
+}
+
+void FrameLoop::DrawUI() {
+  float tickRate = m_tickRate;
+  if (ImGui::DragFloat("f.tick rate", &tickRate, 1.0f, 1.0f, 1000.0f, "%.0f Hz"))
+    SetTickRate(tickRate);
+  ImGui::DragFloat("f.max render rate", &m_maxRenderRate, 1.0f, 0.0f, 1000.0f,
+    m_maxRenderRate > 0.0f ? "%.0f fps" : "unlimited");
+  ImGui::DragInt("f.max ticks per frame", &m_maxTicksPerFrame, 0.1f, 1, 64);
+  ImGui::Text("ticks: %.0f/s, frames: %.0f/s, rendered: %.0f/s",
+    m_ticksPerSecond, m_framesPerSecond, m_rendersPerSecond);
+  ImGui::Text("presented: %.0f/s, input latency %.1f ms avg, %.1f ms max",
+    m_presentsPerSecond, m_latencyAverage, m_latencyMax);
+  ImGui::Checkbox("f.idle mode", &m_idleEnabled);
+  ImGui::DragInt("f.idle settle frames", &m_idleSettleFrames, 0.1f, 1, 120);
+  uint64_t frames = m_renderedTotal + m_skippedTotal;
+  ImGui::Text("rendered %llu, skipped %llu (%.0f%%), re-presented %llu",
+    (unsigned long long)m_renderedTotal, (unsigned long long)m_skippedTotal,
+    frames ? 100.0 * m_skippedTotal / frames : 0.0, (unsigned long long)m_representedTotal);
+  ImGui::Text("idle %.0f%% of %.0f s", m_totalTime > 0.0 ? 100.0 * m_idleTime / m_totalTime : 0.0, m_totalTime);
+  ImGui::Text("tick %llu, alpha %.2f, dropped %.2f s",
+    (unsigned long long)m_time.tick, m_time.alpha, m_droppedTime);
+}
@@ -0,0 +1,106 @@
+#ifndef __FRAME_LOOP_H__
+#define __FRAME_LOOP_H__
+
+#include "common.h"
+#include <mutex>
+
+struct FrameTime {
+  float dt { 1.0f / 60.0f };   // fixed simulation step, seconds
+  float alpha { 1.0f };        // where the rendered frame lies between the last two ticks
+  float frameDelta { 0.0f };   // real seconds since the previous frame
+  double simulationTime { 0.0 };
+  uint64_t tick { 0 };
+};
+
+// fixed timestep simulation with rendering decoupled from it. real time is
+// accumulated and consumed in whole ticks, the frame is then rendered with
+// state interpolated between the last two ticks by alpha:
+//   loop->BeginFrame(elapsed);
+//   while (loop->Tick())
+//     context->Update(loop->GetTime().dt);
+//   if (loop->ShouldRender(now))
+//     context->Render();
+// in idle mode rendering stops once no activity (input, animation, ui
+// interaction) was reported for a few frames, the caller then waits for
+// events instead of polling and re-presents the last frame when the window
+// needs repainting.
+CLASS_PTR(FrameLoop)
+class FrameLoop {
+public:
+  static FrameLoopUPtr Create(float tickRate = 60.0f);
+
+  // seconds since the previous frame, benchmarks and headless runs pass a fixed value
+  void BeginFrame(double elapsed);
+  // true while another tick is due this frame
+  bool Tick();
+  // false when the render rate limit skips this frame, the simulation still ran
+  bool ShouldRender(double now);
+  // seconds until the next frame may render, 0 without a limit
+  double GetTimeToNextRender(double now) const;
+  const FrameTime& GetTime() const { return m_time; }
+  // a frame was presented, from whichever thread presents. the time since its
+  // input was sampled is the input latency
+  void RecordPresent(double inputTime, double presentTime);
+
+  // keeps rendering for the next few frames
+  void NotifyActivity() { m_activeFrames = m_idleSettleFrames; }
+  void SetIdleEnabled(bool enabled) {
+    m_idleEnabled = enabled;
+    NotifyActivity();
+  }
+  bool IsIdle() const { return m_idleEnabled && m_activeFrames <= 0; }
+  // longest wait for events while idle, the simulation and stats still advance
+  double GetIdleTimeout() const { return 0.25; }
+  // after ShouldRender: this is the last frame before going idle, keep a copy
+  // of it for re-presenting
+  bool IsLastActiveFrame() const { return IsIdle(); }
+  void RecordRepresent() { m_representedTotal++; }
+  // rendered versus skipped frames and time spent idle, logged at exit
+  void LogStats() const;
+
+  void SetTickRate(float tickRate);
+  void SetMaxRenderRate(float renderRate) { m_maxRenderRate = renderRate; }
+  void DrawUI();
+
+private:
+  FrameLoop() {}
+
+  FrameTime m_time;
+  double m_step { 1.0 / 60.0 };   // m_time.dt without float rounding
+  double m_accumulator { 0.0 };
+  int m_ticksThisFrame { 0 };
+  // after a stall the simulation catches up at most this many ticks a frame,
+  // anything beyond that is dropped instead of spiralling
+  int m_maxTicksPerFrame { 8 };
+  double m_droppedTime { 0.0 };
+  float m_tickRate { 60.0f };
+  float m_maxRenderRate { 0.0f };   // frames per second, 0: every frame
+  double m_lastRender { -1.0 };
+  bool m_idleEnabled { false };
+  // frames rendered after the last activity, lets taa, queries and the ui settle
+  int m_idleSettleFrames { 10 };
+  int m_activeFrames { 0 };
+  uint64_t m_renderedTotal { 0 };
+  uint64_t m_skippedTotal { 0 };
+  uint64_t m_representedTotal { 0 };
+  double m_idleTime { 0.0 };
+  double m_totalTime { 0.0 };
+
+  // per second rates for the ui
+  double m_statsTime { 0.0 };
+  int m_statsTicks { 0 };
+  int m_statsFrames { 0 };
+  int m_statsRendered { 0 };
+  float m_ticksPerSecond { 0.0f };
+  float m_framesPerSecond { 0.0f };
+  float m_rendersPerSecond { 0.0f };
+  std::mutex m_presentMutex;
+  int m_statsPresents { 0 };
+  double m_statsLatencySum { 0.0 };
+  double m_statsLatencyMax { 0.0 };
+  float m_presentsPerSecond { 0.0f };
+  float m_latencyAverage { 0.0f };   // ms
+  float m_latencyMax { 0.0f };
+};
+
+#endif // __FRAME_LOOP_H__
@@ -1,14 +1,18 @@
 #include "framebuffer.h"
 
 FramebufferUPtr Framebuffer::Create(const TexturePtr colorAttachment) {
+  return Create(std::vector<TexturePtr> { colorAttachment });
+}
+FramebufferUPtr Framebuffer::Create(const std::vector<TexturePtr>& colorAttachments, const TexturePtr depthAttachment,
+  bool createDepthBuffer) {
   auto framebuffer = FramebufferUPtr(new Framebuffer());
-  if (!framebuffer->InitWithColorAttachment(colorAttachment))
+  if (!framebuffer->InitWithColorAttachments(colorAttachments, depthAttachment, createDepthBuffer))
     return nullptr;
   return std::move(framebuffer);
 }
-FramebufferUPtr Framebuffer::CreateMSAA(int width, int height, uint32_t format) {
+FramebufferUPtr Framebuffer::CreateMSAA(int width, int height, uint32_t format, int samples) {
   auto framebuffer = FramebufferUPtr(new Framebuffer());
-  if (!framebuffer->InitWithColorAttachmentMSAA( width,  height, format))
+  if (!framebuffer->InitWithColorAttachmentMSAA( width,  height, format, samples))
     return nullptr;
   return std::move(framebuffer);
 }
@@ -30,19 +34,50 @@ void Framebuffer::Bind() const {
     glBindFramebuffer(GL_FRAMEBUFFER, m_framebuffer);
 }
 
-bool Framebuffer::InitWithColorAttachment(const TexturePtr colorAttachment) {
-  m_colorAttachment = colorAttachment;
+bool Framebuffer::InitWithColorAttachments(const std::vector<TexturePtr>& colorAttachments, const TexturePtr depthAttachment,
+  bool createDepthBuffer) {
+  m_colorAttachments = colorAttachments;
+  m_depthAttachment = depthAttachment;
   glGenFramebuffers(1, &m_framebuffer);
   glBindFramebuffer(GL_FRAMEBUFFER, m_framebuffer);
 
-  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, colorAttachment->Get(), 0);
-
-  glGenRenderbuffers(1, &m_depthStencilBuffer);
-  glBindRenderbuffer(GL_RENDERBUFFER, m_depthStencilBuffer);
-  glRenderbufferStorage( GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, colorAttachment->GetWidth(), colorAttachment->GetHeight());
-  glBindRenderbuffer(GL_RENDERBUFFER, 0);
+  // multisample textures attach the same way, only the texture target differs
+  auto textureTarget = [](const TexturePtr& texture) -> GLenum {
+    return texture->GetSamples() > 1 ? GL_TEXTURE_2D_MULTISAMPLE : GL_TEXTURE_2D;
+  };
+  std::vector<GLenum> drawBuffers;
+  for (size_t i = 0; i < m_colorAttachments.size(); i++) {
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + (GLenum)i,
+      textureTarget(m_colorAttachments[i]), m_colorAttachments[i]->Get(), 0);
+    drawBuffers.push_back(GL_COLOR_ATTACHMENT0 + (GLenum)i);
+  }
+  if (drawBuffers.empty()) {
+    glDrawBuffer(GL_NONE);
+    glReadBuffer(GL_NONE);
+  }
+  else {
+    glDrawBuffers((GLsizei)drawBuffers.size(), drawBuffers.data());
+  }
 
-  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, m_depthStencilBuffer);
+  if (m_depthAttachment) {
+    auto attachment = m_depthAttachment->GetFormat() == GL_DEPTH24_STENCIL8 ?
+      GL_DEPTH_STENCIL_ATTACHMENT : GL_DEPTH_ATTACHMENT;
+    glFramebufferTexture2D(GL_FRAMEBUFFER, attachment, textureTarget(m_depthAttachment), m_depthAttachment->Get(), 0);
+  }
+  else if (createDepthBuffer && !m_colorAttachments.empty()) {
+    int width = m_colorAttachments[0]->GetWidth();
+    int height = m_colorAttachments[0]->GetHeight();
+    int samples = m_colorAttachments[0]->GetSamples();
+    glGenRenderbuffers(1, &m_depthStencilBuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, m_depthStencilBuffer);
+    if (samples > 1)
+      glRenderbufferStorageMultisample(GL_RENDERBUFFER, samples, GL_DEPTH24_STENCIL8, width, height);
+    else
+      glRenderbufferStorage( GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, m_depthStencilBuffer);
+  }
 
   auto result = glCheckFramebufferStatus(GL_FRAMEBUFFER);
   if (result != GL_FRAMEBUFFER_COMPLETE) {
@@ -55,17 +90,18 @@ bool Framebuffer::InitWithColorAttachment(const TexturePtr colorAttachment) {
   return true;
 }
 
-bool Framebuffer::InitWithColorAttachmentMSAA(int width, int height, uint32_t format)
+bool Framebuffer::InitWithColorAttachmentMSAA(int width, int height, uint32_t format, int samples)
 {
-  m_colorAttachment = Texture::CreateMSAA(width,height,format);
+  m_colorAttachments = { Texture::CreateMSAA(width,height,format,samples) };
+  auto colorAttachment = m_colorAttachments[0];
   glGenFramebuffers(1, &m_framebuffer);
   glBindFramebuffer(GL_FRAMEBUFFER, m_framebuffer);
 
-  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D_MULTISAMPLE, m_colorAttachment->Get(), 0);
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D_MULTISAMPLE, colorAttachment->Get(), 0);
 
   glGenRenderbuffers(1, &m_depthStencilBuffer);
   glBindRenderbuffer(GL_RENDERBUFFER, m_depthStencilBuffer);
-  glRenderbufferStorageMultisample( GL_RENDERBUFFER, 4, GL_DEPTH24_STENCIL8, m_colorAttachment->GetWidth(), m_colorAttachment->GetHeight());//*check sample
+  glRenderbufferStorageMultisample( GL_RENDERBUFFER, samples, GL_DEPTH24_STENCIL8, colorAttachment->GetWidth(), colorAttachment->GetHeight());
   glBindRenderbuffer(GL_RENDERBUFFER, 0);
 
   glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, m_depthStencilBuffer);
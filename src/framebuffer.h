@@ -7,23 +7,31 @@ CLASS_PTR(Framebuffer);
 class Framebuffer {
 public:
     static FramebufferUPtr Create(const TexturePtr colorAttachment);
-    static FramebufferUPtr CreateMSAA(int width, int height, uint32_t format);
+    // multiple render targets, a depth texture replaces the depth/stencil renderbuffer when given.
+    // without color attachments the framebuffer is depth-only
+    static FramebufferUPtr Create(const std::vector<TexturePtr>& colorAttachments, const TexturePtr depthAttachment = nullptr,
+        bool createDepthBuffer = true);
+    static FramebufferUPtr CreateMSAA(int width, int height, uint32_t format, int samples = 4);
 
     static void BindToDefault();
     ~Framebuffer();
 
     const uint32_t Get() const { return m_framebuffer; }
     void Bind() const;
-    const TexturePtr GetColorAttachment() const { return m_colorAttachment; }
+    const TexturePtr GetColorAttachment(int index = 0) const { return m_colorAttachments[index]; }
+    int GetColorAttachmentCount() const { return (int)m_colorAttachments.size(); }
+    const TexturePtr GetDepthAttachment() const { return m_depthAttachment; }
 
 private:
     Framebuffer() {}
-    bool InitWithColorAttachment(const TexturePtr colorAttachment);
-    bool InitWithColorAttachmentMSAA(int width, int height, uint32_t format);
+    bool InitWithColorAttachments(const std::vector<TexturePtr>& colorAttachments, const TexturePtr depthAttachment,
+        bool createDepthBuffer);
+    bool InitWithColorAttachmentMSAA(int width, int height, uint32_t format, int samples);
 
     uint32_t m_framebuffer { 0 };
     uint32_t m_depthStencilBuffer { 0 };
-    TexturePtr m_colorAttachment;
+    std::vector<TexturePtr> m_colorAttachments;
+    TexturePtr m_depthAttachment;
 };
 
 #endif // __FRAMEBUFFER_H__
\ No newline at end of file
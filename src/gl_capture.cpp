@@ -0,0 +1,333 @@
+#include "gl_capture.h"
+#include <cctype>
+#include <fstream>
+#include <unordered_map>
+
+using namespace GLCaptureFormat;
+
+const char* const GLCaptureFormat::CallNames[CallCount] = {
+  "",
+#define GL_CAPTURE_CALL_NAME(name, spec) #name,
+  GL_CAPTURE_FUNCTIONS(GL_CAPTURE_CALL_NAME)
+#undef GL_CAPTURE_CALL_NAME
+};
+
+const char* const GLCaptureFormat::CallSpecs[CallCount] = {
+  "",
+#define GL_CAPTURE_CALL_SPEC(name, spec) spec,
+  GL_CAPTURE_FUNCTIONS(GL_CAPTURE_CALL_SPEC)
+#undef GL_CAPTURE_CALL_SPEC
+};
+
+bool ParseGLCaptureOptions(int argc, char** args, GLCaptureOptions& options) {
+  bool capture = false;
+  for (int i = 1; i < argc; i++) {
+    std::string arg = args[i];
+    bool hasValue = i + 1 < argc;
+    if (arg == "--capture" && hasValue) {
+      capture = true;
+      options.filename = args[++i];
+    }
+    else if (arg == "--capture-frames" && hasValue) {
+      options.frames = std::max(atoi(args[++i]), 1);
+    }
+  }
+  return capture;
+}
+
+namespace {
+
+struct CaptureState {
+  std::ofstream file;
+  std::string filename;
+  std::vector<uint8_t> buffer;
+  int frames { 0 };
+  int frameLimit { 0 };
+  uint64_t calls { 0 };
+  uint64_t bytes { 0 };
+  // unhooked query used while recording pixel transfers
+  PFNGLGETINTEGERVPROC getIntegerv { nullptr };
+  // writable buffer mappings by buffer name, their bytes are recorded at the
+  // unmap. by target would mix up buffers mapped at once on the same target
+  struct Mapping {
+    const uint8_t* pointer;
+    size_t size;
+  };
+  std::unordered_map<uint64_t, Mapping> mappings;
+  std::vector<uint8_t> unmapped;   // of the glUnmapBuffer being recorded
+  bool hasUnmapped { false };
+};
+std::unique_ptr<CaptureState> s_capture;
+
+void WriteVarint(uint64_t value) {
+  auto& buffer = s_capture->buffer;
+  while (value >= 0x80) {
+    buffer.push_back((uint8_t)(value | 0x80));
+    value >>= 7;
+  }
+  buffer.push_back((uint8_t)value);
+}
+
+void WriteBytes(const void* data, size_t size) {
+  auto bytes = (const uint8_t*)data;
+  s_capture->buffer.insert(s_capture->buffer.end(), bytes, bytes + size);
+}
+
+void Flush() {
+  auto& buffer = s_capture->buffer;
+  s_capture->file.write((const char*)buffer.data(), buffer.size());
+  s_capture->bytes += buffer.size();
+  buffer.clear();
+}
+
+int GetInteger(GLenum name) {
+  GLint value = 0;
+  s_capture->getIntegerv(name, &value);
+  return value;
+}
+
+// bytes gl reads or writes for a width x height image in client memory
+size_t ImageSize(int width, int height, GLenum format, GLenum type, int alignment) {
+  if (width <= 0 || height <= 0)
+    return 0;
+  size_t components = 4;
+  switch (format) {
+    case GL_RED: case GL_RED_INTEGER: case GL_DEPTH_COMPONENT: case GL_STENCIL_INDEX: case GL_DEPTH_STENCIL:
+      components = 1; break;
+    case GL_RG: case GL_RG_INTEGER:
+      components = 2; break;
+    case GL_RGB: case GL_BGR: case GL_RGB_INTEGER: case GL_BGR_INTEGER:
+      components = 3; break;
+  }
+  size_t pixelSize = 0;
+  switch (type) {
+    case GL_UNSIGNED_BYTE: case GL_BYTE:
+      pixelSize = components; break;
+    case GL_UNSIGNED_SHORT: case GL_SHORT: case GL_HALF_FLOAT:
+      pixelSize = components * 2; break;
+    case GL_UNSIGNED_INT: case GL_INT: case GL_FLOAT:
+      pixelSize = components * 4; break;
+    case GL_UNSIGNED_SHORT_5_6_5: case GL_UNSIGNED_SHORT_4_4_4_4: case GL_UNSIGNED_SHORT_5_5_5_1:
+      pixelSize = 2; break;
+    case GL_FLOAT_32_UNSIGNED_INT_24_8_REV:
+      pixelSize = 8; break;
+    default:    // packed 32 bit formats
+      pixelSize = 4; break;
+  }
+  size_t rowSize = width * pixelSize;
+  size_t stride = (rowSize + alignment - 1) / alignment * alignment;
+  return stride * (height - 1) + rowSize;
+}
+
+// size of the memory behind pointer argument index, from the other arguments.
+// SIZE_MAX means the pointer is an offset into a bound pixel buffer
+size_t PointerSize(uint32_t id, int index, const uint64_t* args) {
+  switch (id) {
+    case Id_glBufferData: return (size_t)args[1];
+    case Id_glClearBufferfv: return args[0] == GL_COLOR ? 4 * sizeof(GLfloat) : sizeof(GLfloat);
+    case Id_glDrawBuffers: return (size_t)args[0] * sizeof(GLenum);
+    case Id_glGetAttribLocation:
+    case Id_glGetUniformLocation: return strlen((const char*)args[1]) + 1;
+    case Id_glPushDebugGroup:
+      return (int64_t)args[2] < 0 ? strlen((const char*)args[3]) + 1 : (size_t)args[2];
+    case Id_glTexParameterfv: return args[1] == GL_TEXTURE_BORDER_COLOR ? 4 * sizeof(GLfloat) : sizeof(GLfloat);
+    case Id_glUniform2fv: return (size_t)args[1] * 2 * sizeof(GLfloat);
+    case Id_glUniform3fv: return (size_t)args[1] * 3 * sizeof(GLfloat);
+    case Id_glUniform4fv: return (size_t)args[1] * 4 * sizeof(GLfloat);
+    case Id_glUniformMatrix4fv: return (size_t)args[1] * 16 * sizeof(GLfloat);
+    case Id_glTexImage2D:
+      if (GetInteger(GL_PIXEL_UNPACK_BUFFER_BINDING))
+        return SIZE_MAX;
+      return ImageSize((int)args[3], (int)args[4], (GLenum)args[6], (GLenum)args[7], GetInteger(GL_UNPACK_ALIGNMENT));
+    case Id_glTexSubImage2D:
+      if (GetInteger(GL_PIXEL_UNPACK_BUFFER_BINDING))
+        return SIZE_MAX;
+      return ImageSize((int)args[4], (int)args[5], (GLenum)args[6], (GLenum)args[7], GetInteger(GL_UNPACK_ALIGNMENT));
+    case Id_glCompressedTexImage2D:
+      if (GetInteger(GL_PIXEL_UNPACK_BUFFER_BINDING))
+        return SIZE_MAX;
+      return (size_t)args[6];
+    case Id_glReadPixels:
+      if (GetInteger(GL_PIXEL_PACK_BUFFER_BINDING))
+        return SIZE_MAX;
+      return ImageSize((int)args[2], (int)args[3], (GLenum)args[4], (GLenum)args[5], GetInteger(GL_PACK_ALIGNMENT));
+    case Id_glGetProgramInfoLog:
+    case Id_glGetShaderInfoLog: return index == 2 ? sizeof(GLsizei) : (size_t)args[1];
+    case Id_glGetQueryObjectui64v: return sizeof(GLuint64);
+    case Id_glGetSynciv: return index == 3 ? sizeof(GLsizei) : (size_t)args[2] * sizeof(GLint);
+  }
+  // glGet* with a handful of values at most
+  return 64;
+}
+
+void WritePointer(uint32_t id, char kind, int index, const uint64_t* args) {
+  const void* pointer = (const void*)(uintptr_t)args[index];
+  if (!pointer) {
+    s_capture->buffer.push_back(PayloadNull);
+    return;
+  }
+  if (kind == 'S') {
+    // all strings joined, replayed as a single one
+    auto strings = (const GLchar* const*)pointer;
+    auto lengths = (const GLint*)(uintptr_t)args[index + 1];
+    std::string source;
+    for (int64_t i = 0; i < (int64_t)args[index - 1]; i++) {
+      if (lengths && lengths[i] >= 0)
+        source.append(strings[i], lengths[i]);
+      else
+        source.append(strings[i]);
+    }
+    s_capture->buffer.push_back(PayloadData);
+    WriteVarint(source.size() + 1);
+    WriteBytes(source.c_str(), source.size() + 1);
+    return;
+  }
+  size_t size = isupper(kind) ? (size_t)args[0] * sizeof(GLuint) : PointerSize(id, index, args);
+  if (size == SIZE_MAX) {
+    s_capture->buffer.push_back(PayloadOffset);
+  }
+  else if (kind == 'o') {
+    s_capture->buffer.push_back(PayloadOutput);
+    WriteVarint(size);
+  }
+  else {
+    s_capture->buffer.push_back(PayloadData);
+    WriteVarint(size);
+    WriteBytes(pointer, size);
+  }
+}
+
+// the mapping is gone once the call returns, its bytes are taken before
+void BeforeCall(uint32_t id, const uint64_t* args) {
+  if (!s_capture || CallSpecs[id][1] != 'm')
+    return;
+  auto mapping = s_capture->mappings.find(GetInteger(BufferBinding((GLenum)args[0])));
+  s_capture->hasUnmapped = mapping != s_capture->mappings.end();
+  if (!s_capture->hasUnmapped)
+    return;
+  s_capture->unmapped.assign(mapping->second.pointer, mapping->second.pointer + mapping->second.size);
+  s_capture->mappings.erase(mapping);
+}
+
+void Record(uint32_t id, const uint64_t* args, int argCount, uint32_t signedMask, uint64_t result) {
+  if (!s_capture)
+    return;
+  auto spec = CallSpecs[id];
+  WriteVarint(id);
+  for (int i = 0; i < argCount; i++)
+    WriteVarint(signedMask & (1u << i) ? ZigZag(args[i]) : args[i]);
+  for (int i = 0; i < argCount; i++) {
+    char kind = spec[i + 1];
+    if (kind == 'd' || kind == 'o' || kind == 'S' || isupper(kind)) {
+      WritePointer(id, kind, i, args);
+    }
+    else if (kind == 'm') {
+      s_capture->buffer.push_back(s_capture->hasUnmapped ? PayloadData : PayloadNull);
+      if (s_capture->hasUnmapped) {
+        WriteVarint(s_capture->unmapped.size());
+        WriteBytes(s_capture->unmapped.data(), s_capture->unmapped.size());
+      }
+      s_capture->hasUnmapped = false;
+    }
+  }
+  // writes through the pointer land in the app's memory, unseen until the unmap
+  if (spec[0] == 'm' && result && (args[3] & GL_MAP_WRITE_BIT))
+    s_capture->mappings[GetInteger(BufferBinding((GLenum)args[0]))] = { (const uint8_t*)(uintptr_t)result, (size_t)args[2] };
+  if (spec[0] == 'l')
+    WriteVarint(ZigZag(result));
+  else if (spec[0] == 'p' || spec[0] == 's' || spec[0] == 'y')
+    WriteVarint(result);
+  s_capture->calls++;
+  if (s_capture->buffer.size() > (1 << 20))
+    Flush();
+}
+
+// forwards to the original entry point, then records the call
+template <uint32_t Id, typename Proc> struct Hook;
+template <uint32_t Id, typename R, typename... A>
+struct Hook<Id, R (APIENTRYP)(A...)> {
+  static inline R (APIENTRYP original)(A...) = nullptr;
+
+  static R APIENTRY Call(A... args) {
+    uint64_t values[sizeof...(A) + 1] = { ToRaw(args)... };
+    BeforeCall(Id, values);
+    if constexpr (std::is_void_v<R>) {
+      original(args...);
+      Record(Id, values, (int)sizeof...(A), SignedMask<A...>(), 0);
+    }
+    else {
+      R result = original(args...);
+      Record(Id, values, (int)sizeof...(A), SignedMask<A...>(), ToRaw(result));
+      return result;
+    }
+  }
+};
+
+void InstallHooks() {
+#define GL_CAPTURE_INSTALL(name, spec) \
+  Hook<Id_##name, decltype(name)>::original = name; \
+  if (name) \
+    name = &Hook<Id_##name, decltype(name)>::Call;
+  GL_CAPTURE_FUNCTIONS(GL_CAPTURE_INSTALL)
+#undef GL_CAPTURE_INSTALL
+}
+
+void RemoveHooks() {
+#define GL_CAPTURE_REMOVE(name, spec) name = Hook<Id_##name, decltype(name)>::original;
+  GL_CAPTURE_FUNCTIONS(GL_CAPTURE_REMOVE)
+#undef GL_CAPTURE_REMOVE
+}
+
+}
+
+bool GLCapture::Start(const GLCaptureOptions& options, int width, int height) {
+  if (s_capture)
+    return false;
+  auto capture = std::make_unique<CaptureState>();
+  capture->file.open(options.filename, std::ios::binary);
+  if (!capture->file.is_open()) {
+    SPDLOG_ERROR("failed to open gl capture file: {}", options.filename);
+    return false;
+  }
+  capture->filename = options.filename;
+  capture->frameLimit = options.frames;
+  capture->getIntegerv = glGetIntegerv;
+  s_capture = std::move(capture);
+
+  // header: default framebuffer size and the call table, so replay can check it
+  WriteBytes(Magic, sizeof(Magic));
+  WriteVarint(width);
+  WriteVarint(height);
+  WriteVarint(CallCount);
+  for (uint32_t i = 1; i < CallCount; i++) {
+    WriteVarint(strlen(CallNames[i]));
+    WriteBytes(CallNames[i], strlen(CallNames[i]));
+    WriteVarint(strlen(CallSpecs[i]));
+    WriteBytes(CallSpecs[i], strlen(CallSpecs[i]));
+  }
+  InstallHooks();
+  SPDLOG_INFO("capturing gl calls of {} frames to {}", options.frames, options.filename);
+  return true;
+}
+
+void GLCapture::EndFrame() {
+  if (!s_capture)
+    return;
+  WriteVarint(FrameEnd);
+  if (++s_capture->frames >= s_capture->frameLimit)
+    Stop();
+}
+
+void GLCapture::Stop() {
+  if (!s_capture)
+    return;
+  RemoveHooks();
+  Flush();
+  SPDLOG_INFO("gl capture: {} frames, {} calls, {:.1f} MB written to {}", s_capture->frames,
+    s_capture->calls, s_capture->bytes / (1024.0 * 1024.0), s_capture->filename);
+  s_capture = nullptr;
+}
+
+bool GLCapture::IsCapturing() {
+  return s_capture != nullptr;
+}
@@ -0,0 +1,248 @@
+#ifndef __GL_CAPTURE_H__
+#define __GL_CAPTURE_H__
+
+#include "common.h"
+#include <cstring>
+#include <type_traits>
+
+// records the gl call stream into a compact binary file for offline replay
+// (gl_replay). the glad function pointers of every entry point listed below
+// are swapped for wrappers that forward the call and then append it to the
+// stream, together with the data behind its pointer arguments (buffer and
+// texture uploads, shader sources, uniform values). capture starts right
+// after gladLoadGL so every object the captured frames use is created inside
+// the stream. calls are expected from one thread.
+//
+// each entry lists the result followed by one character per argument:
+//   -  result not recorded         v  plain value
+//   b t p s a f r q  buffer, texture, program, shader, vertex array,
+//                    framebuffer, renderbuffer or query name
+//   B T A F R Q      array of those names, argument 0 is the count
+//   y  sync object, as a result the fence created
+//   m  as a result the pointer of a buffer mapping, as an argument the target
+//      of the mapping being unmapped: what was written through it is recorded
+//   +  result: the array argument receives newly generated names
+//   l  uniform location, remapped per program on replay
+//   d  data read by gl       o  output written by gl
+//   S  shader source strings n  pointer replayed as null
+// entry points used anywhere in the program have to be added here, calls to
+// anything missing are silently left out of the capture.
+#define GL_CAPTURE_FUNCTIONS(X) \
+  X(glActiveTexture, "-v") \
+  X(glAttachShader, "-ps") \
+  X(glBeginConditionalRender, "-qv") \
+  X(glBeginQuery, "-vq") \
+  X(glBindBuffer, "-vb") \
+  X(glBindFramebuffer, "-vf") \
+  X(glBindRenderbuffer, "-vr") \
+  X(glBindSampler, "-vv") \
+  X(glBindTexture, "-vt") \
+  X(glBindVertexArray, "-a") \
+  X(glBlendEquation, "-v") \
+  X(glBlendEquationSeparate, "-vv") \
+  X(glBlendFunc, "-vv") \
+  X(glBlendFuncSeparate, "-vvvv") \
+  X(glBlitFramebuffer, "-vvvvvvvvvv") \
+  X(glBufferData, "-vvdv") \
+  X(glCheckFramebufferStatus, "-v") \
+  X(glClear, "-v") \
+  X(glClearBufferfi, "-vvvv") \
+  X(glClearBufferfv, "-vvd") \
+  X(glClearColor, "-vvvv") \
+  X(glClientWaitSync, "-yvv") \
+  X(glClipControl, "-vv") \
+  X(glColorMask, "-vvvv") \
+  X(glCompileShader, "-s") \
+  X(glCompressedTexImage2D, "-vvvvvvvd") \
+  X(glCreateProgram, "p") \
+  X(glCreateShader, "sv") \
+  X(glDeleteBuffers, "-vB") \
+  X(glDeleteFramebuffers, "-vF") \
+  X(glDeleteProgram, "-p") \
+  X(glDeleteQueries, "-vQ") \
+  X(glDeleteRenderbuffers, "-vR") \
+  X(glDeleteShader, "-s") \
+  X(glDeleteSync, "-y") \
+  X(glDeleteTextures, "-vT") \
+  X(glDeleteVertexArrays, "-vA") \
+  X(glDepthFunc, "-v") \
+  X(glDepthMask, "-v") \
+  X(glDetachShader, "-ps") \
+  X(glDisable, "-v") \
+  X(glDrawBuffer, "-v") \
+  X(glDrawBuffers, "-vd") \
+  X(glDrawElements, "-vvvv") \
+  X(glDrawElementsBaseVertex, "-vvvvv") \
+  X(glDrawElementsInstanced, "-vvvvv") \
+  X(glEnable, "-v") \
+  X(glEnableVertexAttribArray, "-v") \
+  X(glEndConditionalRender, "-") \
+  X(glEndQuery, "-v") \
+  X(glFenceSync, "yvv") \
+  X(glFinish, "-") \
+  X(glFlush, "-") \
+  X(glFramebufferRenderbuffer, "-vvvr") \
+  X(glFramebufferTexture2D, "-vvvtv") \
+  X(glGenBuffers, "+vB") \
+  X(glGenFramebuffers, "+vF") \
+  X(glGenQueries, "+vQ") \
+  X(glGenRenderbuffers, "+vR") \
+  X(glGenTextures, "+vT") \
+  X(glGenVertexArrays, "+vA") \
+  X(glGenerateMipmap, "-v") \
+  X(glGetAttribLocation, "-pd") \
+  X(glGetBooleanv, "-vo") \
+  X(glGetIntegerv, "-vo") \
+  X(glGetProgramInfoLog, "-pvoo") \
+  X(glGetProgramiv, "-pvo") \
+  X(glGetQueryObjectiv, "-qvo") \
+  X(glGetQueryObjectui64v, "-qvo") \
+  X(glGetShaderInfoLog, "-svoo") \
+  X(glGetShaderiv, "-svo") \
+  X(glGetString, "-v") \
+  X(glGetSynciv, "-yvvoo") \
+  X(glGetUniformLocation, "lpd") \
+  X(glIsEnabled, "-v") \
+  X(glLinkProgram, "-p") \
+  X(glMapBufferRange, "mvvvv") \
+  X(glPixelStorei, "-vv") \
+  X(glPolygonMode, "-vv") \
+  X(glPopDebugGroup, "-") \
+  X(glPushDebugGroup, "-vvvd") \
+  X(glQueryCounter, "-qv") \
+  X(glReadBuffer, "-v") \
+  X(glReadPixels, "-vvvvvvo") \
+  X(glRenderbufferStorage, "-vvvv") \
+  X(glRenderbufferStorageMultisample, "-vvvvv") \
+  X(glScissor, "-vvvv") \
+  X(glShaderSource, "-svSn") \
+  X(glTexBuffer, "-vvb") \
+  X(glTexImage2D, "-vvvvvvvvd") \
+  X(glTexImage2DMultisample, "-vvvvvv") \
+  X(glTexParameterfv, "-vvd") \
+  X(glTexParameteri, "-vvv") \
+  X(glTexSubImage2D, "-vvvvvvvvd") \
+  X(glUniform1f, "-lv") \
+  X(glUniform1i, "-lv") \
+  X(glUniform2fv, "-lvd") \
+  X(glUniform3fv, "-lvd") \
+  X(glUniform4fv, "-lvd") \
+  X(glUniformMatrix4fv, "-lvvd") \
+  X(glUnmapBuffer, "-m") \
+  X(glUseProgram, "-p") \
+  X(glVertexAttribDivisor, "-vv") \
+  X(glVertexAttribPointer, "-vvvvvv") \
+  X(glViewport, "-vvvv")
+
+// file layout: header, then records of a varint call id (0 ends a frame)
+// followed by the varint arguments, the payload of each pointer argument and
+// the recorded result. integers are zigzag encoded when signed, floats as
+// their bits, pointers as addresses.
+namespace GLCaptureFormat {
+  const char Magic[8] = { 'G', 'L', 'C', 'A', 'P', 'T', 'R', '1' };
+  const uint32_t FrameEnd = 0;
+  // how a pointer argument was recorded
+  enum PayloadMode : uint8_t {
+    PayloadNull = 0,
+    PayloadData = 1,      // varint size, then the bytes
+    PayloadOffset = 2,    // the argument is an offset into a bound buffer
+    PayloadOutput = 3,    // varint size of the memory gl writes to
+  };
+  // call ids start at 1, in the order of GL_CAPTURE_FUNCTIONS
+  enum CallId : uint32_t {
+    FirstCall = 0,
+#define GL_CAPTURE_CALL_ID(name, spec) Id_##name,
+    GL_CAPTURE_FUNCTIONS(GL_CAPTURE_CALL_ID)
+#undef GL_CAPTURE_CALL_ID
+    CallCount
+  };
+  extern const char* const CallNames[CallCount];
+  extern const char* const CallSpecs[CallCount];
+
+  // argument values as recorded: sign extended integers, float bits and addresses
+  template <typename T>
+  uint64_t ToRaw(T value) {
+    if constexpr (std::is_pointer_v<T>) {
+      return (uint64_t)(uintptr_t)value;
+    }
+    else if constexpr (std::is_floating_point_v<T>) {
+      uint64_t bits = 0;
+      memcpy(&bits, &value, sizeof(T));
+      return bits;
+    }
+    else if constexpr (std::is_signed_v<T>) {
+      return (uint64_t)(int64_t)value;
+    }
+    else {
+      return (uint64_t)value;
+    }
+  }
+
+  template <typename T>
+  T FromRaw(uint64_t raw) {
+    if constexpr (std::is_pointer_v<T>) {
+      return (T)(uintptr_t)raw;
+    }
+    else if constexpr (std::is_floating_point_v<T>) {
+      T value;
+      memcpy(&value, &raw, sizeof(T));
+      return value;
+    }
+    else {
+      return (T)raw;
+    }
+  }
+
+  // bit i is set when argument i is a signed integer and gets zigzag encoded
+  template <typename... A>
+  constexpr uint32_t SignedMask() {
+    constexpr bool isSigned[] = { false, (std::is_integral_v<A> && std::is_signed_v<A>)... };
+    uint32_t mask = 0;
+    for (size_t i = 0; i < sizeof...(A); i++) {
+      if (isSigned[i + 1])
+        mask |= 1u << i;
+    }
+    return mask;
+  }
+
+  // the binding query of a buffer target, mappings are tracked per buffer
+  inline GLenum BufferBinding(GLenum target) {
+    switch (target) {
+      case GL_ARRAY_BUFFER: return GL_ARRAY_BUFFER_BINDING;
+      case GL_ELEMENT_ARRAY_BUFFER: return GL_ELEMENT_ARRAY_BUFFER_BINDING;
+      case GL_PIXEL_PACK_BUFFER: return GL_PIXEL_PACK_BUFFER_BINDING;
+      case GL_PIXEL_UNPACK_BUFFER: return GL_PIXEL_UNPACK_BUFFER_BINDING;
+      case GL_UNIFORM_BUFFER: return GL_UNIFORM_BUFFER_BINDING;
+      case GL_COPY_READ_BUFFER: return GL_COPY_READ_BUFFER_BINDING;
+      case GL_COPY_WRITE_BUFFER: return GL_COPY_WRITE_BUFFER_BINDING;
+      case GL_TEXTURE_BUFFER: return GL_TEXTURE_BUFFER_BINDING;
+      case GL_TRANSFORM_FEEDBACK_BUFFER: return GL_TRANSFORM_FEEDBACK_BUFFER_BINDING;
+      default: return GL_NONE;
+    }
+  }
+
+  inline uint64_t ZigZag(uint64_t raw) { return (raw << 1) ^ (uint64_t)((int64_t)raw >> 63); }
+  inline uint64_t UnZigZag(uint64_t encoded) { return (encoded >> 1) ^ (~(encoded & 1) + 1); }
+}
+
+struct GLCaptureOptions {
+  std::string filename;
+  int frames { 60 };
+};
+
+// true when the command line asks for a capture:
+//   --capture FILE [--capture-frames N]
+bool ParseGLCaptureOptions(int argc, char** args, GLCaptureOptions& options);
+
+class GLCapture {
+public:
+  // width and height of the default framebuffer, the replay renders into an
+  // offscreen target of that size in its place
+  static bool Start(const GLCaptureOptions& options, int width, int height);
+  // call after the frame is presented, stops once enough frames are recorded
+  static void EndFrame();
+  static void Stop();
+  static bool IsCapturing();
+};
+
+#endif // __GL_CAPTURE_H__
@@ -0,0 +1,529 @@
+#include "gl_capture.h"
+#include "egl_context.h"
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <fstream>
+#include <unordered_map>
+
+// re-issues a --capture file without a window and times every call:
+//   gl_replay FILE [--finish] [--top N] [--csv FILE] [--software]
+// --finish waits for the gpu after each call so its time includes the gpu
+// work it caused, the way to bisect expensive draws and uploads.
+
+using namespace GLCaptureFormat;
+
+namespace {
+
+struct ReplayOptions {
+  std::string filename;
+  std::string csv;
+  bool finish { false };
+  bool software { false };
+  int top { 20 };
+};
+
+struct CallTiming {
+  uint32_t frame;
+  uint32_t index;   // within the frame
+  uint32_t id;
+  uint64_t ns;
+};
+
+class Replayer {
+public:
+  bool Load(const std::string& filename);
+  bool Run(const ReplayOptions& options);
+  void Report(const ReplayOptions& options) const;
+
+  // used by Player
+  void ReadArguments(uint32_t id, uint64_t* args, int argCount, uint32_t signedMask);
+  void FinishCall(uint32_t id, int argCount, uint64_t result);
+  uint64_t ReadResult(uint32_t id);
+
+private:
+  uint64_t ReadVarint();
+  std::string ReadString();
+  uint32_t MapName(char kind, uint32_t name) const;
+  uint64_t MapSync(uint64_t sync) const;
+  // the replayed buffer bound to target
+  GLuint GetBufferBinding(GLenum target) const;
+  GLint MapLocation(uint32_t program, GLint location) const;
+  uint8_t* Scratch(int index, size_t size);
+  bool CreateDefaultFramebuffer();
+
+  std::vector<uint8_t> m_data;
+  size_t m_position { 0 };
+  bool m_error { false };
+  int m_width { 0 };
+  int m_height { 0 };
+  // ids in the file to ids of this build
+  std::vector<uint32_t> m_callMap;
+
+  // captured names to replayed names, per kind
+  std::unordered_map<char, std::unordered_map<uint32_t, uint32_t>> m_names;
+  // (captured program, captured location) to the replayed location
+  std::unordered_map<uint64_t, GLint> m_locations;
+  // captured sync object addresses to the replayed ones
+  std::unordered_map<uint64_t, uint64_t> m_syncs;
+  // replayed buffer mappings by the replayed buffer name
+  std::unordered_map<uint64_t, uint8_t*> m_mappings;
+  uint32_t m_currentProgram { 0 };
+  GLuint m_defaultFramebuffer { 0 };
+
+  // state of the call being replayed
+  uint64_t m_captured[16];
+  uint64_t m_capturedResult { 0 };
+  std::vector<GLuint> m_generated;
+  std::vector<std::vector<uint64_t>> m_scratch;
+  const GLchar* m_source { nullptr };
+
+  std::vector<CallTiming> m_timings;
+  std::vector<double> m_frameCpuMs;
+  std::vector<double> m_frameGpuMs;
+};
+
+// returns the time the call took in ns
+using PlayFunc = uint64_t (*)(Replayer&, uint32_t, bool);
+
+// decodes one call's arguments and issues it through the glad pointer
+template <uint32_t Id, typename Proc> struct Player;
+template <uint32_t Id, typename R, typename... A>
+struct Player<Id, R (APIENTRYP)(A...)> {
+  static inline R (APIENTRYP* proc)(A...) = nullptr;
+
+  template <size_t... I>
+  static R Invoke(const uint64_t* args, std::index_sequence<I...>) {
+    return (*proc)(FromRaw<A>(args[I])...);
+  }
+
+  static uint64_t Play(Replayer& replayer, uint32_t id, bool finish) {
+    uint64_t args[sizeof...(A) + 1] = {};
+    replayer.ReadArguments(id, args, (int)sizeof...(A), SignedMask<A...>());
+    uint64_t result = 0;
+    auto start = std::chrono::steady_clock::now();
+    // entry points this driver lacks are skipped
+    if (*proc) {
+      if constexpr (std::is_void_v<R>)
+        Invoke(args, std::index_sequence_for<A...>());
+      else
+        result = ToRaw(Invoke(args, std::index_sequence_for<A...>()));
+      if (finish)
+        glFinish();
+    }
+    auto end = std::chrono::steady_clock::now();
+    replayer.FinishCall(id, (int)sizeof...(A), result);
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+  }
+};
+
+PlayFunc s_players[CallCount] = { nullptr };
+
+void InitPlayers() {
+#define GL_REPLAY_PLAYER(name, spec) \
+  Player<Id_##name, decltype(name)>::proc = &name; \
+  s_players[Id_##name] = &Player<Id_##name, decltype(name)>::Play;
+  GL_CAPTURE_FUNCTIONS(GL_REPLAY_PLAYER)
+#undef GL_REPLAY_PLAYER
+}
+
+uint64_t Replayer::ReadVarint() {
+  uint64_t value = 0;
+  for (int shift = 0; shift < 64; shift += 7) {
+    if (m_position >= m_data.size()) {
+      m_error = true;
+      return 0;
+    }
+    uint8_t byte = m_data[m_position++];
+    value |= (uint64_t)(byte & 0x7f) << shift;
+    if (!(byte & 0x80))
+      break;
+  }
+  return value;
+}
+
+std::string Replayer::ReadString() {
+  size_t length = (size_t)ReadVarint();
+  if (m_position + length > m_data.size()) {
+    m_error = true;
+    return "";
+  }
+  std::string text((const char*)m_data.data() + m_position, length);
+  m_position += length;
+  return text;
+}
+
+bool Replayer::Load(const std::string& filename) {
+  std::ifstream file(filename, std::ios::binary);
+  if (!file.is_open()) {
+    SPDLOG_ERROR("failed to open gl capture: {}", filename);
+    return false;
+  }
+  m_data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+  if (m_data.size() < sizeof(Magic) || memcmp(m_data.data(), Magic, sizeof(Magic)) != 0) {
+    SPDLOG_ERROR("{} is not a gl capture", filename);
+    return false;
+  }
+  m_position = sizeof(Magic);
+  m_width = (int)ReadVarint();
+  m_height = (int)ReadVarint();
+
+  // the file's call table may come from another build, match entries by name
+  uint32_t callCount = (uint32_t)ReadVarint();
+  m_callMap.assign(callCount, 0);
+  for (uint32_t i = 1; i < callCount && !m_error; i++) {
+    auto name = ReadString();
+    auto spec = ReadString();
+    for (uint32_t j = 1; j < CallCount; j++) {
+      if (name == CallNames[j] && spec == CallSpecs[j])
+        m_callMap[i] = j;
+    }
+    if (!m_callMap[i]) {
+      SPDLOG_ERROR("{} ({}) in the capture is unknown to this replayer", name, spec);
+      return false;
+    }
+  }
+  if (m_error) {
+    SPDLOG_ERROR("truncated gl capture header");
+    return false;
+  }
+  return true;
+}
+
+uint8_t* Replayer::Scratch(int index, size_t size) {
+  if ((int)m_scratch.size() <= index)
+    m_scratch.resize(index + 1);
+  // uint64_t storage keeps payloads aligned for gl
+  m_scratch[index].resize(size / sizeof(uint64_t) + 1);
+  return (uint8_t*)m_scratch[index].data();
+}
+
+uint32_t Replayer::MapName(char kind, uint32_t name) const {
+  // the window's framebuffer is replaced by an offscreen one
+  if (name == 0)
+    return kind == 'f' ? m_defaultFramebuffer : 0;
+  auto names = m_names.find(kind);
+  if (names == m_names.end())
+    return name;
+  auto mapped = names->second.find(name);
+  return mapped != names->second.end() ? mapped->second : name;
+}
+
+uint64_t Replayer::MapSync(uint64_t sync) const {
+  // an unknown fence is passed as null, gl reports the error instead of crashing
+  auto mapped = m_syncs.find(sync);
+  return mapped != m_syncs.end() ? mapped->second : 0;
+}
+
+GLuint Replayer::GetBufferBinding(GLenum target) const {
+  GLint buffer = 0;
+  glGetIntegerv(BufferBinding(target), &buffer);
+  return (GLuint)buffer;
+}
+
+GLint Replayer::MapLocation(uint32_t program, GLint location) const {
+  if (location < 0)
+    return location;
+  auto mapped = m_locations.find(((uint64_t)program << 32) | (uint32_t)location);
+  return mapped != m_locations.end() ? mapped->second : location;
+}
+
+void Replayer::ReadArguments(uint32_t id, uint64_t* args, int argCount, uint32_t signedMask) {
+  auto spec = CallSpecs[id];
+  for (int i = 0; i < argCount; i++) {
+    uint64_t value = ReadVarint();
+    args[i] = signedMask & (1u << i) ? UnZigZag(value) : value;
+    m_captured[i] = args[i];
+  }
+
+  for (int i = 0; i < argCount; i++) {
+    char kind = spec[i + 1];
+    if (kind == 'd' || kind == 'o' || kind == 'S' || isupper(kind)) {
+      uint8_t mode = m_position < m_data.size() ? m_data[m_position++] : PayloadNull;
+      if (mode == PayloadNull) {
+        args[i] = 0;
+      }
+      else if (mode == PayloadData || mode == PayloadOutput) {
+        size_t size = (size_t)ReadVarint();
+        if (mode == PayloadData && m_position + size > m_data.size()) {
+          m_error = true;
+          return;
+        }
+        auto scratch = Scratch(i, size);
+        if (mode == PayloadData) {
+          memcpy(scratch, m_data.data() + m_position, size);
+          m_position += size;
+        }
+        args[i] = (uint64_t)(uintptr_t)scratch;
+        if (kind == 'S') {
+          m_source = (const GLchar*)scratch;
+          args[i] = (uint64_t)(uintptr_t)&m_source;
+          args[i - 1] = 1;
+        }
+        else if (isupper(kind)) {
+          auto names = (GLuint*)scratch;
+          size_t count = size / sizeof(GLuint);
+          if (spec[0] == '+')
+            m_generated.assign(names, names + count);
+          else
+            std::transform(names, names + count, names, [&](GLuint name) { return MapName(tolower(kind), name); });
+        }
+      }
+      // offsets into a bound buffer stay as recorded
+    }
+    else if (kind == 'n') {
+      args[i] = 0;
+    }
+    else if (kind == 'l') {
+      args[i] = (uint64_t)(int64_t)MapLocation(m_currentProgram, (GLint)args[i]);
+    }
+    else if (kind == 'y') {
+      args[i] = MapSync(args[i]);
+    }
+    else if (kind == 'm') {
+      // the bytes the capture wrote through the mapping, copied in before the unmap
+      uint8_t mode = m_position < m_data.size() ? m_data[m_position++] : PayloadNull;
+      if (mode == PayloadData) {
+        size_t size = (size_t)ReadVarint();
+        if (m_position + size > m_data.size()) {
+          m_error = true;
+          return;
+        }
+        auto mapping = m_mappings.find(GetBufferBinding((GLenum)args[i]));
+        if (mapping != m_mappings.end() && mapping->second)
+          memcpy(mapping->second, m_data.data() + m_position, size);
+        m_position += size;
+      }
+      m_mappings.erase(GetBufferBinding((GLenum)args[i]));
+    }
+    else if (kind != 'v') {
+      args[i] = MapName(kind, (uint32_t)args[i]);
+    }
+  }
+  m_capturedResult = ReadResult(id);
+}
+
+uint64_t Replayer::ReadResult(uint32_t id) {
+  char kind = CallSpecs[id][0];
+  if (kind == 'l')
+    return UnZigZag(ReadVarint());
+  if (kind == 'p' || kind == 's' || kind == 'y')
+    return ReadVarint();
+  return 0;
+}
+
+void Replayer::FinishCall(uint32_t id, int argCount, uint64_t result) {
+  auto spec = CallSpecs[id];
+  if (spec[0] == '+') {
+    // names gl just generated for the ones the capture got
+    char kind = tolower(spec[argCount]);
+    auto replayed = (const GLuint*)m_scratch[argCount - 1].data();
+    for (size_t i = 0; i < m_generated.size(); i++)
+      m_names[kind][m_generated[i]] = replayed[i];
+  }
+  else if (spec[0] == 'p' || spec[0] == 's') {
+    m_names[spec[0]][(uint32_t)m_capturedResult] = (uint32_t)result;
+  }
+  else if (spec[0] == 'l') {
+    m_locations[((uint64_t)m_captured[0] << 32) | (uint32_t)m_capturedResult] = (GLint)result;
+  }
+  else if (spec[0] == 'y') {
+    m_syncs[m_capturedResult] = result;
+  }
+  else if (spec[0] == 'm') {
+    m_mappings[GetBufferBinding((GLenum)m_captured[0])] = (uint8_t*)(uintptr_t)result;
+  }
+  if (id == Id_glDeleteSync)
+    m_syncs.erase(m_captured[0]);
+  if (id == Id_glUseProgram)
+    m_currentProgram = (uint32_t)m_captured[0];
+}
+
+bool Replayer::CreateDefaultFramebuffer() {
+  GLuint renderbuffers[2];
+  glGenRenderbuffers(2, renderbuffers);
+  glBindRenderbuffer(GL_RENDERBUFFER, renderbuffers[0]);
+  glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, m_width, m_height);
+  glBindRenderbuffer(GL_RENDERBUFFER, renderbuffers[1]);
+  glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, m_width, m_height);
+  glBindRenderbuffer(GL_RENDERBUFFER, 0);
+  glGenFramebuffers(1, &m_defaultFramebuffer);
+  glBindFramebuffer(GL_FRAMEBUFFER, m_defaultFramebuffer);
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, renderbuffers[0]);
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, renderbuffers[1]);
+  bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+  glBindFramebuffer(GL_FRAMEBUFFER, m_defaultFramebuffer);
+  if (!complete)
+    SPDLOG_ERROR("failed to create the {}x{} replay framebuffer", m_width, m_height);
+  return complete;
+}
+
+bool Replayer::Run(const ReplayOptions& options) {
+  if (!CreateDefaultFramebuffer())
+    return false;
+  InitPlayers();
+
+  // frame gpu times from timestamps, the capture may already use time elapsed queries
+  GLuint timestamps[2];
+  glGenQueries(2, timestamps);
+  auto frameStart = std::chrono::steady_clock::now();
+  glQueryCounter(timestamps[0], GL_TIMESTAMP);
+  uint32_t frame = 0;
+  uint32_t index = 0;
+  while (m_position < m_data.size() && !m_error) {
+    uint32_t fileId = (uint32_t)ReadVarint();
+    if (fileId == FrameEnd) {
+      glQueryCounter(timestamps[1], GL_TIMESTAMP);
+      GLuint64 begin = 0, end = 0;
+      glGetQueryObjectui64v(timestamps[0], GL_QUERY_RESULT, &begin);
+      glGetQueryObjectui64v(timestamps[1], GL_QUERY_RESULT, &end);
+      auto now = std::chrono::steady_clock::now();
+      m_frameCpuMs.push_back(std::chrono::duration<double, std::milli>(now - frameStart).count());
+      m_frameGpuMs.push_back((end - begin) / 1000000.0);
+      frameStart = std::chrono::steady_clock::now();
+      glQueryCounter(timestamps[0], GL_TIMESTAMP);
+      frame++;
+      index = 0;
+      continue;
+    }
+    uint32_t id = fileId < m_callMap.size() ? m_callMap[fileId] : 0;
+    if (!id) {
+      SPDLOG_ERROR("invalid call id {} at offset {}", fileId, m_position);
+      return false;
+    }
+    uint64_t ns = s_players[id](*this, id, options.finish);
+    m_timings.push_back({ frame, index++, id, ns });
+  }
+  glDeleteQueries(2, timestamps);
+  if (m_error) {
+    SPDLOG_ERROR("gl capture is truncated or corrupt at offset {}", m_position);
+    return false;
+  }
+  return true;
+}
+
+void Replayer::Report(const ReplayOptions& options) const {
+  SPDLOG_INFO("replayed {} calls in {} frames{}", m_timings.size(), m_frameCpuMs.size(),
+    options.finish ? ", finishing after every call" : "");
+  for (size_t i = 0; i < m_frameCpuMs.size(); i++) {
+    // frame 0 also holds startup: resource creation and shader compiles
+    SPDLOG_INFO("frame {:4}: cpu {:8.3f} ms, gpu {:8.3f} ms", i, m_frameCpuMs[i], m_frameGpuMs[i]);
+  }
+
+  struct Total {
+    uint64_t calls { 0 };
+    uint64_t ns { 0 };
+  };
+  std::vector<Total> totals(CallCount);
+  for (auto& timing : m_timings) {
+    totals[timing.id].calls++;
+    totals[timing.id].ns += timing.ns;
+  }
+  std::vector<uint32_t> ids;
+  for (uint32_t id = 1; id < CallCount; id++) {
+    if (totals[id].calls)
+      ids.push_back(id);
+  }
+  std::sort(ids.begin(), ids.end(), [&](uint32_t a, uint32_t b) { return totals[a].ns > totals[b].ns; });
+  SPDLOG_INFO("{:<34} {:>8} {:>12}", "function", "calls", "total ms");
+  for (auto id : ids)
+    SPDLOG_INFO("{:<34} {:>8} {:>12.3f}", CallNames[id], totals[id].calls, totals[id].ns / 1000000.0);
+
+  std::vector<size_t> slowest(m_timings.size());
+  for (size_t i = 0; i < slowest.size(); i++)
+    slowest[i] = i;
+  size_t top = std::min(slowest.size(), (size_t)std::max(options.top, 0));
+  std::partial_sort(slowest.begin(), slowest.begin() + top, slowest.end(),
+    [&](size_t a, size_t b) { return m_timings[a].ns > m_timings[b].ns; });
+  SPDLOG_INFO("slowest calls:");
+  for (size_t i = 0; i < top; i++) {
+    auto& timing = m_timings[slowest[i]];
+    SPDLOG_INFO("  frame {:4} call {:6} {:<34} {:10.1f} us", timing.frame, timing.index,
+      CallNames[timing.id], timing.ns / 1000.0);
+  }
+
+  if (!options.csv.empty()) {
+    std::ofstream file(options.csv);
+    if (!file.is_open()) {
+      SPDLOG_ERROR("failed to write {}", options.csv);
+      return;
+    }
+    file << "frame,call,function,ns\n";
+    for (auto& timing : m_timings)
+      file << timing.frame << ',' << timing.index << ',' << CallNames[timing.id] << ',' << timing.ns << '\n';
+  }
+}
+
+}
+
+int main(int argc, char** args) {
+  ReplayOptions options;
+  for (int i = 1; i < argc; i++) {
+    std::string arg = args[i];
+    bool hasValue = i + 1 < argc;
+    if (arg == "--finish")
+      options.finish = true;
+    else if (arg == "--software")
+      options.software = true;
+    else if (arg == "--top" && hasValue)
+      options.top = atoi(args[++i]);
+    else if (arg == "--csv" && hasValue)
+      options.csv = args[++i];
+    else
+      options.filename = arg;
+  }
+  if (options.filename.empty()) {
+    SPDLOG_ERROR("usage: gl_replay FILE [--finish] [--top N] [--csv FILE] [--software]");
+    return -1;
+  }
+
+  Replayer replayer;
+  if (!replayer.Load(options.filename))
+    return -1;
+
+#ifdef HEADLESS_EGL
+  if (options.software)
+    setenv("LIBGL_ALWAYS_SOFTWARE", "1", 1);
+  auto egl = EglContext::Create();
+  if (!egl)
+    return -1;
+  if (!gladLoadGLLoader((GLADloadproc)EglContext::GetProcAddress)) {
+    SPDLOG_ERROR("failed to initialize glad");
+    return -1;
+  }
+#else
+  // no egl: a hidden window provides the context
+  if (!glfwInit()) {
+    SPDLOG_ERROR("failed to initialize glfw");
+    return -1;
+  }
+  glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+  glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+  glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+  glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+  auto window = glfwCreateWindow(64, 64, "gl_replay", nullptr, nullptr);
+  if (!window) {
+    SPDLOG_ERROR("failed to create glfw window");
+    glfwTerminate();
+    return -1;
+  }
+  glfwMakeContextCurrent(window);
+  if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) {
+    SPDLOG_ERROR("failed to initialize glad");
+    glfwTerminate();
+    return -1;
+  }
+#endif
+  SPDLOG_INFO("replaying {} on {}", options.filename, reinterpret_cast<const char*>(glGetString(GL_RENDERER)));
+
+  int result = 0;
+  if (replayer.Run(options))
+    replayer.Report(options);
+  else
+    result = -1;
+
+#ifndef HEADLESS_EGL
+  glfwTerminate();
+#endif
+  return result;
+}
@@ -0,0 +1,176 @@
+#include "gpu_profiler.h"
+#include <imgui.h>
+#include <fstream>
+
+GpuProfilerUPtr GpuProfiler::Create(int frameLatency) {
+  auto profiler = GpuProfilerUPtr(new GpuProfiler());
+  profiler->m_frames.resize(std::max(frameLatency, 2));
+  for (auto& frame : profiler->m_frames) {
+    frame.begin = Query::Create(GL_TIMESTAMP);
+    frame.end = Query::Create(GL_TIMESTAMP);
+  }
+  profiler->m_debugGroups = GLAD_GL_KHR_debug || GLAD_GL_VERSION_4_3;
+  return std::move(profiler);
+}
+
+GpuProfiler::~GpuProfiler() {
+}
+
+void GpuProfiler::NewFrame() {
+  if (m_current >= 0) {
+    // scopes left open close with the frame
+    while (!m_stack.empty())
+      PopScope();
+    auto& frame = m_frames[m_current];
+    frame.end->Timestamp();
+    frame.pending = true;
+  }
+
+  m_current = (m_current + 1) % (int)m_frames.size();
+  auto& frame = m_frames[m_current];
+  if (frame.pending) {
+    // timestamps complete in order, so the frame end being ready means every scope is
+    if (frame.end->IsResultAvailable())
+      ReadFrame(frame);
+    else
+      m_droppedFrames++;
+    frame.pending = false;
+  }
+  frame.markerCount = 0;
+  frame.frameIndex = m_frameIndex++;
+  frame.begin->Timestamp();
+}
+
+void GpuProfiler::PushScope(const std::string& name) {
+  if (m_current < 0)
+    return;
+  auto& frame = m_frames[m_current];
+  if (frame.markerCount == (int)frame.markers.size()) {
+    Marker marker;
+    marker.begin = Query::Create(GL_TIMESTAMP);
+    marker.end = Query::Create(GL_TIMESTAMP);
+    frame.markers.push_back(std::move(marker));
+  }
+  auto& marker = frame.markers[frame.markerCount];
+  marker.name = name;
+  marker.depth = (int)m_stack.size();
+  m_stack.push_back(frame.markerCount++);
+  if (m_debugGroups)
+    glPushDebugGroup(GL_DEBUG_SOURCE_APPLICATION, 0, -1, name.c_str());
+  marker.begin->Timestamp();
+}
+
+void GpuProfiler::PopScope() {
+  if (m_current < 0 || m_stack.empty())
+    return;
+  auto& frame = m_frames[m_current];
+  frame.markers[m_stack.back()].end->Timestamp();
+  m_stack.pop_back();
+  if (m_debugGroups)
+    glPopDebugGroup();
+}
+
+void GpuProfiler::ReadFrame(Frame& frame) {
+  FrameResult result;
+  result.frameIndex = frame.frameIndex;
+  result.begin = frame.begin->GetResult();
+  result.end = frame.end->GetResult();
+  result.scopes.reserve(frame.markerCount);
+  for (int i = 0; i < frame.markerCount; i++) {
+    auto& marker = frame.markers[i];
+    ScopeResult scope { marker.name, marker.depth, marker.begin->GetResult(), marker.end->GetResult() };
+    float ms = (float)((double)(scope.end - scope.begin) / 1000000.0);
+    auto it = m_averages.find(scope.name);
+    if (it == m_averages.end())
+      m_averages[scope.name] = ms;
+    else
+      it->second += (ms - it->second) * 0.05f;
+    result.scopes.push_back(std::move(scope));
+  }
+  if (m_paused)
+    return;
+  m_history.push_back(std::move(result));
+  while (m_history.size() > m_historySize)
+    m_history.pop_front();
+}
+
+void GpuProfiler::DrawUI() {
+  ImGui::Checkbox("g.pause", &m_paused);
+  ImGui::SameLine();
+  if (ImGui::Button("g.export trace"))
+    ExportChromeTrace("gpu_trace.json");
+  if (m_history.empty()) {
+    ImGui::Text("waiting for results");
+    return;
+  }
+  auto& frame = m_history.back();
+  double frameMs = (double)(frame.end - frame.begin) / 1000000.0;
+  ImGui::Text("frame %.3f ms, %d dropped", frameMs, m_droppedFrames);
+
+  // flame chart of the latest frame: x is time, one row per nesting level
+  const float rowHeight = ImGui::GetTextLineHeight() + 4.0f;
+  int maxDepth = 0;
+  for (auto& scope : frame.scopes)
+    maxDepth = std::max(maxDepth, scope.depth);
+  float width = std::max(ImGui::GetContentRegionAvail().x, 100.0f);
+  auto origin = ImGui::GetCursorScreenPos();
+  auto drawList = ImGui::GetWindowDrawList();
+  double scale = width / std::max((double)(frame.end - frame.begin), 1.0);
+  for (auto& scope : frame.scopes) {
+    float x0 = origin.x + (float)((double)(scope.begin - frame.begin) * scale);
+    float x1 = origin.x + (float)((double)(scope.end - frame.begin) * scale);
+    x1 = std::max(x1, x0 + 1.0f);
+    float y0 = origin.y + scope.depth * rowHeight;
+    // stable color per name
+    auto hash = std::hash<std::string>()(scope.name);
+    auto color = ImColor::HSV((hash % 360) / 360.0f, 0.5f, 0.8f);
+    drawList->AddRectFilled(ImVec2(x0, y0), ImVec2(x1, y0 + rowHeight - 1.0f), color);
+    drawList->PushClipRect(ImVec2(x0, y0), ImVec2(x1, y0 + rowHeight), true);
+    drawList->AddText(ImVec2(x0 + 2.0f, y0 + 2.0f), IM_COL32(0, 0, 0, 255), scope.name.c_str());
+    drawList->PopClipRect();
+    if (ImGui::IsMouseHoveringRect(ImVec2(x0, y0), ImVec2(x1, y0 + rowHeight)))
+      ImGui::SetTooltip("%s: %.3f ms", scope.name.c_str(), (double)(scope.end - scope.begin) / 1000000.0);
+  }
+  ImGui::Dummy(ImVec2(width, (maxDepth + 1) * rowHeight));
+
+  // smoothed per scope, in the order of the latest frame
+  for (auto& scope : frame.scopes) {
+    float average = m_averages[scope.name];
+    ImGui::Text("%*s%-24s %7.3f ms", scope.depth * 2, "", scope.name.c_str(), average);
+  }
+}
+
+bool GpuProfiler::ExportChromeTrace(const std::string& filename) const {
+  if (m_history.empty())
+    return false;
+  std::ofstream file(filename);
+  if (!file.is_open()) {
+    SPDLOG_ERROR("failed to write gpu trace: {}", filename);
+    return false;
+  }
+  // complete events in microseconds, nesting comes from the time ranges
+  uint64_t origin = m_history.front().begin;
+  auto event = [&](const std::string& name, uint64_t begin, uint64_t end, bool first) {
+    char text[96];
+    snprintf(text, sizeof(text), "\"ph\": \"X\", \"pid\": 0, \"tid\": 0, \"ts\": %.3f, \"dur\": %.3f",
+      (double)(begin - origin) / 1000.0, (double)(end - begin) / 1000.0);
+    std::string escaped;
+    for (char c : name) {
+      if (c == '"' || c == '\\')
+        escaped += '\\';
+      escaped += c;
+    }
+    file << (first ? "" : ",\n") << "  { \"name\": \"" << escaped << "\", " << text << " }";
+  };
+  file << "{ \"traceEvents\": [\n";
+  bool first = true;
+  for (auto& frame : m_history) {
+    event("frame " + std::to_string(frame.frameIndex), frame.begin, frame.end, first);
+    first = false;
+    for (auto& scope : frame.scopes)
+      event(scope.name, scope.begin, scope.end, false);
+  }
+  file << "\n], \"displayTimeUnit\": \"ms\" }\n";
+  SPDLOG_INFO("gpu trace of {} frames written to {}", m_history.size(), filename);
+  return true;
+}
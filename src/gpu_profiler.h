@@ -0,0 +1,89 @@
+#ifndef __GPU_PROFILER_H__
+#define __GPU_PROFILER_H__
+
+#include "common.h"
+#include "query.h"
+#include <deque>
+#include <unordered_map>
+
+// nested gpu timing scopes. every scope records a begin/end timestamp pair and
+// opens a KHR_debug group so captures show the same structure. frames are
+// buffered frameLatency deep and read back only once the gpu finished them;
+// a frame whose results are still missing when its slot comes around again is dropped
+CLASS_PTR(GpuProfiler)
+class GpuProfiler {
+public:
+  static GpuProfilerUPtr Create(int frameLatency = 3);
+  ~GpuProfiler();
+
+  // closes the previous frame and starts recording the next one
+  void NewFrame();
+  void PushScope(const std::string& name);
+  void PopScope();
+
+  // scope for the rest of the block, profiler may be null
+  class Scope {
+  public:
+    Scope(GpuProfiler* profiler, const std::string& name) : m_profiler(profiler) {
+      if (m_profiler)
+        m_profiler->PushScope(name);
+    }
+    ~Scope() {
+      if (m_profiler)
+        m_profiler->PopScope();
+    }
+  private:
+    GpuProfiler* m_profiler;
+  };
+
+  void DrawUI();
+  // chrome://tracing / perfetto json of the buffered history
+  bool ExportChromeTrace(const std::string& filename) const;
+  int GetDroppedFrameCount() const { return m_droppedFrames; }
+
+private:
+  GpuProfiler() {}
+
+  struct Marker {
+    std::string name;
+    int depth { 0 };
+    QueryUPtr begin;
+    QueryUPtr end;
+  };
+  struct Frame {
+    QueryUPtr begin;
+    QueryUPtr end;
+    std::vector<Marker> markers;   // grows once, entries are reused
+    int markerCount { 0 };
+    bool pending { false };
+    uint64_t frameIndex { 0 };
+  };
+  struct ScopeResult {
+    std::string name;
+    int depth;
+    uint64_t begin;   // gpu timestamps, ns
+    uint64_t end;
+  };
+  struct FrameResult {
+    uint64_t frameIndex;
+    uint64_t begin;
+    uint64_t end;
+    std::vector<ScopeResult> scopes;
+  };
+
+  void ReadFrame(Frame& frame);
+
+  std::vector<Frame> m_frames;
+  int m_current { -1 };
+  std::vector<int> m_stack;
+  uint64_t m_frameIndex { 0 };
+  bool m_debugGroups { false };
+  int m_droppedFrames { 0 };
+
+  std::deque<FrameResult> m_history;
+  size_t m_historySize { 300 };
+  std::unordered_map<std::string, float> m_averages;  // smoothed ms per scope
+  bool m_paused { false };
+};
+
+#endif // __GPU_PROFILER_H__
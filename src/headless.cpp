@@ -0,0 +1,134 @@
+#include "headless.h"
+#include "context.h"
+#include "image.h"
+#include "cpu_profiler.h"
+#include "egl_context.h"
+#include <imgui.h>
+#include <chrono>
+
+bool ParseHeadlessOptions(int argc, char** args, HeadlessOptions& options) {
+  bool headless = false;
+  for (int i = 1; i < argc; i++) {
+    std::string arg = args[i];
+    bool hasValue = i + 1 < argc;
+    if (arg == "--headless" && hasValue) {
+      headless = true;
+      options.frames = std::max(atoi(args[++i]), 1);
+    }
+    else if (arg == "--size" && hasValue) {
+      int width = 0, height = 0;
+      if (sscanf(args[++i], "%dx%d", &width, &height) == 2 && width > 0 && height > 0) {
+        options.width = width;
+        options.height = height;
+      }
+      else {
+        SPDLOG_ERROR("invalid --size {}, expected WxH", args[i]);
+      }
+    }
+    else if (arg == "--output" && hasValue) {
+      options.outputDirectory = args[++i];
+    }
+    else if (arg == "--save-every" && hasValue) {
+      options.saveEvery = std::max(atoi(args[++i]), 0);
+    }
+    else if (arg == "--software") {
+      options.software = true;
+    }
+  }
+  return headless;
+}
+
+#ifdef HEADLESS_EGL
+int RunHeadless(const HeadlessOptions& options) {
+  if (options.software) {
+#ifdef _WIN32
+    _putenv_s("LIBGL_ALWAYS_SOFTWARE", "1");
+#else
+    setenv("LIBGL_ALWAYS_SOFTWARE", "1", 1);
+#endif
+  }
+
+  auto egl = EglContext::Create();
+  if (!egl)
+    return -1;
+  if (!gladLoadGLLoader((GLADloadproc)EglContext::GetProcAddress)) {
+    SPDLOG_ERROR("failed to initialize glad");
+    return -1;
+  }
+  SPDLOG_INFO("OpenGL context version: {}, renderer: {}",
+    reinterpret_cast<const char *>(glGetString(GL_VERSION)), reinterpret_cast<const char *>(glGetString(GL_RENDERER)));
+
+  // the ui is still built every frame but never drawn, so only the font atlas is needed
+  auto imguiContext = ImGui::CreateContext();
+  ImGui::SetCurrentContext(imguiContext);
+  auto& io = ImGui::GetIO();
+  io.DisplaySize = ImVec2((float)options.width, (float)options.height);
+  io.IniFilename = nullptr;
+  unsigned char* fontPixels = nullptr;
+  int fontWidth = 0, fontHeight = 0;
+  io.Fonts->GetTexDataAsRGBA32(&fontPixels, &fontWidth, &fontHeight);
+
+  int result = 0;
+  {
+    // loads run on a shared context like in the windowed app, but every frame
+    // written has to show the whole scene
+    ResourceLoaderPtr resourceLoader = ResourceLoader::Create(egl.get());
+    if (!resourceLoader)
+      resourceLoader = ResourceLoader::CreateImmediate();
+    resourceLoader->GetResidencyManager()->SetOnDemand(false);
+    auto context = Context::Create(resourceLoader);
+    if (!context) {
+      SPDLOG_ERROR("failed to init context");
+      ImGui::DestroyContext(imguiContext);
+      return -1;
+    }
+    resourceLoader->Finish();
+    context->Reshape(options.width, options.height);
+    auto frameLoop = FrameLoop::Create();
+    context->SetFrameLoop(frameLoop.get());
+    TexturePtr output = Texture::Create(options.width, options.height, GL_RGBA8);
+    context->SetOutputTexture(output);
+    auto readback = Framebuffer::Create({ output }, nullptr, false);
+    auto image = Image::Create(options.width, options.height, 4);
+
+    SPDLOG_INFO("rendering {} headless frames at {}x{}", options.frames, options.width, options.height);
+    auto start = std::chrono::steady_clock::now();
+    for (int frame = 0; frame < options.frames; frame++) {
+      // fixed step so runs are reproducible
+      io.DeltaTime = 1.0f / 60.0f;
+      CpuProfiler::FrameMark();
+      frameLoop->BeginFrame(io.DeltaTime);
+      while (frameLoop->Tick())
+        context->Update(frameLoop->GetTime().dt);
+      ImGui::NewFrame();
+      context->Render();
+      ImGui::Render();
+
+      bool last = frame + 1 == options.frames;
+      bool save = last || (options.saveEvery > 0 && frame % options.saveEvery == 0);
+      if (!save)
+        continue;
+      readback->Bind();
+      glPixelStorei(GL_PACK_ALIGNMENT, 1);
+      glReadPixels(0, 0, options.width, options.height, GL_RGBA, GL_UNSIGNED_BYTE, image->GetData());
+      Framebuffer::BindToDefault();
+      char filename[64];
+      snprintf(filename, sizeof(filename), "/frame_%05d.png", frame);
+      if (!image->Save(options.outputDirectory + filename)) {
+        result = -1;
+        break;
+      }
+    }
+    glFinish();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    SPDLOG_INFO("rendered {} frames in {:.2f} s ({:.1f} fps)", options.frames, seconds, options.frames / seconds);
+  }
+  ImGui::DestroyContext(imguiContext);
+  return result;
+}
+#else
+int RunHeadless(const HeadlessOptions& options) {
+  SPDLOG_ERROR("headless mode needs egl, this build has none");
+  return -1;
+}
+#endif
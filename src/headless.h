@@ -0,0 +1,23 @@
+#ifndef __HEADLESS_H__
+#define __HEADLESS_H__
+
+#include "common.h"
+
+// offscreen rendering without a window system: a surfaceless egl context
+// (mesa llvmpipe when there is no gpu) renders frames of Context::Render into
+// a texture and writes them out as png files
+struct HeadlessOptions {
+  int frames { 1 };
+  int width { WINDOW_WIDTH };
+  int height { WINDOW_HEIGHT };
+  int saveEvery { 1 };      // 0 only saves the last frame
+  bool software { false };  // force llvmpipe even when a gpu is present
+  std::string outputDirectory { "." };
+};
+
+// true when the command line asks for headless mode:
+//   --headless N [--size WxH] [--output DIR] [--save-every K] [--software]
+bool ParseHeadlessOptions(int argc, char** args, HeadlessOptions& options);
+int RunHeadless(const HeadlessOptions& options);
+
+#endif // __HEADLESS_H__
@@ -1,6 +1,11 @@
 #include "image.h"
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb/stb_image.h>
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include <stb/stb_image_write.h>
+#include <algorithm>
+#include <cstring>
+#include <fstream>
 
 ImageUPtr Image::Load(const std::string &filepath, bool flipVertical)
 {
@@ -35,6 +40,74 @@ ImageUPtr Image::CreateSingleColorImage(
     return std::move(image);
 }
 
+bool Image::ReadInfo(const std::string& filepath, int& width, int& height, int& channelCount) {
+    if (!stbi_info(filepath.c_str(), &width, &height, &channelCount)) {
+        SPDLOG_ERROR("failed to read image info: {}", filepath);
+        return false;
+    }
+    return true;
+}
+
+bool Image::LoadInto(const std::string& filepath, uint8_t* destination, size_t size, bool flipVertical,
+    bool mipmaps) {
+    // stb decodes into its own buffer, flipping while copying the rows out
+    // saves the separate pass stb would make
+    int width = 0, height = 0, channelCount = 0;
+    stbi_set_flip_vertically_on_load_thread(false);
+    uint8_t* pixels = stbi_load(filepath.c_str(), &width, &height, &channelCount, 0);
+    if (!pixels) {
+        SPDLOG_ERROR("failed to load image: {}", filepath);
+        return false;
+    }
+    size_t expected = mipmaps ? MipGenerator::GetChainSize(width, height, channelCount) :
+        (size_t)width * height * channelCount;
+    if (expected != size) {
+        SPDLOG_ERROR("image changed size while loading: {}", filepath);
+        stbi_image_free(pixels);
+        return false;
+    }
+    // the filters are symmetric, mipmaps of the flipped image are the flipped mipmaps
+    std::vector<uint8_t> chain;
+    if (mipmaps)
+        chain = MipGenerator::Generate(pixels, width, height, channelCount);
+    int levelCount = mipmaps ? MipGenerator::GetLevelCount(width, height) : 1;
+    const uint8_t* source = pixels;
+    for (int level = 0; level < levelCount; level++) {
+        int levelHeight = std::max(height >> level, 1);
+        size_t rowSize = (size_t)std::max(width >> level, 1) * channelCount;
+        for (int y = 0; y < levelHeight; y++) {
+            int sourceY = flipVertical ? levelHeight - 1 - y : y;
+            memcpy(destination + rowSize * y, source + rowSize * sourceY, rowSize);
+        }
+        destination += rowSize * levelHeight;
+        source = level == 0 ? chain.data() : source + rowSize * levelHeight;
+    }
+    stbi_image_free(pixels);
+    return true;
+}
+
+void Image::GenerateMipmaps(MipFilter filter, bool srgb) {
+    m_mipData = MipGenerator::Generate(m_data, m_width, m_height, m_channelCount, filter, srgb);
+}
+
+const uint8_t* Image::GetLevelData(int level) const {
+    if (level == 0)
+        return m_data;
+    const uint8_t* data = m_mipData.data();
+    for (int i = 1; i < level; i++)
+        data += (size_t)GetLevelWidth(i) * GetLevelHeight(i) * m_channelCount;
+    return data;
+}
+
+bool Image::Save(const std::string& filepath, bool flipVertical) const {
+    stbi_flip_vertically_on_write(flipVertical);
+    if (!stbi_write_png(filepath.c_str(), m_width, m_height, m_channelCount, m_data, m_width * m_channelCount)) {
+        SPDLOG_ERROR("failed to save image: {}", filepath);
+        return false;
+    }
+    return true;
+}
+
 Image::~Image()
 {
     if (this->m_data)
@@ -45,7 +118,8 @@ Image::~Image()
 
 bool Image::LoadWithStb(const std::string &filepath,bool flipVertical)
 {
-    stbi_set_flip_vertically_on_load(flipVertical);
+    // images are decoded on loader and streaming threads, the global flag would race
+    stbi_set_flip_vertically_on_load_thread(flipVertical);
     m_data = stbi_load(filepath.c_str(), &m_width, &m_height, &m_channelCount, 0);
     if (!m_data)
     {
@@ -63,3 +137,273 @@ bool Image::Allocate(int width, int height, int channelCount) {
     return m_data ? true : false;
 }
 
+
+//compressed image
+namespace {
+
+// ktx2 layout: identifier, header, level index, data format descriptor,
+// key/value data, then the levels from the smallest up
+const uint8_t Ktx2Identifier[12] = { 0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n' };
+
+// the 64 bit fields sit at 4 byte offsets in the file
+#pragma pack(push, 4)
+struct Ktx2Header {
+    uint32_t vkFormat;
+    uint32_t typeSize;
+    uint32_t pixelWidth;
+    uint32_t pixelHeight;
+    uint32_t pixelDepth;
+    uint32_t layerCount;
+    uint32_t faceCount;
+    uint32_t levelCount;
+    uint32_t supercompressionScheme;
+    uint32_t dfdByteOffset;
+    uint32_t dfdByteLength;
+    uint32_t kvdByteOffset;
+    uint32_t kvdByteLength;
+    uint64_t sgdByteOffset;
+    uint64_t sgdByteLength;
+};
+#pragma pack(pop)
+static_assert(sizeof(Ktx2Header) == 68, "ktx2 header layout");
+
+struct Ktx2Level {
+    uint64_t byteOffset;
+    uint64_t byteLength;
+    uint64_t uncompressedByteLength;
+};
+
+struct FormatInfo {
+    CompressedImage::Format format;
+    const char* name;
+    int blockSize;
+    uint32_t vkFormat;       // unorm
+    uint32_t glFormat;
+    uint8_t colorModel;      // khr data format descriptor
+    int sampleCount;         // splitting the block evenly
+    uint8_t channels[2];     // sample channel ids
+};
+
+const FormatInfo Formats[] = {
+    { CompressedImage::Format::BC1, "bc1", 8, 131, GL_COMPRESSED_RGB_S3TC_DXT1_EXT, 128, 1, { 0 } },
+    { CompressedImage::Format::BC3, "bc3", 16, 137, GL_COMPRESSED_RGBA_S3TC_DXT5_EXT, 130, 2, { 15, 0 } },
+    { CompressedImage::Format::BC5, "bc5", 16, 141, GL_COMPRESSED_RG_RGTC2, 132, 2, { 0, 1 } },
+    { CompressedImage::Format::BC7, "bc7", 16, 145, GL_COMPRESSED_RGBA_BPTC_UNORM, 134, 1, { 0 } },
+    { CompressedImage::Format::ETC2_RGB, "etc2 rgb", 8, 147, GL_COMPRESSED_RGB8_ETC2, 161, 1, { 2 } },
+    { CompressedImage::Format::ETC2_RGBA, "etc2 rgba", 16, 151, GL_COMPRESSED_RGBA8_ETC2_EAC, 161, 2, { 15, 2 } },
+};
+
+const FormatInfo& GetFormatInfo(CompressedImage::Format format) {
+    return Formats[(int)format];
+}
+
+void Append(std::vector<uint8_t>& out, const void* data, size_t size) {
+    out.insert(out.end(), (const uint8_t*)data, (const uint8_t*)data + size);
+}
+
+template <typename T>
+void Append(std::vector<uint8_t>& out, T value) {
+    Append(out, &value, sizeof(T));   // ktx2 is little endian, like every target here
+}
+
+void Align(std::vector<uint8_t>& out, size_t alignment) {
+    out.resize((out.size() + alignment - 1) / alignment * alignment, 0);
+}
+
+}
+
+CompressedImageUPtr CompressedImage::Load(const std::string& filepath) {
+    auto image = CompressedImageUPtr(new CompressedImage());
+    if (!image->LoadKtx2(filepath))
+        return nullptr;
+    return std::move(image);
+}
+
+CompressedImageUPtr CompressedImage::Create(Format format, int width, int height, bool flipVertical) {
+    auto image = CompressedImageUPtr(new CompressedImage());
+    image->m_format = format;
+    image->m_width = width;
+    image->m_height = height;
+    image->m_flipVertical = flipVertical;
+    return std::move(image);
+}
+
+size_t CompressedImage::GetByteSize() const {
+    size_t size = 0;
+    for (auto& level : m_levels)
+        size += level.size();
+    return size;
+}
+
+int CompressedImage::GetBlockSize(Format format) {
+    return GetFormatInfo(format).blockSize;
+}
+
+uint32_t CompressedImage::GetGLFormat(Format format) {
+    return GetFormatInfo(format).glFormat;
+}
+
+const char* CompressedImage::GetFormatName(Format format) {
+    return GetFormatInfo(format).name;
+}
+
+bool CompressedImage::IsSupported(Format format) {
+    switch (format) {
+    case Format::BC1:
+    case Format::BC3: return GLAD_GL_EXT_texture_compression_s3tc;
+    case Format::BC5: return true;   // rgtc is core since 3.0
+    case Format::BC7: return GLAD_GL_ARB_texture_compression_bptc || GLAD_GL_VERSION_4_2;
+    case Format::ETC2_RGB:
+    case Format::ETC2_RGBA: return GLAD_GL_ARB_ES3_compatibility || GLAD_GL_VERSION_4_3;
+    }
+    return false;
+}
+
+std::vector<std::string> CompressedImage::FindCooked(const std::string& filepath) {
+    std::filesystem::path path(filepath);
+    auto stem = path.parent_path() / path.stem();
+    std::vector<std::string> cooked;
+    for (auto suffix : { ".ktx2", ".etc2.ktx2" }) {
+        auto candidate = stem.string() + suffix;
+        std::error_code error;
+        if (std::filesystem::exists(candidate, error))
+            cooked.push_back(candidate);
+    }
+    return cooked;
+}
+
+bool CompressedImage::Save(const std::string& filepath) const {
+    auto& info = GetFormatInfo(m_format);
+    int sampleCount = info.sampleCount;
+    int sampleBits = info.blockSize * 8 / sampleCount;
+    uint32_t levelCount = (uint32_t)m_levels.size();
+
+    // basic data format descriptor, one sample per channel block
+    std::vector<uint8_t> dfd;
+    uint16_t descriptorBlockSize = (uint16_t)(24 + 16 * sampleCount);
+    Append<uint32_t>(dfd, 4 + descriptorBlockSize);
+    Append<uint32_t>(dfd, 0);                                    // vendor khronos, basic descriptor
+    Append<uint32_t>(dfd, 2 | ((uint32_t)descriptorBlockSize << 16)); // version 2
+    uint8_t model[4] = { info.colorModel, 1, 1, 0 };             // bt709 primaries, linear
+    Append(dfd, model, 4);
+    uint8_t blockDimensions[4] = { 3, 3, 0, 0 };                 // 4x4 texels
+    Append(dfd, blockDimensions, 4);
+    uint8_t bytesPlane[8] = { (uint8_t)info.blockSize };
+    Append(dfd, bytesPlane, 8);
+    for (int i = 0; i < sampleCount; i++) {
+        Append<uint16_t>(dfd, (uint16_t)(sampleBits * i));  // bit offset
+        Append<uint8_t>(dfd, (uint8_t)(sampleBits - 1));   // bit length - 1
+        Append<uint8_t>(dfd, info.channels[i]);
+        Append<uint32_t>(dfd, 0);                   // sample position
+        Append<uint32_t>(dfd, 0);
+        Append<uint32_t>(dfd, 0xFFFFFFFFu);
+    }
+
+    std::vector<uint8_t> kvd;
+    auto AddKeyValue = [&](const char* key, const char* value) {
+        size_t keySize = strlen(key) + 1, valueSize = strlen(value) + 1;
+        Append<uint32_t>(kvd, (uint32_t)(keySize + valueSize));
+        Append(kvd, key, keySize);
+        Append(kvd, value, valueSize);
+        Align(kvd, 4);
+    };
+    AddKeyValue("KTXorientation", m_flipVertical ? "ru" : "rd");
+    AddKeyValue("KTXwriter", "texture_cooker");
+
+    Ktx2Header header = {};
+    header.vkFormat = info.vkFormat;
+    header.typeSize = 1;
+    header.pixelWidth = m_width;
+    header.pixelHeight = m_height;
+    header.faceCount = 1;
+    header.levelCount = levelCount;
+    header.dfdByteOffset = (uint32_t)(sizeof(Ktx2Identifier) + sizeof(Ktx2Header) + levelCount * sizeof(Ktx2Level));
+    header.dfdByteLength = (uint32_t)dfd.size();
+    header.kvdByteOffset = header.dfdByteOffset + header.dfdByteLength;
+    header.kvdByteLength = (uint32_t)kvd.size();
+
+    std::vector<uint8_t> out;
+    Append(out, Ktx2Identifier, sizeof(Ktx2Identifier));
+    Append(out, header);
+    out.resize(header.dfdByteOffset);   // level index, filled below
+    Append(out, dfd.data(), dfd.size());
+    Append(out, kvd.data(), kvd.size());
+    std::vector<Ktx2Level> index(levelCount);
+    for (int level = (int)levelCount - 1; level >= 0; level--) {
+        Align(out, info.blockSize);
+        index[level].byteOffset = out.size();
+        index[level].byteLength = m_levels[level].size();
+        index[level].uncompressedByteLength = m_levels[level].size();
+        Append(out, m_levels[level].data(), m_levels[level].size());
+    }
+    memcpy(out.data() + sizeof(Ktx2Identifier) + sizeof(Ktx2Header), index.data(), levelCount * sizeof(Ktx2Level));
+
+    std::ofstream file(filepath, std::ios::binary);
+    if (!file.is_open() || !file.write((const char*)out.data(), out.size())) {
+        SPDLOG_ERROR("failed to write {}", filepath);
+        return false;
+    }
+    return true;
+}
+
+bool CompressedImage::LoadKtx2(const std::string& filepath) {
+    std::ifstream file(filepath, std::ios::binary);
+    if (!file.is_open()) {
+        SPDLOG_ERROR("failed to open {}", filepath);
+        return false;
+    }
+    std::vector<uint8_t> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    Ktx2Header header;
+    size_t indexOffset = sizeof(Ktx2Identifier) + sizeof(Ktx2Header);
+    if (data.size() < indexOffset || memcmp(data.data(), Ktx2Identifier, sizeof(Ktx2Identifier)) != 0) {
+        SPDLOG_ERROR("not a ktx2 file: {}", filepath);
+        return false;
+    }
+    memcpy(&header, data.data() + sizeof(Ktx2Identifier), sizeof(header));
+    const FormatInfo* info = nullptr;
+    for (auto& format : Formats) {
+        if (format.vkFormat == header.vkFormat)
+            info = &format;
+    }
+    if (!info || header.supercompressionScheme != 0 || header.pixelDepth > 1 || header.layerCount > 1 ||
+        header.faceCount != 1 || header.levelCount == 0) {
+        SPDLOG_ERROR("unsupported ktx2 file: {} (vkFormat {})", filepath, header.vkFormat);
+        return false;
+    }
+    if (data.size() < indexOffset + header.levelCount * sizeof(Ktx2Level)) {
+        SPDLOG_ERROR("truncated ktx2 file: {}", filepath);
+        return false;
+    }
+    m_format = info->format;
+    m_width = header.pixelWidth;
+    m_height = header.pixelHeight;
+
+    m_levels.resize(header.levelCount);
+    for (uint32_t level = 0; level < header.levelCount; level++) {
+        Ktx2Level entry;
+        memcpy(&entry, data.data() + indexOffset + level * sizeof(Ktx2Level), sizeof(entry));
+        int width = std::max(m_width >> level, 1), height = std::max(m_height >> level, 1);
+        size_t expected = (size_t)((width + 3) / 4) * ((height + 3) / 4) * info->blockSize;
+        if (entry.byteLength != expected || entry.byteOffset + entry.byteLength > data.size()) {
+            SPDLOG_ERROR("bad level {} in {}", level, filepath);
+            return false;
+        }
+        m_levels[level].assign(data.begin() + entry.byteOffset, data.begin() + entry.byteOffset + entry.byteLength);
+    }
+
+    // KTXorientation "rd" is top-down, the ktx2 default
+    m_flipVertical = false;
+    size_t kvd = header.kvdByteOffset, kvdEnd = std::min((size_t)header.kvdByteOffset + header.kvdByteLength, data.size());
+    while (kvd + 4 <= kvdEnd) {
+        uint32_t length = 0;
+        memcpy(&length, data.data() + kvd, 4);
+        if (kvd + 4 + length > kvdEnd)
+            break;
+        std::string entry((const char*)data.data() + kvd + 4, length);
+        auto separator = entry.find('\0');
+        if (separator != std::string::npos && entry.substr(0, separator) == "KTXorientation")
+            m_flipVertical = entry.size() > separator + 2 && entry[separator + 2] == 'u';
+        kvd += (4 + length + 3) / 4 * 4;
+    }
+    return true;
+}
@@ -2,6 +2,9 @@
 #define __IMAGE_H__
 
 #include "common.h"
+#include "mip_generator.h"
+#include <algorithm>
+#include <vector>
 
 CLASS_PTR(Image)
 class Image
@@ -11,13 +14,32 @@ public:
 
     static ImageUPtr Create(int width, int height, int channelCount = 4);
     static ImageUPtr CreateSingleColorImage(int width, int height, const glm::vec4& color);
+    // size and channel count from the file header, without decoding
+    static bool ReadInfo(const std::string& filepath, int& width, int& height, int& channelCount);
+    // decodes into memory owned by the caller, e.g. a mapped pixel buffer, with
+    // tightly packed rows. with mipmaps the levels of GenerateMipmaps follow
+    // the image. size is checked against the decoded image
+    static bool LoadInto(const std::string& filepath, uint8_t* destination, size_t size, bool flipVertical = true,
+        bool mipmaps = false);
     ~Image();
 
     const uint8_t *GetData() const { return m_data; }
+    uint8_t *GetData() { return m_data; }
+    // png, rows are stored bottom-up like gl read-backs unless flipVertical is false
+    bool Save(const std::string& filepath, bool flipVertical = true) const;
     int GetWidth() const { return m_width; }
     int GetHeight() const { return m_height; }
     int GetChannelCount() const { return m_channelCount; }
 
+    // levels 1 and down on the calling thread, kept with the image so the
+    // texture uploads them instead of generating them on the gl thread
+    void GenerateMipmaps(MipFilter filter = MipFilter::Kaiser, bool srgb = true);
+    // 1 until GenerateMipmaps
+    int GetLevelCount() const { return m_mipData.empty() ? 1 : MipGenerator::GetLevelCount(m_width, m_height); }
+    int GetLevelWidth(int level) const { return std::max(m_width >> level, 1); }
+    int GetLevelHeight(int level) const { return std::max(m_height >> level, 1); }
+    const uint8_t* GetLevelData(int level) const;
+
 private:
     Image(){};
     bool LoadWithStb(const std::string& filepath, bool flipVertical);
@@ -27,6 +49,50 @@ private:
     int m_height{0};
     int m_channelCount{0};
     uint8_t *m_data{nullptr};
+    std::vector<uint8_t> m_mipData;   // levels 1 and down, one after the other
+};
+
+// block compressed mip chain, stored as ktx2 (written by texture_cooker).
+// level 0 is the full size; rows run bottom-up like Image unless the file
+// says otherwise
+CLASS_PTR(CompressedImage)
+class CompressedImage
+{
+public:
+    enum class Format { BC1, BC3, BC5, BC7, ETC2_RGB, ETC2_RGBA };
+
+    static CompressedImageUPtr Load(const std::string& filepath);
+    static CompressedImageUPtr Create(Format format, int width, int height, bool flipVertical = true);
+    bool Save(const std::string& filepath) const;
+
+    // levels are added from the full size down
+    void AddLevel(std::vector<uint8_t> data) { m_levels.push_back(std::move(data)); }
+    Format GetFormat() const { return m_format; }
+    int GetWidth() const { return m_width; }
+    int GetHeight() const { return m_height; }
+    bool IsFlippedVertically() const { return m_flipVertical; }
+    int GetLevelCount() const { return (int)m_levels.size(); }
+    const std::vector<uint8_t>& GetLevel(int level) const { return m_levels[level]; }
+    size_t GetByteSize() const;
+
+    static int GetBlockSize(Format format);   // bytes per 4x4 block
+    static uint32_t GetGLFormat(Format format);
+    static const char* GetFormatName(Format format);
+    // the current gl implementation samples it
+    static bool IsSupported(Format format);
+    // cooked versions of an image file that exist on disk, preferred first:
+    // name.ktx2 (bc) and name.etc2.ktx2
+    static std::vector<std::string> FindCooked(const std::string& filepath);
+
+private:
+    CompressedImage() {}
+    bool LoadKtx2(const std::string& filepath);
+
+    Format m_format { Format::BC1 };
+    int m_width { 0 };
+    int m_height { 0 };
+    bool m_flipVertical { true };
+    std::vector<std::vector<uint8_t>> m_levels;
 };
 
 #endif // __IMAGE_H__
\ No newline at end of file
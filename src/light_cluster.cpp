@@ -0,0 +1,303 @@
+#include "light_cluster.h"
+#include "cpu_profiler.h"
+#include <chrono>
+#include <limits>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define LIGHT_CLUSTER_SSE 1
+#include <emmintrin.h>
+#endif
+
+// padding lanes sit far outside any cluster so they never pass the sphere test
+static const float PaddingPosition = 1.0e9f;
+
+LightClusterUPtr LightCluster::Create(ThreadPoolPtr threadPool,
+  int gridX, int gridY, int gridZ, int maxLightsPerCluster) {
+  auto cluster = LightClusterUPtr(new LightCluster());
+  if (!cluster->Init(threadPool, gridX, gridY, gridZ, maxLightsPerCluster))
+    return nullptr;
+  return std::move(cluster);
+}
+
+LightCluster::~LightCluster() {
+}
+
+void LightCluster::LightSoA::Resize(size_t count) {
+  x.resize(count, PaddingPosition);
+  y.resize(count, PaddingPosition);
+  z.resize(count, PaddingPosition);
+  radius.resize(count, 0.0f);
+  dirX.resize(count, 0.0f);
+  dirY.resize(count, 0.0f);
+  dirZ.resize(count, -1.0f);
+  cosAngle.resize(count, -1.0f);
+  sinAngle.resize(count, 0.0f);
+  spotMask.resize(count, 0);
+  index.resize(count, 0);
+}
+
+bool LightCluster::Init(ThreadPoolPtr threadPool, int gridX, int gridY, int gridZ, int maxLightsPerCluster) {
+  if (gridX <= 0 || gridY <= 0 || gridZ <= 0) {
+    SPDLOG_ERROR("invalid light cluster grid: {}x{}x{}", gridX, gridY, gridZ);
+    return false;
+  }
+  m_threadPool = threadPool;
+  m_gridX = gridX;
+  m_gridY = gridY;
+  m_gridZ = gridZ;
+  m_maxLightsPerCluster = maxLightsPerCluster;
+  m_slices.resize(m_gridZ);
+  m_grid.resize(GetClusterCount(), glm::uvec2(0));
+
+  glm::vec4 emptyLight[3] = { glm::vec4(0.0f), glm::vec4(0.0f), glm::vec4(0.0f) };
+  uint32_t emptyIndex = 0;
+  m_lightTexture = BufferTexture::Create(Buffer::CreateWithData(GL_TEXTURE_BUFFER, GL_STREAM_DRAW,
+    emptyLight, sizeof(glm::vec4), 3), GL_RGBA32F);
+  m_gridTexture = BufferTexture::Create(Buffer::CreateWithData(GL_TEXTURE_BUFFER, GL_STREAM_DRAW,
+    m_grid.data(), sizeof(glm::uvec2), m_grid.size()), GL_RG32UI);
+  m_indexTexture = BufferTexture::Create(Buffer::CreateWithData(GL_TEXTURE_BUFFER, GL_STREAM_DRAW,
+    &emptyIndex, sizeof(uint32_t), 1), GL_R32UI);
+  glBindTexture(GL_TEXTURE_BUFFER, 0);
+  return true;
+}
+
+void LightCluster::BuildClusterBounds(const glm::mat4& projection, float zNear, float zFar) {
+  m_boundsProjection = projection;
+  m_zNear = zNear;
+  m_zFar = zFar;
+
+  // exponential slicing keeps clusters roughly cubic in view space
+  m_sliceDepth.resize(m_gridZ + 1);
+  for (int k = 0; k <= m_gridZ; k++)
+    m_sliceDepth[k] = zNear * powf(zFar / zNear, (float)k / (float)m_gridZ);
+
+  auto invProjection = glm::inverse(projection);
+  auto nearPlanePoint = [&](float ndcX, float ndcY) {
+    auto p = invProjection * glm::vec4(ndcX, ndcY, -1.0f, 1.0f);
+    return glm::vec3(p) / p.w;
+  };
+
+  m_bounds.resize(GetClusterCount());
+  for (int y = 0; y < m_gridY; y++) {
+    for (int x = 0; x < m_gridX; x++) {
+      float x0 = -1.0f + 2.0f * (float)x / (float)m_gridX;
+      float x1 = -1.0f + 2.0f * (float)(x + 1) / (float)m_gridX;
+      float y0 = -1.0f + 2.0f * (float)y / (float)m_gridY;
+      float y1 = -1.0f + 2.0f * (float)(y + 1) / (float)m_gridY;
+      glm::vec3 corners[4] = {
+        nearPlanePoint(x0, y0), nearPlanePoint(x1, y0),
+        nearPlanePoint(x0, y1), nearPlanePoint(x1, y1),
+      };
+      for (int k = 0; k < m_gridZ; k++) {
+        glm::vec3 boundMin(std::numeric_limits<float>::max());
+        glm::vec3 boundMax(-std::numeric_limits<float>::max());
+        for (float depth : { m_sliceDepth[k], m_sliceDepth[k + 1] }) {
+          for (auto& corner : corners) {
+            auto p = corner * (depth / -corner.z);
+            boundMin = glm::min(boundMin, p);
+            boundMax = glm::max(boundMax, p);
+          }
+        }
+        auto& bounds = m_bounds[x + m_gridX * (y + m_gridY * k)];
+        bounds.min = boundMin;
+        bounds.max = boundMax;
+        bounds.center = (boundMin + boundMax) * 0.5f;
+        bounds.radius = glm::length(boundMax - boundMin) * 0.5f;
+      }
+    }
+  }
+}
+
+void LightCluster::Update(const std::vector<ClusterLight>& lights,
+  const glm::mat4& view, const glm::mat4& projection, float zNear, float zFar) {
+  CPU_ZONE("light cluster update");
+  auto start = std::chrono::high_resolution_clock::now();
+
+  if (projection != m_boundsProjection || zNear != m_zNear || zFar != m_zFar)
+    BuildClusterBounds(projection, zNear, zFar);
+
+  m_lightCount = (int)lights.size();
+  m_viewLights.Resize(0);
+  m_viewLights.Resize((lights.size() + 3) & ~(size_t)3);
+  m_lightData.resize(std::max(lights.size(), (size_t)1) * 3, glm::vec4(0.0f));
+  auto viewRotation = glm::mat3(view);
+  for (size_t i = 0; i < lights.size(); i++) {
+    auto& light = lights[i];
+    auto position = glm::vec3(view * glm::vec4(light.position, 1.0f));
+    auto direction = glm::normalize(light.direction);
+    float cosInner = -1.0f;
+    float cosOuter = -2.0f;
+    m_viewLights.x[i] = position.x;
+    m_viewLights.y[i] = position.y;
+    m_viewLights.z[i] = position.z;
+    m_viewLights.radius[i] = light.radius;
+    m_viewLights.index[i] = (uint32_t)i;
+    if (light.spot) {
+      float outerAngle = glm::radians(light.cutoff[0] + light.cutoff[1]);
+      auto viewDirection = glm::normalize(viewRotation * direction);
+      m_viewLights.dirX[i] = viewDirection.x;
+      m_viewLights.dirY[i] = viewDirection.y;
+      m_viewLights.dirZ[i] = viewDirection.z;
+      m_viewLights.cosAngle[i] = cosf(outerAngle);
+      m_viewLights.sinAngle[i] = sinf(outerAngle);
+      m_viewLights.spotMask[i] = 0xffffffffu;
+      cosInner = cosf(glm::radians(light.cutoff[0]));
+      cosOuter = cosf(outerAngle);
+    }
+    m_lightData[3 * i + 0] = glm::vec4(light.position, light.radius);
+    m_lightData[3 * i + 1] = glm::vec4(light.color, cosOuter);
+    m_lightData[3 * i + 2] = glm::vec4(direction, cosInner);
+  }
+
+  m_threadPool->ParallelFor(m_gridZ, [this](int slice) { AssignSlice(slice); });
+
+  // slices wrote offsets local to their own index list, make them global
+  m_indices.clear();
+  int sliceSize = m_gridX * m_gridY;
+  for (int k = 0; k < m_gridZ; k++) {
+    auto base = (uint32_t)m_indices.size();
+    for (int i = 0; i < sliceSize; i++)
+      m_grid[k * sliceSize + i].x += base;
+    auto& sliceIndices = m_slices[k].indices;
+    m_indices.insert(m_indices.end(), sliceIndices.begin(), sliceIndices.end());
+  }
+
+  auto lightBuffer = m_lightTexture->GetBuffer();
+  lightBuffer->SetData(m_lightData.data(), m_lightData.size());
+  auto gridBuffer = m_gridTexture->GetBuffer();
+  gridBuffer->SetData(m_grid.data(), m_grid.size());
+  uint32_t emptyIndex = 0;
+  auto indexBuffer = m_indexTexture->GetBuffer();
+  if (m_indices.empty())
+    indexBuffer->SetData(&emptyIndex, 1);
+  else
+    indexBuffer->SetData(m_indices.data(), m_indices.size());
+
+  auto end = std::chrono::high_resolution_clock::now();
+  m_assignTime = std::chrono::duration<float, std::milli>(end - start).count();
+}
+
+void LightCluster::AssignSlice(int slice) {
+  CPU_ZONE("light cluster slice");
+  auto& result = m_slices[slice];
+  auto& candidates = result.candidates;
+  result.indices.clear();
+
+  // only lights whose depth range overlaps the slice can touch its clusters
+  float sliceNear = m_sliceDepth[slice];
+  float sliceFar = m_sliceDepth[slice + 1];
+  candidates.Resize(0);
+  for (int i = 0; i < m_lightCount; i++) {
+    float depth = -m_viewLights.z[i];
+    float radius = m_viewLights.radius[i];
+    if (depth + radius < sliceNear || depth - radius > sliceFar)
+      continue;
+    candidates.x.push_back(m_viewLights.x[i]);
+    candidates.y.push_back(m_viewLights.y[i]);
+    candidates.z.push_back(m_viewLights.z[i]);
+    candidates.radius.push_back(radius);
+    candidates.dirX.push_back(m_viewLights.dirX[i]);
+    candidates.dirY.push_back(m_viewLights.dirY[i]);
+    candidates.dirZ.push_back(m_viewLights.dirZ[i]);
+    candidates.cosAngle.push_back(m_viewLights.cosAngle[i]);
+    candidates.sinAngle.push_back(m_viewLights.sinAngle[i]);
+    candidates.spotMask.push_back(m_viewLights.spotMask[i]);
+    candidates.index.push_back(m_viewLights.index[i]);
+  }
+  candidates.Resize((candidates.Size() + 3) & ~(size_t)3);
+
+  int sliceSize = m_gridX * m_gridY;
+  for (int i = 0; i < sliceSize; i++) {
+    int clusterIndex = slice * sliceSize + i;
+    auto& bounds = m_bounds[clusterIndex];
+    auto offset = (uint32_t)result.indices.size();
+    uint32_t count = 0;
+    for (size_t first = 0; first < candidates.Size() && count < (uint32_t)m_maxLightsPerCluster; first += 4) {
+      uint32_t mask = TestLights(candidates, first, bounds);
+      for (int lane = 0; lane < 4 && mask; lane++, mask >>= 1) {
+        if ((mask & 1) && count < (uint32_t)m_maxLightsPerCluster) {
+          result.indices.push_back(candidates.index[first + lane]);
+          count++;
+        }
+      }
+    }
+    m_grid[clusterIndex] = glm::uvec2(offset, count);
+  }
+}
+
+uint32_t LightCluster::TestLights(const LightSoA& lights, size_t first, const ClusterBounds& bounds) {
+#ifdef LIGHT_CLUSTER_SSE
+  const __m128 zero = _mm_setzero_ps();
+  __m128 x = _mm_loadu_ps(&lights.x[first]);
+  __m128 y = _mm_loadu_ps(&lights.y[first]);
+  __m128 z = _mm_loadu_ps(&lights.z[first]);
+  __m128 radius = _mm_loadu_ps(&lights.radius[first]);
+
+  // sphere vs aabb: squared distance from the light center to the box
+  __m128 dx = _mm_max_ps(zero, _mm_max_ps(_mm_sub_ps(_mm_set1_ps(bounds.min.x), x), _mm_sub_ps(x, _mm_set1_ps(bounds.max.x))));
+  __m128 dy = _mm_max_ps(zero, _mm_max_ps(_mm_sub_ps(_mm_set1_ps(bounds.min.y), y), _mm_sub_ps(y, _mm_set1_ps(bounds.max.y))));
+  __m128 dz = _mm_max_ps(zero, _mm_max_ps(_mm_sub_ps(_mm_set1_ps(bounds.min.z), z), _mm_sub_ps(z, _mm_set1_ps(bounds.max.z))));
+  __m128 distSq = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+  __m128 sphereHit = _mm_cmple_ps(distSq, _mm_mul_ps(radius, radius));
+
+  // spot lights: cone vs the cluster's bounding sphere
+  __m128 clusterRadius = _mm_set1_ps(bounds.radius);
+  __m128 vx = _mm_sub_ps(_mm_set1_ps(bounds.center.x), x);
+  __m128 vy = _mm_sub_ps(_mm_set1_ps(bounds.center.y), y);
+  __m128 vz = _mm_sub_ps(_mm_set1_ps(bounds.center.z), z);
+  __m128 lenSq = _mm_add_ps(_mm_add_ps(_mm_mul_ps(vx, vx), _mm_mul_ps(vy, vy)), _mm_mul_ps(vz, vz));
+  __m128 axial = _mm_add_ps(_mm_add_ps(
+    _mm_mul_ps(vx, _mm_loadu_ps(&lights.dirX[first])),
+    _mm_mul_ps(vy, _mm_loadu_ps(&lights.dirY[first]))),
+    _mm_mul_ps(vz, _mm_loadu_ps(&lights.dirZ[first])));
+  __m128 lateral = _mm_sqrt_ps(_mm_max_ps(zero, _mm_sub_ps(lenSq, _mm_mul_ps(axial, axial))));
+  __m128 closest = _mm_sub_ps(
+    _mm_mul_ps(_mm_loadu_ps(&lights.cosAngle[first]), lateral),
+    _mm_mul_ps(axial, _mm_loadu_ps(&lights.sinAngle[first])));
+  __m128 coneMiss = _mm_or_ps(_mm_or_ps(
+    _mm_cmpgt_ps(closest, clusterRadius),
+    _mm_cmpgt_ps(axial, _mm_add_ps(clusterRadius, radius))),
+    _mm_cmplt_ps(axial, _mm_sub_ps(zero, clusterRadius)));
+  __m128 spot = _mm_castsi128_ps(_mm_loadu_si128((const __m128i*)&lights.spotMask[first]));
+  __m128 hit = _mm_andnot_ps(_mm_and_ps(coneMiss, spot), sphereHit);
+  return (uint32_t)_mm_movemask_ps(hit);
+#else
+  uint32_t mask = 0;
+  for (int lane = 0; lane < 4; lane++) {
+    size_t i = first + lane;
+    auto center = glm::vec3(lights.x[i], lights.y[i], lights.z[i]);
+    auto d = glm::max(glm::vec3(0.0f), glm::max(bounds.min - center, center - bounds.max));
+    if (glm::dot(d, d) > lights.radius[i] * lights.radius[i])
+      continue;
+    if (lights.spotMask[i]) {
+      auto v = bounds.center - center;
+      float axial = glm::dot(v, glm::vec3(lights.dirX[i], lights.dirY[i], lights.dirZ[i]));
+      float lateral = sqrtf(std::max(0.0f, glm::dot(v, v) - axial * axial));
+      float closest = lights.cosAngle[i] * lateral - axial * lights.sinAngle[i];
+      if (closest > bounds.radius || axial > bounds.radius + lights.radius[i] || axial < -bounds.radius)
+        continue;
+    }
+    mask |= 1u << lane;
+  }
+  return mask;
+#endif
+}
+
+void LightCluster::SetToProgram(const Program* program, int textureSlot, const glm::vec2& viewportSize) const {
+  float logRatio = logf(m_zFar / m_zNear);
+  program->SetUniform("clusterDims", glm::vec3((float)m_gridX, (float)m_gridY, (float)m_gridZ));
+  program->SetUniform("clusterTileSize", viewportSize / glm::vec2((float)m_gridX, (float)m_gridY));
+  program->SetUniform("clusterDepthParams", glm::vec2(
+    (float)m_gridZ / logRatio, -(float)m_gridZ * logf(m_zNear) / logRatio));
+
+  glActiveTexture(GL_TEXTURE0 + textureSlot);
+  m_lightTexture->Bind();
+  program->SetUniform("clusterLights", textureSlot);
+  glActiveTexture(GL_TEXTURE0 + textureSlot + 1);
+  m_gridTexture->Bind();
+  program->SetUniform("clusterGrid", textureSlot + 1);
+  glActiveTexture(GL_TEXTURE0 + textureSlot + 2);
+  m_indexTexture->Bind();
+  program->SetUniform("clusterIndices", textureSlot + 2);
+  glActiveTexture(GL_TEXTURE0);
+}
@@ -0,0 +1,95 @@
+#ifndef __LIGHT_CLUSTER_H__
+#define __LIGHT_CLUSTER_H__
+
+#include "common.h"
+#include "texture.h"
+#include "program.h"
+#include "thread_pool.h"
+
+struct ClusterLight {
+  glm::vec3 position { glm::vec3(0.0f) };
+  float radius { 3.0f };
+  glm::vec3 color { glm::vec3(1.0f) };
+  bool spot { false };
+  glm::vec3 direction { glm::vec3(0.0f, -1.0f, 0.0f) };
+  glm::vec2 cutoff { glm::vec2(30.0f, 10.0f) }; // same (angle, falloff) convention as Context::Light
+};
+
+// view frustum split into gridX * gridY screen tiles and gridZ exponential depth slices.
+// lights are binned per cluster on the cpu and uploaded as buffer textures:
+//   clusterLights  : RGBA32F, 3 texels per light
+//   clusterGrid    : RG32UI, (offset, count) into clusterIndices per cluster
+//   clusterIndices : R32UI, compact light index lists
+CLASS_PTR(LightCluster)
+class LightCluster {
+public:
+  static LightClusterUPtr Create(ThreadPoolPtr threadPool,
+    int gridX = 16, int gridY = 9, int gridZ = 24, int maxLightsPerCluster = 256);
+  ~LightCluster();
+
+  void Update(const std::vector<ClusterLight>& lights,
+    const glm::mat4& view, const glm::mat4& projection, float zNear, float zFar);
+  // uses texture units textureSlot .. textureSlot + 2
+  void SetToProgram(const Program* program, int textureSlot, const glm::vec2& viewportSize) const;
+
+  int GetLightCount() const { return m_lightCount; }
+  int GetClusterCount() const { return m_gridX * m_gridY * m_gridZ; }
+  size_t GetIndexCount() const { return m_indices.size(); }
+  float GetAssignTime() const { return m_assignTime; }
+
+private:
+  LightCluster() {}
+  bool Init(ThreadPoolPtr threadPool, int gridX, int gridY, int gridZ, int maxLightsPerCluster);
+  void BuildClusterBounds(const glm::mat4& projection, float zNear, float zFar);
+  void AssignSlice(int slice);
+
+  struct LightSoA;
+  struct ClusterBounds;
+  // bitmask of which of the 4 lights starting at first touch the cluster
+  static uint32_t TestLights(const LightSoA& lights, size_t first, const ClusterBounds& bounds);
+
+  // view space lights as structure of arrays, padded to a multiple of 4 for the simd path
+  struct LightSoA {
+    std::vector<float> x, y, z, radius;
+    std::vector<float> dirX, dirY, dirZ, cosAngle, sinAngle;
+    std::vector<uint32_t> spotMask, index;
+    void Resize(size_t count);
+    size_t Size() const { return x.size(); }
+  };
+  struct ClusterBounds {
+    glm::vec3 min;
+    glm::vec3 max;
+    glm::vec3 center;
+    float radius;
+  };
+  struct SliceResult {
+    LightSoA candidates;
+    std::vector<uint32_t> indices;
+  };
+
+  ThreadPoolPtr m_threadPool;
+  int m_gridX { 16 };
+  int m_gridY { 9 };
+  int m_gridZ { 24 };
+  int m_maxLightsPerCluster { 256 };
+
+  glm::mat4 m_boundsProjection { glm::mat4(0.0f) };
+  float m_zNear { 0.0f };
+  float m_zFar { 0.0f };
+  std::vector<ClusterBounds> m_bounds;
+  std::vector<float> m_sliceDepth;
+
+  LightSoA m_viewLights;
+  std::vector<SliceResult> m_slices;
+  std::vector<glm::uvec2> m_grid;
+  std::vector<uint32_t> m_indices;
+  std::vector<glm::vec4> m_lightData;
+  int m_lightCount { 0 };
+  float m_assignTime { 0.0f };
+
+  BufferTextureUPtr m_lightTexture;
+  BufferTextureUPtr m_gridTexture;
+  BufferTextureUPtr m_indexTexture;
+};
+
+#endif // __LIGHT_CLUSTER_H__
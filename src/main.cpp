@@ -1,4 +1,10 @@
 #include "context.h"
+#include "headless.h"
+#include "benchmark.h"
+#include "cpu_profiler.h"
+#include "gl_capture.h"
+#include "async_log.h"
+#include "render_thread.h"
 
 #include <GLFW/glfw3.h>
 #include <glad/glad.h>
@@ -7,17 +13,25 @@
 #include <spdlog/spdlog.h>
 
 using namespace std;
+// idle mode: every input callback counts as activity, a refresh only asks to
+// show the last frame again
+static uint64_t s_inputEvents = 0;
+static bool s_refreshRequested = false;
 // callbacks
 void onFramebufferSizeChange(GLFWwindow *window, int width, int height)
 {
-    SPDLOG_INFO("framebuffer size changed: ({} x {})", width, height);
+    s_inputEvents++;
+    // dragging the window edge fires this every few milliseconds
+    LOG_RATE_LIMITED(spdlog::level::info, 4, "framebuffer size changed: ({} x {})", width, height);
     auto context = reinterpret_cast<Context *>(glfwGetWindowUserPointer(window));
     context->Reshape(width, height);
 }
 void onKeyEvent(GLFWwindow *window, int key, int scancode, int action, int mods)
 {
+    s_inputEvents++;
     ImGui_ImplGlfw_KeyCallback(window, key, scancode, action, mods);
-    SPDLOG_INFO("key: {}, scancode: {}, action: {}, mods: {}{}{}", key, scancode,
+    // key repeat and camera movement keys would otherwise log every frame
+    LOG_RATE_LIMITED(spdlog::level::debug, 10, "key: {}, scancode: {}, action: {}, mods: {}{}{}", key, scancode,
                 action == GLFW_PRESS     ? "Pressed"
                 : action == GLFW_RELEASE ? "Released"
                 : action == GLFW_REPEAT  ? "Repeat"
@@ -31,11 +45,15 @@ void onKeyEvent(GLFWwindow *window, int key, int scancode, int action, int mods)
 }
 void OnCursorPos(GLFWwindow *window, double x, double y)
 {
+    s_inputEvents++;
     auto context = (Context *)glfwGetWindowUserPointer(window);
+    // mouse look latency: timed until the gpu finished the frame that used it
+    context->RecordInputEvent(glfwGetTime());
     context->MouseMove(x, y);
 }
 void OnMouseButton(GLFWwindow *window, int button, int action, int modifier)
 {
+    s_inputEvents++;
     ImGui_ImplGlfw_MouseButtonCallback(window, button, action, modifier);
     auto context = (Context *)glfwGetWindowUserPointer(window);
     double x, y;
@@ -44,17 +62,43 @@ void OnMouseButton(GLFWwindow *window, int button, int action, int modifier)
 }
 void OnCharEvent(GLFWwindow *window, unsigned int ch)
 {
+    s_inputEvents++;
     ImGui_ImplGlfw_CharCallback(window, ch);
 }
 
 void OnScroll(GLFWwindow *window, double xoffset, double yoffset)
 {
+    s_inputEvents++;
     ImGui_ImplGlfw_ScrollCallback(window, xoffset, yoffset);
 }
+
+void OnWindowRefresh(GLFWwindow *window)
+{
+    s_refreshRequested = true;
+}
 //----------------------------------------------------------//
 
 int main(int argc, char **args)
 {
+    // console output is written by a background thread from here on
+    AsyncLogOptions logOptions;
+    ParseAsyncLogOptions(argc, args, logOptions);
+    AsyncLog::Init(logOptions);
+
+    // render farm / ci: no window, frames go to png files
+    HeadlessOptions headlessOptions;
+    if (ParseHeadlessOptions(argc, args, headlessOptions))
+        return RunHeadless(headlessOptions);
+
+    BenchmarkOptions benchmarkOptions;
+    BenchmarkUPtr benchmark;
+    if (ParseBenchmarkOptions(argc, args, benchmarkOptions))
+    {
+        benchmark = Benchmark::Load(benchmarkOptions.script);
+        if (!benchmark)
+            return -1;
+    }
+
     // glfw init
     SPDLOG_INFO("init glfw");
     if (!glfwInit())
@@ -68,7 +112,8 @@ int main(int argc, char **args)
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
     glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-    glfwWindowHint(GLFW_SAMPLES, 4);
+    // the scene renders into its own targets, anti-aliasing is configured there
+    glfwWindowHint(GLFW_SAMPLES, 0);
 
     // glfw 윈도우 생성
     SPDLOG_INFO("Create glfw window");
@@ -90,6 +135,14 @@ int main(int argc, char **args)
     }
     auto glVersion = reinterpret_cast<const char *>(glGetString(GL_VERSION));
     SPDLOG_INFO("OpenGL context version: {}", glVersion);
+    // --capture records every gl call from here on, for gl_replay
+    GLCaptureOptions captureOptions;
+    if (ParseGLCaptureOptions(argc, args, captureOptions))
+    {
+        int framebufferWidth = 0, framebufferHeight = 0;
+        glfwGetFramebufferSize(window, &framebufferWidth, &framebufferHeight);
+        GLCapture::Start(captureOptions, framebufferWidth, framebufferHeight);
+    }
     // ImGui init
     auto imguiContext = ImGui::CreateContext();
     ImGui::SetCurrentContext(imguiContext);
@@ -98,44 +151,187 @@ int main(int argc, char **args)
     ImGui_ImplOpenGL3_CreateFontsTexture();
     ImGui_ImplOpenGL3_CreateDeviceObjects();
 
+    // textures and buffers are decoded and uploaded on a second context sharing
+    // objects with the window's. gl capture records one thread, it keeps them here
+    ResourceLoaderPtr resourceLoader = GLCapture::IsCapturing() ? nullptr : ResourceLoader::Create(window);
+    if (!resourceLoader)
+        resourceLoader = ResourceLoader::CreateImmediate();
+    // benchmarks measure the same full resolution textures in every frame
+    if (benchmark)
+        resourceLoader->GetResidencyManager()->SetOnDemand(false);
+
     // create context
-    auto context = Context::Create();
+    auto context = Context::Create(resourceLoader);
     if (!context)
     {
         SPDLOG_ERROR("failed to init context");
         glfwTerminate();
         return -1;
     }
+    // benchmarks measure the complete scene from the first frame
+    if (benchmark)
+        resourceLoader->Finish();
     glfwSetWindowUserPointer(window, context.get());
     // set events
     onFramebufferSizeChange(window, WINDOW_WIDTH, WINDOW_HEIGHT);
     glfwSetFramebufferSizeCallback(window, onFramebufferSizeChange);
-    glfwSetKeyCallback(window, onKeyEvent);
-    glfwSetCursorPosCallback(window, OnCursorPos);
-    glfwSetMouseButtonCallback(window, OnMouseButton);
-    glfwSetCharCallback(window, OnCharEvent);
-    glfwSetScrollCallback(window, OnScroll);
+    if (benchmark)
+    {
+        // no input and no vsync, the script drives the camera
+        if (!benchmark->Apply(context.get()))
+        {
+            glfwTerminate();
+            return -1;
+        }
+        glfwSwapInterval(0);
+    }
+    else
+    {
+        glfwSetKeyCallback(window, onKeyEvent);
+        glfwSetCursorPosCallback(window, OnCursorPos);
+        glfwSetMouseButtonCallback(window, OnMouseButton);
+        glfwSetCharCallback(window, OnCharEvent);
+        glfwSetScrollCallback(window, OnScroll);
+        glfwSetWindowRefreshCallback(window, OnWindowRefresh);
+    }
     // backbuffer draw
     glClearColor(0.0f, 0.1f, 0.2f, 0.0f);
     glClear(GL_COLOR_BUFFER_BIT);
 
     // glfw 루프 실행, 윈도우 close 버튼을 누르면 정상 종료
     SPDLOG_INFO("Start main loop");
+    CpuProfiler::SetThreadName("main");
+    auto frameLoop = FrameLoop::Create();
+    context->SetFrameLoop(frameLoop.get());
+    frameLoop->SetIdleEnabled(!benchmark);
+    // fences after each swap bound how far the cpu runs ahead of the gpu
+    auto frameLatencyLimiter = FrameLatencyLimiter::Create(ParseMaxFramesInFlight(argc, args, 2));
+    context->SetFrameLatencyLimiter(frameLatencyLimiter.get());
+    uint64_t lastInputEvents = 0;
+    // --render-thread: gl submission and present move to their own thread, this
+    // one keeps events, ui and simulation. benchmarks stay single threaded
+    RenderThreadUPtr renderThread;
+    if (ParseRenderThreadOptions(argc, args))
+    {
+        if (benchmark)
+            SPDLOG_WARN("--render-thread is ignored in benchmark runs");
+        else
+            renderThread = RenderThread::Create(window, context.get(), frameLoop.get(), frameLatencyLimiter.get());
+    }
+    double lastFrameTime = glfwGetTime();
     while (!glfwWindowShouldClose(window))
     {
-        glfwPollEvents();
+        CpuProfiler::FrameMark();
+        double frameTime = glfwGetTime();
+        LOG_TELEMETRY("frame ms", (float)((frameTime - lastFrameTime) * 1000.0));
+        {
+            CPU_ZONE("poll events");
+            // nothing changes while idle, sleep until an event arrives
+            if (frameLoop->IsIdle())
+                glfwWaitEventsTimeout(frameLoop->GetIdleTimeout());
+            else
+                glfwPollEvents();
+        }
+        if (s_inputEvents != lastInputEvents || context->IsAnimating())
+        {
+            lastInputEvents = s_inputEvents;
+            frameLoop->NotifyActivity();
+        }
+
+        // simulation in fixed ticks, benchmarks advance exactly one tick per frame
+        frameLoop->BeginFrame(benchmark ? benchmark->GetFrameDeltaTime() : frameTime - lastFrameTime);
+        lastFrameTime = frameTime;
+        if (!benchmark)
+            context->ProcessInput(window);
+        {
+            CPU_ZONE("simulation");
+            while (frameLoop->Tick())
+                context->Update(frameLoop->GetTime().dt);
+        }
+        if (!frameLoop->ShouldRender(glfwGetTime()))
+        {
+            if (!frameLoop->IsIdle())
+            {
+                // render rate limited: wait for events instead of spinning
+                glfwWaitEventsTimeout(frameLoop->GetTimeToNextRender(glfwGetTime()));
+            }
+            else if (s_refreshRequested)
+            {
+                // window uncovered or moved between screens: show the kept frame again
+                auto frame = context->CaptureFrame();
+                frame.represent = true;
+                if (renderThread)
+                {
+                    renderThread->Submit(frame, nullptr);
+                }
+                else
+                {
+                    context->RenderFrame(frame);
+                    glfwSwapBuffers(window);
+                }
+                frameLoop->RecordRepresent();
+            }
+            s_refreshRequested = false;
+            continue;
+        }
+        s_refreshRequested = false;
 
         ImGui_ImplGlfw_NewFrame();
+        if (benchmark)
+        {
+            ImGui::GetIO().DeltaTime = benchmark->GetFrameDeltaTime();
+            benchmark->BeginFrame(context.get());
+        }
         ImGui::NewFrame();
 
-        context->ProcessInput(window);
-        context->Render();
-
+        context->DrawUI();
+        if (ImGui::IsAnyItemActive())
+            frameLoop->NotifyActivity();
+        auto frame = context->CaptureFrame();
+        frame.keepForRepresent = frameLoop->IsLastActiveFrame();
         ImGui::Render();
-        ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
-        glfwSwapBuffers(window);
+        if (renderThread)
+        {
+            renderThread->Submit(frame, ImGui::GetDrawData());
+            continue;
+        }
+
+        context->RenderFrame(frame, ImGui::GetDrawData());
+        if (benchmark)
+            benchmark->EndCpuFrame();
+        {
+            CPU_ZONE("swap buffers");
+            glfwSwapBuffers(window);
+        }
+        frameLatencyLimiter->EndFrame(frame.eventTime);
+        GLCapture::EndFrame();
+        if (!benchmark)
+            frameLoop->RecordPresent(frame.inputTime, glfwGetTime());
+        if (benchmark)
+        {
+            benchmark->EndFrame();
+            if (benchmark->IsFinished())
+                break;
+        }
+    }
+
+    // finishes the frame in flight and hands the gl context back
+    renderThread = nullptr;
+    frameLoop->LogStats();
+    frameLatencyLimiter = nullptr;
+    GLCapture::Stop();
+    int result = 0;
+    if (benchmark)
+    {
+        if (!benchmark->WriteReport(benchmarkOptions.report))
+            result = -1;
+        else if (!benchmarkOptions.baseline.empty() &&
+                 !benchmark->CompareWithBaseline(benchmarkOptions.baseline, benchmarkOptions.threshold))
+            result = 1;
+        benchmark = nullptr;
     }
     context = nullptr;
+    resourceLoader = nullptr;
 
     ImGui_ImplOpenGL3_DestroyFontsTexture();
     ImGui_ImplOpenGL3_DestroyDeviceObjects();
@@ -144,5 +340,5 @@ int main(int argc, char **args)
     ImGui::DestroyContext(imguiContext);
 
     glfwTerminate();
-    return 0;
+    return result;
 }
\ No newline at end of file
@@ -1,17 +1,19 @@
 #include "mesh.h"
 
-void Material::SetToProgram(const Program* program) const {
+void Material::SetToProgram(const Program* program, float pixelsAcross) const {
     int textureCount = 0;
     if (diffuse) {
         glActiveTexture(GL_TEXTURE0 + textureCount);
         program->SetUniform("material.diffuse", textureCount);
         diffuse->Bind();
+        diffuse->MarkUsed(pixelsAcross);
         textureCount++;
     }
     if (specular) {
         glActiveTexture(GL_TEXTURE0 + textureCount);
         program->SetUniform("material.specular", textureCount);
         specular->Bind();
+        specular->MarkUsed(pixelsAcross);
         textureCount++;
     }
     glActiveTexture(GL_TEXTURE0);
@@ -24,26 +26,83 @@ MeshUPtr Mesh::Create(
         return std::move(mesh);
 }
 
+MeshUPtr Mesh::CreateWithoutBuffers(
+  const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices, uint32_t primitiveType) {
+  auto mesh = MeshUPtr(new Mesh());
+  mesh->InitGeometry(vertices, indices, primitiveType);
+  return std::move(mesh);
+}
+
 void Mesh::Init(
   const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices, uint32_t primitiveType) {
+  InitGeometry(vertices, indices, primitiveType);
+  SetBuffers(
+    Buffer::CreateWithData(GL_ARRAY_BUFFER, GL_STATIC_DRAW, vertices.data(), sizeof(Vertex), vertices.size()),
+    Buffer::CreateWithData(GL_ELEMENT_ARRAY_BUFFER, GL_STATIC_DRAW, indices.data(), sizeof(uint32_t), indices.size()),
+    Buffer::CreateWithData(GL_ARRAY_BUFFER, GL_STATIC_DRAW, m_positions.data(), sizeof(glm::vec3), m_positions.size()));
+}
+
+void Mesh::InitGeometry(
+  const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices, uint32_t primitiveType) {
+  m_primitiveType = primitiveType;
+  // tightly packed positions keep depth-only passes from fetching normals and uvs
+  m_positions.resize(vertices.size());
+  for (size_t i = 0; i < vertices.size(); i++)
+    m_positions[i] = vertices[i].position;
+  m_indices = indices;
+  if (!m_positions.empty()) {
+    m_boundsMin = m_boundsMax = m_positions[0];
+    for (auto& position : m_positions) {
+      m_boundsMin = glm::min(m_boundsMin, position);
+      m_boundsMax = glm::max(m_boundsMax, position);
+    }
+  }
+}
+
+void Mesh::SetBuffers(BufferPtr vertexBuffer, BufferPtr indexBuffer, BufferPtr positionBuffer) {
+  m_vertexBuffer = vertexBuffer;
+  m_indexBuffer = indexBuffer;
+  m_positionBuffer = positionBuffer;
   //vao
   m_vertexLayout = VertexLayout::Create();
-  //vbo
-  m_vertexBuffer = Buffer::CreateWithData( GL_ARRAY_BUFFER, GL_STATIC_DRAW, vertices.data(), sizeof(Vertex), vertices.size());
-  //ebo
-  m_indexBuffer = Buffer::CreateWithData( GL_ELEMENT_ARRAY_BUFFER, GL_STATIC_DRAW, indices.data(), sizeof(uint32_t), indices.size());
-  //vao setting
+  m_vertexBuffer->Bind();
+  m_indexBuffer->Bind();
   m_vertexLayout->SetAttrib(0, 3, GL_FLOAT, false, sizeof(Vertex), 0);
   m_vertexLayout->SetAttrib(1, 3, GL_FLOAT, false, sizeof(Vertex), offsetof(Vertex, normal));
   m_vertexLayout->SetAttrib(2, 2, GL_FLOAT, false, sizeof(Vertex), offsetof(Vertex, texCoord));
-  
+
+  m_positionLayout = VertexLayout::Create();
+  m_positionBuffer->Bind();
+  m_indexBuffer->Bind();
+  m_positionLayout->SetAttrib(0, 3, GL_FLOAT, false, sizeof(glm::vec3), 0);
+  glBindVertexArray(0);
+}
+Mesh::DrawStats Mesh::s_drawStats;
+
+void Mesh::CountDraw() const {
+    s_drawStats.drawCalls++;
+    if (m_primitiveType == GL_TRIANGLES)
+        s_drawStats.triangles += m_indexBuffer->GetCount() / 3;
 }
-void Mesh::Draw(const Program* program) const {
+
+void Mesh::Draw(const Program* program, float pixelsAcross) const {
+    // buffers still on the resource loader
+    if (!m_vertexLayout)
+        return;
     m_vertexLayout->Bind();
     if (m_material) {
-        m_material->SetToProgram(program);
+        m_material->SetToProgram(program, pixelsAcross);
     }
     glDrawElements(m_primitiveType, m_indexBuffer->GetCount(), GL_UNSIGNED_INT, 0);
+    CountDraw();
+}
+
+void Mesh::DrawDepthOnly() const {
+    if (!m_positionLayout)
+        return;
+    m_positionLayout->Bind();
+    glDrawElements(m_primitiveType, m_indexBuffer->GetCount(), GL_UNSIGNED_INT, 0);
+    CountDraw();
 }
 
 MeshUPtr Mesh::CreateBox() {
@@ -23,7 +23,8 @@ public:
     TexturePtr specular;
     float shininess { 32.0f };
 
-    void SetToProgram(const Program* program) const;
+    // pixelsAcross: the screen size of what is drawn, for texture residency
+    void SetToProgram(const Program* program, float pixelsAcross = 0.0f) const;
 
 private:
     Material() {}
@@ -35,6 +36,13 @@ public:
   static MeshUPtr Create(const std::vector<Vertex>& vertices,const std::vector<uint32_t>& indices, uint32_t primitiveType);
   static MeshUPtr CreateBox();
   static MeshUPtr CreatePlane();
+  // without gl buffers, nothing is drawn until SetBuffers. for buffers created
+  // on the resource loader's thread
+  static MeshUPtr CreateWithoutBuffers(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices,
+    uint32_t primitiveType);
+  // on the render context: sets up the vertex layouts of buffers holding the
+  // vertices, the indices and GetPositions()
+  void SetBuffers(BufferPtr vertexBuffer, BufferPtr indexBuffer, BufferPtr positionBuffer);
 
   const VertexLayout* GetVertexLayout() const {
     return m_vertexLayout.get();
@@ -44,7 +52,24 @@ public:
   void SetMaterial(MaterialPtr material) { m_material = material; }
   MaterialPtr GetMaterial() const { return m_material; }
 
-  void Draw(const Program* program) const;
+  // cpu copies kept for the software occlusion rasterizer and bounds tests
+  const std::vector<glm::vec3>& GetPositions() const { return m_positions; }
+  const std::vector<uint32_t>& GetIndices() const { return m_indices; }
+  glm::vec3 GetBoundsMin() const { return m_boundsMin; }
+  glm::vec3 GetBoundsMax() const { return m_boundsMax; }
+
+  void Draw(const Program* program, float pixelsAcross = 0.0f) const;
+  // position-only stream for depth passes, no material binding
+  void DrawDepthOnly() const;
+
+  // draws submitted since the last reset, across all meshes. draws skipped on
+  // the gpu by conditional rendering still count
+  struct DrawStats {
+    uint64_t drawCalls { 0 };
+    uint64_t triangles { 0 };
+  };
+  static void ResetDrawStats() { s_drawStats = DrawStats(); }
+  static const DrawStats& GetDrawStats() { return s_drawStats; }
 
 private:
   Mesh() {}
@@ -52,12 +77,23 @@ private:
     const std::vector<Vertex>& vertices,
     const std::vector<uint32_t>& indices,
     uint32_t primitiveType);
+  // the cpu copies and bounds
+  void InitGeometry(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices, uint32_t primitiveType);
 
   uint32_t m_primitiveType { GL_TRIANGLES };
   VertexLayoutUPtr m_vertexLayout;
+  VertexLayoutUPtr m_positionLayout;
   BufferPtr m_vertexBuffer;
+  BufferPtr m_positionBuffer;
   BufferPtr m_indexBuffer;
   MaterialPtr m_material;
+  std::vector<glm::vec3> m_positions;
+  std::vector<uint32_t> m_indices;
+  glm::vec3 m_boundsMin { glm::vec3(0.0f) };
+  glm::vec3 m_boundsMax { glm::vec3(0.0f) };
+
+  void CountDraw() const;
+  static DrawStats s_drawStats;
 };
 
 #endif // __MESH_H__
\ No newline at end of file
@@ -0,0 +1,258 @@
+#include "mip_generator.h"
+#include "cpu_profiler.h"
+#include <algorithm>
+#include <cmath>
+
+#if defined(__AVX__)
+#define MIP_GENERATOR_AVX 1
+#include <immintrin.h>
+#endif
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define MIP_GENERATOR_SSE 1
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+const float KaiserWidth = 3.0f;   // sinc lobes on each side, in texels of the smaller level
+const float KaiserAlpha = 4.0f;
+
+float Sinc(float x) {
+  if (fabsf(x) < 1e-4f)
+    return 1.0f;
+  x *= 3.14159265f;
+  return sinf(x) / x;
+}
+
+float BesselI0(float x) {
+  float sum = 1.0f, term = 1.0f;
+  for (int k = 1; k < 32; k++) {
+    term *= x * 0.5f / k;
+    sum += term * term;
+    if (term * term < sum * 1e-8f)
+      break;
+  }
+  return sum;
+}
+
+float KaiserWindow(float t) {
+  if (fabsf(t) >= 1.0f)
+    return 0.0f;
+  return BesselI0(KaiserAlpha * sqrtf(1.0f - t * t)) / BesselI0(KaiserAlpha);
+}
+
+// weights of one axis: output i sums taps input texels, indices and weights
+// at [i * taps, (i + 1) * taps). indices are clamped to the edge
+struct AxisFilter {
+  int taps { 0 };
+  std::vector<int> indices;
+  std::vector<float> weights;
+};
+
+AxisFilter CreateAxisFilter(int inputSize, int outputSize, MipFilter filter) {
+  float scale = (float)inputSize / outputSize;
+  float radius = filter == MipFilter::Box ? scale * 0.5f : KaiserWidth * scale;   // in input texels
+  int maxTaps = (int)ceilf(radius * 2.0f) + 1;
+  std::vector<int> firsts(outputSize);
+  std::vector<float> weights((size_t)outputSize * maxTaps);
+  int taps = 1;
+  for (int i = 0; i < outputSize; i++) {
+    float center = (i + 0.5f) * scale;
+    firsts[i] = (int)floorf(center - radius);
+    float* weight = &weights[(size_t)i * maxTaps];
+    float sum = 0.0f;
+    for (int k = 0; k < maxTaps; k++) {
+      int texel = firsts[i] + k;
+      if (filter == MipFilter::Box) {
+        // the part of the texel inside the footprint
+        weight[k] = std::max(std::min(texel + 1.0f, center + radius) - std::max((float)texel, center - radius), 0.0f);
+      }
+      else {
+        float distance = (texel + 0.5f - center) / scale;
+        weight[k] = Sinc(distance) * KaiserWindow(distance / KaiserWidth);
+      }
+      sum += weight[k];
+      if (weight[k] != 0.0f)
+        taps = std::max(taps, k + 1);
+    }
+    for (int k = 0; k < maxTaps; k++)
+      weight[k] /= sum;
+  }
+
+  // the trailing taps every output weighs zero are dropped
+  AxisFilter axis;
+  axis.taps = taps;
+  axis.indices.resize((size_t)outputSize * taps);
+  axis.weights.resize((size_t)outputSize * taps);
+  for (int i = 0; i < outputSize; i++) {
+    for (int k = 0; k < taps; k++) {
+      axis.indices[(size_t)i * taps + k] = std::min(std::max(firsts[i] + k, 0), inputSize - 1);
+      axis.weights[(size_t)i * taps + k] = weights[(size_t)i * maxTaps + k];
+    }
+  }
+  return axis;
+}
+
+// rows of inputWidth texels into rows of outputWidth, 4 floats per texel
+void FilterRows(const float* input, int inputWidth, int height, const AxisFilter& axis, int outputWidth, float* output) {
+  int taps = axis.taps;
+  for (int y = 0; y < height; y++) {
+    const float* row = input + (size_t)y * inputWidth * 4;
+    float* out = output + (size_t)y * outputWidth * 4;
+    int x = 0;
+#ifdef MIP_GENERATOR_AVX
+    // two output texels per register
+    for (; x + 2 <= outputWidth; x += 2) {
+      const int* indices = &axis.indices[(size_t)x * taps];
+      const float* weights = &axis.weights[(size_t)x * taps];
+      __m256 sum = _mm256_setzero_ps();
+      for (int k = 0; k < taps; k++) {
+        __m256 texels = _mm256_insertf128_ps(_mm256_castps128_ps256(
+          _mm_loadu_ps(row + indices[k] * 4)), _mm_loadu_ps(row + indices[taps + k] * 4), 1);
+        __m256 weight = _mm256_insertf128_ps(_mm256_castps128_ps256(
+          _mm_set1_ps(weights[k])), _mm_set1_ps(weights[taps + k]), 1);
+        sum = _mm256_add_ps(sum, _mm256_mul_ps(texels, weight));
+      }
+      _mm256_storeu_ps(out + x * 4, sum);
+    }
+#endif
+    for (; x < outputWidth; x++) {
+      const int* indices = &axis.indices[(size_t)x * taps];
+      const float* weights = &axis.weights[(size_t)x * taps];
+#ifdef MIP_GENERATOR_SSE
+      __m128 sum = _mm_setzero_ps();
+      for (int k = 0; k < taps; k++)
+        sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(row + indices[k] * 4), _mm_set1_ps(weights[k])));
+      _mm_storeu_ps(out + x * 4, sum);
+#else
+      float sum[4] = {};
+      for (int k = 0; k < taps; k++) {
+        for (int c = 0; c < 4; c++)
+          sum[c] += row[indices[k] * 4 + c] * weights[k];
+      }
+      for (int c = 0; c < 4; c++)
+        out[x * 4 + c] = sum[c];
+#endif
+    }
+  }
+}
+
+// rows of width texels, outputHeight of them from the input rows, contiguous
+// floats so the channel count does not matter
+void FilterColumns(const float* input, int width, const AxisFilter& axis, int outputHeight, float* output) {
+  int taps = axis.taps;
+  size_t rowFloats = (size_t)width * 4;
+  for (int y = 0; y < outputHeight; y++) {
+    const int* indices = &axis.indices[(size_t)y * taps];
+    const float* weights = &axis.weights[(size_t)y * taps];
+    float* out = output + y * rowFloats;
+    size_t i = 0;
+#ifdef MIP_GENERATOR_AVX
+    for (; i + 8 <= rowFloats; i += 8) {
+      __m256 sum = _mm256_setzero_ps();
+      for (int k = 0; k < taps; k++)
+        sum = _mm256_add_ps(sum, _mm256_mul_ps(_mm256_loadu_ps(input + indices[k] * rowFloats + i), _mm256_set1_ps(weights[k])));
+      _mm256_storeu_ps(out + i, sum);
+    }
+#endif
+#ifdef MIP_GENERATOR_SSE
+    for (; i < rowFloats; i += 4) {
+      __m128 sum = _mm_setzero_ps();
+      for (int k = 0; k < taps; k++)
+        sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(input + indices[k] * rowFloats + i), _mm_set1_ps(weights[k])));
+      _mm_storeu_ps(out + i, sum);
+    }
+#else
+    for (; i < rowFloats; i++) {
+      float sum = 0.0f;
+      for (int k = 0; k < taps; k++)
+        sum += input[indices[k] * rowFloats + i] * weights[k];
+      out[i] = sum;
+    }
+#endif
+  }
+}
+
+struct ColorTables {
+  float toLinear[256];
+  uint8_t toSrgb[4096];   // by linear value * 4095
+
+  ColorTables() {
+    for (int i = 0; i < 256; i++) {
+      float srgb = i / 255.0f;
+      toLinear[i] = srgb <= 0.04045f ? srgb / 12.92f : powf((srgb + 0.055f) / 1.055f, 2.4f);
+    }
+    for (int i = 0; i < 4096; i++) {
+      float linear = i / 4095.0f;
+      float srgb = linear <= 0.0031308f ? linear * 12.92f : 1.055f * powf(linear, 1.0f / 2.4f) - 0.055f;
+      toSrgb[i] = (uint8_t)lroundf(srgb * 255.0f);
+    }
+  }
+};
+
+const ColorTables& GetColorTables() {
+  static const ColorTables tables;
+  return tables;
+}
+
+}
+
+int MipGenerator::GetLevelCount(int width, int height) {
+  int levelCount = 1;
+  for (; width > 1 || height > 1; levelCount++) {
+    width = std::max(width / 2, 1);
+    height = std::max(height / 2, 1);
+  }
+  return levelCount;
+}
+
+size_t MipGenerator::GetChainSize(int width, int height, int channelCount) {
+  size_t size = 0;
+  for (int level = 0; level < GetLevelCount(width, height); level++)
+    size += (size_t)std::max(width >> level, 1) * std::max(height >> level, 1) * channelCount;
+  return size;
+}
+
+std::vector<uint8_t> MipGenerator::Generate(const uint8_t* pixels, int width, int height, int channelCount,
+  MipFilter filter, bool srgb) {
+  CPU_ZONE("mip generation");
+  auto& tables = GetColorTables();
+  int colorChannels = srgb && channelCount >= 3 ? 3 : 0;
+  std::vector<uint8_t> chain(GetChainSize(width, height, channelCount) - (size_t)width * height * channelCount);
+
+  // 4 floats per texel whatever the channel count, one simd lane each
+  std::vector<float> level((size_t)width * height * 4), rows, next;
+  for (size_t i = 0; i < (size_t)width * height; i++) {
+    for (int c = 0; c < channelCount; c++) {
+      uint8_t value = pixels[i * channelCount + c];
+      level[i * 4 + c] = c < colorChannels ? tables.toLinear[value] : value / 255.0f;
+    }
+  }
+
+  size_t offset = 0;
+  while (width > 1 || height > 1) {
+    int nextWidth = std::max(width / 2, 1), nextHeight = std::max(height / 2, 1);
+    auto horizontal = CreateAxisFilter(width, nextWidth, filter);
+    auto vertical = CreateAxisFilter(height, nextHeight, filter);
+    rows.resize((size_t)nextWidth * height * 4);
+    next.resize((size_t)nextWidth * nextHeight * 4);
+    FilterRows(level.data(), width, height, horizontal, nextWidth, rows.data());
+    FilterColumns(rows.data(), nextWidth, vertical, nextHeight, next.data());
+
+    // the sinc lobes overshoot at edges, the next level starts from the clamped values
+    uint8_t* out = chain.data() + offset;
+    for (size_t i = 0; i < (size_t)nextWidth * nextHeight; i++) {
+      for (int c = 0; c < channelCount; c++) {
+        float value = std::min(std::max(next[i * 4 + c], 0.0f), 1.0f);
+        next[i * 4 + c] = value;
+        out[i * channelCount + c] = c < colorChannels ? tables.toSrgb[(int)(value * 4095.0f + 0.5f)] :
+          (uint8_t)(value * 255.0f + 0.5f);
+      }
+    }
+    offset += (size_t)nextWidth * nextHeight * channelCount;
+    level.swap(next);
+    width = nextWidth;
+    height = nextHeight;
+  }
+  return chain;
+}
@@ -0,0 +1,33 @@
+#ifndef __MIP_GENERATOR_H__
+#define __MIP_GENERATOR_H__
+
+#include "common.h"
+#include <vector>
+
+enum class MipFilter {
+  Box,      // 2x2 average, soft
+  Kaiser,   // kaiser windowed sinc, keeps detail with little ringing
+};
+
+// mip chains of 8-bit images with 1 to 4 interleaved channels, computed on the
+// cpu so the gl thread only uploads them. every level is filtered from the
+// float result of the one before with a separable kernel; the passes use
+// sse, or avx in builds for it (USE_AVX), over 4 floats per texel.
+//
+// with srgb the color channels of 3 and 4 channel images are gamma encoded:
+// they are filtered in linear space and encoded again, so bright and dark
+// texels average the way they look. alpha, and 1 or 2 channel images, which
+// hold data like masks and normals, are filtered as they are.
+class MipGenerator {
+public:
+  // levels 1 and down of a width x height image, each max(size / 2, 1) of the
+  // one before down to 1x1, tightly packed rows, one level after the other
+  static std::vector<uint8_t> Generate(const uint8_t* pixels, int width, int height, int channelCount,
+    MipFilter filter = MipFilter::Kaiser, bool srgb = true);
+  // levels down to 1x1, the full size one included
+  static int GetLevelCount(int width, int height);
+  // bytes of every level, the full size one included
+  static size_t GetChainSize(int width, int height, int channelCount);
+};
+
+#endif // __MIP_GENERATOR_H__
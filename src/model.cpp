@@ -1,13 +1,24 @@
 #include "model.h"
+#include "cpu_profiler.h"
+#include "async_log.h"
+#include "resource_loader.h"
 
-ModelUPtr Model::Load(const std::string& filename) {
+// the gl buffers of a mesh, created together on the loader thread
+struct MeshBuffers {
+  BufferPtr vertex;
+  BufferPtr index;
+  BufferPtr position;
+};
+
+ModelUPtr Model::Load(const std::string& filename, ResourceLoader* loader) {
   auto model = ModelUPtr(new Model());
-  if (!model->LoadByAssimp(filename))
+  if (!model->LoadByAssimp(filename, loader))
     return nullptr;
   return std::move(model);
 }
 
-bool Model::LoadByAssimp(const std::string& filename) {
+bool Model::LoadByAssimp(const std::string& filename, ResourceLoader* loader) {
+  CPU_ZONE("load model");
   Assimp::Importer importer;
   auto scene = importer.ReadFile(filename, aiProcess_Triangulate | aiProcess_FlipUVs);
 
@@ -16,42 +27,56 @@ bool Model::LoadByAssimp(const std::string& filename) {
     return false;
   }
   auto dirname = filename.substr(0, filename.find_last_of("/"));
-  auto LoadTexture = [&](aiMaterial* material, aiTextureType type) -> TexturePtr {
+  auto LoadTexture = [&](aiMaterial* material, aiTextureType type, MaterialPtr glMaterial,
+    TexturePtr Material::* slot) {
     if (material->GetTextureCount(type) <= 0)
-      return nullptr;
+      return;
     aiString filepath;
     material->GetTexture(type, 0, &filepath);
-    auto image = Image::Load(fmt::format("{}/{}", dirname, filepath.C_Str()));
+    auto path = fmt::format("{}/{}", dirname, filepath.C_Str());
+    if (loader) {
+      (*glMaterial).*slot = loader->GetPlaceholderTexture();
+      loader->LoadTexture(path, [glMaterial, slot](TexturePtr texture) { (*glMaterial).*slot = texture; });
+      return;
+    }
+    auto image = Image::Load(path);
     if (!image)
-      return nullptr;
-    return Texture::CreateFromImage(image.get());
+      return;
+    image->GenerateMipmaps();
+    (*glMaterial).*slot = Texture::CreateFromImage(image.get());
   };
 
   for (uint32_t i = 0; i < scene->mNumMaterials; i++) {
     auto material = scene->mMaterials[i];
-    auto glMaterial = Material::Create();
-    glMaterial->diffuse = LoadTexture(material, aiTextureType_DIFFUSE);
-    glMaterial->specular = LoadTexture(material, aiTextureType_SPECULAR);
+    MaterialPtr glMaterial = Material::Create();
+    LoadTexture(material, aiTextureType_DIFFUSE, glMaterial, &Material::diffuse);
+    LoadTexture(material, aiTextureType_SPECULAR, glMaterial, &Material::specular);
     m_materials.push_back(std::move(glMaterial));
   }
-  ProcessNode(scene->mRootNode, scene);
+  ProcessNode(scene->mRootNode, scene, loader);
+  SPDLOG_INFO("loaded model: {}, {} meshes, {} materials", filename, m_meshes.size(), m_materials.size());
+  for (size_t i = 0; i < m_meshes.size(); i++) {
+    m_boundsMin = i == 0 ? m_meshes[i]->GetBoundsMin() : glm::min(m_boundsMin, m_meshes[i]->GetBoundsMin());
+    m_boundsMax = i == 0 ? m_meshes[i]->GetBoundsMax() : glm::max(m_boundsMax, m_meshes[i]->GetBoundsMax());
+  }
   return true;
 }
 
-void Model::ProcessNode(aiNode* node, const aiScene* scene) {
+void Model::ProcessNode(aiNode* node, const aiScene* scene, ResourceLoader* loader) {
   for (uint32_t i = 0; i < node->mNumMeshes; i++) {
     auto meshIndex = node->mMeshes[i];
     auto mesh = scene->mMeshes[meshIndex];
-    ProcessMesh(mesh, scene);
+    ProcessMesh(mesh, scene, loader);
   }
 
   for (uint32_t i = 0; i < node->mNumChildren; i++) {
-    ProcessNode(node->mChildren[i], scene);
+    ProcessNode(node->mChildren[i], scene, loader);
   }
 }
 
-void Model::ProcessMesh(aiMesh* mesh, const aiScene* scene) {
-  SPDLOG_INFO("process mesh: {}, #vert: {}, #face: {}",
+void Model::ProcessMesh(aiMesh* mesh, const aiScene* scene, ResourceLoader* loader) {
+  // scenes with thousands of meshes flooded the log, the model summary is logged instead
+  LOG_RATE_LIMITED(spdlog::level::debug, 10, "process mesh: {}, #vert: {}, #face: {}",
     mesh->mName.C_Str(), mesh->mNumVertices, mesh->mNumFaces);
 
   std::vector<Vertex> vertices;
@@ -71,7 +96,28 @@ void Model::ProcessMesh(aiMesh* mesh, const aiScene* scene) {
     indices[3*i+2] = mesh->mFaces[i].mIndices[2];
   }
 
-  auto glMesh = Mesh::Create(vertices, indices, GL_TRIANGLES);
+  MeshPtr glMesh;
+  if (loader) {
+    // buffers on the loader thread, vertex arrays are not shared and get set
+    // up on the render context once they are handed over
+    glMesh = Mesh::CreateWithoutBuffers(vertices, indices, GL_TRIANGLES);
+    loader->Load<MeshBuffers>(mesh->mName.C_Str(),
+      [vertices = std::move(vertices), indices = std::move(indices), positions = glMesh->GetPositions()]() {
+        auto buffers = std::make_shared<MeshBuffers>();
+        buffers->vertex = Buffer::CreateWithData(GL_ARRAY_BUFFER, GL_STATIC_DRAW, vertices.data(), sizeof(Vertex), vertices.size());
+        buffers->index = Buffer::CreateWithData(GL_ELEMENT_ARRAY_BUFFER, GL_STATIC_DRAW, indices.data(), sizeof(uint32_t), indices.size());
+        buffers->position = Buffer::CreateWithData(GL_ARRAY_BUFFER, GL_STATIC_DRAW, positions.data(), sizeof(glm::vec3), positions.size());
+        return buffers->vertex && buffers->index && buffers->position ? buffers : nullptr;
+      },
+      [weakMesh = MeshWPtr(glMesh)](std::shared_ptr<MeshBuffers> buffers) {
+        auto glMesh = weakMesh.lock();
+        if (glMesh && buffers)
+          glMesh->SetBuffers(buffers->vertex, buffers->index, buffers->position);
+      });
+  }
+  else {
+    glMesh = Mesh::Create(vertices, indices, GL_TRIANGLES);
+  }
   if(mesh->mMaterialIndex >=0){
     glMesh->SetMaterial(m_materials[mesh->mMaterialIndex]);
   }
@@ -82,4 +128,10 @@ void Model::Draw(const Program* program) const {
   for (auto& mesh: m_meshes) {
     mesh->Draw(program);
   }
+}
+
+void Model::DrawDepthOnly() const {
+  for (auto& mesh: m_meshes) {
+    mesh->DrawDepthOnly();
+  }
 }
\ No newline at end of file
@@ -8,23 +8,32 @@
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
 
+class ResourceLoader;
+
 CLASS_PTR(Model);
 class Model {
 public:
-    static ModelUPtr Load(const std::string& filename);
+    // with a loader the textures and the mesh buffers arrive later: materials
+    // show its placeholder and meshes draw nothing until then
+    static ModelUPtr Load(const std::string& filename, ResourceLoader* loader = nullptr);
 
     int GetMeshCount() const { return (int)m_meshes.size(); }
     MeshPtr GetMesh(int index) const { return m_meshes[index]; }
+    glm::vec3 GetBoundsMin() const { return m_boundsMin; }
+    glm::vec3 GetBoundsMax() const { return m_boundsMax; }
     void Draw(const Program* program) const;
+    void DrawDepthOnly() const;
     
 private:
     Model() {}
-    bool LoadByAssimp(const std::string& filename);
-    void ProcessMesh(aiMesh* mesh, const aiScene* scene);
-    void ProcessNode(aiNode* node, const aiScene* scene);
+    bool LoadByAssimp(const std::string& filename, ResourceLoader* loader);
+    void ProcessMesh(aiMesh* mesh, const aiScene* scene, ResourceLoader* loader);
+    void ProcessNode(aiNode* node, const aiScene* scene, ResourceLoader* loader);
         
     std::vector<MeshPtr> m_meshes;
     std::vector<MaterialPtr> m_materials;
+    glm::vec3 m_boundsMin { glm::vec3(0.0f) };
+    glm::vec3 m_boundsMax { glm::vec3(0.0f) };
 
 };
 
@@ -0,0 +1,321 @@
+#include "occlusion_culler.h"
+#include "cpu_profiler.h"
+#include <algorithm>
+#include <chrono>
+#include <limits>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define OCCLUSION_CULLER_SSE 1
+#include <emmintrin.h>
+#endif
+
+OcclusionCullerUPtr OcclusionCuller::Create(ThreadPoolPtr threadPool, int width, int height) {
+  auto culler = OcclusionCullerUPtr(new OcclusionCuller());
+  if (!culler->Init(threadPool, width, height))
+    return nullptr;
+  return std::move(culler);
+}
+
+OcclusionCuller::~OcclusionCuller() {
+}
+
+bool OcclusionCuller::Init(ThreadPoolPtr threadPool, int width, int height) {
+  // bands and simd rows need whole tiles
+  if (width <= 0 || height <= 0 || width % TileSize || height % BandHeight) {
+    SPDLOG_ERROR("invalid occlusion buffer size: {}x{}", width, height);
+    return false;
+  }
+  m_threadPool = threadPool;
+  m_width = width;
+  m_height = height;
+  m_tilesX = width / TileSize;
+  m_tilesY = height / TileSize;
+  m_depth.resize(m_width * m_height, 1.0f);
+  m_tileMaxDepth.resize(m_tilesX * m_tilesY, 1.0f);
+  return true;
+}
+
+void OcclusionCuller::BeginFrame(const glm::mat4& viewProjection) {
+  m_viewProjection = viewProjection;
+  m_batches.clear();
+  m_triangleCount = 0;
+  m_testedCount = 0;
+  m_occludedCount = 0;
+  m_outsideCount = 0;
+}
+
+void OcclusionCuller::AddOccluder(const std::vector<glm::vec3>& positions,
+  const std::vector<uint32_t>& indices, const glm::mat4& modelTransform) {
+  // the geometry is referenced, not copied, until Rasterize() returns
+  OccluderBatch batch;
+  batch.positions = &positions;
+  batch.indices = &indices;
+  batch.transform = m_viewProjection * modelTransform;
+  m_batches.push_back(std::move(batch));
+}
+
+void OcclusionCuller::Rasterize() {
+  CPU_ZONE("occluder rasterize");
+  auto start = std::chrono::high_resolution_clock::now();
+
+  // triangle setup, split into fixed size chunks across all occluders
+  struct SetupJob {
+    size_t batch;
+    size_t first;
+    size_t last;
+  };
+  std::vector<SetupJob> jobs;
+  for (size_t i = 0; i < m_batches.size(); i++) {
+    size_t triangleCount = m_batches[i].indices->size() / 3;
+    for (size_t first = 0; first < triangleCount; first += SetupChunkSize)
+      jobs.push_back({ i, first, std::min(first + SetupChunkSize, triangleCount) });
+  }
+  m_setupChunks.resize(jobs.size());
+  m_threadPool->ParallelFor((int)jobs.size(), [&](int i) {
+    m_setupChunks[i].clear();
+    SetupTriangles(m_batches[jobs[i].batch], jobs[i].first, jobs[i].last, m_setupChunks[i]);
+  });
+  m_triangleCount = 0;
+  for (auto& chunk : m_setupChunks)
+    m_triangleCount += (int)chunk.size();
+
+  // each band owns its rows of the depth buffer and the tiles inside them
+  m_threadPool->ParallelFor(m_height / BandHeight, [this](int band) { RasterizeBand(band); });
+
+  auto end = std::chrono::high_resolution_clock::now();
+  m_rasterizeTime = std::chrono::duration<float, std::milli>(end - start).count();
+}
+
+void OcclusionCuller::SetupTriangles(OccluderBatch& batch, size_t firstTriangle, size_t lastTriangle,
+  std::vector<ScreenTriangle>& triangles) const {
+  auto& positions = *batch.positions;
+  auto& indices = *batch.indices;
+  for (size_t t = firstTriangle; t < lastTriangle; t++) {
+    glm::vec4 clip[3];
+    for (int k = 0; k < 3; k++)
+      clip[k] = batch.transform * glm::vec4(positions[indices[3 * t + k]], 1.0f);
+
+    // clip against the near plane (z + w >= 0), the rest is handled by the screen bounds
+    float distance[3];
+    int inside = 0;
+    for (int k = 0; k < 3; k++) {
+      distance[k] = clip[k].z + clip[k].w;
+      inside += distance[k] >= 0.0f ? 1 : 0;
+    }
+    if (inside == 0)
+      continue;
+    if (inside == 3) {
+      AddScreenTriangle(clip, triangles);
+      continue;
+    }
+    glm::vec4 polygon[4];
+    int count = 0;
+    for (int k = 0; k < 3; k++) {
+      int next = (k + 1) % 3;
+      if (distance[k] >= 0.0f)
+        polygon[count++] = clip[k];
+      if ((distance[k] >= 0.0f) != (distance[next] >= 0.0f)) {
+        float t = distance[k] / (distance[k] - distance[next]);
+        polygon[count++] = clip[k] + (clip[next] - clip[k]) * t;
+      }
+    }
+    for (int k = 1; k + 1 < count; k++) {
+      glm::vec4 fan[3] = { polygon[0], polygon[k], polygon[k + 1] };
+      AddScreenTriangle(fan, triangles);
+    }
+  }
+}
+
+void OcclusionCuller::AddScreenTriangle(const glm::vec4 clip[3], std::vector<ScreenTriangle>& triangles) const {
+  ScreenTriangle triangle;
+  float minX = std::numeric_limits<float>::max();
+  float maxX = -minX;
+  float minY = minX;
+  float maxY = -minX;
+  for (int k = 0; k < 3; k++) {
+    float invW = 1.0f / clip[k].w;
+    auto& v = triangle.v[k];
+    v.x = (clip[k].x * invW * 0.5f + 0.5f) * (float)m_width;
+    v.y = (clip[k].y * invW * 0.5f + 0.5f) * (float)m_height;
+    v.z = clip[k].z * invW * 0.5f + 0.5f;
+    minX = std::min(minX, v.x);
+    maxX = std::max(maxX, v.x);
+    minY = std::min(minY, v.y);
+    maxY = std::max(maxY, v.y);
+  }
+  if (maxX < 0.0f || minX > (float)m_width || maxY < 0.0f || minY > (float)m_height)
+    return;
+  float area = (triangle.v[1].x - triangle.v[0].x) * (triangle.v[2].y - triangle.v[0].y) -
+    (triangle.v[2].x - triangle.v[0].x) * (triangle.v[1].y - triangle.v[0].y);
+  if (area == 0.0f)
+    return;
+  // both windings are rasterized, keep them counter-clockwise for the edge functions
+  if (area < 0.0f)
+    std::swap(triangle.v[1], triangle.v[2]);
+  triangle.minY = std::max((int)floorf(minY), 0);
+  triangle.maxY = std::min((int)ceilf(maxY), m_height - 1);
+  triangles.push_back(triangle);
+}
+
+void OcclusionCuller::RasterizeBand(int band) {
+  CPU_ZONE("occluder band");
+  int bandMinY = band * BandHeight;
+  int bandMaxY = bandMinY + BandHeight - 1;
+  std::fill(m_depth.begin() + bandMinY * m_width, m_depth.begin() + (bandMaxY + 1) * m_width, 1.0f);
+
+  for (auto& chunk : m_setupChunks) {
+    for (auto& triangle : chunk) {
+      if (triangle.maxY < bandMinY || triangle.minY > bandMaxY)
+        continue;
+      RasterizeTriangle(triangle, bandMinY, bandMaxY);
+    }
+  }
+
+  // reduce the band to the farthest depth per tile
+  for (int ty = bandMinY / TileSize; ty <= bandMaxY / TileSize; ty++) {
+    for (int tx = 0; tx < m_tilesX; tx++) {
+      float maxDepth = 0.0f;
+      for (int y = ty * TileSize; y < (ty + 1) * TileSize; y++) {
+        const float* row = &m_depth[y * m_width + tx * TileSize];
+        for (int x = 0; x < TileSize; x++)
+          maxDepth = std::max(maxDepth, row[x]);
+      }
+      m_tileMaxDepth[ty * m_tilesX + tx] = maxDepth;
+    }
+  }
+}
+
+void OcclusionCuller::RasterizeTriangle(const ScreenTriangle& triangle, int bandMinY, int bandMaxY) {
+  auto& v0 = triangle.v[0];
+  auto& v1 = triangle.v[1];
+  auto& v2 = triangle.v[2];
+
+  // edge functions E(p) = a * p.x + b * p.y + c, positive inside
+  float a[3], b[3], c[3];
+  const glm::vec3* edges[3][2] = { { &v0, &v1 }, { &v1, &v2 }, { &v2, &v0 } };
+  for (int k = 0; k < 3; k++) {
+    auto& from = *edges[k][0];
+    auto& to = *edges[k][1];
+    a[k] = -(to.y - from.y);
+    b[k] = to.x - from.x;
+    c[k] = -(a[k] * from.x + b[k] * from.y);
+  }
+  // depth plane z(p) = z0 + dzdx * (p.x - x0) + dzdy * (p.y - y0)
+  float area = (v1.x - v0.x) * (v2.y - v0.y) - (v2.x - v0.x) * (v1.y - v0.y);
+  float dzdx = ((v1.z - v0.z) * (v2.y - v0.y) - (v2.z - v0.z) * (v1.y - v0.y)) / area;
+  float dzdy = ((v2.z - v0.z) * (v1.x - v0.x) - (v1.z - v0.z) * (v2.x - v0.x)) / area;
+  float zc = v0.z - dzdx * v0.x - dzdy * v0.y;
+
+  int minX = std::max((int)floorf(std::min({ v0.x, v1.x, v2.x })), 0) & ~3;
+  int maxX = std::min((int)ceilf(std::max({ v0.x, v1.x, v2.x })), m_width - 1);
+  int minY = std::max(triangle.minY, bandMinY);
+  int maxY = std::min(triangle.maxY, bandMaxY);
+
+#ifdef OCCLUSION_CULLER_SSE
+  const __m128 laneOffset = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+  const __m128 zero = _mm_setzero_ps();
+  __m128 a0 = _mm_set1_ps(a[0]), a1 = _mm_set1_ps(a[1]), a2 = _mm_set1_ps(a[2]);
+  __m128 zdx = _mm_set1_ps(dzdx);
+  for (int y = minY; y <= maxY; y++) {
+    float py = (float)y + 0.5f;
+    __m128 rowE0 = _mm_set1_ps(b[0] * py + c[0]);
+    __m128 rowE1 = _mm_set1_ps(b[1] * py + c[1]);
+    __m128 rowE2 = _mm_set1_ps(b[2] * py + c[2]);
+    __m128 rowZ = _mm_set1_ps(dzdy * py + zc);
+    float* row = &m_depth[y * m_width];
+    for (int x = minX; x <= maxX; x += 4) {
+      __m128 px = _mm_add_ps(_mm_set1_ps((float)x), laneOffset);
+      __m128 e0 = _mm_add_ps(_mm_mul_ps(a0, px), rowE0);
+      __m128 e1 = _mm_add_ps(_mm_mul_ps(a1, px), rowE1);
+      __m128 e2 = _mm_add_ps(_mm_mul_ps(a2, px), rowE2);
+      __m128 inside = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(e0, zero), _mm_cmpge_ps(e1, zero)), _mm_cmpge_ps(e2, zero));
+      if (_mm_movemask_ps(inside) == 0)
+        continue;
+      __m128 z = _mm_add_ps(_mm_mul_ps(zdx, px), rowZ);
+      __m128 old = _mm_loadu_ps(row + x);
+      __m128 closer = _mm_min_ps(old, z);
+      _mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, closer), _mm_andnot_ps(inside, old)));
+    }
+  }
+#else
+  for (int y = minY; y <= maxY; y++) {
+    float py = (float)y + 0.5f;
+    float* row = &m_depth[y * m_width];
+    for (int x = minX; x < std::min(maxX + 4, m_width); x++) {
+      float px = (float)x + 0.5f;
+      if (a[0] * px + b[0] * py + c[0] < 0.0f ||
+          a[1] * px + b[1] * py + c[1] < 0.0f ||
+          a[2] * px + b[2] * py + c[2] < 0.0f)
+        continue;
+      row[x] = std::min(row[x], dzdx * px + dzdy * py + zc);
+    }
+  }
+#endif
+}
+
+bool OcclusionCuller::TestBox(const glm::vec3& boundsMin, const glm::vec3& boundsMax, const glm::mat4& modelTransform) {
+  m_testedCount++;
+  auto transform = m_viewProjection * modelTransform;
+  float minX = std::numeric_limits<float>::max();
+  float maxX = -minX;
+  float minY = minX;
+  float maxY = -minX;
+  float minZ = minX;
+  glm::vec4 corners[8];
+  int behindNear = 0;
+  for (int i = 0; i < 8; i++) {
+    auto corner = glm::vec3(
+      (i & 1) ? boundsMax.x : boundsMin.x,
+      (i & 2) ? boundsMax.y : boundsMin.y,
+      (i & 4) ? boundsMax.z : boundsMin.z);
+    corners[i] = transform * glm::vec4(corner, 1.0f);
+    behindNear += corners[i].z < -corners[i].w ? 1 : 0;
+  }
+  if (behindNear == 8) {
+    m_outsideCount++;
+    return false;
+  }
+  // crossing the near plane, nothing to compare against
+  if (behindNear > 0)
+    return true;
+  for (auto& clip : corners) {
+    float invW = 1.0f / clip.w;
+    float x = (clip.x * invW * 0.5f + 0.5f) * (float)m_width;
+    float y = (clip.y * invW * 0.5f + 0.5f) * (float)m_height;
+    minX = std::min(minX, x);
+    maxX = std::max(maxX, x);
+    minY = std::min(minY, y);
+    maxY = std::max(maxY, y);
+    minZ = std::min(minZ, clip.z * invW * 0.5f + 0.5f);
+  }
+  if (maxX < 0.0f || minX > (float)m_width || maxY < 0.0f || minY > (float)m_height || minZ > 1.0f) {
+    m_outsideCount++;
+    return false;
+  }
+
+  int x0 = std::max((int)floorf(minX), 0);
+  int x1 = std::min((int)ceilf(maxX), m_width - 1);
+  int y0 = std::max((int)floorf(minY), 0);
+  int y1 = std::min((int)ceilf(maxY), m_height - 1);
+
+  // coarse test against the tile hierarchy, refine per pixel only in tiles that could pass
+  for (int ty = y0 / TileSize; ty <= y1 / TileSize; ty++) {
+    for (int tx = x0 / TileSize; tx <= x1 / TileSize; tx++) {
+      if (minZ > m_tileMaxDepth[ty * m_tilesX + tx])
+        continue;
+      int px0 = std::max(x0, tx * TileSize);
+      int px1 = std::min(x1, tx * TileSize + TileSize - 1);
+      int py0 = std::max(y0, ty * TileSize);
+      int py1 = std::min(y1, ty * TileSize + TileSize - 1);
+      for (int y = py0; y <= py1; y++) {
+        const float* row = &m_depth[y * m_width];
+        for (int x = px0; x <= px1; x++) {
+          if (minZ <= row[x])
+            return true;
+        }
+      }
+    }
+  }
+  m_occludedCount++;
+  return false;
+}
@@ -0,0 +1,76 @@
+#ifndef __OCCLUSION_CULLER_H__
+#define __OCCLUSION_CULLER_H__
+
+#include "common.h"
+#include "thread_pool.h"
+
+// cpu-only software occlusion culling.
+// designated occluders are rasterized into a low resolution depth buffer in
+// horizontal bands on the worker pool, reduced to a max-depth tile hierarchy,
+// and object bounding boxes are tested against it before draw submission.
+// no gl calls, so it also runs without a context.
+CLASS_PTR(OcclusionCuller)
+class OcclusionCuller {
+public:
+  static OcclusionCullerUPtr Create(ThreadPoolPtr threadPool, int width = 256, int height = 128);
+  ~OcclusionCuller();
+
+  void BeginFrame(const glm::mat4& viewProjection);
+  void AddOccluder(const std::vector<glm::vec3>& positions,
+    const std::vector<uint32_t>& indices, const glm::mat4& modelTransform);
+  void Rasterize();
+  // false when the box is hidden behind occluders or outside the view
+  bool TestBox(const glm::vec3& boundsMin, const glm::vec3& boundsMax, const glm::mat4& modelTransform);
+
+  int GetWidth() const { return m_width; }
+  int GetHeight() const { return m_height; }
+  const std::vector<float>& GetDepth() const { return m_depth; }
+  int GetTriangleCount() const { return m_triangleCount; }
+  int GetTestedCount() const { return m_testedCount; }
+  int GetOccludedCount() const { return m_occludedCount; }
+  int GetOutsideCount() const { return m_outsideCount; }
+  float GetRasterizeTime() const { return m_rasterizeTime; }
+
+private:
+  OcclusionCuller() {}
+  bool Init(ThreadPoolPtr threadPool, int width, int height);
+
+  struct ScreenTriangle {
+    glm::vec3 v[3];   // pixel x, pixel y, depth in [0, 1]
+    int minY, maxY;
+  };
+  struct OccluderBatch {
+    const std::vector<glm::vec3>* positions;
+    const std::vector<uint32_t>* indices;
+    glm::mat4 transform;
+  };
+  void SetupTriangles(OccluderBatch& batch, size_t firstTriangle, size_t lastTriangle,
+    std::vector<ScreenTriangle>& triangles) const;
+  void AddScreenTriangle(const glm::vec4 clip[3], std::vector<ScreenTriangle>& triangles) const;
+  void RasterizeBand(int band);
+  void RasterizeTriangle(const ScreenTriangle& triangle, int bandMinY, int bandMaxY);
+
+  static const int TileSize = 8;
+  static const int BandHeight = 16;
+  static const size_t SetupChunkSize = 4096;
+
+  ThreadPoolPtr m_threadPool;
+  int m_width { 0 };
+  int m_height { 0 };
+  int m_tilesX { 0 };
+  int m_tilesY { 0 };
+  glm::mat4 m_viewProjection { glm::mat4(1.0f) };
+
+  std::vector<float> m_depth;
+  std::vector<float> m_tileMaxDepth;
+  std::vector<OccluderBatch> m_batches;
+  std::vector<std::vector<ScreenTriangle>> m_setupChunks;
+
+  int m_triangleCount { 0 };
+  int m_testedCount { 0 };
+  int m_occludedCount { 0 };
+  int m_outsideCount { 0 };
+  float m_rasterizeTime { 0.0f };
+};
+
+#endif // __OCCLUSION_CULLER_H__
@@ -0,0 +1,98 @@
+#include "post_process.h"
+
+PostProcessStackUPtr PostProcessStack::Create(const std::string& vertexShaderFilename,
+  const std::string& inputFilename) {
+  auto stack = PostProcessStackUPtr(new PostProcessStack());
+  if (!stack->Init(vertexShaderFilename, inputFilename))
+    return nullptr;
+  return std::move(stack);
+}
+
+PostProcessStack::~PostProcessStack() {
+}
+
+bool PostProcessStack::Init(const std::string& vertexShaderFilename, const std::string& inputFilename) {
+  m_vertexShader = Shader::CreateFromFile(vertexShaderFilename, GL_VERTEX_SHADER);
+  if (!m_vertexShader)
+    return false;
+  auto input = LoadTextFile(inputFilename);
+  if (!input.has_value())
+    return false;
+  m_inputSource = input.value();
+  return true;
+}
+
+bool PostProcessStack::AddEffect(const std::string& name, const std::string& snippetFilename,
+  const std::string& function, SetUniformsFunc setUniforms) {
+  if (m_effects.size() >= 32) {
+    SPDLOG_ERROR("too many post effects, can't add {}", name);
+    return false;
+  }
+  auto source = LoadTextFile(snippetFilename);
+  if (!source.has_value())
+    return false;
+  Effect effect;
+  effect.name = name;
+  effect.source = source.value();
+  effect.function = function;
+  effect.setUniforms = std::move(setUniforms);
+  m_effects.push_back(std::move(effect));
+  return true;
+}
+
+const Program* PostProcessStack::Use(int samples, bool bicubic) {
+  uint32_t enabledMask = 0;
+  for (size_t i = 0; i < m_effects.size(); i++) {
+    if (m_effects[i].enabled)
+      enabledMask |= 1u << i;
+  }
+  // bicubic only exists on the single-sample input
+  bicubic = bicubic && samples <= 1;
+  uint64_t key = enabledMask | ((uint64_t)samples << 32) | ((uint64_t)bicubic << 40);
+  auto it = m_programs.find(key);
+  if (it == m_programs.end()) {
+    auto program = BuildProgram(enabledMask, samples, bicubic);
+    if (!program)
+      return nullptr;
+    SPDLOG_INFO("post process variant built: effects 0x{:x}, samples {}, bicubic {}", enabledMask, samples, bicubic);
+    it = m_programs.emplace(key, std::move(program)).first;
+  }
+
+  const Program* program = it->second.get();
+  program->Use();
+  for (auto& effect : m_effects) {
+    if (effect.enabled && effect.setUniforms)
+      effect.setUniforms(program);
+  }
+  return program;
+}
+
+ProgramUPtr PostProcessStack::BuildProgram(uint32_t enabledMask, int samples, bool bicubic) const {
+  std::string source = "#version 330 core\n";
+  source += "#define MSAA_SAMPLES " + std::to_string(samples) + "\n";
+  if (bicubic)
+    source += "#define BICUBIC\n";
+  source +=
+    "in vec4 vertexColor;\n"
+    "in vec2 texCoord;\n"
+    "out vec4 fragColor;\n"
+    "uniform float gamma;\n";
+  source += m_inputSource + "\n";
+  std::string chain;
+  for (size_t i = 0; i < m_effects.size(); i++) {
+    if (!(enabledMask & (1u << i)))
+      continue;
+    source += "// " + m_effects[i].name + "\n" + m_effects[i].source + "\n";
+    chain += "  color = " + m_effects[i].function + "(color, texCoord);\n";
+  }
+  source +=
+    "void main() {\n"
+    "  vec3 color = SampleScene();\n" + chain +
+    "  fragColor = vec4(pow(color, vec3(gamma)), 1.0);\n"
+    "}\n";
+
+  auto fragmentShader = Shader::CreateFromSource(source, GL_FRAGMENT_SHADER, "post process");
+  if (!fragmentShader)
+    return nullptr;
+  return Program::Create({ m_vertexShader, ShaderPtr(std::move(fragmentShader)) });
+}
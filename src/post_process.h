@@ -0,0 +1,51 @@
+#ifndef __POST_PROCESS_H__
+#define __POST_PROCESS_H__
+
+#include "common.h"
+#include "shader.h"
+#include "program.h"
+#include <functional>
+#include <unordered_map>
+
+// full-screen post effects fused into one pass. each effect is a glsl snippet
+// defining `vec3 <function>(vec3 color, vec2 uv)`; the enabled ones are chained
+// in the order they were added and compiled into a single fragment shader,
+// cached per combination of enabled effects and scene input.
+CLASS_PTR(PostProcessStack)
+class PostProcessStack {
+public:
+  using SetUniformsFunc = std::function<void(const Program*)>;
+
+  static PostProcessStackUPtr Create(const std::string& vertexShaderFilename, const std::string& inputFilename);
+  ~PostProcessStack();
+
+  bool AddEffect(const std::string& name, const std::string& snippetFilename, const std::string& function,
+    SetUniformsFunc setUniforms = nullptr);
+  int GetEffectCount() const { return (int)m_effects.size(); }
+  const std::string& GetEffectName(int index) const { return m_effects[index].name; }
+  bool& EffectEnabled(int index) { return m_effects[index].enabled; }
+
+  // binds the program for the enabled effects and sets their uniforms.
+  // samples > 1 reads a multisample scene texture and resolves in the shader
+  const Program* Use(int samples, bool bicubic);
+  int GetVariantCount() const { return (int)m_programs.size(); }
+
+private:
+  PostProcessStack() {}
+  bool Init(const std::string& vertexShaderFilename, const std::string& inputFilename);
+  ProgramUPtr BuildProgram(uint32_t enabledMask, int samples, bool bicubic) const;
+
+  struct Effect {
+    std::string name;
+    std::string source;
+    std::string function;
+    SetUniformsFunc setUniforms;
+    bool enabled { false };
+  };
+  ShaderPtr m_vertexShader;
+  std::string m_inputSource;
+  std::vector<Effect> m_effects;
+  std::unordered_map<uint64_t, ProgramUPtr> m_programs;
+};
+
+#endif // __POST_PROCESS_H__
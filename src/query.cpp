@@ -0,0 +1,42 @@
+#include "query.h"
+
+QueryUPtr Query::Create(uint32_t target) {
+  auto query = QueryUPtr(new Query());
+  query->Init(target);
+  return std::move(query);
+}
+
+Query::~Query() {
+  if (m_query) {
+    glDeleteQueries(1, &m_query);
+  }
+}
+
+void Query::Init(uint32_t target) {
+  m_target = target;
+  glGenQueries(1, &m_query);
+}
+
+void Query::Begin() const {
+  glBeginQuery(m_target, m_query);
+}
+
+void Query::End() const {
+  glEndQuery(m_target);
+}
+
+void Query::Timestamp() const {
+  glQueryCounter(m_query, GL_TIMESTAMP);
+}
+
+bool Query::IsResultAvailable() const {
+  GLint available = 0;
+  glGetQueryObjectiv(m_query, GL_QUERY_RESULT_AVAILABLE, &available);
+  return available != 0;
+}
+
+uint64_t Query::GetResult() const {
+  GLuint64 result = 0;
+  glGetQueryObjectui64v(m_query, GL_QUERY_RESULT, &result);
+  return (uint64_t)result;
+}
@@ -0,0 +1,30 @@
+#ifndef __QUERY_H__
+#define __QUERY_H__
+
+#include "common.h"
+
+CLASS_PTR(Query)
+class Query {
+public:
+  static QueryUPtr Create(uint32_t target);
+  ~Query();
+
+  const uint32_t Get() const { return m_query; }
+  uint32_t GetTarget() const { return m_target; }
+  void Begin() const;
+  void End() const;
+  // GL_TIMESTAMP queries: gpu time once every earlier command has finished.
+  // unlike GL_TIME_ELAPSED these can be taken while another timer is running
+  void Timestamp() const;
+  bool IsResultAvailable() const;
+  // blocks until the gpu has the result, check IsResultAvailable() first to avoid stalls
+  uint64_t GetResult() const;
+
+private:
+  Query() {}
+  void Init(uint32_t target);
+  uint32_t m_query { 0 };
+  uint32_t m_target { 0 };
+};
+
+#endif // __QUERY_H__
@@ -0,0 +1,489 @@
+#include "render_graph.h"
+#include "cpu_profiler.h"
+#include <imgui.h>
+#include <algorithm>
+#include <limits>
+#include <set>
+
+RenderGraph::PassBuilder& RenderGraph::PassBuilder::Read(int resource) {
+  m_graph->m_passes[m_pass].reads.push_back(resource);
+  return *this;
+}
+
+RenderGraph::PassBuilder& RenderGraph::PassBuilder::ReadSamples(int resource) {
+  m_graph->m_passes[m_pass].reads.push_back(resource);
+  m_graph->m_passes[m_pass].sampleReads.push_back(resource);
+  return *this;
+}
+
+RenderGraph::PassBuilder& RenderGraph::PassBuilder::Write(int resource, bool load) {
+  m_graph->m_passes[m_pass].writes.push_back(resource);
+  m_graph->m_passes[m_pass].loads.push_back(load);
+  return *this;
+}
+
+RenderGraph::PassBuilder& RenderGraph::PassBuilder::SideEffect() {
+  m_graph->m_passes[m_pass].sideEffect = true;
+  return *this;
+}
+
+RenderGraphUPtr RenderGraph::Create(RenderTargetPoolPtr pool) {
+  auto graph = RenderGraphUPtr(new RenderGraph());
+  graph->m_pool = pool;
+  return std::move(graph);
+}
+
+RenderGraph::~RenderGraph() {
+}
+
+void RenderGraph::Reset() {
+  // physical textures and framebuffers stay alive for the next Compile()
+  m_resources.clear();
+  m_passes.clear();
+}
+
+int RenderGraph::CreateTexture(const std::string& name, const RenderGraphTextureDesc& desc) {
+  Resource resource;
+  resource.name = name;
+  resource.desc = desc;
+  m_resources.push_back(resource);
+  return (int)m_resources.size() - 1;
+}
+
+int RenderGraph::ImportTexture(const std::string& name, TexturePtr texture) {
+  Resource resource;
+  resource.name = name;
+  resource.desc.width = texture->GetWidth();
+  resource.desc.height = texture->GetHeight();
+  resource.desc.format = texture->GetFormat();
+  resource.desc.type = texture->GetType();
+  resource.desc.samples = texture->GetSamples();
+  resource.imported = true;
+  resource.texture = texture;
+  m_resources.push_back(resource);
+  return (int)m_resources.size() - 1;
+}
+
+int RenderGraph::ImportBackbuffer(const std::string& name, int width, int height) {
+  Resource resource;
+  resource.name = name;
+  resource.desc.width = width;
+  resource.desc.height = height;
+  resource.imported = true;
+  resource.backbuffer = true;
+  resource.output = true;
+  m_resources.push_back(resource);
+  return (int)m_resources.size() - 1;
+}
+
+void RenderGraph::MarkOutput(int resource) {
+  m_resources[resource].output = true;
+}
+
+RenderGraph::PassBuilder RenderGraph::AddPass(const std::string& name, ExecuteFunc execute) {
+  Pass pass;
+  pass.name = name;
+  pass.execute = std::move(execute);
+  m_passes.push_back(std::move(pass));
+  return PassBuilder(this, (int)m_passes.size() - 1);
+}
+
+void RenderGraph::AddBlitPass(const std::string& name, int source, int destination, uint32_t mask) {
+  Pass pass;
+  pass.name = name;
+  pass.reads.push_back(source);
+  pass.writes.push_back(destination);
+  pass.loads.push_back(true);
+  pass.blit = true;
+  pass.blitMask = mask;
+  m_passes.push_back(std::move(pass));
+}
+
+bool RenderGraph::IsDepthFormat(uint32_t format) {
+  switch (format) {
+    case GL_DEPTH_COMPONENT: case GL_DEPTH_COMPONENT16: case GL_DEPTH_COMPONENT24:
+    case GL_DEPTH_COMPONENT32F: case GL_DEPTH_STENCIL: case GL_DEPTH24_STENCIL8:
+      return true;
+    default:
+      return false;
+  }
+}
+
+void RenderGraph::Compile() {
+  CPU_ZONE("render graph compile");
+  InsertResolves();
+  CullPasses();
+  SortPasses();
+
+  // lifetimes in execution order
+  for (auto& resource : m_resources) {
+    resource.firstUse = -1;
+    resource.lastUse = -1;
+  }
+  for (int i = 0; i < (int)m_order.size(); i++) {
+    auto& pass = m_passes[m_order[i]];
+    for (auto list : { &pass.reads, &pass.writes }) {
+      for (int id : *list) {
+        auto& resource = m_resources[id];
+        if (resource.firstUse < 0)
+          resource.firstUse = i;
+        resource.lastUse = i;
+      }
+    }
+  }
+
+  auto signature = BuildSignature();
+  if (signature != m_signature) {
+    // drop our references first so the pool can hand the same textures back
+    m_framebuffers.clear();
+    m_blitSources.clear();
+    m_physicals.clear();
+    AssignPhysicalTextures();
+    CreateFramebuffers();
+    m_signature = signature;
+  }
+  else {
+    // same shape as last frame: the assignment comes out identical, keep the textures
+    auto physicals = std::move(m_physicals);
+    m_physicals.clear();
+    AssignPhysicalTextures();
+    for (size_t i = 0; i < m_physicals.size(); i++)
+      m_physicals[i].texture = physicals[i].texture;
+  }
+}
+
+void RenderGraph::InsertResolves() {
+  // readers sample a single-sample copy, blitted right before the first of them
+  std::vector<Pass> passes;
+  for (auto& pass : m_passes) {
+    for (auto& id : pass.reads) {
+      if (pass.blit || m_resources[id].desc.samples <= 1)
+        continue;
+      if (std::find(pass.sampleReads.begin(), pass.sampleReads.end(), id) != pass.sampleReads.end())
+        continue;
+      if (m_resources[id].resolved < 0) {
+        auto desc = m_resources[id].desc;
+        desc.samples = 1;
+        int resolved = CreateTexture(m_resources[id].name + " (resolved)", desc);
+        m_resources[id].resolved = resolved;
+        Pass resolve;
+        resolve.name = "resolve " + m_resources[id].name;
+        resolve.reads.push_back(id);
+        resolve.writes.push_back(resolved);
+        resolve.loads.push_back(true);
+        resolve.blit = true;
+        resolve.blitMask = IsDepthFormat(desc.format) ?
+          GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT : GL_COLOR_BUFFER_BIT;
+        resolve.resolve = true;
+        passes.push_back(std::move(resolve));
+      }
+      id = m_resources[id].resolved;
+    }
+    passes.push_back(std::move(pass));
+  }
+  m_passes = std::move(passes);
+}
+
+void RenderGraph::CullPasses() {
+  // walk backwards from the outputs; a cleared write ends the need for earlier contents
+  std::set<int> needed;
+  for (int i = 0; i < (int)m_resources.size(); i++) {
+    if (m_resources[i].output)
+      needed.insert(i);
+  }
+  m_culledPassCount = 0;
+  for (int i = (int)m_passes.size() - 1; i >= 0; i--) {
+    auto& pass = m_passes[i];
+    bool alive = pass.sideEffect;
+    for (int id : pass.writes)
+      alive = alive || needed.count(id) > 0;
+    pass.culled = !alive;
+    if (!alive) {
+      m_culledPassCount++;
+      continue;
+    }
+    for (size_t w = 0; w < pass.writes.size(); w++) {
+      if (!pass.loads[w] && !m_resources[pass.writes[w]].output)
+        needed.erase(pass.writes[w]);
+    }
+    for (size_t w = 0; w < pass.writes.size(); w++) {
+      if (pass.loads[w])
+        needed.insert(pass.writes[w]);
+    }
+    for (int id : pass.reads)
+      needed.insert(id);
+  }
+}
+
+void RenderGraph::SortPasses() {
+  // edges from the previous writer of everything a pass touches, then kahn's
+  // algorithm picking the earliest declared ready pass
+  int count = (int)m_passes.size();
+  std::vector<std::vector<int>> edges(count);
+  std::vector<int> inDegree(count, 0);
+  std::vector<int> lastWriter(m_resources.size(), -1);
+  std::vector<std::vector<int>> readersSinceWrite(m_resources.size());
+  for (int i = 0; i < count; i++) {
+    auto& pass = m_passes[i];
+    if (pass.culled)
+      continue;
+    std::set<int> dependencies;
+    for (int id : pass.reads) {
+      if (lastWriter[id] >= 0)
+        dependencies.insert(lastWriter[id]);
+    }
+    for (int id : pass.writes) {
+      if (lastWriter[id] >= 0)
+        dependencies.insert(lastWriter[id]);
+      // don't overwrite a target before its earlier readers ran
+      for (int reader : readersSinceWrite[id])
+        if (reader != i)
+          dependencies.insert(reader);
+    }
+    for (int dependency : dependencies) {
+      edges[dependency].push_back(i);
+      inDegree[i]++;
+    }
+    for (int id : pass.reads)
+      readersSinceWrite[id].push_back(i);
+    for (int id : pass.writes) {
+      lastWriter[id] = i;
+      readersSinceWrite[id].clear();
+    }
+  }
+
+  m_order.clear();
+  std::set<int> ready;
+  for (int i = 0; i < count; i++) {
+    if (!m_passes[i].culled && inDegree[i] == 0)
+      ready.insert(i);
+  }
+  while (!ready.empty()) {
+    int i = *ready.begin();
+    ready.erase(ready.begin());
+    m_order.push_back(i);
+    for (int next : edges[i]) {
+      if (--inDegree[next] == 0)
+        ready.insert(next);
+    }
+  }
+}
+
+void RenderGraph::AssignPhysicalTextures() {
+  std::vector<int> transients;
+  for (int i = 0; i < (int)m_resources.size(); i++) {
+    auto& resource = m_resources[i];
+    resource.physical = -1;
+    if (!resource.imported && resource.firstUse >= 0)
+      transients.push_back(i);
+  }
+  std::stable_sort(transients.begin(), transients.end(), [this](int a, int b) {
+    return m_resources[a].firstUse < m_resources[b].firstUse;
+  });
+
+  // greedy interval packing per description
+  m_transientBytes = 0;
+  for (int id : transients) {
+    auto& resource = m_resources[id];
+    auto& desc = resource.desc;
+    m_transientBytes += (size_t)desc.width * desc.height * desc.samples *
+      RenderTargetPool::GetBytesPerPixel(desc.format);
+    for (int p = 0; p < (int)m_physicals.size(); p++) {
+      auto& physical = m_physicals[p];
+      if (physical.lastUse < resource.firstUse && physical.desc.width == desc.width &&
+          physical.desc.height == desc.height && physical.desc.format == desc.format &&
+          physical.desc.type == desc.type && physical.desc.samples == desc.samples &&
+          !resource.output) {
+        resource.physical = p;
+        break;
+      }
+    }
+    if (resource.physical < 0) {
+      m_physicals.push_back({ desc, -1, nullptr, {} });
+      resource.physical = (int)m_physicals.size() - 1;
+    }
+    auto& physical = m_physicals[resource.physical];
+    physical.lastUse = resource.output ? std::numeric_limits<int>::max() : resource.lastUse;
+    physical.resources.push_back(id);
+  }
+}
+
+void RenderGraph::CreateFramebuffers() {
+  m_allocatedBytes = 0;
+  for (auto& physical : m_physicals) {
+    auto& desc = physical.desc;
+    physical.texture = m_pool->Acquire(desc.width, desc.height, desc.format, desc.type, desc.samples);
+    m_allocatedBytes += (size_t)physical.texture->GetWidth() * physical.texture->GetHeight() *
+      desc.samples * RenderTargetPool::GetBytesPerPixel(desc.format);
+  }
+
+  auto makeFramebuffer = [this](const std::vector<int>& attachments) -> FramebufferUPtr {
+    std::vector<TexturePtr> colors;
+    TexturePtr depth;
+    for (int id : attachments) {
+      auto texture = GetAttachment(id);
+      if (!texture)
+        return nullptr;
+      if (IsDepthFormat(m_resources[id].desc.format))
+        depth = texture;
+      else
+        colors.push_back(texture);
+    }
+    return Framebuffer::Create(colors, depth, false);
+  };
+  m_framebuffers.resize(m_order.size());
+  m_blitSources.resize(m_order.size());
+  for (size_t i = 0; i < m_order.size(); i++) {
+    auto& pass = m_passes[m_order[i]];
+    m_framebuffers[i] = makeFramebuffer(pass.writes);
+    if (pass.blit)
+      m_blitSources[i] = makeFramebuffer({ pass.reads[0] });
+  }
+}
+
+std::string RenderGraph::BuildSignature() const {
+  std::string signature;
+  for (auto& resource : m_resources) {
+    auto& desc = resource.desc;
+    signature += std::to_string(desc.width) + "x" + std::to_string(desc.height) + ":" +
+      std::to_string(desc.format) + ":" + std::to_string(desc.type) + ":" + std::to_string(desc.samples) +
+      ":" + std::to_string(resource.texture ? resource.texture->Get() : 0) +
+      ":" + std::to_string(resource.firstUse) + "-" + std::to_string(resource.lastUse) + ";";
+  }
+  for (int i : m_order) {
+    signature += "|";
+    for (int id : m_passes[i].writes)
+      signature += std::to_string(id) + ",";
+    if (m_passes[i].blit)
+      signature += "<" + std::to_string(m_passes[i].reads[0]);
+  }
+  return signature;
+}
+
+TexturePtr RenderGraph::GetTexture(int resource) const {
+  // readers of a multisampled texture get its resolved copy
+  if (m_resources[resource].resolved >= 0)
+    return GetAttachment(m_resources[resource].resolved);
+  return GetAttachment(resource);
+}
+
+TexturePtr RenderGraph::GetAttachment(int resource) const {
+  auto& entry = m_resources[resource];
+  if (entry.imported)
+    return entry.texture;
+  if (entry.physical < 0 || entry.physical >= (int)m_physicals.size())
+    return nullptr;
+  return m_physicals[entry.physical].texture;
+}
+
+void RenderGraph::Execute() {
+  CPU_ZONE("render graph execute");
+  for (size_t i = 0; i < m_order.size(); i++) {
+    auto& pass = m_passes[m_order[i]];
+    GpuProfiler::Scope scope(m_profiler, pass.name);
+
+    // imported targets are rendered whole, transient ones only inside the viewport
+    int width = m_viewportWidth;
+    int height = m_viewportHeight;
+    bool backbuffer = false;
+    for (int id : pass.writes) {
+      if (m_resources[id].imported) {
+        width = m_resources[id].desc.width;
+        height = m_resources[id].desc.height;
+        backbuffer = backbuffer || m_resources[id].backbuffer;
+      }
+    }
+
+    if (!backbuffer && !m_framebuffers[i]) {
+      SPDLOG_ERROR("render graph pass {} has no framebuffer", pass.name);
+      continue;
+    }
+    if (pass.blit) {
+      glBindFramebuffer(GL_READ_FRAMEBUFFER, m_blitSources[i] ? m_blitSources[i]->Get() : 0);
+      glBindFramebuffer(GL_DRAW_FRAMEBUFFER, backbuffer ? 0 : m_framebuffers[i]->Get());
+      glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, pass.blitMask, GL_NEAREST);
+      continue;
+    }
+
+    if (backbuffer)
+      Framebuffer::BindToDefault();
+    else
+      m_framebuffers[i]->Bind();
+    glViewport(0, 0, width, height);
+    glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+    glDepthMask(GL_TRUE);
+    if (backbuffer) {
+      glClearColor(m_clearColor.r, m_clearColor.g, m_clearColor.b, m_clearColor.a);
+      glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+    }
+    else {
+      int colorIndex = 0;
+      for (size_t w = 0; w < pass.writes.size(); w++) {
+        auto format = m_resources[pass.writes[w]].desc.format;
+        bool depth = IsDepthFormat(format);
+        if (!pass.loads[w]) {
+          if (!depth)
+            glClearBufferfv(GL_COLOR, colorIndex, glm::value_ptr(m_clearColor));
+          else if (format == GL_DEPTH24_STENCIL8 || format == GL_DEPTH_STENCIL)
+            glClearBufferfi(GL_DEPTH_STENCIL, 0, 1.0f, 0);
+          else {
+            float one = 1.0f;
+            glClearBufferfv(GL_DEPTH, 0, &one);
+          }
+        }
+        if (!depth)
+          colorIndex++;
+      }
+    }
+
+    PassContext context { this, width, height };
+    if (pass.execute)
+      pass.execute(context);
+  }
+  Framebuffer::BindToDefault();
+}
+
+void RenderGraph::DrawDebugUI() const {
+  ImGui::Text("%d passes, %d culled, %d textures -> %d allocations",
+    (int)m_passes.size(), m_culledPassCount, (int)std::count_if(m_resources.begin(), m_resources.end(),
+      [](const Resource& resource) { return !resource.imported && resource.firstUse >= 0; }),
+    (int)m_physicals.size());
+  ImGui::Text("transient %.1f MB, allocated %.1f MB", m_transientBytes / (1024.0f * 1024.0f),
+    m_allocatedBytes / (1024.0f * 1024.0f));
+
+  auto names = [this](const std::vector<int>& ids) {
+    std::string text;
+    for (int id : ids)
+      text += (text.empty() ? "" : ", ") + m_resources[id].name;
+    return text.empty() ? std::string("-") : text;
+  };
+  if (ImGui::TreeNode("passes")) {
+    for (size_t i = 0; i < m_order.size(); i++) {
+      auto& pass = m_passes[m_order[i]];
+      ImGui::Text("%d. %s%s", (int)i, pass.name.c_str(), pass.resolve ? " (auto)" : "");
+      ImGui::Text("     reads: %s", names(pass.reads).c_str());
+      ImGui::Text("     writes: %s", names(pass.writes).c_str());
+    }
+    for (auto& pass : m_passes) {
+      if (pass.culled)
+        ImGui::TextDisabled("culled: %s", pass.name.c_str());
+    }
+    ImGui::TreePop();
+  }
+  if (ImGui::TreeNode("resources")) {
+    // one column per executed pass, '#' while the texture is alive
+    for (auto& resource : m_resources) {
+      if (resource.firstUse < 0)
+        continue;
+      std::string lifetime(m_order.size(), '.');
+      for (int i = resource.firstUse; i <= resource.lastUse; i++)
+        lifetime[i] = '#';
+      if (resource.imported)
+        ImGui::Text("%s  imported  %s", lifetime.c_str(), resource.name.c_str());
+      else
+        ImGui::Text("%s  [%d] %dx%d x%d  %s", lifetime.c_str(), resource.physical,
+          resource.desc.width, resource.desc.height, resource.desc.samples, resource.name.c_str());
+    }
+    ImGui::TreePop();
+  }
+}
@@ -0,0 +1,149 @@
+#ifndef __RENDER_GRAPH_H__
+#define __RENDER_GRAPH_H__
+
+#include "common.h"
+#include "framebuffer.h"
+#include "render_target_pool.h"
+#include "gpu_profiler.h"
+#include <functional>
+
+struct RenderGraphTextureDesc {
+  int width { 0 };
+  int height { 0 };
+  uint32_t format { GL_RGBA8 };
+  uint32_t type { GL_UNSIGNED_BYTE };
+  int samples { 1 };
+};
+
+// frame described as passes with declared texture reads and writes.
+// Compile() culls passes whose results nobody consumes, orders the rest by
+// their dependencies, inserts a resolve blit in front of any pass that samples
+// a multisampled texture, and lets transient textures with matching
+// descriptions and disjoint lifetimes share one pool allocation.
+// Execute() binds each pass's framebuffer, sets the viewport and clears
+// attachments that are not loaded before calling the pass.
+// the graph is rebuilt every frame; textures and framebuffers are only
+// reallocated when its shape changes.
+CLASS_PTR(RenderGraph)
+class RenderGraph {
+public:
+  class PassBuilder {
+  public:
+    // sampled as a texture in the pass
+    PassBuilder& Read(int resource);
+    // sampled per sample with texelFetch, so a multisampled texture isn't resolved for it
+    PassBuilder& ReadSamples(int resource);
+    // attached as a render target, cleared first unless load is set
+    PassBuilder& Write(int resource, bool load = false);
+    // keep the pass even if nothing reads what it writes
+    PassBuilder& SideEffect();
+
+  private:
+    friend class RenderGraph;
+    PassBuilder(RenderGraph* graph, int pass) : m_graph(graph), m_pass(pass) {}
+    RenderGraph* m_graph;
+    int m_pass;
+  };
+
+  struct PassContext {
+    const RenderGraph* graph;
+    int width;
+    int height;
+    TexturePtr GetTexture(int resource) const { return graph->GetTexture(resource); }
+    TexturePtr GetMultisampleTexture(int resource) const { return graph->GetAttachment(resource); }
+  };
+  using ExecuteFunc = std::function<void(const PassContext&)>;
+
+  static RenderGraphUPtr Create(RenderTargetPoolPtr pool);
+  ~RenderGraph();
+
+  // starts describing a new frame
+  void Reset();
+  int CreateTexture(const std::string& name, const RenderGraphTextureDesc& desc);
+  int ImportTexture(const std::string& name, TexturePtr texture);
+  int ImportBackbuffer(const std::string& name, int width, int height);
+  // consumed outside the graph, e.g. shown in the ui
+  void MarkOutput(int resource);
+  PassBuilder AddPass(const std::string& name, ExecuteFunc execute);
+  void AddBlitPass(const std::string& name, int source, int destination, uint32_t mask);
+
+  // region of the transient targets that passes render into
+  void SetViewport(int width, int height) { m_viewportWidth = width; m_viewportHeight = height; }
+  void SetClearColor(const glm::vec4& color) { m_clearColor = color; }
+  // every executed pass becomes a profiler scope named after it
+  void SetProfiler(GpuProfiler* profiler) { m_profiler = profiler; }
+
+  void Compile();
+  void Execute();
+  TexturePtr GetTexture(int resource) const;
+  void DrawDebugUI() const;
+
+  int GetPassCount() const { return (int)m_passes.size(); }
+  int GetCulledPassCount() const { return m_culledPassCount; }
+  size_t GetTransientBytes() const { return m_transientBytes; }
+  size_t GetAllocatedBytes() const { return m_allocatedBytes; }
+
+private:
+  RenderGraph() {}
+
+  struct Resource {
+    std::string name;
+    RenderGraphTextureDesc desc;
+    bool imported { false };
+    bool backbuffer { false };
+    bool output { false };
+    TexturePtr texture;         // imported texture, or the physical texture after Compile()
+    int resolved { -1 };        // single-sample copy made for readers
+    int physical { -1 };
+    int firstUse { -1 };
+    int lastUse { -1 };
+  };
+  struct Pass {
+    std::string name;
+    ExecuteFunc execute;
+    std::vector<int> reads;
+    std::vector<int> sampleReads;   // reads that skip the resolve
+    std::vector<int> writes;
+    std::vector<bool> loads;
+    bool sideEffect { false };
+    bool blit { false };
+    uint32_t blitMask { 0 };
+    bool resolve { false };     // inserted by the graph
+    bool culled { false };
+  };
+  struct Physical {
+    RenderGraphTextureDesc desc;
+    int lastUse;
+    TexturePtr texture;
+    std::vector<int> resources;
+  };
+
+  static bool IsDepthFormat(uint32_t format);
+  TexturePtr GetAttachment(int resource) const;
+  void InsertResolves();
+  void CullPasses();
+  void SortPasses();
+  void AssignPhysicalTextures();
+  void CreateFramebuffers();
+  std::string BuildSignature() const;
+
+  RenderTargetPoolPtr m_pool;
+  GpuProfiler* m_profiler { nullptr };
+  std::vector<Resource> m_resources;
+  std::vector<Pass> m_passes;
+  std::vector<int> m_order;
+  std::vector<Physical> m_physicals;
+  // per entry of m_order, blit passes use source and destination
+  std::vector<FramebufferUPtr> m_framebuffers;
+  std::vector<FramebufferUPtr> m_blitSources;
+  std::string m_signature;
+
+  int m_viewportWidth { 0 };
+  int m_viewportHeight { 0 };
+  glm::vec4 m_clearColor { glm::vec4(0.0f) };
+  int m_culledPassCount { 0 };
+  size_t m_transientBytes { 0 };
+  size_t m_allocatedBytes { 0 };
+};
+
+#endif // __RENDER_GRAPH_H__
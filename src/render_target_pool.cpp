@@ -0,0 +1,89 @@
+#include "render_target_pool.h"
+
+RenderTargetPoolUPtr RenderTargetPool::Create(int sizeBucket) {
+  auto pool = RenderTargetPoolUPtr(new RenderTargetPool());
+  pool->m_sizeBucket = std::max(sizeBucket, 1);
+  return std::move(pool);
+}
+
+RenderTargetPool::~RenderTargetPool() {
+}
+
+int RenderTargetPool::GetBucketSize(int size) const {
+  return (std::max(size, 1) + m_sizeBucket - 1) / m_sizeBucket * m_sizeBucket;
+}
+
+TexturePtr RenderTargetPool::Acquire(int width, int height, uint32_t format, uint32_t type, int samples) {
+  int bucketWidth = GetBucketSize(width);
+  int bucketHeight = GetBucketSize(height);
+  for (auto& entry : m_entries) {
+    // the pool's own reference is the only one left when nobody uses it
+    if (entry.texture.use_count() > 1)
+      continue;
+    if (entry.width == bucketWidth && entry.height == bucketHeight &&
+        entry.format == format && entry.type == type && entry.samples == samples) {
+      entry.lastUsedFrame = m_frameIndex;
+      m_reuseCount++;
+      return entry.texture;
+    }
+  }
+
+  TexturePtr texture;
+  if (samples > 1) {
+    texture = Texture::CreateMSAA(bucketWidth, bucketHeight, format, samples);
+  }
+  else {
+    texture = Texture::Create(bucketWidth, bucketHeight, format, type);
+  }
+  Entry entry;
+  entry.width = bucketWidth;
+  entry.height = bucketHeight;
+  entry.format = format;
+  entry.type = type;
+  entry.samples = samples;
+  entry.bytes = (size_t)bucketWidth * bucketHeight * GetBytesPerPixel(format) * samples;
+  entry.lastUsedFrame = m_frameIndex;
+  entry.texture = texture;
+  m_entries.push_back(entry);
+
+  m_allocatedBytes += entry.bytes;
+  m_highWaterBytes = std::max(m_highWaterBytes, m_allocatedBytes);
+  m_allocationCount++;
+  // dynamic resolution steps allocate every frame while the scale moves, the
+  // pool ui counts them
+  SPDLOG_DEBUG("render target allocated: {}x{} format 0x{:x} samples {} ({} KB)",
+    bucketWidth, bucketHeight, format, samples, entry.bytes / 1024);
+  return texture;
+}
+
+void RenderTargetPool::Trim(uint64_t frameIndex, uint64_t maxUnusedFrames) {
+  m_frameIndex = frameIndex;
+  for (auto it = m_entries.begin(); it != m_entries.end();) {
+    if (it->texture.use_count() == 1 && frameIndex - it->lastUsedFrame > maxUnusedFrames) {
+      m_allocatedBytes -= it->bytes;
+      it = m_entries.erase(it);
+    }
+    else {
+      // anything still held counts as used this frame
+      if (it->texture.use_count() > 1)
+        it->lastUsedFrame = frameIndex;
+      ++it;
+    }
+  }
+}
+
+size_t RenderTargetPool::GetBytesPerPixel(uint32_t format) {
+  switch (format) {
+    case GL_R8:
+      return 1;
+    case GL_RG8: case GL_R16F:
+      return 2;
+    case GL_RGBA16F: case GL_RGBA16: case GL_RG32F:
+      return 8;
+    case GL_RGBA32F:
+      return 16;
+    // rgb8, rgba8, rgb10_a2, r11g11b10, r32f, depth24_stencil8 and unsized formats
+    default:
+      return 4;
+  }
+}
@@ -0,0 +1,51 @@
+#ifndef __RENDER_TARGET_POOL_H__
+#define __RENDER_TARGET_POOL_H__
+
+#include "texture.h"
+
+// reuses render target textures keyed by (size bucket, format, type, samples).
+// sizes are rounded up to the bucket so nearby window sizes share one allocation;
+// callers render into the requested sub-rect of the returned texture.
+// a texture is free again once every pointer handed out by Acquire() is released.
+CLASS_PTR(RenderTargetPool)
+class RenderTargetPool {
+public:
+  static RenderTargetPoolUPtr Create(int sizeBucket = 128);
+  ~RenderTargetPool();
+
+  TexturePtr Acquire(int width, int height, uint32_t format, uint32_t type = GL_UNSIGNED_BYTE, int samples = 1);
+  // drops free textures that have not been acquired for maxUnusedFrames frames
+  void Trim(uint64_t frameIndex, uint64_t maxUnusedFrames);
+
+  int GetBucketSize(int size) const;
+  int GetTextureCount() const { return (int)m_entries.size(); }
+  size_t GetAllocatedBytes() const { return m_allocatedBytes; }
+  size_t GetHighWaterBytes() const { return m_highWaterBytes; }
+  int GetAllocationCount() const { return m_allocationCount; }
+  int GetReuseCount() const { return m_reuseCount; }
+  static size_t GetBytesPerPixel(uint32_t format);
+
+private:
+  RenderTargetPool() {}
+
+  struct Entry {
+    int width;
+    int height;
+    uint32_t format;
+    uint32_t type;
+    int samples;
+    size_t bytes;
+    uint64_t lastUsedFrame;
+    TexturePtr texture;
+  };
+
+  int m_sizeBucket { 128 };
+  uint64_t m_frameIndex { 0 };
+  std::vector<Entry> m_entries;
+  size_t m_allocatedBytes { 0 };
+  size_t m_highWaterBytes { 0 };
+  int m_allocationCount { 0 };
+  int m_reuseCount { 0 };
+};
+
+#endif // __RENDER_TARGET_POOL_H__
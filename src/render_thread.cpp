@@ -0,0 +1,99 @@
+#include "render_thread.h"
+#include "cpu_profiler.h"
+#include "gl_capture.h"
+
+bool ParseRenderThreadOptions(int argc, char** args) {
+  for (int i = 1; i < argc; i++) {
+    if (std::string(args[i]) == "--render-thread")
+      return true;
+  }
+  return false;
+}
+
+RenderThreadUPtr RenderThread::Create(GLFWwindow* window, Context* context, FrameLoop* frameLoop,
+  FrameLatencyLimiter* frameLatencyLimiter) {
+  auto renderThread = RenderThreadUPtr(new RenderThread());
+  renderThread->m_window = window;
+  renderThread->m_context = context;
+  renderThread->m_frameLoop = frameLoop;
+  renderThread->m_frameLatencyLimiter = frameLatencyLimiter;
+  renderThread->m_next = std::make_unique<Snapshot>();
+  renderThread->m_current = std::make_unique<Snapshot>();
+  // a context can only be current on one thread
+  glfwMakeContextCurrent(nullptr);
+  renderThread->m_thread = std::thread(&RenderThread::Run, renderThread.get());
+  return std::move(renderThread);
+}
+
+RenderThread::~RenderThread() {
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stop = true;
+  }
+  m_condition.notify_all();
+  if (m_thread.joinable())
+    m_thread.join();
+  glfwMakeContextCurrent(m_window);
+}
+
+void RenderThread::Submit(const Context::Frame& frame, const ImDrawData* drawData) {
+  {
+    CPU_ZONE("wait render thread");
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_condition.wait(lock, [&] { return !m_hasNext; });
+  }
+  // the render thread only swaps the snapshots while m_hasNext is set
+  m_next->frame = frame;
+  m_next->CopyDrawData(drawData);
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_hasNext = true;
+  }
+  m_condition.notify_all();
+}
+
+void RenderThread::Run() {
+  glfwMakeContextCurrent(m_window);
+  CpuProfiler::SetThreadName("render");
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_condition.wait(lock, [&] { return m_hasNext || m_stop; });
+      if (!m_hasNext)
+        break;
+      std::swap(m_next, m_current);
+      m_hasNext = false;
+    }
+    m_condition.notify_all();
+
+    auto& frame = m_current->frame;
+    m_context->RenderFrame(frame, m_current->drawData.Valid ? &m_current->drawData : nullptr);
+    {
+      CPU_ZONE("swap buffers");
+      glfwSwapBuffers(m_window);
+    }
+    m_frameLatencyLimiter->EndFrame(frame.eventTime);
+    GLCapture::EndFrame();
+    if (!frame.represent)
+      m_frameLoop->RecordPresent(frame.inputTime, glfwGetTime());
+  }
+  glfwMakeContextCurrent(nullptr);
+}
+
+void RenderThread::Snapshot::CopyDrawData(const ImDrawData* source) {
+  ClearDrawLists();
+  if (!source) {
+    drawData.Clear();
+    return;
+  }
+  drawData = *source;
+  for (int i = 0; i < source->CmdListsCount; i++)
+    drawLists.push_back(source->CmdLists[i]->CloneOutput());
+  drawData.CmdLists = drawLists.data();
+}
+
+void RenderThread::Snapshot::ClearDrawLists() {
+  for (auto drawList : drawLists)
+    IM_DELETE(drawList);
+  drawLists.clear();
+}
@@ -0,0 +1,55 @@
+#ifndef __RENDER_THREAD_H__
+#define __RENDER_THREAD_H__
+
+#include "context.h"
+#include <condition_variable>
+#include <thread>
+#include <imgui.h>
+
+// true for --render-thread
+bool ParseRenderThreadOptions(int argc, char** args);
+
+// renders and presents on its own thread, which owns the gl context. the main
+// thread keeps events, ui and simulation and hands over one snapshot per frame:
+// the captured Context::Frame and a copy of the imgui draw data. there are two
+// snapshots, the one being rendered and the next one; Submit blocks while the
+// next one has not been picked up, so the main thread runs at most one frame ahead.
+CLASS_PTR(RenderThread)
+class RenderThread {
+public:
+  // the gl context of window has to be current on the calling thread, it moves
+  // to the render thread until this is destroyed
+  static RenderThreadUPtr Create(GLFWwindow* window, Context* context, FrameLoop* frameLoop,
+    FrameLatencyLimiter* frameLatencyLimiter);
+  ~RenderThread();
+
+  // drawData can be null for frames without ui, e.g. re-presents
+  void Submit(const Context::Frame& frame, const ImDrawData* drawData);
+
+private:
+  RenderThread() {}
+  void Run();
+
+  struct Snapshot {
+    Context::Frame frame;
+    ImDrawData drawData;
+    std::vector<ImDrawList*> drawLists;   // clones owned by the snapshot
+    ~Snapshot() { ClearDrawLists(); }
+    void CopyDrawData(const ImDrawData* source);
+    void ClearDrawLists();
+  };
+
+  GLFWwindow* m_window { nullptr };
+  Context* m_context { nullptr };
+  FrameLoop* m_frameLoop { nullptr };
+  FrameLatencyLimiter* m_frameLatencyLimiter { nullptr };
+  std::unique_ptr<Snapshot> m_next;
+  std::unique_ptr<Snapshot> m_current;
+  std::mutex m_mutex;
+  std::condition_variable m_condition;
+  bool m_hasNext { false };
+  bool m_stop { false };
+  std::thread m_thread;
+};
+
+#endif // __RENDER_THREAD_H__
@@ -0,0 +1,145 @@
+#include "residency_manager.h"
+#include "cpu_profiler.h"
+#include <imgui.h>
+#include <algorithm>
+
+static size_t GetBytesFrom(const Texture* texture, int level) {
+  size_t size = 0;
+  for (; level < texture->GetLevelCount(); level++)
+    size += texture->GetLevelByteSize(level);
+  return size;
+}
+
+ResidencyManagerUPtr ResidencyManager::Create(TextureStreamer* streamer, size_t budget) {
+  auto manager = ResidencyManagerUPtr(new ResidencyManager());
+  manager->m_streamer = streamer;
+  manager->m_budget = budget;
+  // textures start at frame 0, as never drawn
+  manager->m_frame = 1;
+  Texture::SetCurrentFrame(manager->m_frame);
+  return std::move(manager);
+}
+
+void ResidencyManager::Stream(const std::string& filename, std::function<void(TexturePtr)> ready, bool flipVertical) {
+  if (!m_onDemand) {
+    m_streamer->Stream(filename, std::move(ready), flipVertical);
+    return;
+  }
+  auto entry = std::make_shared<Entry>();
+  entry->filename = filename;
+  entry->flipVertical = flipVertical;
+  m_streamer->Stream(filename, [this, entry, ready](TexturePtr texture) {
+    entry->texture = texture;
+    entry->coarseLevel = texture->GetBaseLevel();
+    m_entries.push_back(entry);
+    ready(texture);
+  }, flipVertical, CoarseSize);
+}
+
+size_t ResidencyManager::GetCommittedBytes(const Entry& entry, const Texture* texture) const {
+  size_t size = texture->GetByteSize();
+  if (entry.refining)
+    size = std::max(size, GetBytesFrom(texture, entry.refineLevel));
+  return size;
+}
+
+void ResidencyManager::Update() {
+  CPU_ZONE("texture residency");
+  // the stamps of the frame drawn last are complete
+  uint64_t drawnFrame = m_frame++;
+  Texture::SetCurrentFrame(m_frame);
+  m_entries.erase(std::remove_if(m_entries.begin(), m_entries.end(),
+    [](const EntryPtr& entry) { return entry->texture.expired(); }), m_entries.end());
+
+  size_t resident = 0;
+  std::vector<std::pair<int, EntryPtr>> wanting;   // levels missing, entry
+  for (auto& entry : m_entries) {
+    auto texture = entry->texture.lock();
+    resident += GetCommittedBytes(*entry, texture.get());
+    if (!entry->refining && !entry->failed && texture->GetLastUsedFrame() == drawnFrame &&
+      texture->GetWantedLevel() < texture->GetBaseLevel())
+      wanting.push_back({ texture->GetBaseLevel() - texture->GetWantedLevel(), entry });
+  }
+
+  // the textures furthest from what they sampled first
+  std::stable_sort(wanting.begin(), wanting.end(),
+    [](const std::pair<int, EntryPtr>& a, const std::pair<int, EntryPtr>& b) { return a.first > b.first; });
+  for (auto& want : wanting) {
+    if (m_refineCount >= MaxRefines)
+      break;
+    auto& entry = want.second;
+    auto texture = entry->texture.lock();
+    int level = texture->GetWantedLevel();
+    size_t baseBytes = GetBytesFrom(texture.get(), texture->GetBaseLevel());
+    size_t cost = GetBytesFrom(texture.get(), level) - baseBytes;
+    if (resident + cost > m_budget)
+      resident -= Release(resident + cost - m_budget);
+    // as many of the levels as fit
+    while (level < texture->GetBaseLevel() && resident + cost > m_budget) {
+      level++;
+      cost = GetBytesFrom(texture.get(), level) - baseBytes;
+    }
+    if (level == texture->GetBaseLevel())
+      continue;
+    resident += cost;
+    entry->refining = true;
+    entry->refineLevel = level;
+    m_refineCount++;
+    m_streamer->Refine(texture, entry->filename, entry->flipVertical, level, [this, entry](bool succeeded) {
+      entry->refining = false;
+      entry->failed = !succeeded;
+      m_refineCount--;
+      if (succeeded)
+        m_refinedCount++;
+    });
+  }
+
+  // a lowered budget, or textures no longer drawn as close as they were
+  if (resident > m_budget)
+    resident -= Release(resident - m_budget);
+  m_residentBytes = resident;
+}
+
+size_t ResidencyManager::Release(size_t bytes) {
+  std::vector<std::pair<uint64_t, EntryPtr>> used;   // last used frame, entry
+  for (auto& entry : m_entries) {
+    auto texture = entry->texture.lock();
+    // a refine in flight uploads into the levels it expects
+    if (!entry->refining && texture->GetBaseLevel() < entry->coarseLevel)
+      used.push_back({ texture->GetLastUsedFrame(), entry });
+  }
+  std::stable_sort(used.begin(), used.end(),
+    [](const std::pair<uint64_t, EntryPtr>& a, const std::pair<uint64_t, EntryPtr>& b) { return a.first < b.first; });
+
+  size_t freed = 0;
+  for (auto& use : used) {
+    if (freed >= bytes)
+      break;
+    auto texture = use.second->texture.lock();
+    int keep = use.second->coarseLevel;
+    if (use.first + 1 == m_frame)
+      keep = std::min(keep, texture->GetWantedLevel());
+    while (freed < bytes && texture->GetBaseLevel() < keep) {
+      size_t size = texture->GetByteSize();
+      texture->ReleaseLevels(texture->GetBaseLevel() + 1);
+      size -= texture->GetByteSize();
+      freed += size;
+      m_releasedBytes += size;
+      m_releasedLevelCount++;
+    }
+  }
+  return freed;
+}
+
+void ResidencyManager::DrawUI() {
+  int budget = (int)(m_budget >> 20);
+  if (ImGui::DragInt("rl.vram budget", &budget, 1.0f, 16, 8192, "%d MB"))
+    m_budget = (size_t)std::max(budget, 16) << 20;
+  if (!m_onDemand) {
+    ImGui::Text("texture residency off, textures load whole");
+    return;
+  }
+  ImGui::Text("managed textures %d, resident %.1f MB", (int)m_entries.size(), m_residentBytes / (1024.0f * 1024.0f));
+  ImGui::Text("refined %d, %d in flight", m_refinedCount, m_refineCount);
+  ImGui::Text("released %d levels, %.1f MB", m_releasedLevelCount, m_releasedBytes / (1024.0f * 1024.0f));
+}
@@ -0,0 +1,71 @@
+#ifndef __RESIDENCY_MANAGER_H__
+#define __RESIDENCY_MANAGER_H__
+
+#include "common.h"
+#include "texture.h"
+#include "texture_streamer.h"
+#include <functional>
+
+// keeps streamed textures within a vram budget. a texture arrives with its
+// coarse levels only, up to CoarseSize texels on a side. draws binding it
+// stamp the frame and the finest level they sample (Texture::MarkUsed, from
+// Material::SetToProgram), and once a frame Update streams the missing finer
+// levels of the textures drawn last frame, the ones short of the most levels
+// first. when a refine does not fit, and whenever the budget is exceeded, the
+// finest levels of the least recently used textures are released, down to
+// the coarse levels, which stay.
+//
+// everything runs on the render thread, Update once per frame before drawing.
+CLASS_PTR(ResidencyManager)
+class ResidencyManager {
+public:
+  static ResidencyManagerUPtr Create(TextureStreamer* streamer, size_t budget = 256 << 20);
+
+  // streams filename with its coarse levels and manages it from then on
+  void Stream(const std::string& filename, std::function<void(TexturePtr)> ready, bool flipVertical);
+  void Update();
+  void SetBudget(size_t bytes) { m_budget = bytes; }
+  // off: textures are streamed whole and never released, for runs that need
+  // the same image in every frame (benchmarks, headless)
+  void SetOnDemand(bool onDemand) { m_onDemand = onDemand; }
+  size_t GetResidentBytes() const { return m_residentBytes; }
+  void DrawUI();
+
+  static const int CoarseSize = 128;
+  // refines in flight, the streamer's buffers stay free for new textures
+  static const int MaxRefines = 2;
+
+private:
+  ResidencyManager() {}
+
+  struct Entry {
+    TextureWPtr texture;
+    std::string filename;
+    bool flipVertical { true };
+    int coarseLevel { 0 };   // never released
+    int refineLevel { 0 };   // being streamed down to when refining
+    bool refining { false };
+    bool failed { false };   // a refine did, the file is not tried again
+  };
+  using EntryPtr = std::shared_ptr<Entry>;
+  // of the levels it has, or will have once its refine lands
+  size_t GetCommittedBytes(const Entry& entry, const Texture* texture) const;
+  // frees at least bytes from the least recently used textures if it can,
+  // returns how many. textures drawn last frame keep the levels they sampled
+  size_t Release(size_t bytes);
+
+  TextureStreamer* m_streamer { nullptr };
+  std::vector<EntryPtr> m_entries;
+  size_t m_budget { 0 };
+  bool m_onDemand { true };
+  uint64_t m_frame { 0 };
+  int m_refineCount { 0 };   // in flight
+
+  // stats for DrawUI
+  size_t m_residentBytes { 0 };
+  int m_refinedCount { 0 };
+  int m_releasedLevelCount { 0 };
+  uint64_t m_releasedBytes { 0 };
+};
+
+#endif // __RESIDENCY_MANAGER_H__
@@ -0,0 +1,250 @@
+#include "resource_loader.h"
+#include "cpu_profiler.h"
+#include "async_log.h"
+#include <imgui.h>
+#include <chrono>
+
+// headless runs have no glfw timer
+static double Now() {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+ResourceLoaderUPtr ResourceLoader::Create(GLFWwindow* shareWindow) {
+  auto loader = ResourceLoaderUPtr(new ResourceLoader());
+  // the version hints of the main window are still set
+  glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+  loader->m_window = glfwCreateWindow(1, 1, "resource loader", nullptr, shareWindow);
+  glfwWindowHint(GLFW_VISIBLE, GLFW_TRUE);
+  if (!loader->m_window) {
+    SPDLOG_ERROR("failed to create the shared context for the resource loader");
+    return nullptr;
+  }
+  if (!loader->Init())
+    return nullptr;
+  return std::move(loader);
+}
+
+#ifdef HEADLESS_EGL
+ResourceLoaderUPtr ResourceLoader::Create(const EglContext* shareContext) {
+  auto loader = ResourceLoaderUPtr(new ResourceLoader());
+  loader->m_eglContext = EglContext::Create(shareContext);
+  if (!loader->m_eglContext) {
+    SPDLOG_ERROR("failed to create the shared context for the resource loader");
+    return nullptr;
+  }
+  if (!loader->Init())
+    return nullptr;
+  return std::move(loader);
+}
+#endif
+
+ResourceLoaderUPtr ResourceLoader::CreateImmediate() {
+  auto loader = ResourceLoaderUPtr(new ResourceLoader());
+  if (!loader->Init())
+    return nullptr;
+  return std::move(loader);
+}
+
+bool ResourceLoader::Init() {
+  m_textureStreamer = TextureStreamer::Create();
+  m_residencyManager = ResidencyManager::Create(m_textureStreamer.get());
+  m_placeholderTexture = Texture::CreateFromImage(
+    Image::CreateSingleColorImage(4, 4, glm::vec4(0.5f, 0.5f, 0.5f, 1.0f)).get());
+  bool hasSharedContext = m_window != nullptr;
+#ifdef HEADLESS_EGL
+  hasSharedContext = hasSharedContext || m_eglContext;
+#endif
+  if (hasSharedContext)
+    m_thread = std::thread(&ResourceLoader::Run, this);
+  return true;
+}
+
+ResourceLoader::~ResourceLoader() {
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stop = true;
+  }
+  m_condition.notify_all();
+  if (m_thread.joinable())
+    m_thread.join();
+  // created but never handed over, deleted through the calling thread's context
+  for (auto& job : m_completed)
+    glDeleteSync(job.fence);
+  m_completed.clear();
+  if (m_window)
+    glfwDestroyWindow(m_window);
+}
+
+void ResourceLoader::LoadTexture(const std::string& filename, std::function<void(TexturePtr)> ready,
+  bool flipVertical) {
+  // cooked next to the image (see texture_cooker): no decoding and no mipmap
+  // generation, and a fraction of the bytes to upload
+  auto cooked = CompressedImage::FindCooked(filename);
+  if (!cooked.empty()) {
+    Load<Texture>(filename, [filename, cooked, flipVertical]() -> TexturePtr {
+      for (auto& path : cooked) {
+        auto image = CompressedImage::Load(path);
+        if (image && CompressedImage::IsSupported(image->GetFormat()) && image->IsFlippedVertically() == flipVertical)
+          return Texture::CreateFromCompressedImage(image.get());
+      }
+      // none this gl samples, the source image instead
+      auto image = Image::Load(filename, flipVertical);
+      if (!image)
+        return nullptr;
+      image->GenerateMipmaps();
+      return Texture::CreateFromImage(image.get());
+    }, ready);
+    return;
+  }
+  if (!m_thread.joinable()) {
+    // no loader thread or shared context: decoded and uploaded in place, like
+    // every other load of the immediate loader
+    Load<Texture>(filename, [filename, flipVertical]() -> TexturePtr {
+      auto image = Image::Load(filename, flipVertical);
+      if (!image)
+        return nullptr;
+      image->GenerateMipmaps();
+      return Texture::CreateFromImage(image.get());
+    }, ready);
+    return;
+  }
+  m_residencyManager->Stream(filename, ready, flipVertical);
+}
+
+void ResourceLoader::Enqueue(const std::string& name, std::function<bool()> create, std::function<void()> ready) {
+  Job job;
+  job.name = name;
+  job.create = std::move(create);
+  job.ready = std::move(ready);
+  job.requestTime = Now();
+  m_pendingCount++;
+  if (!m_thread.joinable()) {
+    job.succeeded = job.create();
+    job.createdTime = Now();
+    job.createTime = (job.createdTime - job.requestTime) * 1000.0;
+    HandOver(job);
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_queue.push_back(std::move(job));
+  }
+  m_condition.notify_all();
+}
+
+void ResourceLoader::Run() {
+  if (m_window)
+    glfwMakeContextCurrent(m_window);
+#ifdef HEADLESS_EGL
+  if (m_eglContext)
+    m_eglContext->MakeCurrent();
+#endif
+  CpuProfiler::SetThreadName("resource loader");
+  while (true) {
+    Job job;
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_condition.wait(lock, [&] { return !m_queue.empty() || m_stop; });
+      if (m_stop)
+        break;
+      job = std::move(m_queue.front());
+      m_queue.pop_front();
+    }
+    {
+      CPU_ZONE("resource load");
+      double start = Now();
+      job.succeeded = job.create();
+      // the flush sends the uploads and the fence on their way, the render
+      // context only polls the fence and cannot flush this context's commands
+      job.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+      glFlush();
+      job.createdTime = Now();
+      job.createTime = (job.createdTime - start) * 1000.0;
+    }
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_completed.push_back(std::move(job));
+    }
+    m_condition.notify_all();
+  }
+  if (m_window)
+    glfwMakeContextCurrent(nullptr);
+#ifdef HEADLESS_EGL
+  if (m_eglContext)
+    m_eglContext->ReleaseCurrent();
+#endif
+}
+
+void ResourceLoader::Update() {
+  m_textureStreamer->Update();
+  m_residencyManager->Update();
+  if (!m_thread.joinable() || m_pendingCount == 0)
+    return;
+  CPU_ZONE("resource hand over");
+  while (true) {
+    Job job;
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      if (m_completed.empty())
+        break;
+      GLint status = GL_UNSIGNALED;
+      glGetSynciv(m_completed.front().fence, GL_SYNC_STATUS, sizeof(status), nullptr, &status);
+      if (status != GL_SIGNALED)
+        break;
+      job = std::move(m_completed.front());
+      m_completed.pop_front();
+    }
+    glDeleteSync(job.fence);
+    HandOver(job);
+  }
+}
+
+void ResourceLoader::Finish() {
+  CPU_ZONE("resource loader finish");
+  m_textureStreamer->Finish();
+  while (m_thread.joinable() && m_pendingCount > 0) {
+    Job job;
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_condition.wait(lock, [&] { return !m_completed.empty(); });
+      job = std::move(m_completed.front());
+      m_completed.pop_front();
+    }
+    // the loader flushed after the fence, so waiting here cannot hang
+    glClientWaitSync(job.fence, 0, GL_TIMEOUT_IGNORED);
+    glDeleteSync(job.fence);
+    HandOver(job);
+  }
+}
+
+void ResourceLoader::HandOver(Job& job) {
+  double now = Now();
+  if (job.succeeded) {
+    job.ready();
+    m_loadedCount++;
+  }
+  else {
+    SPDLOG_ERROR("failed to load {}", job.name);
+    m_failedCount++;
+  }
+  m_createTime += job.createTime;
+  m_handOverTime += (now - job.createdTime) * 1000.0;
+  m_latencyMax = std::max(m_latencyMax, (now - job.requestTime) * 1000.0);
+  LOG_TELEMETRY("resource load ms", (float)job.createTime, (float)((now - job.requestTime) * 1000.0));
+  m_pendingCount--;
+}
+
+void ResourceLoader::DrawUI() {
+  int handedOver = m_loadedCount + m_failedCount;
+  ImGui::Text("%s, %d pending", m_thread.joinable() ? "loader thread" : "immediate", (int)m_pendingCount);
+  ImGui::Text("loaded %d, failed %d", m_loadedCount, m_failedCount);
+  if (handedOver > 0) {
+    ImGui::Text("on the loader thread %.1f ms avg, fence to hand over %.1f ms avg",
+      m_createTime / handedOver, m_handOverTime / handedOver);
+    ImGui::Text("request to hand over %.1f ms max", m_latencyMax);
+  }
+  ImGui::Separator();
+  m_textureStreamer->DrawUI();
+  ImGui::Separator();
+  m_residencyManager->DrawUI();
+}
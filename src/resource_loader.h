@@ -0,0 +1,114 @@
+#ifndef __RESOURCE_LOADER_H__
+#define __RESOURCE_LOADER_H__
+
+#include "common.h"
+#include "texture.h"
+#include "egl_context.h"
+#include "texture_streamer.h"
+#include "residency_manager.h"
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+// creates textures and buffers on a loader thread, so decoding and uploading
+// never stalls a frame. the thread owns a second gl context sharing objects
+// with the render context: a hidden glfw window, or a surfaceless egl context
+// when headless. every load puts a fence behind its uploads, Update() on the
+// render thread waits for nothing: loads whose fence signaled are handed over
+// by calling their ready callback there, the others stay queued for the next
+// frame. objects are handed over in the order they were requested.
+//
+// vertex arrays and framebuffers are not shared between contexts, ready
+// callbacks set those up on the render context.
+//
+// image files are the exception: LoadTexture streams them through pixel
+// buffers on the render context (see TextureStreamer), within a per-frame
+// upload budget, coarse levels first and the finer ones as draws need them
+// within a vram budget (see ResidencyManager). cooked ktx2 versions of them
+// are loaded like any other object.
+CLASS_PTR(ResourceLoader)
+class ResourceLoader {
+public:
+  // the context of shareWindow has to be current on the calling thread
+  static ResourceLoaderUPtr Create(GLFWwindow* shareWindow);
+#ifdef HEADLESS_EGL
+  static ResourceLoaderUPtr Create(const EglContext* shareContext);
+#endif
+  // no loader thread: Load creates the object and calls ready right away. for
+  // gl capture, which records the calls of a single thread
+  static ResourceLoaderUPtr CreateImmediate();
+  ~ResourceLoader();
+
+  // create runs on the loader thread and returns null on failure, ready gets
+  // the object on the render thread once the gpu has it
+  template <typename T>
+  void Load(const std::string& name, std::function<std::shared_ptr<T>()> create,
+    std::function<void(std::shared_ptr<T>)> ready) {
+    auto result = std::make_shared<std::shared_ptr<T>>();
+    Enqueue(name,
+      [result, create]() { *result = create(); return *result != nullptr; },
+      [result, ready]() { ready(std::move(*result)); });
+  }
+  // through the texture streamer, the image is decoded on its workers. the
+  // immediate loader uploads right away. a cooked NAME.ktx2 or NAME.etc2.ktx2
+  // next to the file is used instead when this gl samples its format
+  void LoadTexture(const std::string& filename, std::function<void(TexturePtr)> ready, bool flipVertical = true);
+  // shown until the real texture is handed over, 0.5 gray
+  TexturePtr GetPlaceholderTexture() const { return m_placeholderTexture; }
+
+  // once per frame on the thread rendering with the shared context
+  void Update();
+  // waits for every queued load and hands it over, for runs that need the
+  // whole scene in the first frame (benchmarks, headless)
+  void Finish();
+  // loads requested but not handed over yet
+  bool IsBusy() const { return m_pendingCount > 0 || m_textureStreamer->IsBusy(); }
+  ResidencyManager* GetResidencyManager() const { return m_residencyManager.get(); }
+  void DrawUI();
+
+private:
+  ResourceLoader() {}
+  bool Init();
+  void Run();
+
+  struct Job {
+    std::string name;
+    std::function<bool()> create;
+    std::function<void()> ready;
+    GLsync fence { nullptr };
+    bool succeeded { false };
+    double requestTime { 0.0 };
+    double createTime { 0.0 };    // ms on the loader thread
+    double createdTime { 0.0 };
+  };
+  void Enqueue(const std::string& name, std::function<bool()> create, std::function<void()> ready);
+  void HandOver(Job& job);
+
+  GLFWwindow* m_window { nullptr };   // hidden, only carries the shared context
+#ifdef HEADLESS_EGL
+  EglContextUPtr m_eglContext;
+#endif
+  TexturePtr m_placeholderTexture;
+  TextureStreamerUPtr m_textureStreamer;
+  ResidencyManagerUPtr m_residencyManager;
+
+  std::deque<Job> m_queue;       // waiting for the loader thread
+  std::deque<Job> m_completed;   // created, fence maybe not signaled yet
+  std::mutex m_mutex;
+  std::condition_variable m_condition;
+  std::atomic<int> m_pendingCount { 0 };
+  bool m_stop { false };
+  std::thread m_thread;
+
+  // stats, written by Update and read by DrawUI, which Context runs under its lock
+  int m_loadedCount { 0 };
+  int m_failedCount { 0 };
+  double m_createTime { 0.0 };     // ms on the loader thread, summed
+  double m_handOverTime { 0.0 };   // ms from the upload finishing to the hand over, summed
+  double m_latencyMax { 0.0 };     // ms from request to hand over
+};
+
+#endif // __RESOURCE_LOADER_H__
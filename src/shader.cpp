@@ -9,6 +9,15 @@ ShaderUPtr Shader::CreateFromFile(const string &filename, uint32_t shaderType)
     }
     return std::move(shader);
 }
+ShaderUPtr Shader::CreateFromSource(const string &source, uint32_t shaderType, const string &name)
+{
+    auto shader = ShaderUPtr(new Shader());
+    if (!shader->compile(source, shaderType, name))
+    {
+        return nullptr;
+    }
+    return std::move(shader);
+}
 Shader::~Shader()
 {
     if (m_shader)
@@ -17,15 +26,58 @@ Shader::~Shader()
     }
 }
 
-bool Shader::loadFile(const string &filename, uint32_t shaderType)
+static optional<string> LoadShaderSource(const string &filename, int depth = 0)
 {
+    if (depth > 8)
+    {
+        SPDLOG_ERROR("shader includes nested too deep: {}", filename);
+        return {};
+    }
     auto result = LoadTextFile(filename);
     if (!result.has_value())
+    {
+        return {};
+    }
+
+    // glsl has no #include, the included source is pasted over the line
+    const string directive = "#include \"";
+    string source = result.value();
+    size_t position = 0;
+    while ((position = source.find(directive, position)) != string::npos)
+    {
+        size_t nameEnd = source.find('"', position + directive.size());
+        size_t lineEnd = source.find('\n', position);
+        if (nameEnd == string::npos || (lineEnd != string::npos && nameEnd > lineEnd))
+        {
+            SPDLOG_ERROR("malformed #include in {}", filename);
+            return {};
+        }
+        auto name = source.substr(position + directive.size(), nameEnd - position - directive.size());
+        auto path = (filesystem::path(filename).parent_path() / name).string();
+        auto included = LoadShaderSource(path, depth + 1);
+        if (!included.has_value())
+        {
+            return {};
+        }
+        source.replace(position, nameEnd + 1 - position, included.value());
+        position += included.value().size();
+    }
+    return source;
+}
+
+bool Shader::loadFile(const string &filename, uint32_t shaderType)
+{
+    auto result = LoadShaderSource(filename);
+    if (!result.has_value())
     {
         return false;
     }
 
-    auto &code = result.value();
+    return compile(result.value(), shaderType, filename);
+}
+
+bool Shader::compile(const string &code, uint32_t shaderType, const string &name)
+{
     const char *codePtr = code.c_str();
     int32_t codeLength = (int32_t)code.length();
 
@@ -41,7 +93,7 @@ bool Shader::loadFile(const string &filename, uint32_t shaderType)
     {
         char infolog[1024];
         glGetShaderInfoLog(m_shader, 1024, nullptr, infolog);
-        SPDLOG_ERROR("failed to compile shader: {}", filename);
+        SPDLOG_ERROR("failed to compile shader: {}", name);
         SPDLOG_ERROR("reason: {}", infolog);
         return false;
     }
@@ -7,7 +7,10 @@ CLASS_PTR(Shader);
 class Shader
 {
 public:
+    // #include "name" lines are replaced by the file name, relative to the including one
     static ShaderUPtr CreateFromFile(const string &filename, uint32_t shaderType);
+    // name only shows up in compile errors
+    static ShaderUPtr CreateFromSource(const string &source, uint32_t shaderType, const string &name = "generated");
     ~Shader();
     uint32_t Get() const
     {
@@ -17,6 +20,7 @@ public:
 private:
     Shader() {}
     bool loadFile(const string &filename, uint32_t shaderType);
+    bool compile(const string &code, uint32_t shaderType, const string &name);
     uint32_t m_shader{0}; // shader ID
 };
 
@@ -1,5 +1,7 @@
 #include "texture.h"
 
+uint64_t Texture::s_currentFrame = 0;
+
 TextureUPtr Texture::Create(int width, int height, uint32_t format, uint32_t type) {
   auto texture = TextureUPtr(new Texture());
   texture->CreateTexture();
@@ -7,7 +9,7 @@ TextureUPtr Texture::Create(int width, int height, uint32_t format, uint32_t typ
   texture->SetFilter(GL_LINEAR, GL_LINEAR);
   return std::move(texture);
 }
-TextureUPtr Texture::CreateMSAA(int width, int height, uint32_t format) {
+TextureUPtr Texture::CreateMSAA(int width, int height, uint32_t format, int samples) {
   auto texture = TextureUPtr(new Texture());
   //gen tex
   glGenTextures(1,&(texture->m_texture));
@@ -16,8 +18,9 @@ TextureUPtr Texture::CreateMSAA(int width, int height, uint32_t format) {
   texture->m_width = width;
   texture->m_height = height;
   texture->m_format = format;
+  texture->m_samples = samples;
    // Create a multisample texture
-  glTexImage2DMultisample(GL_TEXTURE_2D_MULTISAMPLE, 4, GL_RGBA, width, height, GL_TRUE);
+  glTexImage2DMultisample(GL_TEXTURE_2D_MULTISAMPLE, samples, format, width, height, GL_TRUE);
 
   glBindTexture(GL_TEXTURE_2D_MULTISAMPLE, 0);
   
@@ -32,6 +35,44 @@ TextureUPtr Texture::CreateFromImage(const Image *image)
     return std::move(texture);
 }
 
+TextureUPtr Texture::CreateEmpty(int width, int height, int channelCount, int levelCount, int firstLevel)
+{
+    auto texture = TextureUPtr(new Texture());
+    texture->CreateTexture();
+    texture->m_width = width;
+    texture->m_height = height;
+    texture->m_format = GetImageFormat(channelCount);
+    texture->m_type = GL_UNSIGNED_BYTE;
+    texture->m_levelCount = levelCount;
+    texture->m_allocatedLevel = levelCount;
+    texture->AllocateLevels(firstLevel);
+    texture->SetBaseLevel(firstLevel);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levelCount - 1);
+    return std::move(texture);
+}
+
+TextureUPtr Texture::CreateFromCompressedImage(const CompressedImage *image)
+{
+    auto texture = TextureUPtr(new Texture());
+    texture->CreateTexture();
+    texture->m_width = image->GetWidth();
+    texture->m_height = image->GetHeight();
+    texture->m_format = CompressedImage::GetGLFormat(image->GetFormat());
+    texture->m_type = GL_UNSIGNED_BYTE;
+    texture->m_levelCount = image->GetLevelCount();
+    texture->m_blockSize = CompressedImage::GetBlockSize(image->GetFormat());
+    for (int level = 0; level < image->GetLevelCount(); level++)
+    {
+        auto& data = image->GetLevel(level);
+        glCompressedTexImage2D(GL_TEXTURE_2D, level, texture->m_format,
+            std::max(texture->m_width >> level, 1), std::max(texture->m_height >> level, 1), 0,
+            (GLsizei)data.size(), data.data());
+    }
+    // a chain cut short still samples complete
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, image->GetLevelCount() - 1);
+    return std::move(texture);
+}
+
 Texture::~Texture()
 {
     if (m_texture)
@@ -42,7 +83,7 @@ Texture::~Texture()
 
 void Texture::Bind() const
 {
-    glBindTexture(GL_TEXTURE_2D, m_texture);
+    glBindTexture(m_samples > 1 ? GL_TEXTURE_2D_MULTISAMPLE : GL_TEXTURE_2D, m_texture);
 }
 
 void Texture::SetFilter(uint32_t minFilter, uint32_t magFilter) const
@@ -71,43 +112,148 @@ void Texture::SetTextureFormat(int width, int height, uint32_t format,uint32_t t
   m_format = format;
   m_type=type;
 
+  // sized internal formats need their matching base pixel format
+  GLenum imageFormat = format;
+  switch (format) {
+    case GL_RGBA8: case GL_RGBA16: case GL_RGBA16F: case GL_RGBA32F: case GL_RGB10_A2:
+      imageFormat = GL_RGBA; break;
+    case GL_RGB8: case GL_RGB16F: case GL_RGB32F: case GL_R11F_G11F_B10F:
+      imageFormat = GL_RGB; break;
+    case GL_RG8: case GL_RG16: case GL_RG16F: case GL_RG32F:
+      imageFormat = GL_RG; break;
+    case GL_R8: case GL_R16F: case GL_R32F:
+      imageFormat = GL_RED; break;
+    case GL_DEPTH_COMPONENT24: case GL_DEPTH_COMPONENT32F:
+      imageFormat = GL_DEPTH_COMPONENT; break;
+    case GL_DEPTH24_STENCIL8:
+      imageFormat = GL_DEPTH_STENCIL; break;
+  }
+
   glTexImage2D(GL_TEXTURE_2D, 0, m_format,
     m_width, m_height, 0,
-    m_format, m_type,
+    imageFormat, m_type,
     nullptr);
 }
 
 void Texture::SetBorderColor(const glm::vec4& color) const {
   glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, glm::value_ptr(color));
 }
-void Texture::SetTextureFromImage(const Image *image)
+void Texture::SetSubImage(int level, int y, int rowCount, const void* pixels) const
+{
+    Bind();
+    // rows of 1 and 3 channel images are not 4 byte aligned
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexSubImage2D(GL_TEXTURE_2D, level, 0, y, std::max(m_width >> level, 1), rowCount, m_format, m_type, pixels);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+}
+
+void Texture::SetBaseLevel(int level)
+{
+    Bind();
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level);
+    m_baseLevel = level;
+}
+
+void Texture::AllocateLevels(int level)
+{
+    Bind();
+    for (; m_allocatedLevel > level; m_allocatedLevel--)
+    {
+        int allocate = m_allocatedLevel - 1;
+        glTexImage2D(GL_TEXTURE_2D, allocate, m_format, std::max(m_width >> allocate, 1),
+            std::max(m_height >> allocate, 1), 0, m_format, m_type, nullptr);
+    }
+}
+
+void Texture::ReleaseLevels(int level)
+{
+    // nothing samples the levels once the base is past them, a 0x0 image
+    // lets the driver drop their storage
+    SetBaseLevel(level);
+    for (; m_allocatedLevel < level; m_allocatedLevel++)
+    {
+        if (m_blockSize > 0)
+            glCompressedTexImage2D(GL_TEXTURE_2D, m_allocatedLevel, m_format, 0, 0, 0, 0, nullptr);
+        else
+            glTexImage2D(GL_TEXTURE_2D, m_allocatedLevel, m_format, 0, 0, 0, m_format, m_type, nullptr);
+    }
+}
+
+size_t Texture::GetLevelByteSize(int level) const
 {
-    uint32_t format = GL_RGBA;
-    switch (image->GetChannelCount())
+    size_t width = std::max(m_width >> level, 1), height = std::max(m_height >> level, 1);
+    if (m_blockSize > 0)
+        return (width + 3) / 4 * ((height + 3) / 4) * m_blockSize;
+    // drivers pad rgb texels to 4 bytes
+    switch (m_format)
     {
-    default:
-        break;
-    case 1:
-        format = GL_RED;
-        break;
-    case 2:
-        format = GL_RG;
-        break;
-    case 3:
-        format = GL_RGB;
-        break;
+    case GL_RED: return width * height;
+    case GL_RG: return width * height * 2;
+    default: return width * height * 4;
     }
+}
+
+size_t Texture::GetByteSize() const
+{
+    size_t size = 0;
+    for (int level = m_allocatedLevel; level < m_levelCount; level++)
+        size += GetLevelByteSize(level);
+    return size;
+}
+
+void Texture::MarkUsed(float pixelsAcross)
+{
+    // the texture is taken to span what it is drawn on once, the level whose
+    // texels are about a pixel each is enough
+    int wanted = 0;
+    if (pixelsAcross > 0.0f)
+    {
+        float texelsPerPixel = std::max(m_width, m_height) / pixelsAcross;
+        wanted = std::min(std::max((int)floorf(log2f(texelsPerPixel)), 0), m_levelCount - 1);
+    }
+    if (m_lastUsedFrame != s_currentFrame)
+    {
+        m_lastUsedFrame = s_currentFrame;
+        m_wantedLevel = wanted;
+    }
+    else
+        m_wantedLevel = std::min(m_wantedLevel, wanted);
+}
+
+uint32_t Texture::GetImageFormat(int channelCount)
+{
+    switch (channelCount)
+    {
+    case 1: return GL_RED;
+    case 2: return GL_RG;
+    case 3: return GL_RGB;
+    default: return GL_RGBA;
+    }
+}
+
+void Texture::SetTextureFromImage(const Image *image)
+{
+    uint32_t format = GetImageFormat(image->GetChannelCount());
     m_width = image->GetWidth();
     m_height = image->GetHeight();
     m_format = format;
     m_type=GL_UNSIGNED_BYTE;
-  
-    glTexImage2D(GL_TEXTURE_2D, 0, m_format,
-        m_width, m_height, 0,
-        format, m_type,
-        image->GetData());
+    m_levelCount = MipGenerator::GetLevelCount(m_width, m_height);
 
-    glGenerateMipmap(GL_TEXTURE_2D);
+    // mip levels shrink to rows that are not 4 byte aligned
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    for (int level = 0; level < image->GetLevelCount(); level++)
+    {
+        glTexImage2D(GL_TEXTURE_2D, level, m_format,
+            image->GetLevelWidth(level), image->GetLevelHeight(level), 0,
+            format, m_type,
+            image->GetLevelData(level));
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+    // images without a cpu chain still get the driver's
+    if (image->GetLevelCount() == 1)
+        glGenerateMipmap(GL_TEXTURE_2D);
 }
 
 //cubetexture
@@ -155,4 +301,28 @@ bool CubeTexture::InitFromImages(const std::vector<Image*> images) {
   }
 
   return true;
+}
+
+//buffer texture
+BufferTextureUPtr BufferTexture::Create(const BufferPtr buffer, uint32_t format) {
+  auto texture = BufferTextureUPtr(new BufferTexture());
+  texture->Init(buffer, format);
+  return std::move(texture);
+}
+
+BufferTexture::~BufferTexture() {
+  if (m_texture) {
+    glDeleteTextures(1, &m_texture);
+  }
+}
+
+void BufferTexture::Bind() const {
+  glBindTexture(GL_TEXTURE_BUFFER, m_texture);
+}
+
+void BufferTexture::Init(const BufferPtr buffer, uint32_t format) {
+  m_buffer = buffer;
+  glGenTextures(1, &m_texture);
+  Bind();
+  glTexBuffer(GL_TEXTURE_BUFFER, format, m_buffer->Get());
 }
\ No newline at end of file
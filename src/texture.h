@@ -1,14 +1,20 @@
 #ifndef __TEXTURE_H__
 #define __TEXTURE_H__
 #include "image.h"
+#include "buffer.h"
 
 CLASS_PTR(Texture);
 class Texture
 {
 public:
     static TextureUPtr Create(int width, int height, uint32_t format, uint32_t type = GL_UNSIGNED_BYTE);
-    static TextureUPtr CreateMSAA(int width, int height, uint32_t format);
+    static TextureUPtr CreateMSAA(int width, int height, uint32_t format, int samples = 4);
     static TextureUPtr CreateFromImage(const Image *image);
+    // storage of levelCount levels for 8-bit pixels with channelCount channels, filled by SetSubImage.
+    // levels finer than firstLevel get none yet and are not sampled (see AllocateLevels)
+    static TextureUPtr CreateEmpty(int width, int height, int channelCount, int levelCount = 1, int firstLevel = 0);
+    // every level of the chain as it is, no mipmaps are generated
+    static TextureUPtr CreateFromCompressedImage(const CompressedImage *image);
     ~Texture();
     const uint32_t Get() const { return m_texture; }
     void Bind() const;
@@ -18,19 +24,54 @@ public:
     int GetHeight() const { return m_height; }
     uint32_t GetFormat() const { return m_format; }
     uint32_t GetType() const { return m_type; }
+    int GetSamples() const { return m_samples; }
     void SetBorderColor(const glm::vec4& color)const;
+    // rows [y, y + rowCount) of a level, tightly packed. pixels is an offset
+    // into the bound GL_PIXEL_UNPACK_BUFFER when there is one
+    void SetSubImage(int level, int y, int rowCount, const void* pixels) const;
+
+    int GetLevelCount() const { return m_levelCount; }
+    // the finest level sampled, GL_TEXTURE_BASE_LEVEL
+    int GetBaseLevel() const { return m_baseLevel; }
+    void SetBaseLevel(int level);
+    // storage for the levels from level up to the allocated ones, filled by
+    // SetSubImage. uncompressed textures only
+    void AllocateLevels(int level);
+    // frees the levels finer than level, which becomes the base level
+    void ReleaseLevels(int level);
+    size_t GetLevelByteSize(int level) const;
+    // of the allocated levels
+    size_t GetByteSize() const;
+
+    // residency bookkeeping (see ResidencyManager): a draw binding the texture
+    // stamps the frame and how many pixels it spans on screen, 0 when unknown
+    void MarkUsed(float pixelsAcross = 0.0f);
+    uint64_t GetLastUsedFrame() const { return m_lastUsedFrame; }
+    // the finest level the draws of the last used frame sample
+    int GetWantedLevel() const { return m_wantedLevel; }
+    static void SetCurrentFrame(uint64_t frame) { s_currentFrame = frame; }
 
 private:
     Texture() {}
     void CreateTexture();
     void SetTextureFromImage(const Image *image);
     void SetTextureFormat(int width, int height, uint32_t format, uint32_t type);
+    static uint32_t GetImageFormat(int channelCount);
 
     uint32_t m_texture{0};
     int m_width { 0 };
     int m_height { 0 };
     uint32_t m_format { GL_RGBA };
     uint32_t m_type{ GL_UNSIGNED_BYTE };
+    int m_samples { 1 };
+    int m_levelCount { 1 };
+    int m_baseLevel { 0 };
+    int m_allocatedLevel { 0 };   // the finest level with storage
+    int m_blockSize { 0 };        // bytes per 4x4 block of compressed formats
+    uint64_t m_lastUsedFrame { 0 };
+    int m_wantedLevel { 0 };
+
+    static uint64_t s_currentFrame;
 };
 CLASS_PTR(CubeTexture)
 class CubeTexture {
@@ -47,4 +88,20 @@ private:
   uint32_t m_texture { 0 };
 };
 
+CLASS_PTR(BufferTexture)
+class BufferTexture {
+public:
+  static BufferTextureUPtr Create(const BufferPtr buffer, uint32_t format);
+  ~BufferTexture();
+
+  const uint32_t Get() const { return m_texture; }
+  const BufferPtr GetBuffer() const { return m_buffer; }
+  void Bind() const;
+private:
+  BufferTexture() {}
+  void Init(const BufferPtr buffer, uint32_t format);
+  uint32_t m_texture { 0 };
+  BufferPtr m_buffer;
+};
+
 #endif
\ No newline at end of file
@@ -0,0 +1,150 @@
+#include "image.h"
+#include "block_compressor.h"
+#include "thread_pool.h"
+#include <chrono>
+
+// cooks image files into block compressed ktx2 files with their whole mip chain:
+//   texture_cooker [--format auto|bc1|bc3|bc5|bc7] [--filter kaiser|box] [--linear] [--no-etc2] [--no-flip]
+//                  [--threads N] [-o DIR] FILE...
+// writes NAME.ktx2 next to each FILE, or into DIR, plus NAME.etc2.ktx2 for gl
+// implementations without s3tc or bptc. ResourceLoader::LoadTexture picks
+// them up in place of FILE when they sit next to it. auto is bc1 for opaque
+// images and bc3 otherwise, bc5 keeps red and green (normal maps), bc7 has
+// the size of bc3 at a better quality. the mips are filtered in linear space
+// unless --linear says the colors are data already, bc5 always is. --no-flip
+// keeps the rows top-down, for textures loaded with flipVertical false.
+
+namespace {
+
+struct CookOptions {
+  std::string format { "auto" };
+  std::string outputDirectory;
+  MipFilter filter { MipFilter::Kaiser };
+  bool linear { false };
+  bool etc2 { true };
+  bool flipVertical { true };
+  int threads { 0 };
+  std::vector<std::string> inputs;
+};
+
+double Now() {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// rgba8 of a level that samples like the uncompressed upload: 1 and 2
+// channel images become red and red green textures
+std::vector<uint8_t> ExpandToRgba(const Image* image, int level) {
+  size_t texelCount = (size_t)image->GetLevelWidth(level) * image->GetLevelHeight(level);
+  int channelCount = image->GetChannelCount();
+  std::vector<uint8_t> rgba(texelCount * 4);
+  for (size_t i = 0; i < texelCount; i++) {
+    const uint8_t* source = image->GetLevelData(level) + i * channelCount;
+    uint8_t* texel = rgba.data() + i * 4;
+    for (int c = 0; c < 4; c++)
+      texel[c] = c < channelCount ? source[c] : (c == 3 ? 255 : 0);
+  }
+  return rgba;
+}
+
+bool IsOpaque(const std::vector<uint8_t>& rgba) {
+  for (size_t i = 3; i < rgba.size(); i += 4) {
+    if (rgba[i] != 255)
+      return false;
+  }
+  return true;
+}
+
+bool Cook(const std::string& input, const CookOptions& options, ThreadPool* threadPool) {
+  double start = Now();
+  auto image = Image::Load(input, options.flipVertical);
+  if (!image) {
+    SPDLOG_ERROR("failed to load {}", input);
+    return false;
+  }
+  int width = image->GetWidth(), height = image->GetHeight();
+
+  using Format = CompressedImage::Format;
+  Format format = Format::BC1;
+  if (options.format == "bc3")
+    format = Format::BC3;
+  else if (options.format == "bc5")
+    format = Format::BC5;
+  else if (options.format == "bc7")
+    format = Format::BC7;
+  image->GenerateMipmaps(options.filter, !options.linear && format != Format::BC5);
+  std::vector<std::vector<uint8_t>> chain;
+  for (int level = 0; level < image->GetLevelCount(); level++)
+    chain.push_back(ExpandToRgba(image.get(), level));
+  bool opaque = IsOpaque(chain[0]);
+  if (options.format == "auto" && !opaque)
+    format = Format::BC3;
+
+  std::filesystem::path path(input);
+  auto directory = options.outputDirectory.empty() ? path.parent_path() : std::filesystem::path(options.outputDirectory);
+  auto stem = (directory / path.stem()).string();
+  std::vector<std::pair<Format, std::string>> outputs = { { format, stem + ".ktx2" } };
+  if (options.etc2) {
+    // no etc2 format keeps two channels apart, bc5 falls back to rgb
+    bool hasAlpha = !opaque && format != Format::BC5;
+    outputs.push_back({ hasAlpha ? Format::ETC2_RGBA : Format::ETC2_RGB, stem + ".etc2.ktx2" });
+  }
+
+  for (auto& output : outputs) {
+    auto compressed = CompressedImage::Create(output.first, width, height, options.flipVertical);
+    for (int level = 0; level < (int)chain.size(); level++) {
+      compressed->AddLevel(BlockCompressor::Compress(chain[level].data(),
+        std::max(width >> level, 1), std::max(height >> level, 1), output.first, threadPool));
+    }
+    if (!compressed->Save(output.second))
+      return false;
+    SPDLOG_INFO("{}: {} {}x{}, {} levels, {:.1f} KB", output.second, CompressedImage::GetFormatName(output.first),
+      width, height, compressed->GetLevelCount(), compressed->GetByteSize() / 1024.0);
+  }
+  SPDLOG_INFO("cooked {} in {:.1f} ms", input, (Now() - start) * 1000.0);
+  return true;
+}
+
+}
+
+int main(int argc, char** args) {
+  CookOptions options;
+  for (int i = 1; i < argc; i++) {
+    std::string arg = args[i];
+    bool hasValue = i + 1 < argc;
+    if (arg == "--format" && hasValue)
+      options.format = args[++i];
+    else if (arg == "--filter" && hasValue)
+      options.filter = std::string(args[++i]) == "box" ? MipFilter::Box : MipFilter::Kaiser;
+    else if (arg == "--linear")
+      options.linear = true;
+    else if (arg == "--no-etc2")
+      options.etc2 = false;
+    else if (arg == "--no-flip")
+      options.flipVertical = false;
+    else if (arg == "--threads" && hasValue)
+      options.threads = atoi(args[++i]);
+    else if (arg == "-o" && hasValue)
+      options.outputDirectory = args[++i];
+    else
+      options.inputs.push_back(arg);
+  }
+  bool knownFormat = options.format == "auto" || options.format == "bc1" || options.format == "bc3" ||
+    options.format == "bc5" || options.format == "bc7";
+  if (options.inputs.empty() || !knownFormat) {
+    SPDLOG_ERROR("usage: texture_cooker [--format auto|bc1|bc3|bc5|bc7] [--filter kaiser|box] [--linear] "
+      "[--no-etc2] [--no-flip] [--threads N] [-o DIR] FILE...");
+    return -1;
+  }
+
+  // block rows of each level are spread over the workers and this thread,
+  // --threads 1 compresses on this thread alone
+  ThreadPoolUPtr threadPool;
+  if (options.threads != 1)
+    threadPool = ThreadPool::Create(options.threads > 1 ? options.threads - 1 : 0);
+  int failed = 0;
+  for (auto& input : options.inputs) {
+    if (!Cook(input, options, threadPool.get()))
+      failed++;
+  }
+  return failed > 0 ? -1 : 0;
+}
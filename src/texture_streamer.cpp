@@ -0,0 +1,298 @@
+#include "texture_streamer.h"
+#include "cpu_profiler.h"
+#include "async_log.h"
+#include <imgui.h>
+#include <chrono>
+#include <thread>
+
+static double Now() {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+TextureStreamerUPtr TextureStreamer::Create(size_t bytesPerFrame) {
+  auto streamer = TextureStreamerUPtr(new TextureStreamer());
+  streamer->Init(bytesPerFrame);
+  return std::move(streamer);
+}
+
+void TextureStreamer::Init(size_t bytesPerFrame) {
+  m_bytesPerFrame = bytesPerFrame;
+  // two decoders keep the buffers busy without competing with the frame's workers
+  m_threadPool = ThreadPool::Create(2);
+  m_statsStart = Now();
+}
+
+TextureStreamer::~TextureStreamer() {
+  // runs the decodes still queued, they write into mapped buffers
+  m_threadPool = nullptr;
+  for (auto& request : m_requests) {
+    if (request->fence)
+      glDeleteSync(request->fence);
+    ReleaseBuffer(*request);
+  }
+}
+
+void TextureStreamer::Stream(const std::string& filename, std::function<void(TexturePtr)> ready, bool flipVertical,
+  int maxSize) {
+  auto request = std::make_shared<Request>();
+  request->filename = filename;
+  request->flipVertical = flipVertical;
+  request->maxSize = maxSize;
+  request->ready = std::move(ready);
+  Submit(request);
+}
+
+void TextureStreamer::Refine(TexturePtr texture, const std::string& filename, bool flipVertical, int level,
+  std::function<void(bool)> done) {
+  auto request = std::make_shared<Request>();
+  request->filename = filename;
+  request->flipVertical = flipVertical;
+  request->texture = std::move(texture);
+  request->finestLevel = level;
+  request->refined = std::move(done);
+  Submit(request);
+}
+
+void TextureStreamer::Submit(RequestPtr request) {
+  request->requestTime = Now();
+  m_pendingCount++;
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_incoming.push_back(request);
+  }
+  m_threadPool->Submit([request]() {
+    CPU_ZONE("texture probe");
+    bool ok = Image::ReadInfo(request->filename, request->width, request->height, request->channelCount);
+    request->levelCount = MipGenerator::GetLevelCount(request->width, request->height);
+    request->size = MipGenerator::GetChainSize(request->width, request->height, request->channelCount);
+    if (request->maxSize > 0) {
+      while (request->finestLevel < request->levelCount - 1 &&
+        std::max(request->width, request->height) >> request->finestLevel > request->maxSize)
+        request->finestLevel++;
+    }
+    request->state = ok ? Probed : Failed;
+  });
+}
+
+size_t TextureStreamer::GetLevelOffset(const Request& request, int level) {
+  size_t offset = 0;
+  for (int finer = 0; finer < level; finer++)
+    offset += (size_t)std::max(request.width >> finer, 1) * std::max(request.height >> finer, 1) * request.channelCount;
+  return offset;
+}
+
+void TextureStreamer::Update() {
+  CPU_ZONE("texture streaming");
+  double start = Now();
+  size_t uploaded = IsBusy() ? Pump(m_bytesPerFrame > 0 ? m_bytesPerFrame : SIZE_MAX) : 0;
+  double now = Now();
+
+  m_updateHistory[m_historyIndex] = (float)((now - start) * 1000.0);
+  m_uploadHistory[m_historyIndex] = uploaded / (1024.0f * 1024.0f);
+  m_historyIndex = (m_historyIndex + 1) % HistorySize;
+  m_historyCount = std::min(m_historyCount + 1, HistorySize);
+  m_statsBytes += uploaded;
+  if (now - m_statsStart >= 1.0) {
+    m_megabytesPerSecond = (float)(m_statsBytes / (1024.0 * 1024.0) / (now - m_statsStart));
+    m_statsBytes = 0;
+    m_statsStart = now;
+  }
+  if (uploaded > 0)
+    LOG_TELEMETRY("texture upload", (float)((now - start) * 1000.0), uploaded / (1024.0f * 1024.0f));
+}
+
+void TextureStreamer::Finish() {
+  CPU_ZONE("texture streamer finish");
+  while (IsBusy()) {
+    Pump(SIZE_MAX);
+    if (!IsBusy())
+      break;
+    // fences only signal once their commands reach the gpu
+    glFlush();
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+}
+
+size_t TextureStreamer::Pump(size_t budget) {
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_requests.insert(m_requests.end(), m_incoming.begin(), m_incoming.end());
+    m_incoming.clear();
+  }
+  size_t uploaded = 0;
+  for (auto it = m_requests.begin(); it != m_requests.end();) {
+    auto request = *it;
+    int state = request->state;
+    if (state == Probed && MapBuffer(*request)) {
+      request->state = state = Decoding;
+      m_threadPool->Submit([request]() {
+        CPU_ZONE("texture decode");
+        // the mip chain is filtered here too, off the gl thread
+        bool ok = Image::LoadInto(request->filename, request->mapped, request->size, request->flipVertical, true);
+        request->state = ok ? Decoded : Failed;
+      });
+    }
+    if (state == Decoded) {
+      m_buffers[request->buffer].buffer->Bind();
+      glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+      glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+      request->mapped = nullptr;
+      if (!request->texture) {
+        request->texture = Texture::CreateEmpty(request->width, request->height, request->channelCount,
+          request->levelCount, request->finestLevel);
+        request->level = request->levelCount - 1;
+        request->state = state = Uploading;
+      }
+      else if (request->texture->GetWidth() == request->width && request->texture->GetHeight() == request->height &&
+        request->texture->GetLevelCount() == request->levelCount) {
+        request->texture->AllocateLevels(request->finestLevel);
+        request->level = request->texture->GetBaseLevel() - 1;
+        request->state = state = Uploading;
+      }
+      else {
+        // the file changed since the texture was streamed
+        request->state = state = Failed;
+      }
+    }
+    if (state == Uploading) {
+      // level by level from the coarsest in whole rows, at least one so a
+      // texture wider than the budget still moves
+      m_buffers[request->buffer].buffer->Bind();
+      while (uploaded < budget && request->level >= request->finestLevel) {
+        int levelHeight = std::max(request->height >> request->level, 1);
+        size_t rowSize = (size_t)std::max(request->width >> request->level, 1) * request->channelCount;
+        // in size_t: an unlimited budget overflows int
+        int rows = (int)std::min<size_t>(std::max<size_t>((budget - uploaded) / rowSize, 1),
+          levelHeight - request->uploadedRows);
+        request->texture->SetSubImage(request->level, request->uploadedRows, rows,
+          (const void*)(GetLevelOffset(*request, request->level) + rowSize * request->uploadedRows));
+        request->uploadedRows += rows;
+        uploaded += rowSize * rows;
+        if (request->uploadedRows == levelHeight) {
+          // draws after this sample the level, they are queued behind its upload
+          if (request->level < request->texture->GetBaseLevel())
+            request->texture->SetBaseLevel(request->level);
+          request->uploadedRows = 0;
+          request->level--;
+        }
+      }
+      glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+      if (request->level < request->finestLevel) {
+        request->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        request->state = state = Finishing;
+      }
+    }
+    if (state == Finishing) {
+      GLint status = GL_UNSIGNALED;
+      glGetSynciv(request->fence, GL_SYNC_STATUS, sizeof(status), nullptr, &status);
+      if (status == GL_SIGNALED) {
+        glDeleteSync(request->fence);
+        request->fence = nullptr;
+        ReleaseBuffer(*request);
+        if (request->refined)
+          request->refined(true);
+        else
+          request->ready(request->texture);
+        m_streamedCount++;
+        m_latencyMax = std::max(m_latencyMax, (Now() - request->requestTime) * 1000.0);
+        m_pendingCount--;
+        it = m_requests.erase(it);
+        continue;
+      }
+    }
+    if (state == Failed) {
+      SPDLOG_ERROR("failed to stream texture {}", request->filename);
+      ReleaseBuffer(*request);
+      if (request->refined)
+        request->refined(false);
+      m_pendingCount--;
+      it = m_requests.erase(it);
+      continue;
+    }
+    ++it;
+  }
+  m_uploadedBytes += uploaded;
+  return uploaded;
+}
+
+bool TextureStreamer::MapBuffer(Request& request) {
+  // the smallest free buffer that fits, else a new one, else the largest free one grows
+  int best = -1, largest = -1;
+  for (int i = 0; i < (int)m_buffers.size(); i++) {
+    auto& buffer = m_buffers[i];
+    if (buffer.inUse)
+      continue;
+    if (buffer.size >= request.size && (best < 0 || buffer.size < m_buffers[best].size))
+      best = i;
+    if (largest < 0 || buffer.size > m_buffers[largest].size)
+      largest = i;
+  }
+  if (best < 0 && (int)m_buffers.size() < MaxBuffers) {
+    PixelBuffer buffer;
+    buffer.buffer = Buffer::CreateWithData(GL_PIXEL_UNPACK_BUFFER, GL_STREAM_DRAW, nullptr, 1, request.size);
+    buffer.size = request.size;
+    m_buffers.push_back(std::move(buffer));
+    best = (int)m_buffers.size() - 1;
+  }
+  if (best < 0)
+    best = largest;
+  if (best < 0)
+    return false;
+
+  auto& buffer = m_buffers[best];
+  if (buffer.size < request.size) {
+    buffer.buffer->SetData(nullptr, request.size);
+    buffer.size = request.size;
+  }
+  // the previous texture from this buffer finished, nothing on the gpu reads it
+  buffer.buffer->Bind();
+  request.mapped = (uint8_t*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, request.size,
+    GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+  if (!request.mapped) {
+    SPDLOG_ERROR("failed to map a {} byte pixel buffer", request.size);
+    return false;
+  }
+  buffer.inUse = true;
+  request.buffer = best;
+  return true;
+}
+
+void TextureStreamer::ReleaseBuffer(Request& request) {
+  if (request.buffer < 0)
+    return;
+  auto& buffer = m_buffers[request.buffer];
+  if (request.mapped) {
+    buffer.buffer->Bind();
+    glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    request.mapped = nullptr;
+  }
+  buffer.inUse = false;
+  request.buffer = -1;
+}
+
+void TextureStreamer::DrawUI() {
+  int budget = (int)(m_bytesPerFrame >> 20);
+  if (ImGui::DragInt("rl.upload budget", &budget, 0.1f, 0, 256, budget > 0 ? "%d MB/frame" : "unlimited"))
+    m_bytesPerFrame = (size_t)std::max(budget, 0) << 20;
+  size_t poolBytes = 0;
+  for (auto& buffer : m_buffers)
+    poolBytes += buffer.size;
+  ImGui::Text("textures streamed %d (%.1f MB), %d pending", m_streamedCount,
+    m_uploadedBytes / (1024.0f * 1024.0f), (int)m_pendingCount);
+  ImGui::Text("upload %.1f MB/s, request to hand over %.1f ms max", m_megabytesPerSecond, m_latencyMax);
+  ImGui::Text("pixel buffers %d, %.1f MB", (int)m_buffers.size(), poolBytes / (1024.0f * 1024.0f));
+  if (m_historyCount > 0) {
+    float average = 0.0f, maximum = 0.0f;
+    for (int i = 0; i < m_historyCount; i++) {
+      average += m_updateHistory[i];
+      maximum = std::max(maximum, m_updateHistory[i]);
+    }
+    average /= m_historyCount;
+    ImGui::Text("render thread cost: %.3f ms avg, %.3f ms max per frame", average, maximum);
+    int offset = m_historyCount == HistorySize ? m_historyIndex : 0;
+    ImGui::PlotLines("rl.update ms", m_updateHistory, m_historyCount, offset, nullptr, 0.0f, FLT_MAX, ImVec2(0, 40));
+    ImGui::PlotHistogram("rl.MB per frame", m_uploadHistory, m_historyCount, offset, nullptr, 0.0f, FLT_MAX, ImVec2(0, 40));
+  }
+}
@@ -0,0 +1,118 @@
+#ifndef __TEXTURE_STREAMER_H__
+#define __TEXTURE_STREAMER_H__
+
+#include "common.h"
+#include "texture.h"
+#include "buffer.h"
+#include "thread_pool.h"
+#include <atomic>
+#include <functional>
+#include <list>
+#include <mutex>
+
+// streams image files into textures through a pool of pixel unpack buffers.
+// workers decode the image and filter its mip chain into a mapped buffer and
+// glTexSubImage2D reads the rows from it, so the render thread never touches
+// pixels and the driver copies them whenever the gpu gets to it. the rows are
+// spread over frames by a byte budget, level by level from the coarsest; a
+// texture is handed over once its upload is done on the gpu and its buffer
+// goes back to the pool. Refine streams finer levels into a texture later on.
+//
+// Update() runs once per frame on the render context, Stream may be called
+// from any thread.
+CLASS_PTR(TextureStreamer)
+class TextureStreamer {
+public:
+  static TextureStreamerUPtr Create(size_t bytesPerFrame = 8 << 20);
+  ~TextureStreamer();
+
+  // maxSize > 0 uploads only the levels no larger than maxSize texels on a
+  // side, the finer ones get no storage until Refine
+  void Stream(const std::string& filename, std::function<void(TexturePtr)> ready, bool flipVertical = true,
+    int maxSize = 0);
+  // decodes filename again and uploads its levels from the base level of
+  // texture down to level, the base follows each one as it lands. done gets
+  // whether it worked, texture must not change its levels meanwhile
+  void Refine(TexturePtr texture, const std::string& filename, bool flipVertical, int level,
+    std::function<void(bool)> done);
+  void Update();
+  // streams everything requested without a budget
+  void Finish();
+  bool IsBusy() const { return m_pendingCount > 0; }
+  // 0: no limit
+  void SetBytesPerFrame(size_t bytes) { m_bytesPerFrame = bytes; }
+  void DrawUI();
+
+private:
+  TextureStreamer() {}
+  void Init(size_t bytesPerFrame);
+  // uploads at most budget bytes, returns how many
+  size_t Pump(size_t budget);
+
+  enum State {
+    Probing,      // worker reads the header
+    Probed,       // waits for a free buffer
+    Decoding,     // worker writes into the mapped buffer
+    Decoded,
+    Uploading,    // rows left to copy
+    Finishing,    // fence after the last level
+    Failed,
+  };
+  struct Request {
+    std::string filename;
+    bool flipVertical { true };
+    int maxSize { 0 };
+    std::function<void(TexturePtr)> ready;
+    std::function<void(bool)> refined;    // set for Refine
+    std::atomic<int> state { Probing };   // workers set Probed, Decoded and Failed
+    int width { 0 };
+    int height { 0 };
+    int channelCount { 0 };
+    int levelCount { 1 };
+    size_t size { 0 };    // of the whole chain
+    int buffer { -1 };
+    uint8_t* mapped { nullptr };
+    TexturePtr texture;
+    int finestLevel { 0 };    // the last to upload
+    int level { 0 };          // being uploaded, counts down to finestLevel
+    int uploadedRows { 0 };   // of level
+    GLsync fence { nullptr };
+    double requestTime { 0.0 };
+  };
+  using RequestPtr = std::shared_ptr<Request>;
+  void Submit(RequestPtr request);
+  // of level in the decoded chain
+  static size_t GetLevelOffset(const Request& request, int level);
+  bool MapBuffer(Request& request);
+  void ReleaseBuffer(Request& request);
+
+  struct PixelBuffer {
+    BufferUPtr buffer;
+    size_t size { 0 };
+    bool inUse { false };
+  };
+  static const int MaxBuffers = 4;
+  std::vector<PixelBuffer> m_buffers;
+  ThreadPoolUPtr m_threadPool;   // decoding, apart from the scene's pool
+  size_t m_bytesPerFrame { 0 };
+
+  std::mutex m_mutex;
+  std::vector<RequestPtr> m_incoming;   // from Stream, picked up by Update
+  std::list<RequestPtr> m_requests;
+  std::atomic<int> m_pendingCount { 0 };
+
+  // stats, written by Update and read by DrawUI, which Context runs under its lock
+  static const int HistorySize = 120;
+  float m_updateHistory[HistorySize] {};   // ms of cpu time in Update per frame
+  float m_uploadHistory[HistorySize] {};   // MB uploaded per frame
+  int m_historyIndex { 0 };
+  int m_historyCount { 0 };
+  int m_streamedCount { 0 };
+  uint64_t m_uploadedBytes { 0 };
+  uint64_t m_statsBytes { 0 };
+  double m_statsStart { 0.0 };
+  float m_megabytesPerSecond { 0.0f };
+  double m_latencyMax { 0.0 };   // ms from request to hand over
+};
+
+#endif // __TEXTURE_STREAMER_H__
@@ -0,0 +1,91 @@
+#include "thread_pool.h"
+#include "cpu_profiler.h"
+#include <atomic>
+
+ThreadPoolUPtr ThreadPool::Create(int threadCount) {
+  auto pool = ThreadPoolUPtr(new ThreadPool());
+  pool->Init(threadCount);
+  return std::move(pool);
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stop = true;
+  }
+  m_condition.notify_all();
+  for (auto& worker : m_workers)
+    worker.join();
+}
+
+void ThreadPool::Init(int threadCount) {
+  if (threadCount <= 0)
+    threadCount = std::max((int)std::thread::hardware_concurrency() - 1, 1);
+  for (int i = 0; i < threadCount; i++)
+    m_workers.emplace_back([this, i]() {
+      CpuProfiler::SetThreadName(fmt::format("worker {}", i).c_str());
+      WorkerLoop();
+    });
+}
+
+void ThreadPool::Submit(std::function<void()> task) {
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_tasks.push(std::move(task));
+  }
+  m_condition.notify_one();
+}
+
+void ThreadPool::ParallelFor(int count, const std::function<void(int)>& job) {
+  if (count <= 0)
+    return;
+  if (count == 1 || m_workers.empty()) {
+    for (int i = 0; i < count; i++)
+      job(i);
+    return;
+  }
+
+  // workers and the caller pull indices from a shared counter
+  struct Batch {
+    std::atomic<int> next { 0 };
+    std::atomic<int> done { 0 };
+    std::mutex mutex;
+    std::condition_variable finished;
+  };
+  auto batch = std::make_shared<Batch>();
+  auto run = [batch, count, &job]() {
+    int ran = 0;
+    for (int i = batch->next++; i < count; i = batch->next++) {
+      CPU_ZONE("parallel for job");
+      job(i);
+      ran++;
+    }
+    if (ran > 0 && batch->done.fetch_add(ran) + ran == count) {
+      std::lock_guard<std::mutex> lock(batch->mutex);
+      batch->finished.notify_all();
+    }
+  };
+
+  int helpers = std::min((int)m_workers.size(), count - 1);
+  for (int i = 0; i < helpers; i++)
+    Submit(run);
+  run();
+
+  std::unique_lock<std::mutex> lock(batch->mutex);
+  batch->finished.wait(lock, [&]() { return batch->done.load() == count; });
+}
+
+void ThreadPool::WorkerLoop() {
+  while (true) {
+    std::function<void()> task;
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_condition.wait(lock, [this]() { return m_stop || !m_tasks.empty(); });
+      if (m_stop && m_tasks.empty())
+        return;
+      task = std::move(m_tasks.front());
+      m_tasks.pop();
+    }
+    task();
+  }
+}
@@ -0,0 +1,35 @@
+#ifndef __THREAD_POOL_H__
+#define __THREAD_POOL_H__
+
+#include "common.h"
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <thread>
+
+CLASS_PTR(ThreadPool)
+class ThreadPool {
+public:
+  // threadCount 0 uses every hardware thread except the calling one
+  static ThreadPoolUPtr Create(int threadCount = 0);
+  ~ThreadPool();
+
+  int GetThreadCount() const { return (int)m_workers.size(); }
+  void Submit(std::function<void()> task);
+  // runs job(i) for i in [0, count) on the workers and the calling thread, returns when all are done
+  void ParallelFor(int count, const std::function<void(int)>& job);
+
+private:
+  ThreadPool() {}
+  void Init(int threadCount);
+  void WorkerLoop();
+
+  std::vector<std::thread> m_workers;
+  std::queue<std::function<void()>> m_tasks;
+  std::mutex m_mutex;
+  std::condition_variable m_condition;
+  bool m_stop { false };
+};
+
+#endif // __THREAD_POOL_H__